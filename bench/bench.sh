@@ -0,0 +1,83 @@
+#!/bin/sh
+
+# Runs the benchmark suite and writes the measurements, as a JSON array, to
+# stdout. Use compare.py to compare the output of two builds.
+#
+# Workloads are generated by bench_gen: for each scale (number of leaves), a
+# balanced tree and a caterpillar; plus a stream of many small balanced trees.
+# Each program listed in bench_tools is timed on the workloads it applies to
+# (by bench_time), and libnw's core routines are timed on each single-tree
+# workload (by bench_kernels).
+#
+# The following variables can be set in the environment:
+#
+# BENCH_SCALES		leaf counts (default: "1000 10000 100000 1000000"; 10^7
+# 			is possible, given ~10 GB of RAM)
+# BENCH_STREAM_TREES	number of trees in the stream (default: 100000)
+# BENCH_STREAM_LEAVES	leaves per tree in the stream (default: 16)
+# BENCH_REPS		timed repetitions (default: 5)
+# BENCH_WARMUPS		untimed runs before the timed ones (default: 1)
+# BENCH_LCA_PAIRS	leaf pairs per lca2 run (default: 10)
+
+# Like the test scripts, this one is given its directories as arguments when
+# run by CMake; with GNU autotools, the defaults apply.
+
+# Programs are run from a scratch directory, hence the absolute paths.
+
+BENCH_SRC_DIR=$(cd ${1:-.} && pwd)
+BENCH_BIN_DIR=$(cd ${2:-.} && pwd)
+PROG_BIN_DIR=$(cd ${3:-../src} && pwd)
+
+scales=${BENCH_SCALES:-1000 10000 100000 1000000}
+stream_trees=${BENCH_STREAM_TREES:-100000}
+stream_leaves=${BENCH_STREAM_LEAVES:-16}
+reps=${BENCH_REPS:-5}
+warmups=${BENCH_WARMUPS:-1}
+lca_pairs=${BENCH_LCA_PAIRS:-10}
+
+work_dir=$(mktemp -d ${TMPDIR:-/tmp}/nw_bench.XXXXXX) || exit 1
+trap 'rm -rf $work_dir' EXIT
+results=$work_dir/results
+
+# Times the programs that apply to shape $1, on workload file $2 (in
+# $work_dir).
+
+bench_tools()
+{
+	shape=$1
+	input=$2
+	while IFS=':' read prog shapes args ; do
+		echo $prog | grep '^#' > /dev/null && continue
+		echo " $shapes " | grep " $shape " > /dev/null || continue
+		[ -x $PROG_BIN_DIR/$prog ] || continue
+		name=$(echo "$prog $args" | tr -d "'")
+		echo "$name < $input" >&2
+		cmd="$BENCH_BIN_DIR/bench_time -r $reps -w $warmups \
+			-i $input \"\$name\" $PROG_BIN_DIR/$prog $args"
+		(cd $work_dir; eval $cmd) >> $results || echo "FAILED" >&2
+	done < $BENCH_SRC_DIR/bench_tools
+}
+
+for scale in $scales ; do
+	for shape in balanced caterpillar ; do
+		input=${shape}_$scale.nw
+		$BENCH_BIN_DIR/bench_gen $shape $scale > $work_dir/$input ||
+			exit 1
+		echo "kernels < $input" >&2
+		(cd $work_dir; $BENCH_BIN_DIR/bench_kernels -r $reps \
+			-w $warmups -l $lca_pairs $input) >> $results ||
+			echo "FAILED" >&2
+		bench_tools $shape $input
+		rm $work_dir/$input
+	done
+done
+
+input=stream_${stream_trees}x$stream_leaves.nw
+$BENCH_BIN_DIR/bench_gen balanced $stream_leaves $stream_trees \
+	> $work_dir/$input || exit 1
+bench_tools stream $input
+
+# Join the measurements (one JSON object per line) into an array.
+echo "["
+sed -e '$!s/$/,/' -e 's/^/  /' $results
+echo "]"
@@ -0,0 +1,89 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* bench_gen: writes benchmark workloads to stdout. Trees are deterministic,
+ * so that two builds are always timed on the same input. Leaves are labelled
+ * L0, L1, ... and inner nodes are unlabelled; every branch has a length.
+ *
+ * Usage: bench_gen <shape> <leaves> [<trees>]
+ *
+ * where <shape> is 'balanced' (a complete binary tree, as far as the number of
+ * leaves allows) or 'caterpillar' (every inner node has a leaf child, so the
+ * depth equals the number of leaves). With <trees>, that many copies of the
+ * tree are written, one per line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Writes a balanced tree on leaves [first, first+count). Recursion is safe
+ * here: the depth is only log2(count). */
+
+static void write_balanced(long first, long count)
+{
+	if (1 == count) {
+		printf("L%ld:1", first);
+		return;
+	}
+	long left = count / 2;
+	putchar('(');
+	write_balanced(first, left);
+	putchar(',');
+	write_balanced(first + left, count - left);
+	fputs("):1", stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <balanced|caterpillar> <leaves> "
+				"[<trees>]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	long leaves = atol(argv[2]);
+	long trees = argc > 3 ? atol(argv[3]) : 1;
+	long i, t;
+
+	for (t = 0; t < trees; t++) {
+		if (0 == strcmp("balanced", argv[1])) {
+			write_balanced(0, leaves);
+		} else if (0 == strcmp("caterpillar", argv[1])) {
+			for (i = 1; i < leaves; i++) putchar('(');
+			printf("L0:1");
+			for (i = 1; i < leaves; i++) printf(",L%ld:1):1", i);
+		} else {
+			fprintf(stderr, "Unknown shape '%s'\n", argv[1]);
+			exit(EXIT_FAILURE);
+		}
+		puts(";");
+	}
+
+	return 0;
+}
@@ -0,0 +1,228 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* bench_kernels: times libnw's core routines on the first tree of a file, and
+ * prints one JSON measurement (see bench_report.h) per routine. Each routine
+ * is run a few times untimed, then 'reps' times timed. The peak RSS reported
+ * is that of the whole process so far.
+ *
+ * Usage: bench_kernels [-r reps] [-w warmups] [-l lca_pairs] <file> */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "parser.h"
+#include "tree.h"
+#include "rnode.h"
+#include "list.h"
+#include "hash.h"
+#include "lca.h"
+#include "nodemap.h"
+#include "to_newick.h"
+#include "order_tree.h"
+#include "common.h"
+#include "bench_report.h"
+
+void newick_scanner_set_file_input(FILE *);
+
+struct kernel_input {
+	char *file;
+	struct rooted_tree *tree;
+	struct rnode **leaves;
+	int leaf_count;
+	struct hash *label_map;
+	int lca_pairs;
+};
+
+typedef int (*kernel)(struct kernel_input *);
+
+static struct rooted_tree *read_tree(const char *file)
+{
+	FILE *in = fopen(file, "r");
+	if (NULL == in) { perror(file); exit(EXIT_FAILURE); }
+	newick_scanner_set_file_input(in);
+	struct rooted_tree *tree = parse_tree();
+	fclose(in);
+	return tree;
+}
+
+/* The kernels. Each returns SUCCESS or FAILURE. */
+
+static int parse_kernel(struct kernel_input *in)
+{
+	/* Frees the tree, but only the nodes created since it was first
+	 * parsed, which is the one the other kernels work on. */
+	int watermark = rnode_watermark();
+	struct rooted_tree *tree = read_tree(in->file);
+	if (NULL == tree) return FAILURE;
+	destroy_rnodes_since(watermark, NULL);
+	destroy_tree(tree);
+	return SUCCESS;
+}
+
+static int to_newick_kernel(struct kernel_input *in)
+{
+	char *newick = to_newick(in->tree->root);
+	if (NULL == newick) return FAILURE;
+	free(newick);
+	return SUCCESS;
+}
+
+static int nodes_in_order_kernel(struct kernel_input *in)
+{
+	struct llist *nodes = get_nodes_in_order(in->tree->root);
+	if (NULL == nodes) return FAILURE;
+	destroy_llist(nodes);
+	return SUCCESS;
+}
+
+static int order_tree_kernel(struct kernel_input *in)
+{
+	return order_tree(in->tree, ORDER_ALNUM_LBL);
+}
+
+static int hash_get_kernel(struct kernel_input *in)
+{
+	int i;
+	for (i = 0; i < in->leaf_count; i++)
+		if (NULL == hash_get(in->label_map, in->leaves[i]->label))
+			return FAILURE;
+	return SUCCESS;
+}
+
+/* Pairs leaves from both ends of the leaf list inwards, so that LCAs range
+ * from the root down to small clades. */
+
+static int lca2_kernel(struct kernel_input *in)
+{
+	int i;
+	for (i = 0; i < in->lca_pairs; i++) {
+		int a = (long) i * in->leaf_count / (2 * in->lca_pairs);
+		int b = in->leaf_count - 1 - a;
+		if (NULL == lca2(in->tree, in->leaves[a], in->leaves[b]))
+			return FAILURE;
+	}
+	return SUCCESS;
+}
+
+static void time_kernel(const char *name, kernel k, struct kernel_input *in,
+		int reps, int warmups)
+{
+	double *walls = malloc(reps * sizeof(double));
+	double *cpus = malloc(reps * sizeof(double));
+	if (NULL == walls || NULL == cpus) { perror(NULL); exit(EXIT_FAILURE); }
+	int i;
+
+	for (i = 0; i < warmups + reps; i++) {
+		double wall_start = wall_time();
+		double cpu_start = cpu_time();
+		if (! k(in)) {
+			fprintf(stderr, "%s failed\n", name);
+			exit(EXIT_FAILURE);
+		}
+		if (i >= warmups) {
+			walls[i - warmups] = wall_time() - wall_start;
+			cpus[i - warmups] = cpu_time() - cpu_start;
+		}
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	print_measurement(name, "kernel", in->file, walls, cpus, reps,
+			usage.ru_maxrss);
+	free(walls);
+	free(cpus);
+}
+
+int main(int argc, char *argv[])
+{
+	int reps = 5;
+	int warmups = 1;
+	struct kernel_input in;
+	in.lca_pairs = 100;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:r:w:")) != -1) {
+		switch (opt) {
+		case 'l':
+			in.lca_pairs = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'w':
+			warmups = atoi(optarg);
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (reps < 1 || argc - optind != 1) {
+		fprintf(stderr, "Usage: %s [-r reps] [-w warmups] "
+				"[-l lca_pairs] <file>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	in.file = argv[optind];
+	in.tree = read_tree(in.file);
+	if (NULL == in.tree) {
+		fprintf(stderr, "Could not parse a tree from %s\n", in.file);
+		exit(EXIT_FAILURE);
+	}
+
+	struct list_elem *el;
+	in.leaf_count = leaf_count(in.tree);
+	in.leaves = malloc(in.leaf_count * sizeof(struct rnode *));
+	if (NULL == in.leaves) { perror(NULL); exit(EXIT_FAILURE); }
+	int n = 0;
+	for (el = in.tree->nodes_in_order->head; NULL != el; el = el->next)
+		if (is_leaf(el->data)) in.leaves[n++] = el->data;
+	in.label_map = create_label2node_map(in.tree->nodes_in_order);
+	if (NULL == in.label_map) { perror(NULL); exit(EXIT_FAILURE); }
+	if (in.lca_pairs > in.leaf_count / 2) in.lca_pairs = in.leaf_count / 2;
+
+	time_kernel("parse", parse_kernel, &in, reps, warmups);
+	time_kernel("to_newick", to_newick_kernel, &in, reps, warmups);
+	time_kernel("get_nodes_in_order", nodes_in_order_kernel, &in,
+			reps, warmups);
+	time_kernel("hash_get", hash_get_kernel, &in, reps, warmups);
+	time_kernel("lca2", lca2_kernel, &in, reps, warmups);
+	/* last, as it reorders the tree */
+	time_kernel("order_tree", order_tree_kernel, &in, reps, warmups);
+
+	destroy_hash(in.label_map);
+	free(in.leaves);
+	destroy_all_rnodes(NULL);
+	destroy_tree(in.tree);
+	return 0;
+}
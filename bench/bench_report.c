@@ -0,0 +1,104 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "bench_report.h"
+
+double wall_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double cpu_time()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+static double median(double *values, int n)
+{
+	qsort(values, n, sizeof(double), compare_doubles);
+	if (n % 2) return values[n/2];
+	return (values[n/2 - 1] + values[n/2]) / 2;
+}
+
+/* JSON strings: names and inputs are our own, but file names might contain
+ * quotes or backslashes. */
+
+static void print_json_string(const char *s)
+{
+	putchar('"');
+	for (; '\0' != *s; s++) {
+		if ('"' == *s || '\\' == *s) putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+void print_measurement(const char *name, const char *kind, const char *input,
+		double *walls, double *cpus, int reps, long max_rss_kb)
+{
+	double mean = 0;
+	int i;
+	for (i = 0; i < reps; i++) mean += walls[i];
+	mean /= reps;
+	double wall_median = median(walls, reps);	/* sorts 'walls' */
+	double cpu_median = median(cpus, reps);
+
+	printf("{\"name\": ");
+	print_json_string(name);
+	printf(", \"kind\": ");
+	print_json_string(kind);
+	printf(", \"input\": ");
+	print_json_string(input);
+	printf(", \"reps\": %d, \"wall_median_s\": %.6f, "
+		"\"wall_min_s\": %.6f, \"wall_mean_s\": %.6f, "
+		"\"cpu_median_s\": %.6f, \"max_rss_kb\": %ld}\n",
+		reps, wall_median, walls[0], mean, cpu_median, max_rss_kb);
+	fflush(stdout);
+}
@@ -0,0 +1,49 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* bench_report.h: timing and JSON reporting shared by the benchmark programs.
+ * Each measurement is printed as one JSON object on a line of its own;
+ * bench.sh gathers them into an array. */
+
+/* Wall-clock time in seconds, from a monotonic clock. */
+
+double wall_time();
+
+/* CPU time (user + system) used so far by this process, in seconds. */
+
+double cpu_time();
+
+/* Prints a measurement as a JSON object. 'walls' and 'cpus' hold the times of
+ * the 'reps' timed repetitions (they are sorted in place); 'max_rss_kb' is the
+ * peak resident set size. 'name' is the benchmark's name, 'kind' is "tool" or
+ * "kernel", and 'input' names the workload. */
+
+void print_measurement(const char *name, const char *kind, const char *input,
+		double *walls, double *cpus, int reps, long max_rss_kb);
@@ -0,0 +1,143 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* bench_time: times a command. The command is run a few times untimed (to
+ * warm up caches), then 'reps' times timed, with its standard input read from
+ * a file and its output discarded. Prints one JSON measurement (see
+ * bench_report.h) with the wall and CPU times of the child, and its peak RSS.
+ *
+ * Usage: bench_time [-r reps] [-w warmups] -i input name command [args...]
+ * */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "bench_report.h"
+
+/* Runs the command once. Sets 'cpu' (seconds) and 'rss' (kB), and returns the
+ * wall time in seconds, or -1 if the command failed. */
+
+static double run_once(char *argv[], const char *input, double *cpu,
+		long *rss)
+{
+	double start = wall_time();
+	pid_t pid = fork();
+	if (pid < 0) { perror(NULL); exit(EXIT_FAILURE); }
+	if (0 == pid) {
+		int in = open(input, O_RDONLY);
+		int null = open("/dev/null", O_WRONLY);
+		if (in < 0 || null < 0) { perror(input); _exit(127); }
+		dup2(in, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) < 0) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
+	}
+	double wall = wall_time() - start;
+	*cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	*rss = usage.ru_maxrss;
+
+	if (! WIFEXITED(status) || 0 != WEXITSTATUS(status)) return -1;
+	return wall;
+}
+
+int main(int argc, char *argv[])
+{
+	int reps = 5;
+	int warmups = 1;
+	char *input = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+i:r:w:")) != -1) {
+		switch (opt) {
+		case 'i':
+			input = optarg;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 'w':
+			warmups = atoi(optarg);
+			break;
+		default:
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (NULL == input || reps < 1 || argc - optind < 2) {
+		fprintf(stderr, "Usage: %s [-r reps] [-w warmups] -i input "
+				"name command [args...]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	char *name = argv[optind];
+	char **command = argv + optind + 1;
+
+	double *walls = malloc(reps * sizeof(double));
+	double *cpus = malloc(reps * sizeof(double));
+	if (NULL == walls || NULL == cpus) { perror(NULL); exit(EXIT_FAILURE); }
+	long max_rss = 0, rss;
+	double cpu;
+	int i;
+
+	for (i = 0; i < warmups; i++)
+		if (run_once(command, input, &cpu, &rss) < 0) {
+			fprintf(stderr, "%s: command failed\n", name);
+			exit(EXIT_FAILURE);
+		}
+	for (i = 0; i < reps; i++) {
+		walls[i] = run_once(command, input, &cpus[i], &rss);
+		if (walls[i] < 0) {
+			fprintf(stderr, "%s: command failed\n", name);
+			exit(EXIT_FAILURE);
+		}
+		if (rss > max_rss) max_rss = rss;
+	}
+
+	print_measurement(name, "tool", input, walls, cpus, reps, max_rss);
+
+	free(walls);
+	free(cpus);
+	return 0;
+}
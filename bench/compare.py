@@ -0,0 +1,92 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+# 
+# * Redistributions of source code must retain the above copyright notice,
+#     this list of conditions and the following disclaimer.
+# * Redistributions in binary form must reproduce the above copyright notice,
+#     this list of conditions and the following disclaimer in the documentation
+#     and/or other materials provided with the distribution.
+# * Neither the name of the University of Geneva nor the names of its
+#     contributors may be used to endorse or promote products derived from this
+#     software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+# SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+# CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# compare.py - compares two benchmark runs (the JSON output of bench.sh) and
+# flags regressions, i.e. measurements whose median wall time (or peak RSS)
+# grew by more than a threshold. Exits with status 1 if there are any.
+#
+# Usage: compare.py [-t threshold] [-m min_seconds] old.json new.json
+#
+# The threshold is relative (default: 0.10, i.e. 10%). Times below
+# min_seconds (default: 0.01) in both runs are too noisy to compare and are
+# ignored.
+
+from __future__ import print_function
+
+import getopt
+import json
+import sys
+
+def load(fname):
+	with open(fname) as f:
+		return dict(((m['kind'], m['name'], m['input']), m)
+			for m in json.load(f))
+
+def main(argv):
+	threshold = 0.10
+	min_seconds = 0.01
+	opts, args = getopt.getopt(argv, 't:m:')
+	for opt, val in opts:
+		if opt == '-t':
+			threshold = float(val)
+		elif opt == '-m':
+			min_seconds = float(val)
+	if len(args) != 2:
+		print('Usage: compare.py [-t threshold] [-m min_seconds] '
+			'old.json new.json', file=sys.stderr)
+		return 2
+
+	old = load(args[0])
+	new = load(args[1])
+	regressions = 0
+	print('%-8s %-40s %-26s %10s %10s %8s' % ('kind', 'name', 'input',
+		'old (s)', 'new (s)', 'change'))
+	for key in sorted(set(old) & set(new)):
+		o, n = old[key], new[key]
+		t_old, t_new = o['wall_median_s'], n['wall_median_s']
+		flags = []
+		if max(t_old, t_new) >= min_seconds and \
+				t_new > t_old * (1 + threshold):
+			flags.append('SLOWER')
+		if n['max_rss_kb'] > o['max_rss_kb'] * (1 + threshold) and \
+				n['max_rss_kb'] - o['max_rss_kb'] > 1024:
+			flags.append('MORE MEMORY')
+		change = (t_new - t_old) / t_old * 100 if t_old > 0 else 0
+		print('%-8s %-40s %-26s %10.4f %10.4f %+7.1f%% %s' % (key + (
+			t_old, t_new, change, ' '.join(flags))))
+		if flags:
+			regressions += 1
+	for key in sorted(set(old) ^ set(new)):
+		print('%-8s %-40s %-26s only in %s' % (key + (
+			args[0] if key in old else args[1],)))
+
+	print('%d regression(s).' % regressions)
+	return 1 if regressions else 0
+
+if __name__ == '__main__':
+	sys.exit(main(sys.argv[1:]))
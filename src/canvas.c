@@ -429,6 +429,21 @@ void canvas_write(struct canvas *canvasp, int col, int line, char *text)
 	canvasp->write(canvasp, col, line, text);
 }
 
+void clear_canvas(struct canvas *canvasp)
+{
+	int line_no;
+
+	for (line_no = 0; line_no < canvasp->height; line_no++) {
+		/* vt100_canvas_write() may have lengthened the line: shrink it
+		 * back (if this fails, the line is still long enough). */
+		char *line = realloc(canvasp->lines[line_no],
+				canvasp->width + 1);
+		if (NULL != line) canvasp->lines[line_no] = line;
+		memset(canvasp->lines[line_no], ' ', canvasp->width);
+		canvasp->lines[line_no][canvasp->width] = '\0';
+	}
+}
+
 // TODO: not sure we need this anymore
 enum plus_type find_plus_type(struct canvas *canvasp, int line_nb, int col_nb)
 {
@@ -145,6 +145,14 @@ void canvas_draw_cross(struct canvas *canvas, int col, int line);
 void canvas_draw_root(struct canvas *canvas, int col, int line);
 void canvas_decorate_leaf(struct canvas *canvas, int col, int line);
 
+/** Blanks the whole canvas, so that it can be drawn on again. This is how the
+ * text renderer reuses a one-line canvas for every row of a tree (see
+ * display_tree()).
+ * \param[out]	canvas	the canvas to clear
+ */
+
+void clear_canvas(struct canvas *canvas);
+
 /** Dumps the canvas to standard output. Use this function after filling the
  * canvas' contents with the draw and write functions. If the canvas was
  * created with create_vt100_canvas(), then VT100 characters will be used. 
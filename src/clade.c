@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 #include <regex.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "tree.h"
 #include "parser.h"
@@ -47,8 +48,27 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "common.h"
 #include "link.h"
 #include "subtree.h"
+#include "label_intern.h"
+#include "profile.h"
+#include "tree_index.h"
+#include "readline.h"
 
-enum modes {EXACT, REGEXP};
+enum modes {EXACT, REGEXP, QUERIES};
+
+/* In -f mode, threads take this many queries at a time */
+
+#define QUERIES_PER_TAKE 64
+/* With -r, interned labels (and their memoized matches) are cleared once there
+ * are this many, so that memory stays bounded when labels do not recur. */
+#define MAX_MEMO_LABELS 65536
+
+/* A named label set, from a -f file */
+
+struct clade_query {
+	char *name;
+	int label_count;
+	char **labels;
+};
 
 struct parameters {
 	struct llist *labels;
@@ -57,7 +77,14 @@ struct parameters {
 	enum modes mode;
 	char * regexp_string;
 	regex_t *regexp;
+	/* Labels recur from tree to tree, so each is matched only once */
+	struct regexp_memo *regexp_memo;
 	int context;	/* how many levels above LCA */
+	char *index_filename;	/* NULL unless -i */
+	char *trees_filename;
+	struct clade_query *queries;	/* -f */
+	int query_count;
+	int nb_threads;
 };
 
 void help(char *argv[])
@@ -68,7 +95,8 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-chmrs] <target tree filename|-> <label> [label]+\n"
+"%s [-chmrs] [-i <index>] <target tree filename|-> <label> [label]+\n"
+"%s [-chms] [-t <threads>] -f <queries> <target tree filename|->\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -80,11 +108,15 @@ void help(char *argv[])
 "labels work). Any label not found in the tree will be ignored. There\n"
 "must be at least one label. (See also option -r)\n"
 "\n"
+"In the second form, the label sets are read from a file instead (see -f),\n"
+"and all of them are looked up in each tree.\n"
+"\n"
 "Output\n"
 "------\n"
 "\n"
 "Outputs the clade rooted at the last common ancestor of all labels passed\n"
-"as arguments, as Newick.\n"
+"as arguments, as Newick. With -f, prints one line per clade found, made of\n"
+"the query's name, a TAB, and the clade.\n"
 "\n"
 "Options\n"
 "-------\n"
@@ -92,7 +124,16 @@ void help(char *argv[])
 "    -c <levels (int)>: give context, i.e. start the subtree not at the last\n"
 "        common ancestor of the labels, but 'level' nodes higher (limited\n"
 "        by the tree's root, of course).\n"
+"    -f <queries filename>: read many named label sets from this file, one\n"
+"        per line: the set's name, then its labels, separated by whitespace\n"
+"        (empty lines and lines starting with '#' are ignored). Each tree is\n"
+"        indexed once and then all sets are looked up in it, which is much\n"
+"        faster than running %s once per set. -i and -r cannot be used.\n"
 "    -h: prints this message and exits\n"
+"    -i <index filename>: use this index of the target trees (see nw_index)\n"
+"        to read only the trees that contain ALL the labels; the others are\n"
+"        skipped. Much faster on large files. The target file cannot be\n"
+"        standard input, and -r cannot be used.\n"
 "    -m: only prints the clade if it is monophyletic, in the sense that ONLY\n"
 "        the labels passed as arguments are found in the clade.\n"
 "        See also -s.\n"
@@ -102,6 +143,8 @@ void help(char *argv[])
 "        arguments, in the order in which they appear in the Newick.\n"
 "        If -m is also passed, only prints siblings if the labels passed\n"
 "        as arguments form a monophyletic group.\n"
+"    -t <int>: with -f, look up the label sets with this many threads\n"
+"        (default: 1). This does not change the output.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -122,7 +165,19 @@ void help(char *argv[])
 "$ %s -r data/HRV.nw '^POLIO.*'\n"
 "\n"
 "# clade defined by Homo and Pan, plus 1 level of context\n"
-"$ %s -c 1 data/catarrhini Homo Pan\n",
+"$ %s -c 1 data/catarrhini Homo Pan\n"
+"\n"
+"# same as the first example, using an index (built once with nw_index)\n"
+"$ nw_index data/catarrhini\n"
+"$ %s -i data/catarrhini.nwi data/catarrhini Homo Hylobates\n"
+"\n"
+"# several clades at once: each line of hominoids.txt is a name and labels,\n"
+"# e.g. 'great_apes Homo Pan Gorilla Pongo'\n"
+"$ %s -m -f hominoids.txt data/catarrhini\n",
+	argv[0],
+	argv[0],
+	argv[0],
+	argv[0],
 	argv[0],
 	argv[0],
 	argv[0],
@@ -152,6 +207,87 @@ static regex_t * compile_regexp(char *regexp_string)
 	return preg;
 }
 
+/* Reads the label sets of a -f file. Exits on error. */
+
+static struct clade_query *read_queries(const char *filename, int *count)
+{
+	FILE *in = fopen(filename, "r");
+	if (NULL == in) { perror(filename); exit(EXIT_FAILURE); }
+
+	int capacity = 64;
+	struct clade_query *queries = malloc(capacity *
+			sizeof(struct clade_query));
+	if (NULL == queries) { perror(NULL); exit(EXIT_FAILURE); }
+	*count = 0;
+
+	char *line;
+	while (NULL != (line = read_line(in))) {
+		/* Skip comments and lines that are empty or all whitespace */
+		if ('#' == line[0] || is_all_whitespace(line)) {
+			free(line);
+			continue;
+		}
+		if (*count == capacity) {
+			capacity *= 2;
+			queries = realloc(queries, capacity *
+					sizeof(struct clade_query));
+			if (NULL == queries) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		}
+		struct clade_query *query = &queries[(*count)++];
+		struct word_tokenizer *wtok = create_word_tokenizer(line);
+		if (NULL == wtok) { perror(NULL); exit(EXIT_FAILURE); }
+		query->name = wt_next(wtok);
+		query->label_count = 0;
+		int label_capacity = 8;
+		query->labels = malloc(label_capacity * sizeof(char *));
+		if (NULL == query->name || NULL == query->labels) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		char *label;
+		while (NULL != (label = wt_next(wtok))) {
+			if (query->label_count == label_capacity) {
+				label_capacity *= 2;
+				query->labels = realloc(query->labels,
+					label_capacity * sizeof(char *));
+				if (NULL == query->labels) {
+					perror(NULL); exit(EXIT_FAILURE);
+				}
+			}
+			query->labels[query->label_count++] = label;
+		}
+		if (NEXT_TOKEN_ERROR == next_token_status) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		if (0 == query->label_count) {
+			fprintf (stderr, "%s: query '%s' has no labels - "
+					"aborting.\n", filename, query->name);
+			exit(EXIT_FAILURE);
+		}
+		destroy_word_tokenizer(wtok);
+		free(line);
+	}
+	if (READLINE_ERROR == read_line_status) {
+		perror(filename); exit(EXIT_FAILURE);
+	}
+
+	fclose(in);
+	return queries;
+}
+
+static void destroy_queries(struct clade_query *queries, int count)
+{
+	int i, j;
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < queries[i].label_count; j++)
+			free(queries[i].labels[j]);
+		free(queries[i].labels);
+		free(queries[i].name);
+	}
+	free(queries);
+}
+
 struct parameters get_params(int argc, char *argv[])
 {
 
@@ -161,16 +297,27 @@ struct parameters get_params(int argc, char *argv[])
 	params.siblings = false;
 	params.mode = EXACT;
 	params.context = 0;
+	params.index_filename = NULL;
+	params.queries = NULL;
+	params.query_count = 0;
+	params.nb_threads = 1;
+	char *queries_filename = NULL;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "c:hmrs")) != -1) {
+	while ((opt_char = getopt(argc, argv, "c:f:hi:mrst:")) != -1) {
 		switch (opt_char) {
 		case 'c':
 			params.context = atoi(optarg);
 			break;
+		case 'f':
+			queries_filename = optarg;
+			break;
 		case 'h':
 			help(argv);
 			exit(EXIT_SUCCESS);
+		case 'i':
+			params.index_filename = optarg;
+			break;
 		case 'm':
 			params.check_monophyly = true;
 			break;
@@ -180,6 +327,14 @@ struct parameters get_params(int argc, char *argv[])
 		case 's':
 			params.siblings = true;
 			break;
+		case 't':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -t must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
 			exit(EXIT_FAILURE);
@@ -188,13 +343,51 @@ struct parameters get_params(int argc, char *argv[])
 	}
 
 	/* check arguments */
-	if ((argc - optind) >= 2)	{
+	if (NULL != queries_filename) {
+		if (REGEXP == params.mode ||
+		    NULL != params.index_filename) {
+			fprintf (stderr, "Option -f can't be used with -i "
+					"or -r.\n");
+			exit(EXIT_FAILURE);
+		}
+		if ((argc - optind) != 1) {
+			fprintf(stderr, "Usage: %s [-chms] [-t <threads>] "
+				"-f <queries> <filename|->\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
 		if (0 != strcmp("-", argv[optind])) {
 			if (! set_parser_input_filename(argv[optind])) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
 		}
+		params.mode = QUERIES;
+		params.queries = read_queries(queries_filename,
+				&params.query_count);
+		return params;
+	}
+	if (NULL != params.index_filename) {
+		if (REGEXP == params.mode) {
+			fprintf (stderr, "Options -i and -r can't be used "
+					"together.\n");
+			exit(EXIT_FAILURE);
+		}
+		if ((argc - optind) >= 1 && 0 == strcmp("-", argv[optind])) {
+			fprintf (stderr, "Option -i needs a target tree "
+					"file, not standard input.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if ((argc - optind) >= 2)	{
+		params.trees_filename = argv[optind];
+		/* With an index, the trees are read by parse_tree_at() */
+		if (NULL == params.index_filename &&
+		    0 != strcmp("-", argv[optind])) {
+			if (! set_parser_input_filename(argv[optind])) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+		}
 		struct llist *lbl_list;
 		switch (params.mode) {
 		case EXACT:
@@ -215,6 +408,15 @@ struct parameters get_params(int argc, char *argv[])
 			optind++;	/* optind is now index of regexp */
 			params.regexp_string = argv[optind];
 			params.regexp = compile_regexp(params.regexp_string);
+			if (! enable_label_interning()) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			params.regexp_memo = create_regexp_memo(params.regexp);
+			if (NULL == params.regexp_memo) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 			break;
 		default:
 			fprintf (stderr, "Unknown mode %d\n", params.mode);
@@ -246,7 +448,7 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 		}
 		break;
 	case REGEXP:
-		descendants = nodes_from_regexp(tree, params.regexp);
+		descendants = nodes_from_regexp_memo(tree, params.regexp_memo);
 		if (NULL == descendants) { perror(NULL); exit(EXIT_FAILURE); }
 		if (0 == descendants->count) {
 			fprintf (stderr, "WARNING: no match for regexp /%s/\n",
@@ -298,22 +500,266 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 
 }
 
+/* -f mode. Each tree is indexed once: its nodes are numbered in preorder (see
+ * struct lca_table), and each label is mapped to its node. The clade of a
+ * query is then the LCA of its first and last nodes in preorder, and it is
+ * monophyletic IFF the query's nodes are all leaves and are as many as the
+ * clade's labeled leaves. Queries are independent, so they are answered by
+ * several threads; the clades are then printed in query order. */
+
+enum { NO_MATCH = -1, NOT_MONOPHYLETIC = -2 };
+
+struct tree_queries {
+	const struct parameters *params;
+	struct lca_table *table;
+	struct hash *numbers;	/* label -> &table->nodes[number] */
+	int *labeled_leaves;	/* in each node's subtree */
+	int max_labels;		/* of any query */
+	int *clades;		/* per query: clade root's number, or NO_MATCH
+				   etc. */
+	int *missing;		/* per query: number of labels not found */
+	int next;		/* first query not yet taken */
+	pthread_mutex_t lock;
+};
+
+static int compare_numbers(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/* 'numbers' must have room for the query's labels */
+
+static int answer_query(struct tree_queries *tq, struct clade_query *query,
+		int *missing, int *numbers)
+{
+	const struct lca_table *table = tq->table;
+	int found = 0;
+	int i;
+
+	*missing = 0;
+	for (i = 0; i < query->label_count; i++) {
+		struct rnode **node = hash_get(tq->numbers, query->labels[i]);
+		if (NULL == node)
+			(*missing)++;
+		else
+			numbers[found++] = node - table->nodes;
+	}
+	if (0 == found) return NO_MATCH;
+
+	qsort(numbers, found, sizeof(int), compare_numbers);
+	int clade = lca_table_query(table, numbers[0], numbers[found - 1]);
+	int context;
+	for (context = tq->params->context; context > 0; context--)
+		if (-1 != table->parent[clade])
+			clade = table->parent[clade];
+
+	if (tq->params->check_monophyly) {
+		int distinct = 0;
+		for (i = 0; i < found; i++) {
+			if (i > 0 && numbers[i] == numbers[i - 1]) continue;
+			if (! is_leaf(table->nodes[numbers[i]]))
+				return NOT_MONOPHYLETIC;
+			distinct++;
+		}
+		if (distinct != tq->labeled_leaves[clade])
+			return NOT_MONOPHYLETIC;
+	}
+
+	return clade;
+}
+
+static void *answer_queries(void *arg)
+{
+	struct tree_queries *tq = arg;
+	const struct parameters *params = tq->params;
+	int *numbers = malloc(tq->max_labels * sizeof(int));
+	if (NULL == numbers) { perror(NULL); exit(EXIT_FAILURE); }
+
+	for (;;) {
+		pthread_mutex_lock(&tq->lock);
+		int first = tq->next;
+		tq->next += QUERIES_PER_TAKE;
+		pthread_mutex_unlock(&tq->lock);
+		if (first >= params->query_count) break;
+		int last = first + QUERIES_PER_TAKE;
+		if (last > params->query_count) last = params->query_count;
+		int q;
+		for (q = first; q < last; q++)
+			tq->clades[q] = answer_query(tq, &params->queries[q],
+					&tq->missing[q], numbers);
+	}
+
+	free(numbers);
+	return NULL;
+}
+
+void process_queries(struct rooted_tree *tree, struct parameters *params)
+{
+	struct tree_queries tq;
+	tq.params = params;
+	tq.table = create_lca_table(tree->root);
+	if (NULL == tq.table) { perror(NULL); exit(EXIT_FAILURE); }
+	int n = tq.table->node_count;
+	tq.numbers = create_hash(n);
+	tq.labeled_leaves = malloc(n * sizeof(int));
+	tq.clades = malloc(params->query_count * sizeof(int));
+	tq.missing = malloc(params->query_count * sizeof(int));
+	pthread_t *threads = malloc(params->nb_threads * sizeof(pthread_t));
+	if (NULL == tq.numbers || NULL == tq.labeled_leaves ||
+	    NULL == tq.clades || NULL == tq.missing || NULL == threads) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+
+	int i;
+	for (i = 0; i < n; i++) {
+		struct rnode *node = tq.table->nodes[i];
+		if ('\0' == node->label[0]) {
+			tq.labeled_leaves[i] = 0;
+			continue;
+		}
+		tq.labeled_leaves[i] = is_leaf(node) ? 1 : 0;
+		if (! hash_set(tq.numbers, node->label, &tq.table->nodes[i])) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	}
+	/* children come after their parent in preorder */
+	for (i = n - 1; i > 0; i--)
+		tq.labeled_leaves[tq.table->parent[i]] +=
+			tq.labeled_leaves[i];
+
+	tq.max_labels = 0;
+	for (i = 0; i < params->query_count; i++)
+		if (params->queries[i].label_count > tq.max_labels)
+			tq.max_labels = params->queries[i].label_count;
+
+	tq.next = 0;
+	pthread_mutex_init(&tq.lock, NULL);
+	int t;
+	/* the main thread answers queries too */
+	for (t = 1; t < params->nb_threads; t++)
+		if (0 != pthread_create(&threads[t], NULL, answer_queries,
+					&tq)) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	answer_queries(&tq);
+	for (t = 1; t < params->nb_threads; t++)
+		pthread_join(threads[t], NULL);
+	pthread_mutex_destroy(&tq.lock);
+
+	for (i = 0; i < params->query_count; i++) {
+		const char *name = params->queries[i].name;
+		int clade = tq.clades[i];
+		if (NO_MATCH == clade) {
+			fprintf (stderr, "WARNING: query '%s': no label "
+					"matches.\n", name);
+			continue;
+		}
+		if (tq.missing[i] > 0)
+			fprintf (stderr, "WARNING: query '%s': %d label(s) "
+					"not found.\n", name, tq.missing[i]);
+		if (NOT_MONOPHYLETIC == clade) continue;
+
+		struct rnode *clade_root = tq.table->nodes[clade];
+		if (params->siblings) {
+			struct llist *sibs = siblings(clade_root);
+			if (NULL == sibs) { perror(NULL); exit(EXIT_FAILURE); }
+			struct list_elem *el;
+			for (el = sibs->head; NULL != el; el = el->next) {
+				printf("%s\t", name);
+				dump_newick(el->data);
+			}
+			destroy_llist(sibs);
+		} else {
+			printf("%s\t", name);
+			dump_newick(clade_root);
+		}
+	}
+
+	free(threads);
+	free(tq.missing);
+	free(tq.clades);
+	free(tq.labeled_leaves);
+	destroy_hash(tq.numbers);
+	destroy_lca_table(tq.table);
+}
+
+/* Processes only the trees that contain all the labels, according to the
+ * index. */
+
+void process_indexed_trees(struct parameters params)
+{
+	FILE *trees = fopen(params.trees_filename, "r");
+	if (NULL == trees) { perror(params.trees_filename); exit(EXIT_FAILURE); }
+
+	struct tree_index *index = open_tree_index(params.index_filename,
+			trees);
+	if (NULL == index) {
+		print_tree_index_error(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+	long count;
+	off_t *offsets = trees_with_labels(index, params.labels, &count);
+	if (NULL == offsets) {
+		print_tree_index_error(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+
+	long i;
+	for (i = 0; i < count; i++) {
+		struct rooted_tree *tree = parse_tree_at(trees, offsets[i]);
+		if (NULL == tree) {
+			fprintf (stderr, "Could not read tree at offset %lld "
+					"of %s - is the index up to date?\n",
+					(long long) offsets[i],
+					params.trees_filename);
+			exit(EXIT_FAILURE);
+		}
+		process_tree(tree, params);
+		destroy_all_rnodes(NULL);
+		destroy_tree(tree);
+	}
+
+	free(offsets);
+	close_tree_index(index);
+	fclose(trees);
+}
+
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params;
 	
 	params = get_params(argc, argv);
 
-	while ((tree = parse_tree()) != NULL) {
-		process_tree(tree, params);
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
-	}
+	if (NULL != params.index_filename)
+		process_indexed_trees(params);
+	else if (QUERIES == params.mode)
+		while ((tree = parse_tree()) != NULL) {
+			process_queries(tree, &params);
+			destroy_all_rnodes(NULL);
+			destroy_tree(tree);
+		}
+	else
+		while ((tree = parse_tree()) != NULL) {
+			process_tree(tree, params);
+			destroy_all_rnodes(NULL);
+			destroy_tree(tree);
+			if (REGEXP == params.mode &&
+				interned_label_count() > MAX_MEMO_LABELS) {
+				clear_regexp_memo(params.regexp_memo);
+				forget_labels_since(0);
+			}
+		}
 
 	if (EXACT == params.mode)
 		destroy_llist(params.labels);
+	else if (QUERIES == params.mode)
+		destroy_queries(params.queries, params.query_count);
 	else {
+		destroy_regexp_memo(params.regexp_memo);
+		destroy_label_interner();
 		/* This does not free 'params.regexp' itself, only memory
 		 * pointed to by 'params.regexp' members and allocated by
 		 * regcomp().*/
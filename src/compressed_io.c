@@ -0,0 +1,988 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* compressed_io.c: transparent (de)compression of input and output */
+
+#define _GNU_SOURCE	/* for fopencookie() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "common.h"
+#include "compressed_io.h"
+
+/* Size of the chunks passed between the (de)compressing threads and the
+ * program, and how many of them may wait in between. */
+
+#define CHUNK_SIZE (1 << 20)
+#define QUEUE_LENGTH 4
+
+#define MAX_THREADS 16
+
+/* BGZF: a gzip member per block of at most 64 KiB, with the block size in an
+ * extra field. Blocks are (de)compressed BGZF_BATCH at a time. */
+
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_BLOCK_DATA 0xff00	/* input per block, as bgzip */
+#define BGZF_HEADER_SIZE 18
+#define BGZF_FOOTER_SIZE 8	/* CRC32, ISIZE */
+#define BGZF_BATCH 64
+
+typedef void *(*thread_function)(void *);
+
+static int compression_threads()
+{
+	long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nb_cpus < 1) return 1;
+	if (nb_cpus > MAX_THREADS) return MAX_THREADS;
+	return nb_cpus;
+}
+
+/* Chunk queue between a producer and a consumer thread. Chunks are passed
+ * with their data, which the consumer free()s. */
+
+struct chunk {
+	char *data;
+	size_t size;
+};
+
+struct chunk_queue {
+	struct chunk chunks[QUEUE_LENGTH];
+	int head;		/* next chunk to take */
+	int count;
+	bool closed;		/* producer is done */
+	bool failed;		/* ... because of an error */
+	bool cancelled;		/* consumer is gone, producer should stop */
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+static void init_queue(struct chunk_queue *queue)
+{
+	queue->head = 0;
+	queue->count = 0;
+	queue->closed = false;
+	queue->failed = false;
+	queue->cancelled = false;
+	pthread_mutex_init(&(queue->lock), NULL);
+	pthread_cond_init(&(queue->changed), NULL);
+}
+
+/* Returns SUCCESS, or FAILURE if the consumer has cancelled (the data is then
+ * free()d). */
+
+static int queue_put(struct chunk_queue *queue, char *data, size_t size)
+{
+	pthread_mutex_lock(&(queue->lock));
+	while (QUEUE_LENGTH == queue->count && ! queue->cancelled)
+		pthread_cond_wait(&(queue->changed), &(queue->lock));
+	if (queue->cancelled) {
+		pthread_mutex_unlock(&(queue->lock));
+		free(data);
+		return FAILURE;
+	}
+	struct chunk *chunk = queue->chunks +
+		(queue->head + queue->count) % QUEUE_LENGTH;
+	chunk->data = data;
+	chunk->size = size;
+	queue->count++;
+	pthread_cond_broadcast(&(queue->changed));
+	pthread_mutex_unlock(&(queue->lock));
+	return SUCCESS;
+}
+
+/* Returns SUCCESS, or FAILURE if the producer is done and there are no chunks
+ * left (check queue->failed to tell errors from the end of data). */
+
+static int queue_get(struct chunk_queue *queue, struct chunk *chunk)
+{
+	pthread_mutex_lock(&(queue->lock));
+	while (0 == queue->count && ! queue->closed)
+		pthread_cond_wait(&(queue->changed), &(queue->lock));
+	if (0 == queue->count) {
+		pthread_mutex_unlock(&(queue->lock));
+		return FAILURE;
+	}
+	*chunk = queue->chunks[queue->head];
+	queue->head = (queue->head + 1) % QUEUE_LENGTH;
+	queue->count--;
+	pthread_cond_broadcast(&(queue->changed));
+	pthread_mutex_unlock(&(queue->lock));
+	return SUCCESS;
+}
+
+static void close_queue(struct chunk_queue *queue, bool failed)
+{
+	pthread_mutex_lock(&(queue->lock));
+	queue->closed = true;
+	queue->failed = failed;
+	pthread_cond_broadcast(&(queue->changed));
+	pthread_mutex_unlock(&(queue->lock));
+}
+
+/* Called by the consumer when it stops taking chunks: drops those that are
+ * waiting, and tells the producer to stop. */
+
+static void cancel_queue(struct chunk_queue *queue)
+{
+	pthread_mutex_lock(&(queue->lock));
+	queue->cancelled = true;
+	for (; queue->count > 0; queue->count--) {
+		free(queue->chunks[queue->head].data);
+		queue->head = (queue->head + 1) % QUEUE_LENGTH;
+	}
+	pthread_cond_broadcast(&(queue->changed));
+	pthread_mutex_unlock(&(queue->lock));
+}
+
+static void destroy_queue(struct chunk_queue *queue)
+{
+	pthread_mutex_destroy(&(queue->lock));
+	pthread_cond_destroy(&(queue->changed));
+}
+
+/* Little-endian fields of gzip headers */
+
+static unsigned get_le16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/* Format detection */
+
+static bool is_bgzf_header(const unsigned char *header, size_t length)
+{
+	return length >= BGZF_HEADER_SIZE && (header[3] & 4) &&
+		get_le16(header + 10) >= 6 &&
+		'B' == header[12] && 'C' == header[13] &&
+		2 == get_le16(header + 14);
+}
+
+enum compression stream_compression(FILE *in)
+{
+	struct stat in_stat;
+	if (0 != fstat(fileno(in), &in_stat) || ! S_ISREG(in_stat.st_mode))
+		return COMPRESSION_NONE;
+
+	long position = ftell(in);
+	unsigned char magic[BGZF_HEADER_SIZE];
+	size_t length = fread(magic, 1, BGZF_HEADER_SIZE, in);
+	fseek(in, position, SEEK_SET);
+
+	if (length >= 4 && 0x28 == magic[0] && 0xb5 == magic[1] &&
+			0x2f == magic[2] && 0xfd == magic[3])
+		return COMPRESSION_ZSTD;
+	if (length >= 3 && 0x1f == magic[0] && 0x8b == magic[1] &&
+			8 == magic[2])
+		return is_bgzf_header(magic, length) ?
+			COMPRESSION_BGZF : COMPRESSION_GZIP;
+	return COMPRESSION_NONE;
+}
+
+static int compression_from_name(const char *name,
+		enum compression *compression)
+{
+	if (0 == strcmp("gz", name))
+		*compression = COMPRESSION_BGZF;
+	else if (0 == strcmp("zst", name))
+		*compression = COMPRESSION_ZSTD;
+	else
+		return FAILURE;
+	return SUCCESS;
+}
+
+/* Input: a background thread decompresses 'in' into the queue, and the
+ * stream returned to the program reads from the queue. */
+
+struct decompressor {
+	FILE *in;
+	int nb_threads;
+	struct chunk_queue queue;
+	pthread_t thread;
+	struct chunk current;	/* being read by the program */
+	size_t position;
+};
+
+static ssize_t decompressor_read(void *cookie, char *buf, size_t size)
+{
+	struct decompressor *dec = cookie;
+	size_t done = 0;
+
+	while (done < size) {
+		if (dec->position == dec->current.size) {
+			free(dec->current.data);
+			dec->current.data = NULL;
+			dec->current.size = 0;
+			dec->position = 0;
+			/* Don't wait for more if we have something */
+			if (done > 0) break;
+			if (! queue_get(&(dec->queue), &(dec->current))) {
+				if (dec->queue.failed) {
+					errno = EIO;
+					return -1;
+				}
+				break;	/* end of data */
+			}
+			continue;
+		}
+		size_t length = dec->current.size - dec->position;
+		if (length > size - done) length = size - done;
+		memcpy(buf + done, dec->current.data + dec->position, length);
+		dec->position += length;
+		done += length;
+	}
+
+	return done;
+}
+
+static int decompressor_close(void *cookie)
+{
+	struct decompressor *dec = cookie;
+	cancel_queue(&(dec->queue));
+	pthread_join(dec->thread, NULL);
+	free(dec->current.data);
+	destroy_queue(&(dec->queue));
+	fclose(dec->in);
+	free(dec);
+	return 0;
+}
+
+#ifdef USE_ZLIB
+
+/* More little-endian fields, see get_le16() */
+
+static uint32_t get_le32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_le16(unsigned char *p, unsigned value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+static void put_le32(unsigned char *p, uint32_t value)
+{
+	put_le16(p, value & 0xffff);
+	put_le16(p + 2, value >> 16);
+}
+
+/* Plain gzip: one stream (possibly of several members), inflated serially */
+
+static void *inflate_gzip(void *arg)
+{
+	struct decompressor *dec = arg;
+	const size_t IN_BUF_SIZE = 1 << 18;
+	unsigned char *in_buf = malloc(IN_BUF_SIZE);
+	char *out = NULL;
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	/* 16: gzip format */
+	bool ok = (NULL != in_buf && Z_OK == inflateInit2(&strm, 15 + 16));
+	bool member_ended = false;
+	bool pending = false;	/* output was full, there may be more */
+
+	while (ok) {
+		if (0 == strm.avail_in && ! pending) {
+			size_t length = fread(in_buf, 1, IN_BUF_SIZE, dec->in);
+			if (0 == length) break;
+			strm.next_in = in_buf;
+			strm.avail_in = length;
+		}
+		if (NULL == out) {
+			out = malloc(CHUNK_SIZE);
+			if (NULL == out) { ok = false; break; }
+			strm.next_out = (unsigned char *) out;
+			strm.avail_out = CHUNK_SIZE;
+		}
+		int status = inflate(&strm, Z_NO_FLUSH);
+		if (Z_STREAM_END == status) {
+			/* Another member may follow */
+			member_ended = true;
+			if (Z_OK != inflateReset(&strm)) ok = false;
+		} else if (Z_OK == status)
+			member_ended = false;
+		else if (Z_BUF_ERROR != status)
+			ok = false;
+		pending = (0 == strm.avail_out);
+		if (pending) {
+			if (! queue_put(&(dec->queue), out, CHUNK_SIZE))
+				ok = false;	/* cancelled */
+			out = NULL;
+		}
+	}
+	if (NULL != out) {
+		size_t length = CHUNK_SIZE - strm.avail_out;
+		if (ok && length > 0)
+			queue_put(&(dec->queue), out, length);
+		else
+			free(out);
+	}
+	ok = ok && member_ended && ! ferror(dec->in);
+
+	inflateEnd(&strm);
+	free(in_buf);
+	close_queue(&(dec->queue), ! ok);
+	return NULL;
+}
+
+/* BGZF: blocks are read serially, then inflated in parallel, BGZF_BATCH at a
+ * time, each straight to its place in the output chunk. */
+
+struct bgzf_block {
+	unsigned char *data;	/* whole block, header to footer */
+	size_t size;
+	size_t header_size;
+	size_t out_offset;	/* in the batch's output */
+	size_t out_size;
+};
+
+struct bgzf_batch {
+	struct bgzf_block blocks[BGZF_BATCH];
+	int count;
+	char *out;
+	int next;		/* next block to (de)compress */
+	bool failed;
+	int level;		/* for compression */
+	pthread_mutex_t lock;
+};
+
+/* Returns the index of the next block to work on, or -1 if none is left */
+
+static int next_block(struct bgzf_batch *batch)
+{
+	pthread_mutex_lock(&(batch->lock));
+	int i = batch->next < batch->count ? batch->next++ : -1;
+	pthread_mutex_unlock(&(batch->lock));
+	return i;
+}
+
+static void fail_batch(struct bgzf_batch *batch)
+{
+	pthread_mutex_lock(&(batch->lock));
+	batch->failed = true;
+	pthread_mutex_unlock(&(batch->lock));
+}
+
+/* Runs 'worker' on 'batch' in 'nb_threads' threads, including this one */
+
+static void run_batch(struct bgzf_batch *batch, int nb_threads,
+		void *(*worker)(void *))
+{
+	pthread_t threads[MAX_THREADS];
+	int nb_started = 0;
+
+	batch->next = 0;
+	if (nb_threads > batch->count) nb_threads = batch->count;
+	for (; nb_started < nb_threads - 1; nb_started++)
+		if (0 != pthread_create(threads + nb_started, NULL, worker,
+					batch))
+			break;	/* fewer threads, still correct */
+	worker(batch);
+	int i;
+	for (i = 0; i < nb_started; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static void *inflate_bgzf_blocks(void *arg)
+{
+	struct bgzf_batch *batch = arg;
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	if (Z_OK != inflateInit2(&strm, -15)) {	/* raw deflate */
+		fail_batch(batch);
+		return NULL;
+	}
+
+	int i;
+	while (-1 != (i = next_block(batch))) {
+		struct bgzf_block *block = batch->blocks + i;
+		/* empty blocks, e.g. the EOF marker, have nothing to inflate */
+		if (0 == block->out_size) continue;
+		unsigned char *out = (unsigned char *) batch->out +
+			block->out_offset;
+		strm.next_in = block->data + block->header_size;
+		strm.avail_in = block->size - block->header_size -
+			BGZF_FOOTER_SIZE;
+		strm.next_out = out;
+		strm.avail_out = block->out_size;
+		int status = inflate(&strm, Z_FINISH);
+		uint32_t crc = get_le32(block->data + block->size -
+				BGZF_FOOTER_SIZE);
+		if (Z_STREAM_END != status || 0 != strm.avail_out ||
+		    crc != crc32(0L, out, block->out_size)) {
+			fail_batch(batch);
+			break;
+		}
+		inflateReset(&strm);
+	}
+
+	inflateEnd(&strm);
+	return NULL;
+}
+
+/* Reads a BGZF block into 'block', whose buffer must hold
+ * BGZF_MAX_BLOCK_SIZE bytes. Returns 1 if a block was read, 0 at the end of
+ * the file, and -1 in case of problems. */
+
+static int read_bgzf_block(FILE *in, struct bgzf_block *block)
+{
+	unsigned char *data = block->data;
+	size_t length = fread(data, 1, BGZF_HEADER_SIZE, in);
+	if (0 == length && ! ferror(in)) return 0;
+	if (BGZF_HEADER_SIZE != length) return -1;
+	if (0x1f != data[0] || 0x8b != data[1] || 8 != data[2] ||
+	    ! is_bgzf_header(data, length))
+		return -1;
+
+	size_t extra_size = get_le16(data + 10);
+	block->header_size = 12 + extra_size;
+	block->size = get_le16(data + 16) + 1;
+	if (block->size < block->header_size + BGZF_FOOTER_SIZE)
+		return -1;
+	size_t rest = block->size - BGZF_HEADER_SIZE;
+	if (rest != fread(data + BGZF_HEADER_SIZE, 1, rest, in))
+		return -1;
+	block->out_size = get_le32(data + block->size - 4);
+	if (block->out_size > BGZF_MAX_BLOCK_SIZE) return -1;
+
+	return 1;
+}
+
+static void *inflate_bgzf(void *arg)
+{
+	struct decompressor *dec = arg;
+	struct bgzf_batch batch;
+	bool ok = true;
+	int i;
+
+	pthread_mutex_init(&(batch.lock), NULL);
+	batch.failed = false;
+	for (i = 0; i < BGZF_BATCH; i++) {
+		batch.blocks[i].data = malloc(BGZF_MAX_BLOCK_SIZE);
+		if (NULL == batch.blocks[i].data) ok = false;
+	}
+
+	while (ok) {
+		size_t out_size = 0;
+		int status = 1;
+		for (batch.count = 0; batch.count < BGZF_BATCH; batch.count++) {
+			struct bgzf_block *block = batch.blocks + batch.count;
+			status = read_bgzf_block(dec->in, block);
+			if (1 != status) break;
+			block->out_offset = out_size;
+			out_size += block->out_size;
+		}
+		/* The blocks before a bad one are still passed on, so that
+		 * the program gets all the data there is before the error. */
+		if (-1 == status) ok = false;
+		if (0 == batch.count) break;
+
+		batch.out = malloc(out_size > 0 ? out_size : 1);
+		if (NULL == batch.out) { ok = false; break; }
+		run_batch(&batch, dec->nb_threads, inflate_bgzf_blocks);
+		if (batch.failed) {
+			free(batch.out);
+			ok = false;
+			break;
+		}
+		if (out_size > 0) {
+			if (! queue_put(&(dec->queue), batch.out, out_size)) {
+				ok = false;	/* cancelled */
+				break;
+			}
+		} else
+			free(batch.out);
+		if (1 != status) break;		/* end of file, or bad block */
+	}
+
+	for (i = 0; i < BGZF_BATCH; i++)
+		free(batch.blocks[i].data);
+	pthread_mutex_destroy(&(batch.lock));
+	close_queue(&(dec->queue), ! ok);
+	return NULL;
+}
+
+#endif	/* USE_ZLIB */
+
+#ifdef USE_ZSTD
+
+/* zstd frames are decompressed serially (libzstd has no multi-threaded
+ * decompression), but still off the parsing thread. */
+
+static void *decompress_zstd(void *arg)
+{
+	struct decompressor *dec = arg;
+	size_t in_buf_size = ZSTD_DStreamInSize();
+	char *in_buf = malloc(in_buf_size);
+	ZSTD_DStream *stream = ZSTD_createDStream();
+	bool ok = (NULL != in_buf && NULL != stream &&
+			! ZSTD_isError(ZSTD_initDStream(stream)));
+	ZSTD_inBuffer input = { in_buf, 0, 0 };
+	ZSTD_outBuffer output = { NULL, CHUNK_SIZE, 0 };
+	size_t hint = 0;	/* 0 iff a frame has just ended */
+	bool pending = false;	/* output was full, there may be more */
+
+	while (ok) {
+		if (input.pos == input.size && ! pending) {
+			input.size = fread(in_buf, 1, in_buf_size, dec->in);
+			input.pos = 0;
+			if (0 == input.size) break;
+		}
+		if (NULL == output.dst) {
+			output.dst = malloc(CHUNK_SIZE);
+			output.pos = 0;
+			if (NULL == output.dst) { ok = false; break; }
+		}
+		hint = ZSTD_decompressStream(stream, &output, &input);
+		if (ZSTD_isError(hint)) { ok = false; break; }
+		pending = (output.pos == output.size);
+		if (pending) {
+			if (! queue_put(&(dec->queue), output.dst, output.pos))
+				ok = false;	/* cancelled */
+			output.dst = NULL;
+		}
+	}
+	if (NULL != output.dst) {
+		if (ok && output.pos > 0)
+			queue_put(&(dec->queue), output.dst, output.pos);
+		else
+			free(output.dst);
+	}
+	ok = ok && 0 == hint && ! ferror(dec->in);
+
+	ZSTD_freeDStream(stream);
+	free(in_buf);
+	close_queue(&(dec->queue), ! ok);
+	return NULL;
+}
+
+#endif	/* USE_ZSTD */
+
+static thread_function decompression_thread(enum compression compression)
+{
+	switch (compression) {
+#ifdef USE_ZLIB
+	case COMPRESSION_GZIP:
+		return inflate_gzip;
+	case COMPRESSION_BGZF:
+		return inflate_bgzf;
+#endif
+#ifdef USE_ZSTD
+	case COMPRESSION_ZSTD:
+		return decompress_zstd;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+FILE *open_input_file(const char *filename)
+{
+	FILE *in = fopen(filename, "r");
+	if (NULL == in) return NULL;
+
+	enum compression compression = stream_compression(in);
+	if (COMPRESSION_NONE == compression) return in;
+	thread_function decompress = decompression_thread(compression);
+	if (NULL == decompress) {
+		fprintf (stderr, "%s is compressed with %s, which this build "
+				"does not support.\n", filename,
+				COMPRESSION_ZSTD == compression ?
+				"zstd" : "gzip");
+		fclose(in);
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	struct decompressor *dec = malloc(sizeof(struct decompressor));
+	if (NULL == dec) { fclose(in); return NULL; }
+	dec->in = in;
+	dec->nb_threads = compression_threads();
+	dec->current.data = NULL;
+	dec->current.size = 0;
+	dec->position = 0;
+	init_queue(&(dec->queue));
+
+	int error = pthread_create(&(dec->thread), NULL, decompress, dec);
+	if (0 != error) {
+		destroy_queue(&(dec->queue));
+		free(dec);
+		fclose(in);
+		errno = error;
+		return NULL;
+	}
+	cookie_io_functions_t functions = {
+		decompressor_read, NULL, NULL, decompressor_close
+	};
+	FILE *decompressed = fopencookie(dec, "r", functions);
+	if (NULL == decompressed) {
+		error = errno;
+		decompressor_close(dec);
+		errno = error;
+		return NULL;
+	}
+
+	return decompressed;
+}
+
+/* Output: the program's writes are gathered in chunks, which a writer thread
+ * compresses and writes to 'out'. */
+
+struct compressor {
+	FILE *out;
+	enum compression compression;
+	int nb_threads;
+	struct chunk_queue queue;
+	pthread_t thread;
+	char *buf;		/* being filled by the program */
+	size_t size;
+	size_t capacity;
+	bool failed;		/* set by the writer thread */
+};
+
+static ssize_t compressor_write(void *cookie, const char *buf, size_t size)
+{
+	struct compressor *comp = cookie;
+	size_t done = 0;
+
+	while (done < size) {
+		if (NULL == comp->buf) {
+			comp->buf = malloc(comp->capacity);
+			if (NULL == comp->buf) return -1;
+			comp->size = 0;
+		}
+		size_t length = comp->capacity - comp->size;
+		if (length > size - done) length = size - done;
+		memcpy(comp->buf + comp->size, buf + done, length);
+		comp->size += length;
+		done += length;
+		if (comp->size == comp->capacity) {
+			/* the buffer is passed on in any case */
+			char *full = comp->buf;
+			comp->buf = NULL;
+			if (! queue_put(&(comp->queue), full, comp->size)) {
+				errno = EIO;
+				return -1;
+			}
+		}
+	}
+
+	return done;
+}
+
+static int compressor_close(void *cookie)
+{
+	struct compressor *comp = cookie;
+	if (NULL != comp->buf && comp->size > 0)
+		queue_put(&(comp->queue), comp->buf, comp->size);
+	else
+		free(comp->buf);
+	close_queue(&(comp->queue), false);
+	pthread_join(comp->thread, NULL);
+	bool ok = ! comp->failed && 0 == fflush(comp->out);
+	destroy_queue(&(comp->queue));
+	free(comp);
+	if (! ok) {
+		errno = EIO;
+		return EOF;
+	}
+	return 0;
+}
+
+#ifdef USE_ZLIB
+
+/* An empty BGZF block, which marks the end of a BGZF file */
+
+static const unsigned char BGZF_EOF[] = {
+	0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+	0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static void *deflate_bgzf_blocks(void *arg)
+{
+	struct bgzf_batch *batch = arg;
+	z_stream strm;	/* at the batch's level */
+	z_stream store;	/* level 0, for incompressible data */
+	memset(&strm, 0, sizeof(strm));
+	memset(&store, 0, sizeof(store));
+	if (Z_OK != deflateInit2(&strm, batch->level, Z_DEFLATED, -15, 8,
+				Z_DEFAULT_STRATEGY)) {
+		fail_batch(batch);
+		return NULL;
+	}
+	if (Z_OK != deflateInit2(&store, 0, Z_DEFLATED, -15, 8,
+				Z_DEFAULT_STRATEGY)) {
+		deflateEnd(&strm);
+		fail_batch(batch);
+		return NULL;
+	}
+
+	int i;
+	while (-1 != (i = next_block(batch))) {
+		struct bgzf_block *block = batch->blocks + i;
+		unsigned char *in = (unsigned char *) batch->out +
+			block->out_offset;
+		z_stream *s = &strm;
+		int status;
+		do {
+			deflateReset(s);
+			s->next_in = in;
+			s->avail_in = block->out_size;
+			s->next_out = block->data + BGZF_HEADER_SIZE;
+			s->avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE -
+				BGZF_FOOTER_SIZE;
+			status = deflate(s, Z_FINISH);
+			/* Stored data always fits, see BGZF_BLOCK_DATA */
+			if (Z_STREAM_END != status && s == &strm)
+				s = &store;
+			else
+				break;
+		} while (true);
+		if (Z_STREAM_END != status) {
+			fail_batch(batch);
+			break;
+		}
+		block->size = BGZF_HEADER_SIZE + s->total_out +
+			BGZF_FOOTER_SIZE;
+		memcpy(block->data, BGZF_EOF, BGZF_HEADER_SIZE);
+		put_le16(block->data + 16, block->size - 1);
+		put_le32(block->data + block->size - 8,
+				crc32(0L, in, block->out_size));
+		put_le32(block->data + block->size - 4, block->out_size);
+	}
+
+	deflateEnd(&strm);
+	deflateEnd(&store);
+	return NULL;
+}
+
+/* Compresses each chunk as BGZF_BATCH blocks (see the compressor's
+ * capacity), in parallel. */
+
+static void *deflate_bgzf(void *arg)
+{
+	struct compressor *comp = arg;
+	struct bgzf_batch batch;
+	struct chunk chunk;
+	bool ok = true;
+	int i;
+
+	pthread_mutex_init(&(batch.lock), NULL);
+	batch.failed = false;
+	batch.level = Z_DEFAULT_COMPRESSION;
+	for (i = 0; i < BGZF_BATCH; i++) {
+		batch.blocks[i].data = malloc(BGZF_MAX_BLOCK_SIZE);
+		if (NULL == batch.blocks[i].data) ok = false;
+	}
+
+	while (ok && queue_get(&(comp->queue), &chunk)) {
+		size_t offset;
+		batch.count = 0;
+		for (offset = 0; offset < chunk.size;
+				offset += BGZF_BLOCK_DATA) {
+			struct bgzf_block *block = batch.blocks + batch.count++;
+			block->out_offset = offset;
+			block->out_size = chunk.size - offset;
+			if (block->out_size > BGZF_BLOCK_DATA)
+				block->out_size = BGZF_BLOCK_DATA;
+		}
+		batch.out = chunk.data;
+		run_batch(&batch, comp->nb_threads, deflate_bgzf_blocks);
+		free(chunk.data);
+		if (batch.failed) { ok = false; break; }
+		for (i = 0; i < batch.count; i++) {
+			struct bgzf_block *block = batch.blocks + i;
+			fwrite(block->data, 1, block->size, comp->out);
+		}
+		if (ferror(comp->out)) ok = false;
+	}
+	if (ok) fwrite(BGZF_EOF, 1, sizeof(BGZF_EOF), comp->out);
+
+	for (i = 0; i < BGZF_BATCH; i++)
+		free(batch.blocks[i].data);
+	pthread_mutex_destroy(&(batch.lock));
+	comp->failed = ! ok || ferror(comp->out);
+	if (comp->failed) cancel_queue(&(comp->queue));
+	return NULL;
+}
+
+#endif	/* USE_ZLIB */
+
+#ifdef USE_ZSTD
+
+/* libzstd compresses in parallel by itself, given workers */
+
+static void *compress_zstd(void *arg)
+{
+	struct compressor *comp = arg;
+	size_t out_buf_size = ZSTD_CStreamOutSize();
+	char *out_buf = malloc(out_buf_size);
+	ZSTD_CCtx *context = ZSTD_createCCtx();
+	bool ok = (NULL != out_buf && NULL != context);
+	struct chunk chunk;
+
+	/* Fails harmlessly if libzstd was built without threads */
+	if (ok && comp->nb_threads > 1)
+		ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers,
+				comp->nb_threads);
+
+	while (ok) {
+		bool last = ! queue_get(&(comp->queue), &chunk);
+		ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+		ZSTD_inBuffer input = { last ? NULL : chunk.data,
+			last ? 0 : chunk.size, 0 };
+		bool finished;
+		do {
+			ZSTD_outBuffer output = { out_buf, out_buf_size, 0 };
+			size_t remaining = ZSTD_compressStream2(context,
+					&output, &input, mode);
+			if (ZSTD_isError(remaining)) { ok = false; break; }
+			fwrite(out_buf, 1, output.pos, comp->out);
+			finished = last ? (0 == remaining) :
+				(input.pos == input.size);
+		} while (! finished);
+		if (! last) free(chunk.data);
+		if (last) break;
+	}
+
+	ZSTD_freeCCtx(context);
+	free(out_buf);
+	comp->failed = ! ok || ferror(comp->out);
+	if (comp->failed) cancel_queue(&(comp->queue));
+	return NULL;
+}
+
+#endif	/* USE_ZSTD */
+
+static thread_function compression_thread(enum compression compression)
+{
+	switch (compression) {
+#ifdef USE_ZLIB
+	case COMPRESSION_GZIP:
+	case COMPRESSION_BGZF:
+		return deflate_bgzf;
+#endif
+#ifdef USE_ZSTD
+	case COMPRESSION_ZSTD:
+		return compress_zstd;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/* Returns a stream whose data is compressed to 'out', or NULL in case of
+ * problems. Closing the stream finishes compression and flushes 'out', but
+ * does not close it. */
+
+static FILE *open_compressed(FILE *out, enum compression compression)
+{
+	thread_function compress = compression_thread(compression);
+	if (NULL == compress) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+	struct compressor *comp = malloc(sizeof(struct compressor));
+	if (NULL == comp) return NULL;
+	comp->out = out;
+	comp->compression = compression;
+	comp->nb_threads = compression_threads();
+	comp->buf = NULL;
+	comp->size = 0;
+	comp->capacity = COMPRESSION_ZSTD == compression ?
+		CHUNK_SIZE : BGZF_BATCH * BGZF_BLOCK_DATA;
+	comp->failed = false;
+	init_queue(&(comp->queue));
+
+	int error = pthread_create(&(comp->thread), NULL, compress, comp);
+	if (0 != error) {
+		destroy_queue(&(comp->queue));
+		free(comp);
+		errno = error;
+		return NULL;
+	}
+	cookie_io_functions_t functions = {
+		NULL, compressor_write, NULL, compressor_close
+	};
+	FILE *compressed = fopencookie(comp, "w", functions);
+	if (NULL == compressed) {
+		error = errno;
+		compressor_close(comp);
+		errno = error;
+		return NULL;
+	}
+
+	return compressed;
+}
+
+static FILE *uncompressed_stdout = NULL;
+
+static void close_compressed_stdout()
+{
+	if (0 != fclose(stdout)) perror(NULL);
+	stdout = uncompressed_stdout;
+}
+
+int compress_stdout(const char *format)
+{
+	enum compression compression;
+	if (! compression_from_name(format, &compression)) {
+		errno = EINVAL;
+		return FAILURE;
+	}
+
+	FILE *compressed = open_compressed(stdout, compression);
+	if (NULL == compressed) return FAILURE;
+	if (0 != atexit(close_compressed_stdout)) {
+		fclose(compressed);
+		return FAILURE;
+	}
+	uncompressed_stdout = stdout;
+	stdout = compressed;
+
+	return SUCCESS;
+}
@@ -0,0 +1,68 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* compressed_io.h: transparent (de)compression of input and output */
+
+/* Tree files may be compressed with gzip (including BGZF, the blocked gzip of
+ * bgzip and samtools) or zstd. Programs open them with open_input_file(),
+ * which tells the format by its magic number and decompresses on background
+ * threads: BGZF blocks are independent, so they are inflated in parallel.
+ * Output can likewise be compressed on a writer thread (see
+ * compress_stdout()). gzip support needs zlib, and zstd support needs libzstd;
+ * without them, such files are refused. */
+
+#include <stdio.h>
+
+enum compression {
+	COMPRESSION_NONE,
+	COMPRESSION_GZIP,	/* any gzip stream, decompressed serially */
+	COMPRESSION_BGZF,	/* gzip made of independent blocks */
+	COMPRESSION_ZSTD
+};
+
+/* Tells how the data in 'in', from its current position, is compressed. Only
+ * regular files are examined (the position is restored afterwards); for
+ * anything else, returns COMPRESSION_NONE. */
+
+enum compression stream_compression(FILE *in);
+
+/* Opens file 'filename' for reading. If it is compressed, the returned stream
+ * yields the decompressed data, which is decompressed by background threads.
+ * Returns NULL in case of problems (errno is set; it is ENOTSUP if the file's
+ * compression is not supported by this build). */
+
+FILE *open_input_file(const char *filename);
+
+/* Compresses all further output to stdout, in format 'format': "gz" or "zst"
+ * (as for option -z). Compression runs on a writer thread (and, for gz, on
+ * worker threads too; for zst, libzstd's), and is finished at exit. gz output
+ * is written as BGZF, which gunzip reads as usual. Returns SUCCESS, or FAILURE
+ * in case of problems: errno is then EINVAL for an unknown format, ENOTSUP
+ * for one this build does not support. */
+
+int compress_stdout(const char *format);
@@ -44,18 +44,47 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "list.h"
 #include "link.h"
 #include "masprintf.h"
+#include "label_intern.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 enum actions { PURE_CLADES, STAIR_NODES , UNIQUE }; /* not sure we'll keep stair nodes */
 
-struct group_data {
-	char *name;
-	char *repr_member;	/* the label of a "representative" for the group */
+/* The group of a clade whose leaves are not all in the same group, or of a
+ * leaf that is in no group */
+
+#define NO_GROUP -1
+
+/* A label -> group map, indexed by label ID. A group is identified by the ID
+ * of its (interned) name. Labels first seen after the map was read have IDs
+ * beyond 'size', and no group. */
+
+struct group_index {
+	int *group_of;	/* NO_GROUP if the label is not in the map */
 	int size;
 };
 
+/* Per-node work space of condense_clades(), indexed by postorder rank. It is
+ * kept from one tree to the next, and grows as needed. */
+
+enum fates { KEPT, CONDENSED, DROPPED };
+
+struct clade_table {
+	struct rnode **nodes;
+	int *parent;
+	int *group;	/* of all the clade's leaves, or NO_GROUP */
+	int *size;	/* number of leaves */
+	int *repr;	/* label ID of the clade's last leaf */
+	int *stack;	/* of clades whose parent is not yet known */
+	int *fate;
+	int capacity;
+};
+
 struct parameters {
 	enum actions action;	/* for now, only condense pure clades */
 	char *grp_map_fname;
+	bool check_support;	/* -b */
+	double min_support;
 };
 
 void help(char *argv[])
@@ -66,7 +95,7 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-hm:u] <tree|->\n"
+"%s [-hu] [-b <support>] [-m <map file>] <tree|->\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -87,6 +116,11 @@ void help(char *argv[])
 "Options\n"
 "-------\n"
 "\n"
+"   -b <support>: only condense clades whose support is greater than\n"
+"      <support>. The support is the clade's (inner node's) label, read as a\n"
+"      number: clades whose label is not a number are not condensed. Leaves\n"
+"      are not affected, but a pure clade that is not condensed may still\n"
+"      have condensed pure subclades.\n"
 "   -h: prints this message and exits\n"
 "   -m <map file>: uses a group map. This is a text file that lists one\n"
 "      label and one group name per line. For example a file with the\n"
@@ -120,7 +154,11 @@ void help(char *argv[])
 "$ %s data/falc_families\n"
 "\n"
 "# condense by geographic origin\n"
-"$ %s -m data/catarrhini_geog.map data/catarrhini\n",
+"$ %s -m data/catarrhini_geog.map data/catarrhini\n"
+"\n"
+"# same, but only where bootstrap support is over 70\n"
+"$ %s -b 70 data/falc_families\n",
+argv[0],
 argv[0],
 argv[0],
 argv[0]
@@ -134,11 +172,23 @@ struct parameters params;
 
 params.action = PURE_CLADES;
 params.grp_map_fname = NULL;
+params.check_support = false;
 
 /* parse options and switches */
 int opt_char;
-while ((opt_char = getopt(argc, argv, "hm:u")) != -1) {
+while ((opt_char = getopt(argc, argv, "b:hm:u")) != -1) {
 	switch (opt_char) {
+	case 'b':
+		params.check_support = true;
+		char *end;
+		params.min_support = strtod(optarg, &end);
+		if (end == optarg || '\0' != *end ||
+		    params.min_support < 0) {
+			fprintf(stderr, "Argument to -b must be a "
+					"non-negative number.\n");
+			exit(EXIT_FAILURE);
+		}
+		break;
 	case 'h':
 		help(argv);
 		exit(EXIT_SUCCESS);
@@ -160,7 +210,7 @@ while ((opt_char = getopt(argc, argv, "hm:u")) != -1) {
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -169,7 +219,8 @@ while ((opt_char = getopt(argc, argv, "hm:u")) != -1) {
 			nwsin = fin;
 		}
 	} else {
-		fprintf(stderr, "Usage: %s [-hm:u] <filename|->\n",
+		fprintf(stderr, "Usage: %s [-hu] [-b <support>] [-m <map>] "
+				"<filename|->\n",
 				argv[0]);
 		exit(EXIT_FAILURE);
 	}
@@ -226,93 +277,156 @@ struct hash *read_map(const char *filename)
 	return map;
 }
 
-/* Like all_children_have_same_label() in rnode.c, but returns true if all
- * children belong to the same group, as determined by the rnode->data member.
- * Sets group to the common group, if any, or else to NULL.  */
+/* Converts a label -> group hash (see read_map()) into a group_index. This
+ * interns all the labels and group names in the map. */
 
-bool all_children_in_same_group(struct rnode *node, struct group_data *grp_data)
+struct group_index *index_groups_by_label_id(struct hash *group_map)
 {
+	struct llist *keys = hash_keys(group_map);
+	if (NULL == keys) { perror(NULL); exit(EXIT_FAILURE); }
+	struct list_elem *e;
+	for (e = keys->head; NULL != e; e = e->next)
+		if (intern_label((char *) e->data) < 0 ||
+		    intern_label(hash_get(group_map, e->data)) < 0) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
 
-	if (is_leaf(node))
-		return false;
-
-	/* get first child's group */
-	struct rnode *curr = node->first_child;
-	struct group_data *g_data = curr->data;
-	char *ref_group = g_data->name;
-
-	/* iterate over other children, and compare their group to the first's
-	 * */
-
-	int status = 1;
-	int size = 1;
-	for (curr = curr->next_sibling; curr; curr = curr->next_sibling) {
-		g_data = curr->data;
-		char *curr_group = g_data->name;
-		if (0 != strcmp(ref_group, curr_group))
-			status *= 0; /* found a different group */
-		size += g_data->size;
+	struct group_index *index = malloc(sizeof(struct group_index));
+	if (NULL == index) { perror(NULL); exit(EXIT_FAILURE); }
+	index->size = interned_label_count();
+	index->group_of = malloc(index->size * sizeof(int));
+	if (NULL == index->group_of) { perror(NULL); exit(EXIT_FAILURE); }
+	int i;
+	for (i = 0; i < index->size; i++)
+		index->group_of[i] = NO_GROUP;
+	for (e = keys->head; NULL != e; e = e->next) {
+		char *key = (char *) e->data;
+		index->group_of[find_label_id(key)] =
+			find_label_id(hash_get(group_map, key));
 	}
+	destroy_llist(keys);
 
-	grp_data->name = strdup(g_data->name);
-	grp_data->repr_member = strdup(g_data->repr_member);
-	grp_data->size = size;
+	return index;
+}
 
-	return (bool) status;
+static void grow_clade_table(struct clade_table *table, int capacity)
+{
+	table->nodes = realloc(table->nodes, capacity *
+			sizeof(struct rnode *));
+	table->parent = realloc(table->parent, capacity * sizeof(int));
+	table->group = realloc(table->group, capacity * sizeof(int));
+	table->size = realloc(table->size, capacity * sizeof(int));
+	table->repr = realloc(table->repr, capacity * sizeof(int));
+	table->stack = realloc(table->stack, capacity * sizeof(int));
+	table->fate = realloc(table->fate, capacity * sizeof(int));
+	if (NULL == table->nodes || NULL == table->parent ||
+	    NULL == table->group || NULL == table->size ||
+	    NULL == table->repr || NULL == table->stack ||
+	    NULL == table->fate) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+	table->capacity = capacity;
 }
 
-/* Same as collapse_pure_clades() (tree.c), but collapses clades of the same
- * group, usig a label->group map. */
+/* A leaf's group: its label's, if there is a group map, or else the label
+ * itself (so that pure clades are those of identical labels). */
 
-void collapse_by_groups(struct rooted_tree *tree, struct hash *group_map)
+static int leaf_group(struct rnode *leaf, const struct group_index *groups)
 {
-	struct list_elem *el;		
-	struct group_data *grp_data;
+	if (NULL == groups)
+		return leaf->label_id;
+	if (leaf->label_id < groups->size)
+		return groups->group_of[leaf->label_id];
+	return NO_GROUP;
+}
 
-	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
-		struct rnode *current = el->data;
-		grp_data = malloc(sizeof(grp_data));
-		if (NULL == grp_data) { perror(NULL); exit (EXIT_FAILURE); }
-		current->data = grp_data;
-
-		if (is_leaf(current)) {
-			char *group = hash_get(group_map, current->label);
-			if (NULL == group) 
-				grp_data->name = strdup("");
-			else
-				grp_data->name = strdup(group);
-			grp_data->repr_member = strdup(current->label);
-			grp_data->size = 1;
-			
-			continue;
-		}
+/* True IFF the node's label is a number greater than 'min_support' */
 
-		grp_data->name = strdup("MIXED");
-		grp_data->repr_member = strdup("");
-		grp_data->size = -1;
-
-		/* attempt collapse only if all children are leaves (any pure
-		 * subtree will have been collapsed to a leaf by now) */
-		if (! all_children_are_leaves(current)) continue;
-
-		/* this also sets grp_data */
-		if (all_children_in_same_group(current, grp_data)) {
-			/*
-			 fprintf(stderr,
-				"%s and %d other descendants of '%s' "
-				"belong to group '%s'\n",
-				grp_data->repr_member,
-				grp_data->size - 1,
-				current->label,
-				grp_data->name);
-				*/
-			remove_children(current);
-			char *new_label = masprintf("%s_%s_%d",
-					grp_data->name, grp_data->repr_member,
-					grp_data->size);
-			free(current->label);
-			current->label = new_label;
+static bool is_supported(struct rnode *node, double min_support)
+{
+	char *end;
+	double support = strtod(node->label, &end);
+	return end != node->label && '\0' == *end && support > min_support;
+}
+
+/* Replaces each largest pure clade by a leaf. A clade is pure if its leaves
+ * all belong to the same group (see leaf_group()); with -b, its support must
+ * also be high enough. Without a map, the leaf gets the clade's common label;
+ * with a map, it is labelled <group>_<last leaf's label>_<number of leaves>.
+ *
+ * The nodes are visited twice, by rank in 'nodes_in_order': in postorder, to
+ * find each clade's group from its children's (which are on top of a stack of
+ * ranks), then in reverse, so that a clade is condensed only if none of its
+ * ancestors is. Nothing is allocated per node, and labels are only made for
+ * the clades that are condensed. */
+
+void condense_clades(struct rooted_tree *tree, const struct group_index *groups,
+		const struct parameters *params)
+{
+	static struct clade_table table;	/* all zero at first */
+	int n = tree->nodes_in_order->count;
+	if (n > table.capacity) grow_clade_table(&table, n);
+
+	struct list_elem *el;
+	int top = 0;	/* of stack */
+	int i;
+	for (i = 0, el = tree->nodes_in_order->head; NULL != el;
+			el = el->next, i++) {
+		struct rnode *node = el->data;
+		table.nodes[i] = node;
+		table.parent[i] = -1;
+		if (is_leaf(node)) {
+			table.group[i] = leaf_group(node, groups);
+			table.size[i] = 1;
+			table.repr[i] = node->label_id;
+		} else {
+			int first = top - node->child_count;
+			int c;
+			table.group[i] = table.group[table.stack[first]];
+			table.size[i] = 0;
+			for (c = first; c < top; c++) {
+				int child = table.stack[c];
+				table.parent[child] = i;
+				if (table.group[child] != table.group[i])
+					table.group[i] = NO_GROUP;
+				table.size[i] += table.size[child];
+			}
+			table.repr[i] = table.repr[table.stack[top - 1]];
+			top = first;
 		}
+		table.stack[top++] = i;
+	}
+
+	/* Ancestors come after their descendants */
+	for (i = n - 1; i >= 0; i--) {
+		int parent = table.parent[i];
+		struct rnode *node = table.nodes[i];
+		if (-1 != parent && KEPT != table.fate[parent])
+			table.fate[i] = DROPPED;
+		else if (! is_leaf(node) && NO_GROUP != table.group[i] &&
+				(! params->check_support ||
+				 is_supported(node, params->min_support)))
+			table.fate[i] = CONDENSED;
+		else
+			table.fate[i] = KEPT;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (CONDENSED != table.fate[i]) continue;
+		struct rnode *node = table.nodes[i];
+		const char *group_label = interned_label(table.group[i]);
+		char *new_label;
+		if (NULL == groups)
+			new_label = strdup(group_label);
+		else
+			new_label = masprintf("%s_%s_%d", group_label,
+				interned_label(table.repr[i]), table.size[i]);
+		if (NULL == new_label) { perror(NULL); exit(EXIT_FAILURE); }
+		remove_children(node);
+		free(node->label);
+		node->label = new_label;
+		node->label_id = NULL == groups ?
+			table.group[i] : intern_label(new_label);
 	}
 }
 
@@ -322,46 +436,52 @@ void collapse_by_groups(struct rooted_tree *tree, struct hash *group_map)
 
 void unicify_tree_leaves(struct rooted_tree *tree)
 {
+	/* seen_in[id] is the number of the last tree in which a leaf labelled
+	 * 'id' was seen, so that it need not be cleared between trees. */
+	static int *seen_in = NULL;
+	static int seen_in_size = 0;
+	static int tree_number = 0;
 	struct list_elem *el = NULL;			
-	const unsigned int HASH_SIZE = 1000;	/* most trees will have fewer nodes */
-	const double LOAD_THRESHOLD = 0.8;
-	const unsigned RESIZE_FACTOR = 10;
-	/* Actually I only need a set (not a full-blown hash), but my set_t type
-	 * is not dynamic (yet...), and sets are implemented with hashes
-	 * anyway... */
-	struct hash *seen_labels = create_dynamic_hash(HASH_SIZE,
-			LOAD_THRESHOLD, RESIZE_FACTOR);
-	if (NULL == seen_labels) return; // TODO: return a status code
-	char *SEEN = "seen";
+
+	tree_number++;
+	int label_count = interned_label_count();
+	if (label_count > seen_in_size) {
+		int *grown = realloc(seen_in, label_count * sizeof(int));
+		if (NULL == grown) return; // TODO: return a status code
+		for (; seen_in_size < label_count; seen_in_size++)
+			grown[seen_in_size] = 0;
+		seen_in = grown;
+	}
 
 	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
 		struct rnode *current = el->data;
 		if (! is_leaf(current)) continue;
-		char *label = current->label;
-		if(NULL == hash_get(seen_labels, label)) {
-			hash_set(seen_labels, label, SEEN);
+		if (tree_number != seen_in[current->label_id]) {
+			seen_in[current->label_id] = tree_number;
 		}
 		else {
 			unlink_rnode(current);
 		}
 	}
-
-	destroy_hash(seen_labels);
-
 }
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params;
-	struct hash *group_map = NULL;
+	struct group_index *group_map = NULL;
 	
 	params = get_params(argc, argv);
+	/* Labels are compared within and across trees, so we intern them and
+	 * compare label IDs. Only the map's labels are kept across trees: the
+	 * others are forgotten after each tree. */
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
 	if (NULL != params.grp_map_fname)
-		group_map = read_map(params.grp_map_fname);
-
-	// debug
-	// if (NULL != group_map) dump_hash(group_map, NULL);
+		group_map = index_groups_by_label_id(
+				read_map(params.grp_map_fname));
+	int label_watermark = interned_label_count();
 
 	// TODO: the tree-processing functions below (collapse_pure_clades(),
 	// etc.) should return a value for success or failure. main() should
@@ -371,10 +491,7 @@ int main(int argc, char *argv[])
 		if (NULL != tree) {
 			switch (params.action) {
 			case PURE_CLADES: 
-				if (NULL == group_map)
-					collapse_pure_clades(tree);
-				else
-					collapse_by_groups(tree, group_map);
+				condense_clades(tree, group_map, &params);
 				break;
 			case UNIQUE:
 				unicify_tree_leaves(tree);
@@ -388,6 +505,7 @@ int main(int argc, char *argv[])
 			dump_newick(tree->root);
 			destroy_all_rnodes(NULL);
 			destroy_tree(tree);
+			forget_labels_since(label_watermark);
 		}
 		else switch (newick_parser_status) {
 			case PARSER_STATUS_EMPTY:	/* EOF, etc. */
@@ -50,6 +50,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "text_graph_common.h"
 #include "error.h"
 #include "node_pos_alloc.h"
+#include "profile.h"
+#include "compressed_io.h"
+#include "label_intern.h"
 
 struct parameters {
 	double 	width;
@@ -73,6 +76,9 @@ struct parameters {
 	bool	scale_zero_at_root;	/* if false, at max depth */
 	int	label_space_correction;	/* between a node and its label */
 	enum text_graph_style txt_graph_style;		/* ... text graph style (surprise!)*/
+	double	lod_budget;	/* lines or px; collapse clades beyond */
+	char	*tile_dir;	/* SVG tiles go there, if not NULL */
+	int	tile_threads;
 };
 
 void help(char* argv[])
@@ -162,11 +168,16 @@ void help(char* argv[])
 "    -I <char> sets the position of the inner node label. Valid options are\n"
 "       'l' (near the leaves), 'm' (middle) or 'r' (near the root). Default\n"
 "       is 'l'.\n"
+"    -j <number>: write tiles (see -T) with this many threads (default: 1)\n"
 "    -l <string>: CSS for leaf node labels. [only SVG]\n"
 "       Default: 'font-size:medium;font-family:sans'.\n"    
 "       setting 'visibility:hidden' disables printing of leaf node labels.\n"
 "       Note: if you change this, you will probably need to adjust the\n"
 "       space allocated to leaf labels - see option -W.\n"
+"    -m <number>: level of detail. Clades whose leaves would not fit in this\n"
+"       many lines (text) or pixels (SVG, one leaf every -v pixels) are\n"
+"       collapsed into a triangle (wedge for radial trees) labelled with\n"
+"       their number of leaves. Default: no collapsing.\n"
 "    -n <number> add this number of pixels to the horizontal position of\n"
 "       node labels. [SVG only]\n"
 "    -o <filename>: use specified file as ornament map. Works like the CSS\n"
@@ -192,6 +203,15 @@ void help(char* argv[])
 "       will generate as many SVG files as there are Newick trees in\n"
 "       many_trees.nw. The files will be named tree_01.svg, tree_02.svg, etc.\n"
 "    -S: suppress scale bar (ignored for cladograms)\n"
+"    -T <directory>: write each tree as a pyramid of SVG tiles, for trees\n"
+"       too large for a single SVG document [implies -s, only SVG\n"
+"       orthogonal]. Tree 1 goes in <directory>/1, etc., which contains a\n"
+"       page, index.html, that shows the tiles in view as one scrolls and\n"
+"       zooms. Zoom levels only stretch the tree vertically, from the whole\n"
+"       tree in 256 pixels to one leaf every -v pixels. Small clades are\n"
+"       drawn as triangles, and text is only drawn where leaves are at least\n"
+"       12 pixels apart. Ornaments, URLs and the scale bar are not drawn.\n"
+"       Nothing is printed.\n"
 "    -t: set the zero of the scale at the maximum depth instead of the root.\n"
 "       This is useful when the branch lengths are in time units: zero marks\n"
 "       the present, and the scale shows the age of the ancestral nodes.\n"
@@ -249,7 +269,11 @@ void help(char* argv[])
 "$ %s -s -b 'visibility:hidden' -c data/color.map data/catarrhini\n"
 "\n"
 "# radial tree, leaf labels in italics\n"
-"$ %s -s -r -l 'font-style:italics' data/catarrhini\n",
+"$ %s -s -r -l 'font-style:italics' data/catarrhini\n"
+"\n"
+"# tiles of a large tree, written by 4 threads; open big/1/index.html\n"
+"$ %s -T big -j 4 big_tree.nw\n",
+	argv[0],
 	argv[0],
 	argv[0],
 	argv[0],
@@ -319,6 +343,9 @@ struct parameters get_params(int argc, char *argv[])
 	params.inner_label_pos = INNER_LBL_LEAVES;
 	params.scale_zero_at_root = true;
 	params.label_space_correction = 0;	/* px */
+	params.lod_budget = 0;	/* no collapsing */
+	params.tile_dir = NULL;
+	params.tile_threads = 1;
 	// params.text_st = false;
 
 	char *nw_display_text_style = getenv("NW_DISPLAY_TEXT_STYLE");
@@ -333,7 +360,7 @@ struct parameters get_params(int argc, char *argv[])
 	int pos;
 	
 	/* parse options and switches */
-	while ((opt_char = getopt(argc, argv, "a:A:b:c:d:e:hi:I:l:n:o:rR:sStu:U:v:Vw:W:")) != -1) {
+	while ((opt_char = getopt(argc, argv, "a:A:b:c:d:e:hi:I:j:l:m:n:o:rR:sStT:u:U:v:Vw:W:")) != -1) {
 		switch (opt_char) {
 		case 'a':
 			params.label_angle_correction = atof(optarg);
@@ -370,9 +397,20 @@ struct parameters get_params(int argc, char *argv[])
 			else
 				params.inner_label_pos = pos;
 			break;
+		case 'j':
+			params.tile_threads = atoi(optarg);
+			if (params.tile_threads < 1) {
+				fprintf(stderr, "Argument to -j must be a "
+					"positive integer.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'l':
 			params.leaf_label_style = optarg;
 			break;
+		case 'm':
+			params.lod_budget = atof(optarg);
+			break;
 		case 'o':
 			params.ornament_map = fopen(optarg, "r");
 			if (NULL == params.ornament_map) {
@@ -397,6 +435,10 @@ struct parameters get_params(int argc, char *argv[])
 		case 't':
 			params.scale_zero_at_root = false;
 			break;
+		case 'T':
+			params.tile_dir = optarg;
+			params.svg = true;
+			break;
 		case 'u':
 			params.branch_length_unit = optarg;
 			break;
@@ -433,10 +475,15 @@ struct parameters get_params(int argc, char *argv[])
 
 		}
 	}
+	if (NULL != params.tile_dir && SVG_RADIAL == params.style) {
+		fprintf(stderr, "Tiles (-T) are only drawn for orthogonal "
+				"trees.\n");
+		exit(EXIT_FAILURE);
+	}
 	/* check arguments */
 	if (1 == (argc - optind)) {
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -445,7 +492,7 @@ struct parameters get_params(int argc, char *argv[])
 			nwsin = fin;
 		}
 	} else {
-		fprintf(stderr, "Usage: %s [-aAbchilsuUvw] <filename|->\n",
+		fprintf(stderr, "Usage: %s [-aAbchijlmsTuUvw] <filename|->\n",
 				argv[0]);
 		exit(EXIT_FAILURE);
 	}
@@ -483,9 +530,22 @@ void set_svg_parameters(struct parameters params)
 	set_root_length(params.root_length);
 	set_label_char_width(params.label_char_width);
 	set_scalebar_zero_at_root(params.scale_zero_at_root);
+	set_tile_dir(params.tile_dir);
+	set_tile_threads(params.tile_threads);
 	add_to_label_space(params.label_space_correction);
 }
 
+/* Number of leaves that fit in the level-of-detail budget: text graphs use 2
+ * lines per leaf, SVG graphs use one leaf_vskip per leaf. */
+
+int lod_max_leaves(struct parameters params)
+{
+	if (params.svg)
+		return params.lod_budget / params.leaf_vskip;
+	else
+		return params.lod_budget / 2;
+}
+
 /* Prints an XML comment containing the command line parameters, so that the
  * result is easier to reproduce. */
 
@@ -504,6 +564,8 @@ void svg_run_params_comment(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;
 	struct parameters params;
 	bool align_leaves;
@@ -511,6 +573,8 @@ int main(int argc, char *argv[])
 	enum display_status status; 
 	/* Stays NULL for text, but not for SVG */
 	void (*node_destroyer)(void *) = NULL;
+	/* Leaves standing for collapsed clades, if any */
+	struct llist *collapsed = NULL;
 
 	params = get_params(argc, argv);
 
@@ -522,6 +586,9 @@ int main(int argc, char *argv[])
 		}
 		node_destroyer = destroy_svg_node_data;
 	}
+	/* svg_init() may have interned the map labels: these are kept, but
+	 * those of each tree are forgotten with it. */
+	int label_watermark = interned_label_count();
 
 	while (NULL != (tree = parse_tree())) {
 		align_leaves = is_cladogram(tree);
@@ -532,11 +599,21 @@ int main(int argc, char *argv[])
 		/* User can also suppress scale bar */
 		if (params.no_scale_bar) with_scale_bar = false;
 
-		if (strcmp("", tree->root->edge_length_as_string) &&
+		if (has_edge_length(tree->root) &&
 			0 == params.root_length) {
-			free(tree->root->edge_length_as_string);
-			tree->root->edge_length_as_string =
-				strdup("");
+			if (! set_edge_length_string(tree->root, "")) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		if (params.lod_budget > 0) {
+			collapsed = collapse_clades(tree,
+					lod_max_leaves(params));
+			if (NULL == collapsed) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 		}
 
 		if (params.svg) {
@@ -548,6 +625,8 @@ int main(int argc, char *argv[])
 			// refactored out into their own f().
 			if (! svg_alloc_node_pos(tree))
 				return DISPLAY_MEM_ERROR;
+			if (NULL != collapsed)
+				svg_set_collapsed_clades(collapsed);
 			set_node_vpos_cb(tree,
 					svg_set_node_top, svg_set_node_bottom,
 					svg_get_node_top, svg_get_node_bottom);
@@ -555,9 +634,12 @@ int main(int argc, char *argv[])
 					svg_set_node_depth, svg_get_node_depth);
 			if (FAILURE == hd.status) return DISPLAY_MEM_ERROR;
 
-			svg_header(leaf_count(tree), with_scale_bar,
-					params.style, hd);
-			svg_run_params_comment(argc, argv);
+			/* tiles go to files, not stdout */
+			if (NULL == params.tile_dir) {
+				svg_header(leaf_count(tree), with_scale_bar,
+						params.style, hd);
+				svg_run_params_comment(argc, argv);
+			}
 			status = display_svg_tree(tree, params.style,
 					align_leaves, with_scale_bar,
 					params.branch_length_unit, hd);
@@ -573,7 +655,8 @@ int main(int argc, char *argv[])
 				default:
 					assert(0);
 			}
-			svg_footer();
+			if (NULL == params.tile_dir)
+				svg_footer();
 		} else {
 			prettify_labels(tree);
 			status = display_tree(tree, params.width,
@@ -596,8 +679,13 @@ int main(int argc, char *argv[])
 					assert(0);
 			}
 		}
+		if (NULL != collapsed) {
+			destroy_llist(collapsed);
+			collapsed = NULL;
+		}
 		destroy_all_rnodes(node_destroyer);
 		destroy_tree(tree);
+		forget_labels_since(label_watermark);
 	}
 
 	return 0;
@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "tree.h"
 #include "parser.h"
@@ -46,8 +47,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rnode.h"
 #include "node_pos_alloc.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
+#include "leaf_neighbors.h"
+#include "readline.h"
 
-enum distance_methods {FROM_ROOT, FROM_LCA, MATRIX, FROM_PARENT};
+enum distance_methods {FROM_ROOT, FROM_LCA, MATRIX, FROM_PARENT, NEAREST,
+	WITHIN_RADIUS};
 enum orientations {HORIZONTAL, VERTICAL};
 enum shapes {SQUARE, TRIANGLE};
 enum selections {ALL_NODES, ALL_LABELS, ALL_LEAF_LABELS, ARGV_LABELS, ALL_INNER_NODES,
@@ -61,8 +67,16 @@ struct parameters {
 	bool show_header;
 	enum orientations list_orientation;
 	enum shapes matrix_shape;
+	int k;			/* -k */
+	double radius;		/* -r */
+	int nb_threads;
 };
 
+/* In modes -k and -r, threads answer this many queries each, then the answers
+ * are printed. */
+
+#define NEIGHBOR_QUERIES_PER_THREAD 1024
+
 void help(char *argv[])
 {
 	printf (
@@ -72,6 +86,7 @@ void help(char *argv[])
 "--------\n"
 "\n"
 "%s [-hmnst] <tree file|-> [label]*\n"
+"%s [-hs] [-f <file>] [-j <int>] -k <int>|-r <dist> <tree file|-> [label]*\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -110,15 +125,30 @@ void help(char *argv[])
 "      and the selection is formed by the corresponding nodes, in the\n"
 "      same order.\n"
 "\n"
+"With -k or -r (second form), nw_distance looks for the labeled leaves that\n"
+"are nearest to each node in the selection (the query): the k nearest ones\n"
+"(-k), or those within a given distance (-r). It prints one line per leaf\n"
+"found, nearest first: the query's label, the leaf's label, and the\n"
+"distance, separated by TABs. The query itself is not reported. The tree\n"
+"is indexed once, so that each query takes time proportional to the number\n"
+"of leaves found (times log n) rather than to the size of the tree.\n"
+"\n"
 "Options\n"
 "-------\n"
 "\n"
+"    -f <labels filename>: with -k or -r, read the queries' labels from this\n"
+"        file, one per line, in addition to those passed as arguments.\n"
 "    -h: print this message and exit \n"
+"    -j <int>: with -k or -r, answer queries with this many threads\n"
+"        (default: 1). This does not change the output.\n"
+"    -k <int>: find the <int> leaves nearest to each query (see Output).\n"
 "    -m <mode>: selects mode (see Output). Mode is determined by the first\n"
 "        letter of the argument: 'r' for root mode (default), 'l' for LCA,\n"
 "        'p' for parent, and 'm' for matrix. Thus, '-mm', '-m matrix',\n"
 "        and '-m mat' all select matrix mode.\n"
 "    -n: prints labels (or '' if empty) in addition to distances.\n"
+"    -r <distance>: find the leaves at most <distance> from each query (see\n"
+"        Output).\n"
 "    -s <selection>, where selection is determined by the first letter of\n"
 "        the argument: 'a' for all nodes, 'l' for labeled nodes,\n"
 "        'i' for inner nodes, 'f' for leaves.\n"
@@ -130,7 +160,9 @@ void help(char *argv[])
 "---------------------------\n"
 "\n"
 "Labels passed as arguments are assumed to exist in the tree. Behaviour is\n"
-"undefined if a label is not found.\n"
+"undefined if a label is not found, except with -k and -r, where the\n"
+"label is ignored (with a warning). Options -k and -r assume that branch\n"
+"lengths are not negative.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -144,7 +176,16 @@ void help(char *argv[])
 "$ %s -mm -n -sl data/catarrhini\n"
 "\n"
 "# All nodes, distance to parent\n"
-"$ %s -m p -s a data/catarrhini\n",
+"$ %s -m p -s a data/catarrhini\n"
+"\n"
+"# The 3 nearest leaves to each leaf\n"
+"$ %s -k 3 data/catarrhini\n"
+"\n"
+"# Leaves at most 30 from Homo or Colobus\n"
+"$ %s -r 30 data/catarrhini Homo Colobus\n",
+	argv[0],
+	argv[0],
+	argv[0],
 	argv[0],
 	argv[0],
 	argv[0],
@@ -193,6 +234,32 @@ int get_distance_method()
 	return -1;
 }
 
+/* Appends the labels of file 'filename' (one per line) to 'labels'. Exits on
+ * error. */
+
+static void read_query_labels(const char *filename, struct llist *labels)
+{
+	FILE *in = fopen(filename, "r");
+	if (NULL == in) { perror(filename); exit(EXIT_FAILURE); }
+
+	char *line;
+	while (NULL != (line = read_line(in))) {
+		if (is_all_whitespace(line)) {
+			free(line);
+			continue;
+		}
+		if (! append_element(labels, line)) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (READLINE_ERROR == read_line_status) {
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+	fclose(in);
+}
+
 struct parameters get_params(int argc, char *argv[])
 {
 
@@ -204,15 +271,48 @@ struct parameters get_params(int argc, char *argv[])
 	params.show_header = false;
 	params.list_orientation = VERTICAL;
 	params.matrix_shape = SQUARE;
+	params.nb_threads = 1;
 
 	bool alternative_format = false;
+	char *labels_filename = NULL;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "hm:ns:t")) != -1) {
+	while ((opt_char = getopt(argc, argv, "f:hj:k:m:nr:s:t")) != -1) {
 		switch (opt_char) {
+		case 'f':
+			labels_filename = optarg;
+			break;
 		case 'h':
 			help(argv);
 			exit(EXIT_SUCCESS);
+		case 'j':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -j must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'k':
+			params.distance_method = NEAREST;
+			params.k = atoi(optarg);
+			if (params.k < 1) {
+				fprintf(stderr, "Argument to -k must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'r':
+			params.distance_method = WITHIN_RADIUS;
+			char *end;
+			params.radius = strtod(optarg, &end);
+			if (end == optarg || '\0' != *end ||
+			    params.radius < 0) {
+				fprintf(stderr, "Argument to -r must be a "
+						"non-negative number.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case 'm':
 			params.distance_method = get_distance_method();
 			break;
@@ -235,7 +335,7 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) >= 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -251,6 +351,8 @@ struct parameters get_params(int argc, char *argv[])
 				perror(NULL); exit(EXIT_FAILURE);
 			}
 		params.labels = lbl_list;
+		if (NULL != labels_filename)
+			read_query_labels(labels_filename, lbl_list);
 		if (0 != lbl_list->count)
 			params.selection = ARGV_LABELS;
 	} else {
@@ -259,6 +361,12 @@ struct parameters get_params(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	if (NULL != labels_filename && NEAREST != params.distance_method &&
+			WITHIN_RADIUS != params.distance_method) {
+		fprintf (stderr, "Option -f requires -k or -r.\n");
+		exit(EXIT_FAILURE);
+	}
+
 	if (alternative_format) {
 		if (MATRIX == params.distance_method)
 			params.matrix_shape = TRIANGLE;
@@ -550,6 +658,143 @@ void print_triangular_distance_matrix (struct rooted_tree *tree,
 	free(matrix);
 }
 
+/* Modes -k and -r. The queries are answered in batches, by all threads, and
+ * the answers are printed in order after each batch. */
+
+struct neighbor_batch {
+	const struct parameters *params;
+	const int *queries;	/* preorder numbers, see struct lca_table */
+	int count;
+	struct leaf_neighbor **answers;
+	int *answer_counts;
+	int next;		/* first query not yet taken */
+	pthread_mutex_t lock;
+};
+
+struct neighbor_worker {
+	struct neighbor_batch *batch;
+	struct leaf_search *search;
+};
+
+static void *answer_neighbor_queries(void *arg)
+{
+	struct neighbor_worker *worker = arg;
+	struct neighbor_batch *batch = worker->batch;
+	struct leaf_search *search = worker->search;
+	const struct parameters *params = batch->params;
+
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count) break;
+
+		int status;
+		if (NEAREST == params->distance_method)
+			status = nearest_leaves(search, batch->queries[i],
+					params->k);
+		else
+			status = leaves_within(search, batch->queries[i],
+					params->radius);
+		size_t size = search->found_count *
+			sizeof(struct leaf_neighbor);
+		batch->answers[i] = malloc(size + 1);
+		if (! status || NULL == batch->answers[i]) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		memcpy(batch->answers[i], search->found, size);
+		batch->answer_counts[i] = search->found_count;
+	}
+
+	return NULL;
+}
+
+void print_nearest_leaves(struct rooted_tree *tree,
+		struct llist *selected_nodes, const struct parameters *params)
+{
+	struct leaf_index *index = create_leaf_index(tree->root);
+	if (NULL == index) { perror(NULL); exit(EXIT_FAILURE); }
+	struct lca_table *table = index->table;
+
+	/* The queries' numbers, found through their nodes' data */
+	int query_count = selected_nodes->count;
+	int *queries = malloc((query_count + 1) * sizeof(int));
+	if (NULL == queries) { perror(NULL); exit(EXIT_FAILURE); }
+	int i;
+	for (i = 0; i < table->node_count; i++)
+		table->nodes[i]->data = &table->nodes[i];
+	struct list_elem *el;
+	for (i = 0, el = selected_nodes->head; NULL != el; el = el->next, i++)
+		queries[i] = (struct rnode **)
+			((struct rnode *) el->data)->data - table->nodes;
+	for (i = 0; i < table->node_count; i++)
+		table->nodes[i]->data = NULL;
+
+	int nb_threads = params->nb_threads;
+	int max_count = nb_threads * NEIGHBOR_QUERIES_PER_THREAD;
+	struct neighbor_batch batch;
+	batch.params = params;
+	batch.answers = malloc(max_count * sizeof(struct leaf_neighbor *));
+	batch.answer_counts = malloc(max_count * sizeof(int));
+	pthread_t *threads = malloc(nb_threads * sizeof(pthread_t));
+	struct neighbor_worker *workers = malloc(nb_threads *
+			sizeof(struct neighbor_worker));
+	if (NULL == batch.answers || NULL == batch.answer_counts ||
+	    NULL == threads || NULL == workers) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+	int t;
+	for (t = 0; t < nb_threads; t++) {
+		workers[t].batch = &batch;
+		workers[t].search = create_leaf_search(index);
+		if (NULL == workers[t].search) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	}
+
+	int first;
+	for (first = 0; first < query_count; first += max_count) {
+		batch.queries = queries + first;
+		batch.count = query_count - first < max_count ?
+			query_count - first : max_count;
+		batch.next = 0;
+		/* the main thread is a worker too */
+		for (t = 1; t < nb_threads; t++)
+			if (0 != pthread_create(&threads[t], NULL,
+					answer_neighbor_queries, &workers[t])) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		answer_neighbor_queries(&workers[0]);
+		for (t = 1; t < nb_threads; t++)
+			pthread_join(threads[t], NULL);
+
+		for (i = 0; i < batch.count; i++) {
+			const char *query_label =
+				table->nodes[batch.queries[i]]->label;
+			int j;
+			for (j = 0; j < batch.answer_counts[i]; j++) {
+				struct leaf_neighbor *answer =
+					&batch.answers[i][j];
+				printf("%s\t%s\t%g\n", query_label,
+					table->nodes[answer->leaf]->label,
+					answer->distance);
+			}
+			free(batch.answers[i]);
+		}
+	}
+
+	for (t = 0; t < nb_threads; t++)
+		destroy_leaf_search(workers[t].search);
+	pthread_mutex_destroy(&batch.lock);
+	free(workers);
+	free(threads);
+	free(batch.answer_counts);
+	free(batch.answers);
+	free(queries);
+	destroy_leaf_index(index);
+}
+
 /* Debugging functions */
 
 void show_selection (struct llist *selection)
@@ -584,6 +829,8 @@ void show_method (int method)
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params;
 	struct h_data depths;	
@@ -594,14 +841,20 @@ int main(int argc, char *argv[])
 	 * understand this way, and it's unlikely the switch has a visible
 	 * impact on performance. */
 
+	bool neighbors = NEAREST == params.distance_method ||
+		WITHIN_RADIUS == params.distance_method;
+
 	while ((tree = parse_tree()) != NULL) {
-		alloc_simple_node_pos(tree);
-		depths = set_node_depth_cb(tree,
-				set_simple_node_pos_depth,
-				get_simple_node_pos_depth);
-		if (FAILURE == depths.status) {
-			perror(NULL);
-			exit(EXIT_FAILURE);
+		/* -k and -r have their own index */
+		if (! neighbors) {
+			alloc_simple_node_pos(tree);
+			depths = set_node_depth_cb(tree,
+					set_simple_node_pos_depth,
+					get_simple_node_pos_depth);
+			if (FAILURE == depths.status) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 		}
 		struct rnode *lca_node;
 		struct llist *selected_nodes;
@@ -661,6 +914,10 @@ int main(int argc, char *argv[])
 			print_distance_list(NULL, selected_nodes,
 				params.list_orientation, params.show_header);
 			break;
+		case NEAREST:
+		case WITHIN_RADIUS:
+			print_nearest_leaves(tree, selected_nodes, &params);
+			break;
 		default:
 			fprintf (stderr,
 				"ERROR: invalid distance type '%d'.\n",
@@ -39,7 +39,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "list.h"
 #include "tree.h"
 #include "rnode.h"
-#include "masprintf.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 void help(char *argv[])
 {
@@ -110,7 +111,7 @@ void get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -132,31 +133,29 @@ void process_tree(struct rooted_tree *tree)
 		struct rnode *current = (struct rnode *) el->data;
 		if (is_root(current)) {
 			/* set to none */
-			free(current->edge_length_as_string);
-			current->edge_length_as_string = strdup("");
+			if (! set_edge_length_string(current, "")) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 		}
 		else {
-			double age = -1.0;
-			if (strcmp("", current->edge_length_as_string) == 0)
-				age = 0.0;
-			else 
-				age = atof(current->edge_length_as_string);	
+			/* an empty length counts as age 0 */
+			double age = get_edge_length(current);
 
 			/* Note: we are assuming that only leaves can have an
-			 * empty length_as_string. Thus we do not check
-			 * for emptiness before calling atof(). */
-			double parent_age = atof(current->parent->
-				edge_length_as_string);
-			double edge_length = parent_age - age;
-			free(current->edge_length_as_string);
-			current->edge_length_as_string = masprintf("%g",
-					edge_length);
+			 * empty length_as_string. The parent comes after its
+			 * children in the list, so its length is still its
+			 * age. */
+			double parent_age = get_edge_length(current->parent);
+			set_edge_length(current, parent_age - age);
 		}
 	}
 }
 
 int main (int argc, char* argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;
 
 	get_params(argc, argv);
@@ -34,18 +34,30 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
 
+#include "common.h"
+#include "prng.h"
 #include "tree_models.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 enum tree_models { GEOMETRIC_TREE, TIME_LIMITED_TREE };
 
 const double	DEFAULT_MEAN_BRANCH_LENGTH = 1.0;
 const double	DEFAULT_DURATION = 3;
 
+/* Trees are generated in batches; each thread generates this many trees per
+ * batch, then the batch is printed in order. */
+#define TREES_PER_JOB 256
+
 struct parameters {
 	enum tree_models tree_model;
-	int seed;
+	uint64_t seed;
+	long nb_trees;
+	int nb_threads;
 	double duration;
 	double mean_branch_length;
 	double prob_node_has_children;
@@ -54,12 +66,12 @@ struct parameters {
 void help(char *argv[])
 {
 	printf (
-"Generates a random tree\n"
+"Generates random trees\n"
 "\n"
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-dghlps]\n"
+"%s [-dghlnpstz]\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -69,7 +81,7 @@ void help(char *argv[])
 "Output\n"
 "------\n"
 "\n"
-"The generated tree. By default, this is a \"time-limited\" tree: branches\n"
+"The generated tree(s), one per line. By default, this is a \"time-limited\" tree: branches\n"
 "are \"grown\" using exponentially distributed lengths. If the length\n"
 "exceeds the time limit, growth stops; otherwise the lineage splits in two,\n"
 "and the process is repeated on the children.\n"
@@ -84,20 +96,33 @@ void help(char *argv[])
 "    -h: print this message and exit\n"
 "    -l <float>: sets the average branch length (default: 1.0)\n"
 "       Only for time-limited trees.\n"
+"    -n <int>: generate this many trees (default: 1)\n"
 "    -p <float>: sets the probability of a node having (2) children.\n"
 "       Only for geometric trees. WARNING: if > 0.5, the tree will\n"
 "       probably grow 'forever'. On the other hand, low values will\n"
 "       result in most trees having only a root, as the probability\n"
 "       that the root has no children is 1-p, like for every other node.\n"
 "    -s <int>: sets the pseudorandom number generator's seed\n"
-"       (default: 0.1)\n"
+"       (default: current time). Each tree is generated from its own stream,\n"
+"       derived from the seed and the tree's rank, so the output only\n"
+"       depends on the seed and the parameters.\n"
+"    -t <int>: use this many threads (default: 1). This does not change\n"
+"       the output.\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"       gunzip reads as usual) or zstd. Compression runs on separate\n"
+"       threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
 "\n"
 "# Generate a random time-limited tree\n"
 "\n"
-"$ %s\n",
+"$ %s\n"
+"\n"
+"# Generate 100,000 geometric trees on 4 threads, reproducibly\n"
+"\n"
+"$ %s -g -p 0.4 -s 42 -n 100000 -t 4\n",
+	argv[0],
 	argv[0],
 	argv[0]
 	);
@@ -112,9 +137,11 @@ struct parameters get_params(int argc, char *argv[])
 	params.duration = DEFAULT_DURATION;
 	params.mean_branch_length = DEFAULT_MEAN_BRANCH_LENGTH;
 	params.prob_node_has_children = 0.1;
+	params.nb_trees = 1;
+	params.nb_threads = 1;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "d:ghl:p:s:")) != -1) {
+	while ((opt_char = getopt(argc, argv, "d:ghl:n:p:s:t:z:")) != -1) {
 		switch (opt_char) {
 		case 'd':
 			params.duration = atof(optarg);	
@@ -128,18 +155,36 @@ struct parameters get_params(int argc, char *argv[])
 		case 'l':
 			params.mean_branch_length = atof(optarg);	
 			break;
+		case 'n':
+			params.nb_trees = atol(optarg);
+			break;
 		case 'p':
 			params.prob_node_has_children = atof(optarg);
 			break;
 		case 's':
-			params.seed = atoi(optarg);
+			params.seed = strtoull(optarg, NULL, 10);
+			break;
+		case 't':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -t must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 			break;
 		}
 	}
 
 	/* check arguments */
 	if ((argc - optind) != 0)	{
-		fprintf(stderr, "Usage: %s [-hs]\n",
+		fprintf(stderr, "Usage: %s [-dghlnpst]\n",
 				argv[0]);
 		exit(EXIT_FAILURE);
 	}
@@ -147,24 +192,105 @@ struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
+/* A run of consecutive trees, generated by one thread */
+
+struct gen_job {
+	const struct parameters *params;
+	struct tree_generator *generator;
+	long first;	/* rank of first tree */
+	long count;
+	int status;
+};
+
+static void *run_job(void *arg)
+{
+	struct gen_job *job = arg;
+	const struct parameters *params = job->params;
+	long rank;
+
+	job->status = SUCCESS;
+	for (rank = job->first; rank < job->first + job->count; rank++) {
+		struct prng prng;
+		prng_init(&prng, params->seed, rank);
+		int result;
+		switch (params->tree_model) {
+		case GEOMETRIC_TREE:
+			result = geometric_tree(job->generator, &prng,
+					params->prob_node_has_children);
+			break;
+		case TIME_LIMITED_TREE:
+			result = time_limited_tree(job->generator, &prng,
+				1.0 / params->mean_branch_length,
+				params->duration);
+			break;
+		default:
+			assert(0);	/* programmer error */
+		}
+		if (! result) {
+			job->status = FAILURE;
+			break;
+		}
+	}
+	return NULL;
+}
+
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct parameters params = get_params(argc, argv);
-	srand(params.seed);
-
-	int result;
-	switch (params.tree_model) {
-	case GEOMETRIC_TREE:
-		result = geometric_tree(params.prob_node_has_children);
-		break;
-	case TIME_LIMITED_TREE:
-		result = time_limited_tree(1.0 / params.mean_branch_length,
-			params.duration);
-		break;
-	default:
-		assert(0);	/* programmer error */
+	int nb_threads = params.nb_threads;
+
+	struct gen_job *jobs = malloc(nb_threads * sizeof(struct gen_job));
+	pthread_t *threads = malloc(nb_threads * sizeof(pthread_t));
+	if (NULL == jobs || NULL == threads) {
+		perror(NULL); exit(EXIT_FAILURE);
 	}
-	if (! result) { perror(NULL); exit(EXIT_FAILURE); }
+	int t;
+	for (t = 0; t < nb_threads; t++) {
+		jobs[t].params = &params;
+		jobs[t].generator = create_tree_generator();
+		if (NULL == jobs[t].generator) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	}
+
+	long next_rank = 0;
+	while (next_rank < params.nb_trees) {
+		for (t = 0; t < nb_threads; t++) {
+			long left = params.nb_trees - next_rank;
+			jobs[t].first = next_rank;
+			jobs[t].count = left < TREES_PER_JOB ?
+				left : TREES_PER_JOB;
+			next_rank += jobs[t].count;
+		}
+		/* the main thread runs the first job itself */
+		for (t = 1; t < nb_threads; t++)
+			if (0 != pthread_create(&threads[t], NULL, run_job,
+						&jobs[t])) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		run_job(&jobs[0]);
+		for (t = 1; t < nb_threads; t++)
+			pthread_join(threads[t], NULL);
+
+		/* print in rank order */
+		for (t = 0; t < nb_threads; t++) {
+			if (! jobs[t].status) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+			size_t length;
+			const char *trees = generated_trees(
+					jobs[t].generator, &length);
+			fwrite(trees, 1, length, stdout);
+			clear_generated_trees(jobs[t].generator);
+		}
+	}
+
+	for (t = 0; t < nb_threads; t++)
+		destroy_tree_generator(jobs[t].generator);
+	free(jobs);
+	free(threads);
 
 	exit(EXIT_SUCCESS);
 }
@@ -36,6 +36,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tree.h"
 #include "list.h"
 #include "rnode.h"
+#include "link.h"
+#include "masprintf.h"
 
 void underscores2spaces(char *s)
 {
@@ -128,3 +130,145 @@ double tick_interval(double x)
 
 	return best_tick_interval;
 }
+
+/* Per-node data used by collapse_clades() */
+
+struct clade_size {
+	int nb_leaves;
+	double height;		/* depth of deepest leaf, from the clade's root */
+};
+
+/* Sets the clade size of every node, in a single postorder pass. Edges with
+ * empty length count as 1, as in set_node_depth_cb(). */
+
+static void set_clade_sizes(struct rooted_tree *tree, struct clade_size *sizes)
+{
+	struct list_elem *el;
+	int i = 0;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next, i++) {
+		struct rnode *node = el->data;
+		struct clade_size *size = sizes + i;
+		node->data = size;
+		if (is_leaf(node)) {
+			size->nb_leaves = 1;
+			size->height = 0.0;
+			continue;
+		}
+		size->nb_leaves = 0;
+		size->height = 0.0;
+		struct rnode *kid;
+		for (kid = node->first_child; NULL != kid;
+				kid = kid->next_sibling) {
+			struct clade_size *kid_size = kid->data;
+			double kid_length = has_edge_length(kid) ?
+				get_edge_length(kid) : 1.0;
+			size->nb_leaves += kid_size->nb_leaves;
+			if (kid_size->height + kid_length > size->height)
+				size->height = kid_size->height + kid_length;
+		}
+	}
+}
+
+/* Returns the smallest clade size T such that cutting the tree at the maximal
+ * clades of at most T leaves yields no more than 'max_leaves' clades. A node
+ * with n leaves whose parent has p leaves is one of those clades for n <= T <
+ * p (the root: for T >= n), so the number of clades for every T is a prefix
+ * sum. Returns -1 in case of malloc() problem. */
+
+static int collapse_threshold(struct rooted_tree *tree, int max_leaves)
+{
+	struct rnode *root = tree->root;
+	int nb_leaves = ((struct clade_size *) root->data)->nb_leaves;
+	int *delta = calloc(nb_leaves + 2, sizeof(int));
+	if (NULL == delta) return -1;
+
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *node = el->data;
+		delta[((struct clade_size *) node->data)->nb_leaves]++;
+		if (! is_root(node))
+			delta[((struct clade_size *)
+				node->parent->data)->nb_leaves]--;
+	}
+
+	int threshold;
+	int nb_clades = 0;
+	for (threshold = 1; threshold < nb_leaves; threshold++) {
+		nb_clades += delta[threshold];
+		if (nb_clades <= max_leaves) break;
+	}
+	free(delta);
+
+	return threshold;
+}
+
+struct llist *collapse_clades(struct rooted_tree *tree, int max_leaves)
+{
+	struct llist *collapsed = create_llist();
+	if (NULL == collapsed) return NULL;
+	if (max_leaves < 1) max_leaves = 1;
+
+	struct clade_size *sizes = malloc(tree->nodes_in_order->count *
+			sizeof(struct clade_size));
+	if (NULL == sizes) goto fail;
+	set_clade_sizes(tree, sizes);
+
+	int threshold = -1;
+	if (((struct clade_size *) tree->root->data)->nb_leaves > max_leaves) {
+		threshold = collapse_threshold(tree, max_leaves);
+		if (-1 == threshold) goto fail;
+	}
+
+	/* Replace the children of every maximal clade of at most 'threshold'
+	 * leaves (but more than one) by a single leaf, at the depth of the
+	 * clade's deepest leaf. The leaf gets a length even in cladograms:
+	 * without one, it would be one edge below the clade's root, and the
+	 * aligned leaves (whose depth is that of the deepest leaf) could move
+	 * up. Collapsed leaves' lengths are never shown. */
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *node = el->data;
+		struct clade_size *size = node->data;
+		if (size->nb_leaves > threshold || 1 == size->nb_leaves)
+			continue;
+		if (! is_root(node) && ((struct clade_size *)
+				node->parent->data)->nb_leaves <= threshold)
+			continue;
+
+		char *label = masprintf("[%d leaves]", size->nb_leaves);
+		if (NULL == label) goto fail;
+		struct rnode *leaf = create_rnode(label, "");
+		free(label);
+		if (NULL == leaf) goto fail;
+		set_edge_length(leaf, size->height);
+		node->first_child = node->last_child = NULL;
+		node->child_count = 0;
+		add_child(node, leaf);
+		if (! append_element(collapsed, leaf)) goto fail;
+	}
+
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next)
+		((struct rnode *) el->data)->data = NULL;
+	free(sizes);
+
+	if (0 != collapsed->count) {
+		struct llist *nodes_in_order = get_nodes_in_order(tree->root);
+		if (NULL == nodes_in_order) {
+			destroy_llist(collapsed);
+			return NULL;
+		}
+		destroy_llist(tree->nodes_in_order);
+		tree->nodes_in_order = nodes_in_order;
+	}
+
+	return collapsed;
+
+fail:
+	if (NULL != sizes)
+		for (el = tree->nodes_in_order->head; NULL != el;
+				el = el->next)
+			((struct rnode *) el->data)->data = NULL;
+	free(sizes);
+	destroy_llist(collapsed);
+	return NULL;
+}
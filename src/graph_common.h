@@ -34,6 +34,7 @@ enum display_status { DISPLAY_OK, DISPLAY_UNKNOWN_STYLE, DISPLAY_MEM_ERROR };
 enum inner_lbl_pos {INNER_LBL_LEAVES, INNER_LBL_MIDDLE, INNER_LBL_ROOT};
 
 struct rooted_tree;
+struct llist;
 
 /* Replaces '_' by ' ' (changes argument!) */
 
@@ -53,3 +54,13 @@ void prettify_labels(struct rooted_tree *);
  * length of n */
 
 double tick_interval(double x);
+
+/* Level of detail: collapses clades so that the tree has at most 'max_leaves'
+ * leaves, keeping as much detail as possible. The children of a collapsed
+ * clade are replaced by a single leaf labelled with the clade's number of
+ * leaves, placed at the depth of the clade's deepest leaf. Collapsing is done
+ * in place, and must take place before any node data is allocated. Returns
+ * the list of leaves that stand for collapsed clades (empty if the tree
+ * already fits), or NULL in case of malloc() problem. */
+
+struct llist *collapse_clades(struct rooted_tree *tree, int max_leaves);
@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "list.h"
 #include "masprintf.h"
 #include "common.h"
+#include "profile.h"
 
 struct key_val_pair {
 	char *key;
@@ -171,6 +172,8 @@ int hash_set(struct hash *h, const char *key, void *value)
 	kvp = (struct key_val_pair *) malloc (sizeof (struct key_val_pair));
 	if (NULL == kvp) return FAILURE;
 	kvp->key = strdup(key);
+	PROFILE_ALLOC(sizeof(struct key_val_pair));
+	PROFILE_ALLOC(strlen(key) + 1);
 	kvp->value = value;
 
 	if (! append_element(bin, kvp)) return FAILURE;
@@ -34,6 +34,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 extern char *indent_string;
 extern char *eol;
@@ -120,7 +122,7 @@ void get_params(int argc, char* argv[])
 	}
 	if (1 == (argc - optind))       {
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *yyin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -137,6 +139,8 @@ void get_params(int argc, char* argv[])
 
 int main(int argc, char* argv[])
 {
+	argc = profile_init(argc, argv);
+
 	get_params(argc, argv);
 
 	yylex();
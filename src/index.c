@@ -0,0 +1,209 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* nw_index: build an inverted label -> tree index over a Newick file */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tree.h"
+#include "rnode.h"
+#include "parser.h"
+#include "common.h"
+#include "label_intern.h"
+#include "masprintf.h"
+#include "profile.h"
+#include "compressed_io.h"
+#include "tree_index.h"
+
+void newick_scanner_set_string_input(char *);
+void newick_scanner_clear_string_input();
+
+struct parameters {
+	char *trees_filename;
+	char *index_filename;
+};
+
+void help(char *argv[])
+{
+	printf(
+"Builds an index of the labels of a tree file, for fast queries\n"
+"\n"
+"Synopsis\n"
+"--------\n"
+"\n"
+"%s [-h] [-o <index filename>] <newick trees filename>\n"
+"\n"
+"Input\n"
+"-----\n"
+"\n"
+"Argument is the name of a file that contains Newick trees. It cannot be\n"
+"standard input, since queries need to seek to the indexed trees.\n"
+"\n"
+"Output\n"
+"------\n"
+"\n"
+"Writes an index that maps every (leaf or inner) label to the positions of\n"
+"the trees that contain it, by default to file <newick trees filename>.nwi.\n"
+"Programs that accept an index (option -i of nw_clade and nw_match) then\n"
+"only need to read the trees that contain all the labels they look for,\n"
+"instead of the whole file.\n"
+"\n"
+"The index records the size and modification time of the tree file, and is\n"
+"refused if these change: it must then be rebuilt.\n"
+"\n"
+"Options\n"
+"-------\n"
+"\n"
+"    -h: print this message and exit\n"
+"    -o <filename>: write the index to this file.\n"
+"\n"
+"Examples\n"
+"--------\n"
+"\n"
+"# index gene trees, then extract the clade of Homo and Pan from those trees\n"
+"# that have both\n"
+"$ %s data/gene_trees.nw\n"
+"$ nw_clade -i data/gene_trees.nw.nwi data/gene_trees.nw Homo Pan\n",
+	argv[0],
+	argv[0]
+	);
+}
+
+struct parameters get_params(int argc, char *argv[])
+{
+	struct parameters params;
+
+	params.index_filename = NULL;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "ho:")) != -1) {
+		switch (opt_char) {
+		case 'h':
+			help(argv);
+			exit(EXIT_SUCCESS);
+		case 'o':
+			params.index_filename = optarg;
+			break;
+		default:
+			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (1 == (argc - optind)) {
+		params.trees_filename = argv[optind];
+		if (0 == strcmp("-", params.trees_filename)) {
+			fprintf (stderr, "Can't index standard input.\n");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		fprintf(stderr, "Usage: %s [-ho:] <filename>\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (NULL == params.index_filename) {
+		params.index_filename = masprintf("%s.nwi",
+				params.trees_filename);
+		if (NULL == params.index_filename) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	return params;
+}
+
+int main(int argc, char *argv[])
+{
+	argc = profile_init(argc, argv);
+
+	struct parameters params = get_params(argc, argv);
+
+	FILE *trees = fopen(params.trees_filename, "r");
+	if (NULL == trees) { perror(params.trees_filename); exit(EXIT_FAILURE); }
+	if (COMPRESSION_NONE != stream_compression(trees)) {
+		fprintf (stderr, "Can't index compressed file %s, since queries "
+				"need to seek in it - please decompress it "
+				"first.\n", params.trees_filename);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Label IDs are the keys of the index */
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
+	struct tree_index_builder *builder = create_tree_index_builder();
+	if (NULL == builder) { perror(NULL); exit(EXIT_FAILURE); }
+
+	/* Each tree's text is read separately, so that we know its offset,
+	 * and then parsed from memory. */
+	char *text;
+	off_t offset;
+	while (NULL != (text = read_tree_text(trees, &offset))) {
+		newick_scanner_set_string_input(text);
+		struct rooted_tree *tree = parse_tree();
+		newick_scanner_clear_string_input();
+		free(text);
+		if (NULL == tree) {
+			/* e.g. a comment after the last tree */
+			if (PARSER_STATUS_EMPTY == newick_parser_status)
+				continue;
+			fprintf (stderr, "Could not parse tree at offset "
+					"%lld.\n", (long long) offset);
+			exit(EXIT_FAILURE);
+		}
+		if (! add_tree_to_index(builder, tree, offset)) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		destroy_all_rnodes(NULL);
+		destroy_tree(tree);
+	}
+	if (TREE_INDEX_OK != tree_index_status) {
+		perror(params.trees_filename);
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *out = fopen(params.index_filename, "w");
+	if (NULL == out) { perror(params.index_filename); exit(EXIT_FAILURE); }
+	if (! write_tree_index(builder, trees, out)) {
+		print_tree_index_error(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+	if (0 != fclose(out)) {
+		perror(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+
+	destroy_tree_index_builder(builder);
+	destroy_label_interner();
+	fclose(trees);
+
+	return 0;
+}
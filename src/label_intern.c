@@ -0,0 +1,199 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* The interner is an open-addressing hash table of indexes into an array of
+ * labels; the label's index is its ID. The table is kept at most half full. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "label_intern.h"
+#include "common.h"
+
+static const int INIT_TABLE_SIZE = 1024;	/* must be a power of 2 */
+
+static bool enabled = false;
+static char **labels = NULL;	/* labels[id] is the label with that ID */
+static unsigned int *codes = NULL;	/* codes[id] is its hash code */
+static int label_count = 0;
+static int labels_size = 0;
+static int *table = NULL;	/* label IDs, or -1 for empty slots */
+static unsigned int table_mask = 0;	/* table size - 1 */
+
+static unsigned int label_hash(const char *label)
+{
+	/* FNV-1a */
+	unsigned int h = 2166136261U;
+	while (*label) {
+		h ^= (unsigned char) *label++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Returns the table slot that holds 'label', or the empty slot where it
+ * should go. */
+
+static unsigned int find_slot(const char *label, unsigned int code)
+{
+	unsigned int slot = code & table_mask;
+	while (-1 != table[slot]) {
+		int id = table[slot];
+		if (codes[id] == code && 0 == strcmp(labels[id], label))
+			break;
+		slot = (slot + 1) & table_mask;
+	}
+	return slot;
+}
+
+static int grow_table()
+{
+	unsigned int new_size = 2 * (table_mask + 1);
+	int *new_table = malloc(new_size * sizeof(int));
+	if (NULL == new_table) return FAILURE;
+	free(table);
+	table = new_table;
+	table_mask = new_size - 1;
+
+	unsigned int slot;
+	for (slot = 0; slot < new_size; slot++) table[slot] = -1;
+	int id;
+	for (id = 0; id < label_count; id++)
+		table[find_slot(labels[id], codes[id])] = id;
+
+	return SUCCESS;
+}
+
+static int grow_labels()
+{
+	int new_size = 2 * labels_size;
+	char **new_labels = realloc(labels, new_size * sizeof(char *));
+	if (NULL == new_labels) return FAILURE;
+	labels = new_labels;
+	unsigned int *new_codes = realloc(codes,
+			new_size * sizeof(unsigned int));
+	if (NULL == new_codes) return FAILURE;
+	codes = new_codes;
+	labels_size = new_size;
+
+	return SUCCESS;
+}
+
+int enable_label_interning()
+{
+	if (enabled) return SUCCESS;
+
+	table = malloc(INIT_TABLE_SIZE * sizeof(int));
+	labels = malloc(INIT_TABLE_SIZE / 2 * sizeof(char *));
+	codes = malloc(INIT_TABLE_SIZE / 2 * sizeof(unsigned int));
+	if (NULL == table || NULL == labels || NULL == codes) return FAILURE;
+	table_mask = INIT_TABLE_SIZE - 1;
+	labels_size = INIT_TABLE_SIZE / 2;
+	unsigned int slot;
+	for (slot = 0; slot <= table_mask; slot++) table[slot] = -1;
+	enabled = true;
+
+	/* makes sure "" gets EMPTY_LABEL_ID */
+	if (EMPTY_LABEL_ID != intern_label("")) return FAILURE;
+
+	return SUCCESS;
+}
+
+bool label_interning_enabled() { return enabled; }
+
+int intern_label(const char *label)
+{
+	if (! enabled) return -1;
+	/* the most frequent label by far (inner nodes) */
+	if ('\0' == label[0] && label_count > 0) return EMPTY_LABEL_ID;
+
+	unsigned int code = label_hash(label);
+	unsigned int slot = find_slot(label, code);
+	if (-1 != table[slot]) return table[slot];
+
+	if (label_count == labels_size)
+		if (! grow_labels()) return -1;
+	char *copy = strdup(label);
+	if (NULL == copy) return -1;
+	int id = label_count++;
+	labels[id] = copy;
+	codes[id] = code;
+	table[slot] = id;
+
+	/* label_count is never negative */
+	if (2 * (unsigned int) label_count > table_mask + 1)
+		if (! grow_table()) return -1;
+
+	return id;
+}
+
+int find_label_id(const char *label)
+{
+	if (! enabled) return -1;
+	int id = table[find_slot(label, label_hash(label))];
+	return id;
+}
+
+const char *interned_label(int id)
+{
+	if (id < 0 || id >= label_count) return NULL;
+	return labels[id];
+}
+
+int interned_label_count() { return label_count; }
+
+/* Labels are removed last in, first out. Then no remaining label was placed
+ * beyond a removed one's slot (that slot was still empty when it was placed,
+ * and grow_table() reinserts labels in ID order), so emptying the slot does not
+ * break any probe sequence. */
+
+void forget_labels_since(int watermark)
+{
+	if (watermark < 1) watermark = 1;	/* "" stays EMPTY_LABEL_ID */
+	while (label_count > watermark) {
+		int id = --label_count;
+		table[find_slot(labels[id], codes[id])] = -1;
+		free(labels[id]);
+	}
+}
+
+void destroy_label_interner()
+{
+	int id;
+	for (id = 0; id < label_count; id++) free(labels[id]);
+	free(labels);
+	free(codes);
+	free(table);
+	labels = NULL;
+	codes = NULL;
+	table = NULL;
+	label_count = labels_size = 0;
+	table_mask = 0;
+	enabled = false;
+}
@@ -0,0 +1,87 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/** \file
+ * Label interning. When enabled, every label seen by create_rnode() (and thus
+ * by the parser) gets a small integer ID, the same for equal labels across all
+ * trees of a run. Apps that look labels up in every tree of a stream (e.g.
+ * bootstrap replicates) can then use arrays indexed by ID instead of hashing
+ * the label strings over and over. Interning is off by default; its memory
+ * grows with the number of distinct labels and is kept until
+ * destroy_label_interner() is called. */
+
+#include <stdbool.h>
+
+/** The empty label ("") always has this ID. */
+
+#define EMPTY_LABEL_ID 0
+
+/** Turns interning on. Returns SUCCESS, or FAILURE if memory could not be
+ * allocated. */
+
+int enable_label_interning();
+
+/** Returns true IFF interning is on. */
+
+bool label_interning_enabled();
+
+/** Returns the ID of 'label', interning it if it has not been seen before.
+ * Returns -1 if interning is off or in case of malloc() problems. */
+
+int intern_label(const char *label);
+
+/** Returns the ID of 'label' if it has already been interned, -1 otherwise.
+ * Does not intern the label. */
+
+int find_label_id(const char *label);
+
+/** Returns the label with ID 'id'. The string belongs to the interner and must
+ * not be modified or free()d. */
+
+const char *interned_label(int id);
+
+/** Returns the number of distinct labels interned so far. IDs go from 0 to
+ * this number minus one, so this is also the size of an array indexed by
+ * label ID. */
+
+int interned_label_count();
+
+/** Forgets the labels interned since interned_label_count() returned
+ * 'watermark': their IDs will be given again to the next new labels. Apps
+ * that read a stream of trees call this once each tree is processed, so that
+ * only the labels they keep across trees (e.g. those of a map) stay interned,
+ * and memory does not grow with the number of distinct labels in the input.
+ * Nodes that bear a forgotten label must not be used afterwards. A watermark
+ * of 0 forgets every label but "". */
+
+void forget_labels_since(int watermark);
+
+/** Frees all interned labels and turns interning off. */
+
+void destroy_label_interner();
@@ -35,17 +35,26 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdbool.h>
 
-#include "parser.h"
-#include "tree.h"
-#include "rnode.h"
-#include "list.h"
+#include "newick_events.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 struct parameters {
 	bool show_inner_labels;
 	bool show_leaf_labels;
 	bool show_only_root_label;
 	char separator;
+	FILE *input;
+};
+
+/* Labels are printed as the parser finds them, so no tree is built. We only
+ * need the nesting depth, to tell the root from other nodes. */
+
+struct label_printer {
+	struct parameters *params;
+	int depth;
+	bool first_label;	/* of the current tree */
 };
 
 void help(char *argv[])
@@ -103,6 +112,7 @@ struct parameters get_params(int argc, char *argv[])
 	params.show_leaf_labels = true;
 	params.show_only_root_label = false;
 	params.separator = '\n';
+	params.input = stdin;
 
 	int opt_char;
 	while ((opt_char = getopt(argc, argv, "hILrt")) != -1) {
@@ -131,13 +141,12 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
-			extern FILE *nwsin;
+			FILE *fin = open_input_file(argv[optind]);
 			if (NULL == fin) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
-			nwsin = fin;
+			params.input = fin;
 		}
 	} else {
 		fprintf(stderr, "Usage: %s [-hILt] <filename|->\n", argv[0]);
@@ -148,55 +157,75 @@ struct parameters get_params(int argc, char *argv[])
 }
 
 
-void process_tree(struct rooted_tree *tree, struct parameters params)
+static void print_label(struct label_printer *printer, char *label)
 {
+	if ('\0' == label[0]) return;
+	if (! printer->first_label) putchar(printer->params->separator);
+	fputs(label, stdout);
+	printer->first_label = false;
+}
 
-	struct list_elem *elem;
-	int first_line = 1;
+static void open_clade(void *param)
+{
+	struct label_printer *printer = param;
+	printer->depth++;
+}
 
-	if (params.show_only_root_label) {
-		printf ("%s\n", tree->root->label);
+static void leaf(void *param, char *label, char *length)
+{
+	struct label_printer *printer = param;
+	(void) length;
+	if (printer->params->show_only_root_label) {
+		if (0 == printer->depth) puts(label);
 		return;
 	}
+	if (printer->params->show_leaf_labels)
+		print_label(printer, label);
+}
 
-	for (elem = tree->nodes_in_order->head; NULL != elem; elem = elem->next) {
-		struct rnode *current = (struct rnode *) elem->data;
-		char *label = current->label;
-
-		if (strcmp("", label) == 0)
-			continue;
-
-		if (is_leaf(current)) {
-			if (params.show_leaf_labels) {
-				if (! first_line) putchar(params.separator);
-				printf ("%s", label);
-				if (first_line) first_line = 0;
-			}
-		} else {
-			if (params.show_inner_labels) {
-				if (! first_line) putchar(params.separator);
-				printf ("%s", label);
-				if (first_line) first_line = 0;
-			}
-		}
-		
+static void close_clade(void *param, char *label, char *length)
+{
+	struct label_printer *printer = param;
+	(void) length;
+	printer->depth--;
+	if (printer->params->show_only_root_label) {
+		if (0 == printer->depth) puts(label);
+		return;
 	}
+	if (printer->params->show_inner_labels)
+		print_label(printer, label);
+}
 
-	putchar('\n');
+static void end_tree(void *param)
+{
+	struct label_printer *printer = param;
+	if (! printer->params->show_only_root_label)
+		putchar('\n');
+	printer->first_label = true;
 }
 
 int main (int argc, char* argv[])
 {
-	struct rooted_tree *tree;
-	struct parameters params;
-
-	params = get_params(argc, argv);
-
-	while ((tree = parse_tree()) != NULL) {
-		process_tree(tree, params);
-		destroy_tree(tree);
-		destroy_all_rnodes(NULL);
+	argc = profile_init(argc, argv);
+
+	struct parameters params = get_params(argc, argv);
+
+	struct label_printer printer = { &params, 0, true };
+	struct newick_handlers handlers = {
+		open_clade, leaf, close_clade, end_tree, &printer };
+	struct newick_stream *stream = create_newick_stream(params.input);
+	if (NULL == stream) { perror(NULL); exit(EXIT_FAILURE); }
+
+	/* like the other programs, we stop at the first faulty tree */
+	enum parser_status_type status;
+	do
+		status = parse_newick_events(stream, &handlers);
+	while (PARSER_STATUS_OK == status);
+	if (PARSER_STATUS_MALLOC_ERROR == status) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
 	}
 
+	destroy_newick_stream(stream);
 	return 0;
 }
@@ -37,8 +37,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "hash.h"
 #include "nodemap.h"
 #include "error.h"
+#include "lca.h"
 
-struct rooted_tree *lca2w_tree;
+/* The tree for lca2w() (see lca()). There is one per thread, since nw_pipe
+ * computes LCAs in several trees at once. */
+
+static __thread struct rooted_tree *lca2w_tree;
 
 /* NOTE: these two functions are obsolete, but I keep them in case the new
  * implementation turns out to be faulty. */
@@ -219,3 +223,112 @@ struct rnode *lca_from_labels_multi (struct rooted_tree *tree,
 	return result;
 }
 
+
+struct lca_table *create_lca_table(struct rnode *root)
+{
+	struct lca_table *table = malloc(sizeof(struct lca_table));
+	if (NULL == table) return NULL;
+
+	/* Count the nodes, then number them (depth-first, without recursion,
+	 * like to_newick()) */
+	int n = 0;
+	struct rnode *current = root;
+	for (;;) {
+		n++;
+		if (! is_leaf(current)) {
+			current = current->first_child;
+			continue;
+		}
+		while (current != root && NULL == current->next_sibling)
+			current = current->parent;
+		if (current == root) break;
+		current = current->next_sibling;
+	}
+
+	table->node_count = n;
+	table->nodes = malloc(n * sizeof(struct rnode *));
+	table->parent = malloc(n * sizeof(int));
+	table->subtree_size = malloc(n * sizeof(int));
+	table->depth = malloc(n * sizeof(int));
+	int levels = 1;
+	while ((1 << levels) <= n) levels++;
+	table->level_count = levels;
+	table->shallowest = malloc(levels * sizeof(int *));
+	if (NULL == table->nodes || NULL == table->parent ||
+	    NULL == table->subtree_size || NULL == table->depth ||
+	    NULL == table->shallowest)
+		return NULL;
+
+	/* 'number' is the preorder number of 'current' */
+	int number = 0;
+	int parent = -1;
+	current = root;
+	for (;;) {
+		table->nodes[number] = current;
+		table->parent[number] = parent;
+		table->depth[number] = -1 == parent ?
+			0 : table->depth[parent] + 1;
+		table->subtree_size[number] = 1;
+		if (! is_leaf(current)) {
+			parent = number++;
+			current = current->first_child;
+			continue;
+		}
+		/* leaving 'current', and all clades of which it is the last
+		 * child: their sizes are known */
+		while (current != root && NULL == current->next_sibling) {
+			table->subtree_size[parent] = number - parent + 1;
+			current = current->parent;
+			parent = table->parent[parent];
+		}
+		if (current == root) break;
+		current = current->next_sibling;
+		number++;
+	}
+
+	int k, i;
+	for (k = 0; k < levels; k++) {
+		table->shallowest[k] = malloc(n * sizeof(int));
+		if (NULL == table->shallowest[k]) return NULL;
+	}
+	for (i = 0; i < n; i++)
+		table->shallowest[0][i] = i;
+	for (k = 1; k < levels; k++) {
+		int half = 1 << (k - 1);
+		int *above = table->shallowest[k - 1];
+		for (i = 0; i + 2 * half <= n; i++) {
+			int a = above[i], b = above[i + half];
+			table->shallowest[k][i] =
+				table->depth[a] <= table->depth[b] ? a : b;
+		}
+	}
+
+	return table;
+}
+
+int lca_table_query(const struct lca_table *table, int i, int j)
+{
+	if (i == j) return i;
+	if (i > j) { int tmp = i; i = j; j = tmp; }
+
+	/* the range i+1 .. j is covered by two (overlapping) runs of 2^k */
+	int k = 31 - __builtin_clz(j - i);
+	int a = table->shallowest[k][i + 1];
+	int b = table->shallowest[k][j - (1 << k) + 1];
+	int shallowest = table->depth[a] <= table->depth[b] ? a : b;
+
+	return table->parent[shallowest];
+}
+
+void destroy_lca_table(struct lca_table *table)
+{
+	int k;
+	for (k = 0; k < table->level_count; k++)
+		free(table->shallowest[k]);
+	free(table->shallowest);
+	free(table->depth);
+	free(table->subtree_size);
+	free(table->parent);
+	free(table->nodes);
+	free(table);
+}
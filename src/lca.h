@@ -56,3 +56,38 @@ struct rnode *lca_from_labels(struct rooted_tree *tree, struct llist *labels);
 labels unique in tree)  */
 
 struct rnode *lca_from_labels_multi(struct rooted_tree *tree, struct llist *labels);
+
+/* Constant-time LCAs, for when many are needed in the same tree (e.g. nw_clade
+ * -f). The nodes are numbered in preorder, so that the nodes of a subtree have
+ * consecutive numbers; the LCA of nodes i < j is then the parent of the
+ * shallowest node among i+1 .. j, which a sparse table finds in constant time.
+ * Building the table takes O(n log n) time and space. Queries don't modify it,
+ * so threads can share one, but the tree must not change while it is in use. */
+
+struct lca_table {
+	int node_count;
+	struct rnode **nodes;	/* in preorder */
+	int *parent;		/* preorder number of parent, -1 for the root */
+	int *subtree_size;	/* number of nodes in subtree, including itself */
+	/* The remaining members are private. */
+	int *depth;
+	int level_count;
+	/* shallowest[k][i] is the shallowest node among i .. i + 2^k - 1 */
+	int **shallowest;
+};
+
+/* Returns the table of the tree rooted at 'root', or NULL in case of malloc()
+ * problems. */
+
+struct lca_table *create_lca_table(struct rnode *root);
+
+/* Returns the (preorder number of the) LCA of nodes number 'i' and 'j' */
+
+int lca_table_query(const struct lca_table *table, int i, int j);
+
+/* Returns true IFF node 'i' is 'j' or one of its descendants */
+
+#define lca_table_is_descendant(table, i, j) \
+	((i) >= (j) && (i) < (j) + (table)->subtree_size[j])
+
+void destroy_lca_table(struct lca_table *table);
@@ -0,0 +1,432 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* leaf_neighbors.c: nearest leaves by patristic distance */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#include "rnode.h"
+#include "lca.h"
+#include "common.h"
+#include "leaf_neighbors.h"
+
+/* A component has at most half the nodes of the enclosing one, so there are
+ * at most this many around any node (there are fewer than 2^31 nodes). */
+
+#define MAX_CENTROID_LEVELS 32
+
+static bool is_labeled_leaf(struct rnode *node)
+{
+	return is_leaf(node) && '\0' != node->label[0];
+}
+
+/* Orders by distance, then preorder */
+
+static int compare_neighbors(const void *a, const void *b)
+{
+	const struct leaf_neighbor *na = a, *nb = b;
+	if (na->distance < nb->distance) return -1;
+	if (na->distance > nb->distance) return 1;
+	return na->leaf - nb->leaf;
+}
+
+/* Work space of create_leaf_index() */
+
+struct decomposition {
+	const struct lca_table *table;
+	double *edge;		/* length of edge to parent */
+	bool *removed;		/* already a centroid */
+	int *order;		/* of traversal */
+	int *via;		/* node from which each node was reached */
+	int *size;		/* of subtree, in the traversal's spanning tree */
+	double *distance;	/* from the traversal's start */
+};
+
+/* Visits the component of 'start' (the nodes that can be reached without
+ * crossing a centroid) breadth-first, and computes their distance from
+ * 'start'. Returns the number of nodes, which are in d->order. */
+
+static int traverse_component(struct decomposition *d, int start)
+{
+	const struct lca_table *table = d->table;
+	int count = 1, i;
+
+	d->order[0] = start;
+	d->via[start] = -1;
+	d->distance[start] = 0;
+	for (i = 0; i < count; i++) {
+		int v = d->order[i];
+		int w = table->parent[v];
+		if (-1 != w && w != d->via[v] && ! d->removed[w]) {
+			d->via[w] = v;
+			d->distance[w] = d->distance[v] + d->edge[v];
+			d->order[count++] = w;
+		}
+		for (w = v + 1; w < v + table->subtree_size[v];
+				w += table->subtree_size[w]) {
+			if (w == d->via[v] || d->removed[w]) continue;
+			d->via[w] = v;
+			d->distance[w] = d->distance[v] + d->edge[w];
+			d->order[count++] = w;
+		}
+	}
+
+	return count;
+}
+
+/* Returns the centroid of the component that was just traversed */
+
+static int find_centroid(struct decomposition *d, int count)
+{
+	const struct lca_table *table = d->table;
+	int i;
+
+	for (i = 0; i < count; i++)
+		d->size[d->order[i]] = 1;
+	for (i = count - 1; i > 0; i--) {
+		int v = d->order[i];
+		d->size[d->via[v]] += d->size[v];
+	}
+
+	/* Go down into the piece that has more than half the nodes, if any */
+	int v = d->order[0];
+	for (;;) {
+		int heavy = -1;
+		int w = table->parent[v];
+		if (-1 != w && ! d->removed[w] && v == d->via[w] &&
+				d->size[w] > count / 2)
+			heavy = w;
+		for (w = v + 1; w < v + table->subtree_size[v];
+				w += table->subtree_size[w])
+			if (! d->removed[w] && v == d->via[w] &&
+					d->size[w] > count / 2)
+				heavy = w;
+		if (-1 == heavy) return v;
+		v = heavy;
+	}
+}
+
+struct leaf_index *create_leaf_index(struct rnode *root)
+{
+	struct leaf_index *index = malloc(sizeof(struct leaf_index));
+	if (NULL == index) return NULL;
+	index->table = create_lca_table(root);
+	if (NULL == index->table) return NULL;
+	const struct lca_table *table = index->table;
+	int n = table->node_count;
+
+	struct decomposition d;
+	d.table = table;
+	d.edge = malloc(n * sizeof(double));
+	d.removed = calloc(n, sizeof(bool));
+	d.order = malloc(n * sizeof(int));
+	d.via = malloc(n * sizeof(int));
+	d.size = malloc(n * sizeof(int));
+	d.distance = malloc(n * sizeof(double));
+	/* components still to decompose, and the centroids around them */
+	int *pending = malloc(n * sizeof(int));
+	int *pending_parent = malloc(n * sizeof(int));
+	index->depth = malloc(n * sizeof(double));
+	index->centroid_parent = malloc(n * sizeof(int));
+	index->list_start = malloc(n * sizeof(long));
+	index->list_length = malloc(n * sizeof(int));
+	long list_capacity = n;
+	index->lists = malloc(list_capacity * sizeof(struct leaf_neighbor));
+	if (NULL == d.edge || NULL == d.removed || NULL == d.order ||
+	    NULL == d.via || NULL == d.size || NULL == d.distance ||
+	    NULL == pending || NULL == pending_parent ||
+	    NULL == index->depth || NULL == index->centroid_parent ||
+	    NULL == index->list_start || NULL == index->list_length ||
+	    NULL == index->lists)
+		return NULL;
+
+	int i;
+	/* As in set_node_depth_cb(), the root's depth is its own length, so
+	 * that distances come out exactly as in nw_distance's matrix. */
+	d.edge[0] = 0;
+	index->depth[0] = get_edge_length(table->nodes[0]);
+	for (i = 1; i < n; i++) {
+		/* as in set_node_depth_cb(), a missing length counts as 1 */
+		struct rnode *node = table->nodes[i];
+		d.edge[i] = has_edge_length(node) ? get_edge_length(node) : 1.0;
+		index->depth[i] = index->depth[table->parent[i]] + d.edge[i];
+	}
+
+	/* There are never more pending components than nodes left */
+	int pending_count = 1;
+	pending[0] = 0;
+	pending_parent[0] = -1;
+	long list_total = 0;
+	while (pending_count > 0) {
+		pending_count--;
+		int count = traverse_component(&d, pending[pending_count]);
+		int centroid = find_centroid(&d, count);
+		index->centroid_parent[centroid] =
+			pending_parent[pending_count];
+
+		count = traverse_component(&d, centroid);
+		index->list_start[centroid] = list_total;
+		for (i = 0; i < count; i++) {
+			int v = d.order[i];
+			if (! is_labeled_leaf(table->nodes[v])) continue;
+			if (list_total == list_capacity) {
+				list_capacity *= 2;
+				struct leaf_neighbor *lists = realloc(
+					index->lists, list_capacity *
+					sizeof(struct leaf_neighbor));
+				if (NULL == lists) return NULL;
+				index->lists = lists;
+			}
+			index->lists[list_total].leaf = v;
+			index->lists[list_total].distance = d.distance[v];
+			list_total++;
+		}
+		index->list_length[centroid] =
+			list_total - index->list_start[centroid];
+		qsort(index->lists + index->list_start[centroid],
+				index->list_length[centroid],
+				sizeof(struct leaf_neighbor), compare_neighbors);
+
+		d.removed[centroid] = true;
+		int w = table->parent[centroid];
+		if (-1 != w && ! d.removed[w]) {
+			pending[pending_count] = w;
+			pending_parent[pending_count++] = centroid;
+		}
+		for (w = centroid + 1;
+				w < centroid + table->subtree_size[centroid];
+				w += table->subtree_size[w])
+			if (! d.removed[w]) {
+				pending[pending_count] = w;
+				pending_parent[pending_count++] = centroid;
+			}
+	}
+
+	free(pending_parent);
+	free(pending);
+	free(d.distance);
+	free(d.size);
+	free(d.via);
+	free(d.order);
+	free(d.removed);
+	free(d.edge);
+
+	return index;
+}
+
+double node_distance(const struct leaf_index *index, int a, int b)
+{
+	int lca = lca_table_query(index->table, a, b);
+	return index->depth[a] + index->depth[b] - 2 * index->depth[lca];
+}
+
+void destroy_leaf_index(struct leaf_index *index)
+{
+	free(index->lists);
+	free(index->list_length);
+	free(index->list_start);
+	free(index->centroid_parent);
+	free(index->depth);
+	destroy_lca_table(index->table);
+	free(index);
+}
+
+struct leaf_search *create_leaf_search(const struct leaf_index *index)
+{
+	struct leaf_search *search = malloc(sizeof(struct leaf_search));
+	if (NULL == search) return NULL;
+	int n = index->table->node_count;
+
+	search->index = index;
+	search->found_count = 0;
+	search->found_capacity = 64;
+	search->found = malloc(search->found_capacity *
+			sizeof(struct leaf_neighbor));
+	search->stamps = calloc(n, sizeof(int));
+	search->stamp = 0;
+	if (NULL == search->found || NULL == search->stamps)
+		return NULL;
+
+	return search;
+}
+
+/* Starts a query: forgets the leaves found by the previous one */
+
+static void new_query(struct leaf_search *search)
+{
+	if (INT_MAX == search->stamp) {
+		memset(search->stamps, 0,
+			search->index->table->node_count * sizeof(int));
+		search->stamp = 0;
+	}
+	search->stamp++;
+	search->found_count = 0;
+}
+
+/* The distance is recomputed from depths rather than taken from the merged
+ * lists, whose sums may differ in the last bits. */
+
+static int add_found(struct leaf_search *search, int node, int leaf)
+{
+	if (search->found_count == search->found_capacity) {
+		int capacity = 2 * search->found_capacity;
+		struct leaf_neighbor *found = realloc(search->found,
+				capacity * sizeof(struct leaf_neighbor));
+		if (NULL == found) return FAILURE;
+		search->found = found;
+		search->found_capacity = capacity;
+	}
+	search->stamps[leaf] = search->stamp;
+	search->found[search->found_count].leaf = leaf;
+	search->found[search->found_count].distance =
+		node_distance(search->index, node, leaf);
+	search->found_count++;
+	return SUCCESS;
+}
+
+/* A centroid's list, offset by the centroid's distance to the query, being
+ * merged with the others. */
+
+struct merge_run {
+	double distance;	/* of the current leaf to the query */
+	int leaf;
+	double offset;
+	long position;		/* of the current leaf in the lists */
+	long end;
+};
+
+static bool run_before(const struct merge_run *a, const struct merge_run *b)
+{
+	if (a->distance != b->distance) return a->distance < b->distance;
+	return a->leaf < b->leaf;
+}
+
+/* Restores the heap property of 'heap' (of 'count' runs) from the top down */
+
+static void sift_down(struct merge_run *heap, int count)
+{
+	int i = 0;
+	for (;;) {
+		int first = i, child;
+		for (child = 2 * i + 1; child <= 2 * i + 2; child++)
+			if (child < count && run_before(&heap[child],
+						&heap[first]))
+				first = child;
+		if (first == i) return;
+		struct merge_run tmp = heap[i];
+		heap[i] = heap[first];
+		heap[first] = tmp;
+		i = first;
+	}
+}
+
+int nearest_leaves(struct leaf_search *search, int node, int k)
+{
+	const struct leaf_index *index = search->index;
+	struct merge_run heap[MAX_CENTROID_LEVELS];
+	int count = 0;
+	int c;
+
+	new_query(search);
+	for (c = node; -1 != c; c = index->centroid_parent[c]) {
+		if (0 == index->list_length[c]) continue;
+		struct merge_run *run = &heap[count];
+		run->offset = node_distance(index, node, c);
+		run->position = index->list_start[c];
+		run->end = run->position + index->list_length[c];
+		run->leaf = index->lists[run->position].leaf;
+		run->distance = run->offset +
+			index->lists[run->position].distance;
+		/* sift up */
+		int i = count++;
+		while (i > 0 && run_before(&heap[i], &heap[(i - 1) / 2])) {
+			struct merge_run tmp = heap[i];
+			heap[i] = heap[(i - 1) / 2];
+			heap[(i - 1) / 2] = tmp;
+			i = (i - 1) / 2;
+		}
+	}
+
+	/* Runs come out in order of distance. A leaf's first appearance is
+	 * its true distance: the others go through a centroid that is off the
+	 * path. */
+	while (count > 0 && search->found_count < k) {
+		struct merge_run *top = &heap[0];
+		int leaf = top->leaf;
+		if (leaf != node && search->stamps[leaf] != search->stamp)
+			if (! add_found(search, node, leaf))
+				return FAILURE;
+		if (++top->position < top->end) {
+			top->leaf = index->lists[top->position].leaf;
+			top->distance = top->offset +
+				index->lists[top->position].distance;
+		} else {
+			heap[0] = heap[--count];
+		}
+		sift_down(heap, count);
+	}
+
+	return SUCCESS;
+}
+
+int leaves_within(struct leaf_search *search, int node, double radius)
+{
+	const struct leaf_index *index = search->index;
+	int c;
+
+	new_query(search);
+	for (c = node; -1 != c; c = index->centroid_parent[c]) {
+		double offset = node_distance(index, node, c);
+		long position = index->list_start[c];
+		long end = position + index->list_length[c];
+		for (; position < end; position++) {
+			double distance = offset +
+				index->lists[position].distance;
+			if (distance > radius) break;
+			int leaf = index->lists[position].leaf;
+			if (leaf == node) continue;
+			if (search->stamps[leaf] != search->stamp)
+				if (! add_found(search, node, leaf))
+					return FAILURE;
+		}
+	}
+	qsort(search->found, search->found_count,
+			sizeof(struct leaf_neighbor), compare_neighbors);
+
+	return SUCCESS;
+}
+
+void destroy_leaf_search(struct leaf_search *search)
+{
+	free(search->stamps);
+	free(search->found);
+	free(search);
+}
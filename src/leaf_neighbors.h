@@ -0,0 +1,105 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* leaf_neighbors.h: nearest leaves by patristic distance, for nw_distance
+ * (options -k and -r) */
+
+/* The index is a centroid decomposition of the tree, seen as an unrooted
+ * graph. The centroid of a component is a node whose removal leaves no piece
+ * with more than half the component's nodes; the pieces are decomposed in
+ * turn, so that every node is the centroid of exactly one component and lies
+ * in O(log n) of them. Each centroid keeps the labeled leaves of its component,
+ * sorted by distance from it. The path from a node q to any leaf x goes
+ * through the centroid of the smallest component that contains both, so the
+ * leaves nearest to q come out of a merge of the lists of the (O(log n))
+ * components around q, each offset by its centroid's distance to q. That
+ * distance is found from root depths and the LCA (see struct lca_table).
+ *
+ * Edge lengths are assumed not to be negative; undefined lengths count as 1,
+ * as in set_node_depth_cb().
+ * Nodes are designated by their preorder number, as in struct lca_table. */
+
+struct rnode;
+struct lca_table;
+
+struct leaf_neighbor {
+	int leaf;
+	double distance;
+};
+
+struct leaf_index {
+	struct lca_table *table;
+	double *depth;		/* distance from the root */
+	/* The remaining members are private. */
+	int *centroid_parent;	/* centroid of enclosing component, or -1 */
+	long *list_start;	/* in 'lists', for each centroid */
+	int *list_length;
+	struct leaf_neighbor *lists;
+};
+
+/* Returns the index of the tree rooted at 'root', or NULL in case of malloc()
+ * problems. The tree must not change while the index is in use. */
+
+struct leaf_index *create_leaf_index(struct rnode *root);
+
+/* Returns the distance between nodes 'a' and 'b' */
+
+double node_distance(const struct leaf_index *index, int a, int b);
+
+void destroy_leaf_index(struct leaf_index *index);
+
+/* Work space for queries. Queries don't modify the index, so threads can
+ * share one as long as each has its own search. */
+
+struct leaf_search {
+	const struct leaf_index *index;
+	/* Results of the last query, by increasing distance (then preorder) */
+	struct leaf_neighbor *found;
+	int found_count;
+	/* The remaining members are private. */
+	int found_capacity;
+	int *stamps;		/* stamps[x] == stamp IFF x found in query */
+	int stamp;
+};
+
+/* Returns a search, or NULL in case of malloc() problems */
+
+struct leaf_search *create_leaf_search(const struct leaf_index *index);
+
+/* Finds the 'k' labeled leaves nearest to 'node' (other than 'node' itself),
+ * or all of them if there are fewer. Ties at the k-th distance are broken by
+ * preorder. Returns FAILURE in case of malloc() problems, SUCCESS otherwise. */
+
+int nearest_leaves(struct leaf_search *search, int node, int k);
+
+/* Finds all labeled leaves (other than 'node') at most 'radius' away from
+ * 'node'. Returns FAILURE in case of malloc() problems, SUCCESS otherwise. */
+
+int leaves_within(struct leaf_search *search, int node, double radius);
+
+void destroy_leaf_search(struct leaf_search *search);
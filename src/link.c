@@ -36,7 +36,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rnode.h"
 #include "list.h"
 #include "link.h"
-#include "masprintf.h"
 #include "common.h"
 
 /* Avoid global variables by making external vars static and using a getter. */
@@ -59,49 +58,30 @@ void add_child(struct rnode *parent, struct rnode *child)
 
 	parent->child_count++;
 	parent->last_child = child;
+	/* 'child' may have been removed from another list of children (see
+	 * _swap_nodes()), in which case it still points to its old sibling */
+	child->next_sibling = NULL;
 	child->linked = true;
 }
 
-/* Returns half the length passed as a parameter (as char *), or "". */
-
-char * compute_new_edge_length(char * length_as_string)
-{
-	char *result;
-
-	if (0 != strcmp("", length_as_string)) {
-		double length = atof(length_as_string);
-		result = masprintf("%g", length / 2);
-		if (NULL == result) return NULL;
-	} else  {
-                /* Note: we cannot just say result = ""; because result will be
-                 * free()d later, so it has to have been dynamically allocated.
-                 * */
-                result = strdup("");
-        }
-
-	return result;
-}
-
 int insert_node_above(struct rnode *this, char *label)
 {
 	struct rnode *new;
-	char * new_edge_length;	/* both new edges have 1/2 the length of the
-				   old one */
 
-	new_edge_length = compute_new_edge_length(this->edge_length_as_string);
-	if (NULL == new_edge_length) return FAILURE;
 	/* create new node */
-	new = create_rnode(label, new_edge_length);
+	new = create_rnode(label, "");
 	if (NULL == new) return FAILURE;
-	free(this->edge_length_as_string);
-	this->edge_length_as_string = strdup(new_edge_length);
+	/* both new edges have 1/2 the length of the old one */
+	if (has_edge_length(this)) {
+		double new_edge_length = get_edge_length(this) / 2;
+		set_edge_length(new, new_edge_length);
+		set_edge_length(this, new_edge_length);
+	}
 	replace_child(this, new);
 	this->next_sibling = NULL;
 	/* link new node to this node */
 	add_child(new, this);
 
-	free(new_edge_length);
-
 	return SUCCESS;
 }
 	
@@ -133,26 +113,6 @@ void replace_child (struct rnode *old, struct rnode *new)
 	new->linked = true;
 }
 
-char *add_len_strings(char *ls1, char *ls2)
-{
-	char * result;
-
-	/* if ls1 and ls2 are not both "" */
-	if (	strcmp("", ls1) != 0 ||
-		strcmp("", ls2) != 0)	{
-		double l1 = atof(ls1);
-		double l2 = atof(ls2);
-		result = masprintf("%g", l1 + l2);
-		if (NULL == result) return NULL;
-	} else {
-		result = strdup("");
-		/* I'd be REALLY suprised if this fails... */
-		if (NULL == result) return NULL;
-	}
-
-	return result;
-}
-
 /* 'this' node is the one that is to be spliced out. All nodes and edges are
  * relative to this one. */
 
@@ -167,12 +127,7 @@ int splice_out_rnode(struct rnode *this)
 	 * must be added. */
 	for (current_child = this->first_child; NULL != current_child;
 			current_child = current_child->next_sibling) {
-		char *new_edge_len_s = add_len_strings(
-			this->edge_length_as_string,
-			current_child->edge_length_as_string);
-		if (NULL == new_edge_len_s) return FAILURE;
-		free(current_child->edge_length_as_string);
-		current_child->edge_length_as_string = new_edge_len_s;
+		add_edge_length(current_child, this);
 		current_child->parent = parent;  /* instead of this node */
 	}
 
@@ -230,6 +185,7 @@ int remove_child(struct rnode *child)
 	dummy_head.label = "DUMMY";
 	dummy_head.edge_length_as_string = "-1";
 	dummy_head.edge_length = -1;
+	dummy_head.length_parsed = true;
 	dummy_head.data = NULL;
 	dummy_head.parent = parent;
 	dummy_head.first_child = dummy_head.last_child = NULL;
@@ -297,7 +253,6 @@ static int _swap_nodes(struct rnode *node, bool i_node_lbl_as_support)
 	assert(is_root(node->parent));  /* must swap below root */
 
 	struct rnode *parent = node->parent;
-	char *length = strdup(node->edge_length_as_string);
 	if(remove_child(node) < 0) return FAILURE;
 	node->parent = NULL;
 	add_child(node, parent);
@@ -305,12 +260,16 @@ static int _swap_nodes(struct rnode *node, bool i_node_lbl_as_support)
 	if (i_node_lbl_as_support) {
 		free(parent->label);
 		parent->label = strdup(node->label);
+		parent->label_id = node->label_id;
 	}
 
-	free(node->edge_length_as_string);
-	node->edge_length_as_string = strdup("");
+	/* the edge's length moves from above 'node' to above 'parent' */
 	free(parent->edge_length_as_string);
-	parent->edge_length_as_string = length;
+	parent->edge_length_as_string = node->edge_length_as_string;
+	parent->edge_length = node->edge_length;
+	parent->length_parsed = node->length_parsed;
+	node->edge_length_as_string = strdup("");
+	node->length_parsed = false;
 
 	return SUCCESS;
 }
@@ -33,6 +33,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "common.h"
 #include "list.h"
+#include "profile.h"
 
 
 struct llist *create_llist()
@@ -40,6 +41,7 @@ struct llist *create_llist()
 	struct llist *llist_p;
 	llist_p = malloc(sizeof(struct llist));
 	if (NULL == llist_p) return NULL;
+	PROFILE_ALLOC(sizeof(struct llist));
 	llist_p->head = llist_p->tail = NULL;
 	llist_p->count = 0;
 	return llist_p;
@@ -51,6 +53,7 @@ int prepend_element(struct llist *list, void *data)
 
 	el_p = malloc(sizeof(struct list_elem));
 	if (NULL == el_p) return FAILURE;
+	PROFILE_ALLOC(sizeof(struct list_elem));
 	el_p->data = data;
 	el_p->next = NULL;
 
@@ -72,6 +75,7 @@ int append_element(struct llist *list, void *data)
 
 	el_p = malloc(sizeof(struct list_elem));
 	if (NULL == el_p) return FAILURE;
+	PROFILE_ALLOC(sizeof(struct list_elem));
 	el_p->data = data;
 	el_p->next = NULL;
 
@@ -59,6 +59,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tree_editor_rnode_data.h"
 #include "common.h"
 #include "masprintf.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 const char *CONDITION = "condition";
 const char *ACTION = "action";
@@ -375,7 +377,7 @@ static struct parameters get_params(int argc, char *argv[])
 	/* check arguments */ // TODO: refactor
 	if (3 == (argc - optind))	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -392,7 +394,7 @@ static struct parameters get_params(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 		}
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -466,9 +468,9 @@ static void reverse_parse_order_traversal(struct rooted_tree *tree)
 		if (parent_data->is_depth_defined) {
 			double edge_length;
 			char *endptr;
-			edge_length = strtod(node->edge_length_as_string,
-					&endptr);
-			if (endptr == node->edge_length_as_string) {
+			const char *length_s = edge_length_string(node);
+			edge_length = strtod(length_s, &endptr);
+			if (endptr == length_s) {
 				/* no conversion: depth is undefined */
 				rndata->is_depth_defined = false;
 			} else {
@@ -563,11 +565,11 @@ static void set_predefined_variables(struct rnode *node, lua_State *L)
 	lua_setglobal(L, "i");
 
 	/* L: parent edge's length */
-	if (strcmp ("", node->edge_length_as_string) == 0) {
+	if (! has_edge_length(node)) {
 		lua_pushnil(L);
 	} else {
 		/* edge_length_as_string represents a number */
-		lua_pushstring(L, node->edge_length_as_string);
+		lua_pushstring(L, edge_length_string(node));
 		lua_Number len = lua_tonumber(L, -1);
 		lua_pop(L, 1);
 		lua_pushnumber(L, len);
@@ -847,8 +849,7 @@ static int lua_node_set(lua_State *L)
 	case NODE_LENGTH:
 		if (lua_isnumber(L, 3)) {
 			const char *len_s = lua_tostring(L, 3);
-			free(lnode->orig->edge_length_as_string);
-			lnode->orig->edge_length_as_string = strdup(len_s);
+			set_edge_length_string(lnode->orig, len_s);
 			return 0;
 		} else if (lua_isstring(L, 3)) {
 			/* already checked for numbers, so this is a
@@ -857,8 +858,7 @@ static int lua_node_set(lua_State *L)
 			luaL_argcheck(L, '\0' == *len_s, 3,
 				"expected a number, a number-convertible "
 				"string, or the empty string.");
-			free(lnode->orig->edge_length_as_string);
-			lnode->orig->edge_length_as_string = strdup("");
+			set_edge_length_string(lnode->orig, "");
 			return 0;
 		} else {
 			luaL_error(L, false, 3,
@@ -917,7 +917,7 @@ static int lua_node_get(lua_State *L)
 		lua_pushstring(L, orig->label);
 		return 1;
 	case NODE_LENGTH:
-		lua_pushnumber(L, atof(orig->edge_length_as_string));
+		lua_pushnumber(L, get_edge_length(orig));
 		return 1;
 	case NODE_PARENT:
 		push_new_lnode(L, orig->parent);
@@ -1027,6 +1027,8 @@ static void run_user_hook(lua_State *L, const char *phase)
 
 int main(int argc, char* argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct parameters params = get_params(argc, argv);
 	struct rooted_tree *tree;
 
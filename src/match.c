@@ -49,6 +49,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "common.h"
 #include "rnode_iterator.h"
 #include "masprintf.h"
+#include "profile.h"
+#include "tree_index.h"
+#include "compressed_io.h"
 
 #ifdef DEBUG_MATCH
 #define DEBUG 1
@@ -64,6 +67,7 @@ struct parameters {
 	char *pattern;
 	FILE *target_trees;
 	bool reverse;
+	char *index_filename;	/* NULL unless -i */
 };
 
 void help(char* argv[])
@@ -73,7 +77,7 @@ void help(char* argv[])
 "\n"
 "Synopsis\n"
 "--------\n"
-"%s [-v] <target tree filename|-> <pattern tree>\n"
+"%s [-v] [-i <index>] <target tree filename|-> <pattern tree>\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -92,6 +96,10 @@ void help(char* argv[])
 "Options\n"
 "-------\n"
 "\n"
+"    -i <index filename>: use this index of the target trees (see nw_index)\n"
+"        to read only the trees that contain all the pattern's labels (no\n"
+"        other tree can match). Much faster on large files. The target file\n"
+"        cannot be standard input, and -v cannot be used.\n"
 "    -v: prints tree which do NOT match the pattern.\n"
 "\n"
 "Limits & Assumptions\n"
@@ -124,23 +132,40 @@ struct parameters get_params(int argc, char *argv[])
 
 
 	params.reverse = false;
+	params.index_filename = NULL;
 
 	/* parse options and switches */
-	while ((opt_char = getopt(argc, argv, "hv")) != -1) {
+	while ((opt_char = getopt(argc, argv, "hi:v")) != -1) {
 		switch (opt_char) {
 		case 'h':
 			help(argv);
 			exit(EXIT_SUCCESS);
+		case 'i':
+			params.index_filename = optarg;
+			break;
 		/* we keep this for debugging, but not documented */
 		case 'v':
 			params.reverse = true;
 			break;
 		}
 	}
+	if (NULL != params.index_filename) {
+		/* The index tells which trees may match, not which can't */
+		if (params.reverse) {
+			fprintf (stderr, "Options -i and -v can't be used "
+					"together.\n");
+			exit(EXIT_FAILURE);
+		}
+		if ((argc - optind) >= 1 && 0 == strcmp("-", argv[optind])) {
+			fprintf (stderr, "Option -i needs a target tree "
+					"file, not standard input.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
 	/* get arguments */
 	if (2 == (argc - optind))	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			if (NULL == fin) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
@@ -295,12 +320,11 @@ void remove_branch_lengths(struct rooted_tree *target_tree)
 
 	for (el = target_tree->nodes_in_order->head; NULL != el; el = el->next) {
 		struct rnode *current = el->data;
-		if (strcmp("", current->edge_length_as_string) != 0) {
-			free(current->edge_length_as_string);
-			// We need to allocate dynamically, since this will
-			// later be passed to free():
-			// cur_edge->length_as_string = "" *WRONG!*
-			current->edge_length_as_string = strdup("");
+		if (has_edge_length(current)) {
+			if (! set_edge_length_string(current, "")) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 		}
 	}
 	/* The tree topology was not changed, so no need to recompute
@@ -335,6 +359,50 @@ void remove_knee_nodes(struct rooted_tree *tree)
 	tree->nodes_in_order = nodes_in_order;
 }
 
+/* Returns the pattern's (non-empty) leaf labels, which any matching tree must
+ * contain. */
+
+struct llist *pattern_leaf_labels(struct rooted_tree *pattern_tree)
+{
+	struct llist *labels = create_llist();
+	if (NULL == labels) { perror(NULL); exit(EXIT_FAILURE); }
+
+	struct list_elem *el;
+	for (el = pattern_tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = el->data;
+		if (is_leaf(current) && 0 != strcmp("", current->label))
+			if (! append_element(labels, current->label)) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+	}
+
+	return labels;
+}
+
+/* Returns the offsets of the trees that may match, according to the index */
+
+off_t *candidate_trees(struct rooted_tree *pattern_tree,
+		struct parameters params, long *count)
+{
+	struct tree_index *index = open_tree_index(params.index_filename,
+			params.target_trees);
+	if (NULL == index) {
+		print_tree_index_error(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+	struct llist *labels = pattern_leaf_labels(pattern_tree);
+	off_t *offsets = trees_with_labels(index, labels, count);
+	if (NULL == offsets) {
+		print_tree_index_error(params.index_filename);
+		exit(EXIT_FAILURE);
+	}
+	destroy_llist(labels);
+	close_tree_index(index);
+
+	return offsets;
+}
+
 void process_tree(struct rooted_tree *tree, struct hash *pattern_labels,
 		char *pattern_newick, struct parameters params)
 {
@@ -342,8 +410,8 @@ void process_tree(struct rooted_tree *tree, struct hash *pattern_labels,
 	 * as soon as possible. Then I no longer need to guard against this
 	 * list being invalid. */
 
-	/* In this case I stick with the old, recursive to_newick, because it
-	 * directly returns a char* */
+	/* In this case I use to_newick() rather than dump_newick(), because
+	 * I need the tree as a char* */
 	char *original_newick = to_newick(tree->root);
 	remove_inner_node_labels(tree);
 	prune_extra_labels(tree, pattern_labels);
@@ -368,6 +436,8 @@ void process_tree(struct rooted_tree *tree, struct hash *pattern_labels,
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *pattern_tree;	
 	struct rooted_tree *tree;	
 	char *pattern_newick;
@@ -379,16 +449,41 @@ int main(int argc, char *argv[])
 	pattern_newick = to_newick(pattern_tree->root);
 	pattern_labels = create_label2node_map(pattern_tree->nodes_in_order);
 
-	/* get_ordered_pattern_tree() causes a tree to be read from a string,
-	 * which means that we must now tell the lexer to change its input
-	 * source. It's not enough to just set the external FILE pointer
-	 * 'nwsin' to standard input or the user-supplied file, apparently:
-	 * this would segfault. */
-	newick_scanner_set_file_input(params.target_trees);
-
-	while (NULL != (tree = parse_tree())) {
-		process_tree(tree, pattern_labels, pattern_newick, params);
-		destroy_tree(tree);
+	/* The pattern's nodes are kept for the whole run; those of each
+	 * target tree are freed as soon as it is processed. */
+	int pattern_watermark = rnode_watermark();
+
+	if (NULL != params.index_filename) {
+		long count, i;
+		off_t *offsets = candidate_trees(pattern_tree, params, &count);
+		for (i = 0; i < count; i++) {
+			tree = parse_tree_at(params.target_trees, offsets[i]);
+			if (NULL == tree) {
+				fprintf (stderr, "Could not read tree at "
+					"offset %lld - is the index up to "
+					"date?\n", (long long) offsets[i]);
+				exit(EXIT_FAILURE);
+			}
+			process_tree(tree, pattern_labels, pattern_newick,
+					params);
+			destroy_rnodes_since(pattern_watermark, NULL);
+			destroy_tree(tree);
+		}
+		free(offsets);
+	} else {
+		/* get_ordered_pattern_tree() causes a tree to be read from a
+		 * string, which means that we must now tell the lexer to
+		 * change its input source. It's not enough to just set the
+		 * external FILE pointer 'nwsin' to standard input or the
+		 * user-supplied file, apparently: this would segfault. */
+		newick_scanner_set_file_input(params.target_trees);
+
+		while (NULL != (tree = parse_tree())) {
+			process_tree(tree, pattern_labels, pattern_newick,
+					params);
+			destroy_rnodes_since(pattern_watermark, NULL);
+			destroy_tree(tree);
+		}
 	}
 
 	destroy_hash(pattern_labels);
@@ -0,0 +1,429 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* The input is read in large chunks into a buffer, and tokens are found in
+ * place. A token (label or length) is kept as an offset into the buffer until
+ * it is passed to a callback, at which point it is '\0'-terminated in place:
+ * the character that followed it has been read by then. When the buffer must
+ * be refilled, the bytes from the oldest token still needed onwards are moved
+ * to its start, and the buffer grows only if that is not enough. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "newick_events.h"
+#include "profile.h"
+
+static const size_t INIT_BUFFER_SIZE = 1 << 20;
+static const size_t NO_TOKEN = (size_t) -1;
+
+enum token { TOK_LABEL, TOK_O_PAREN, TOK_C_PAREN, TOK_COMMA, TOK_COLON,
+	TOK_SEMICOLON, TOK_EOF, TOK_MALLOC_ERROR };
+
+/* character classes */
+enum { CC_LABEL, CC_SPACE, CC_NEWLINE, CC_PUNCT, CC_QUOTE, CC_COMMENT,
+	CC_OTHER };
+
+struct newick_stream {
+	FILE *in;
+	char *buf;
+	size_t size;	/* capacity, not counting room for a final '\0' */
+	size_t len;	/* number of bytes read into buf */
+	size_t pos;	/* next byte to scan */
+	bool eof;
+	int lineno;
+	/* offsets into buf, or NO_TOKEN */
+	size_t tok_start;	/* token being scanned */
+	size_t label, length;	/* pending label and length */
+	size_t label_len, length_len;
+};
+
+static unsigned char char_class[256];
+
+static void init_char_classes()
+{
+	static bool done = false;
+	if (done) return;
+	int c;
+	for (c = 0; c < 256; c++) {
+		/* like [[:graph:]] in the Flex scanner, but bytes above 127
+		 * (e.g. UTF-8) are allowed in labels too */
+		if ((c > ' ' && c < 127) || c > 127)
+			char_class[c] = CC_LABEL;
+		else
+			char_class[c] = CC_OTHER;
+	}
+	char_class[' '] = char_class['\t'] = char_class['\r'] = CC_SPACE;
+	char_class['\n'] = CC_NEWLINE;
+	char_class['('] = char_class[')'] = char_class[','] = CC_PUNCT;
+	char_class[':'] = char_class[';'] = CC_PUNCT;
+	char_class['\''] = CC_QUOTE;
+	char_class['['] = CC_COMMENT;
+	char_class[']'] = CC_OTHER;
+	done = true;
+}
+
+struct newick_stream *create_newick_stream(FILE *in)
+{
+	struct newick_stream *stream = malloc(sizeof(struct newick_stream));
+	if (NULL == stream) return NULL;
+	stream->buf = malloc(INIT_BUFFER_SIZE + 1);
+	if (NULL == stream->buf) { free(stream); return NULL; }
+	stream->in = in;
+	stream->size = INIT_BUFFER_SIZE;
+	stream->len = stream->pos = 0;
+	stream->eof = false;
+	stream->lineno = 0;
+	stream->tok_start = stream->label = stream->length = NO_TOKEN;
+	init_char_classes();
+
+	return stream;
+}
+
+void destroy_newick_stream(struct newick_stream *stream)
+{
+	free(stream->buf);
+	free(stream);
+}
+
+static void shift(size_t *offset, size_t by)
+{
+	if (NO_TOKEN != *offset) *offset -= by;
+}
+
+/* Reads more input, keeping the bytes of any token still needed. Returns the
+ * number of bytes read (0 at end of input), or -1 if the buffer could not be
+ * grown. */
+
+static long fill(struct newick_stream *s)
+{
+	if (s->eof) return 0;
+
+	size_t keep = s->pos;
+	if (s->tok_start < keep) keep = s->tok_start;
+	if (s->label < keep) keep = s->label;
+	if (s->length < keep) keep = s->length;
+	if (keep > 0) {
+		memmove(s->buf, s->buf + keep, s->len - keep);
+		s->len -= keep;
+		s->pos -= keep;
+		shift(&s->tok_start, keep);
+		shift(&s->label, keep);
+		shift(&s->length, keep);
+	}
+	if (s->len == s->size) {
+		char *grown = realloc(s->buf, 2 * s->size + 1);
+		if (NULL == grown) return -1;
+		s->buf = grown;
+		s->size *= 2;
+	}
+
+	size_t nread = fread(s->buf + s->len, 1, s->size - s->len, s->in);
+	if (0 == nread) {
+		/* As in the Flex scanner, read errors (e.g. a truncated
+		 * compressed file) are fatal: they must not pass for the end
+		 * of input. */
+		if (ferror(s->in)) {
+			fprintf(stderr, "Could not read input - aborting.\n");
+			exit(EXIT_FAILURE);
+		}
+		s->eof = true;
+	}
+	s->len += nread;
+	return nread;
+}
+
+/* Returns the class of the next byte, or -1 at end of input (-2 in case of
+ * malloc() problems). */
+
+static int refill_and_peek_class(struct newick_stream *s)
+{
+	long nread = fill(s);
+	if (nread < 0) return -2;
+	if (0 == nread) return -1;
+	return char_class[(unsigned char) s->buf[s->pos]];
+}
+
+static inline int peek_class(struct newick_stream *s)
+{
+	if (s->pos < s->len)
+		return char_class[(unsigned char) s->buf[s->pos]];
+	return refill_and_peek_class(s);
+}
+
+/* Scans a quoted label, i.e. one or more quoted strings, from the opening
+ * quote. */
+
+static enum token scan_quoted(struct newick_stream *s)
+{
+	int cc;
+	do {
+		s->pos++;	/* opening quote */
+		for (;;) {
+			cc = peek_class(s);
+			if (-2 == cc) return TOK_MALLOC_ERROR;
+			if (-1 == cc) return TOK_LABEL; /* unterminated */
+			if (CC_NEWLINE == cc) s->lineno++;
+			s->pos++;
+			if (CC_QUOTE == cc) break;
+		}
+		cc = peek_class(s);
+		if (-2 == cc) return TOK_MALLOC_ERROR;
+	} while (CC_QUOTE == cc);
+
+	return TOK_LABEL;
+}
+
+/* Scans an unquoted label. Like the Flex scanner, we accept spaces inside
+ * labels (but not at their ends), and convert them to underscores. */
+
+static enum token scan_unquoted(struct newick_stream *s)
+{
+	for (;;) {
+		int cc;
+		/* this is the inner loop of the whole parser, hence the local
+		 * variables */
+		do {
+			const unsigned char *buf = (unsigned char *) s->buf;
+			size_t pos = s->pos, len = s->len;
+			while (pos < len && CC_LABEL == char_class[buf[pos]])
+				pos++;
+			s->pos = pos;
+			cc = peek_class(s);
+		} while (CC_LABEL == cc);
+		if (-2 == cc) return TOK_MALLOC_ERROR;
+		if (CC_SPACE != cc || ' ' != s->buf[s->pos]) break;
+
+		/* See if the spaces are followed by more of the label. The
+		 * buffer may be refilled meanwhile, so work relative to the
+		 * token's start. */
+		size_t spaces = s->pos - s->tok_start;
+		while (' ' == s->buf[s->pos]) {
+			s->pos++;
+			cc = peek_class(s);
+			if (-2 == cc) return TOK_MALLOC_ERROR;
+			if (-1 == cc) break;
+		}
+		spaces += s->tok_start;
+		if (CC_LABEL != cc) {
+			s->pos = spaces;
+			break;
+		}
+		size_t i;
+		for (i = spaces; i < s->pos; i++) s->buf[i] = '_';
+		fprintf(stderr, "WARNING: spaces found in label at line %d - "
+				"converting to underscores.\n", s->lineno);
+	}
+
+	return TOK_LABEL;
+}
+
+/* Handles all cases of next_token(), below. */
+
+static enum token next_token_slow(struct newick_stream *s)
+{
+	for (;;) {
+		int cc = peek_class(s);
+		switch (cc) {
+		case -2:
+			return TOK_MALLOC_ERROR;
+		case -1:
+			return TOK_EOF;
+		case CC_NEWLINE:
+			s->lineno++;
+			/* fall through */
+		case CC_SPACE:
+		case CC_OTHER:
+			s->pos++;
+			continue;
+		case CC_COMMENT:
+			do {
+				s->pos++;
+				cc = peek_class(s);
+				if (CC_NEWLINE == cc) s->lineno++;
+			} while (cc >= 0 && ']' != s->buf[s->pos]);
+			if (-2 == cc) return TOK_MALLOC_ERROR;
+			if (-1 == cc) return TOK_EOF;
+			s->pos++;
+			continue;
+		case CC_PUNCT:
+			switch (s->buf[s->pos++]) {
+			case '(': return TOK_O_PAREN;
+			case ')': return TOK_C_PAREN;
+			case ',': return TOK_COMMA;
+			case ':': return TOK_COLON;
+			default: return TOK_SEMICOLON;
+			}
+		case CC_QUOTE:
+			s->tok_start = s->pos;
+			return scan_quoted(s);
+		default:	/* CC_LABEL */
+			s->tok_start = s->pos;
+			return scan_unquoted(s);
+		}
+	}
+}
+
+/* Returns the next token. For labels, s->tok_start is the offset of the
+ * token's first byte, and s->pos is just past its last byte. The common
+ * cases, a punctuation mark or a label that does not reach the end of the
+ * buffer, are handled here, and the rest in next_token_slow(). */
+
+static inline enum token next_token(struct newick_stream *s)
+{
+	const unsigned char *buf = (unsigned char *) s->buf;
+	size_t pos = s->pos, len = s->len;
+	if (pos < len) {
+		switch (buf[pos]) {
+		case '(': s->pos = pos + 1; return TOK_O_PAREN;
+		case ')': s->pos = pos + 1; return TOK_C_PAREN;
+		case ',': s->pos = pos + 1; return TOK_COMMA;
+		case ':': s->pos = pos + 1; return TOK_COLON;
+		case ';': s->pos = pos + 1; return TOK_SEMICOLON;
+		}
+		size_t start = pos;
+		while (pos < len && CC_LABEL == char_class[buf[pos]])
+			pos++;
+		if (pos > start && pos < len && ' ' != buf[pos]) {
+			s->tok_start = start;
+			s->pos = pos;
+			return TOK_LABEL;
+		}
+	}
+	return next_token_slow(s);
+}
+
+/* Returns the pending token starting at 'offset', '\0'-terminated, or "" if
+ * there is none. */
+
+static char *token_text(struct newick_stream *s, size_t offset, size_t len)
+{
+	if (NO_TOKEN == offset) return "";
+	s->buf[offset + len] = '\0';
+	return s->buf + offset;
+}
+
+/* Sends the pending leaf or clade end, and clears the pending tokens. */
+
+static void send_node(struct newick_stream *s, struct newick_handlers *h,
+		bool is_leaf)
+{
+	void (*callback)(void *, char *, char *) =
+		is_leaf ? h->leaf : h->close_clade;
+	PROFILE_NODES(1);
+	if (NULL != callback)
+		callback(h->param, token_text(s, s->label, s->label_len),
+			token_text(s, s->length, s->length_len));
+	s->label = s->length = NO_TOKEN;
+}
+
+static enum parser_status_type syntax_error(struct newick_stream *s,
+		enum token tok)
+{
+	if (TOK_MALLOC_ERROR == tok) return PARSER_STATUS_MALLOC_ERROR;
+	if (TOK_EOF == tok)
+		fprintf(stderr, "ERROR: missing ';' at end of tree, line %d\n",
+				s->lineno);
+	else
+		fprintf(stderr, "ERROR: Syntax error at line %d\n", s->lineno);
+
+	/* skip the rest of the tree */
+	s->label = s->length = s->tok_start = NO_TOKEN;
+	while (TOK_SEMICOLON != tok && TOK_EOF != tok) {
+		tok = next_token(s);
+		s->tok_start = NO_TOKEN;
+		if (TOK_MALLOC_ERROR == tok) return PARSER_STATUS_MALLOC_ERROR;
+	}
+	return PARSER_STATUS_PARSE_ERROR;
+}
+
+/* The grammar is that of newick_parser.y. Since a clade's label comes after
+ * its closing parenthesis, we only need to know the nesting depth. */
+
+static enum parser_status_type parse_events(struct newick_stream *s,
+		struct newick_handlers *h)
+{
+	enum token tok = next_token(s);
+	if (TOK_EOF == tok) return PARSER_STATUS_EMPTY;
+
+	int depth = 0;
+	for (;;) {
+		/* a node starts here */
+		bool is_leaf = true;
+		while (TOK_O_PAREN == tok) {
+			if (NULL != h->open_clade) h->open_clade(h->param);
+			depth++;
+			tok = next_token(s);
+		}
+		for (;;) {
+			/* label and length of a leaf or clade */
+			if (TOK_LABEL == tok) {
+				s->label = s->tok_start;
+				s->label_len = s->pos - s->tok_start;
+				tok = next_token(s);
+			}
+			if (TOK_COLON == tok) {
+				tok = next_token(s);
+				if (TOK_LABEL != tok)
+					return syntax_error(s, tok);
+				s->length = s->tok_start;
+				s->length_len = s->pos - s->tok_start;
+				tok = next_token(s);
+			}
+			s->tok_start = NO_TOKEN;
+			send_node(s, h, is_leaf);
+
+			if (TOK_C_PAREN != tok) break;
+			if (0 == depth) return syntax_error(s, tok);
+			depth--;
+			is_leaf = false;
+			tok = next_token(s);
+		}
+		if (TOK_COMMA == tok && depth > 0) {
+			tok = next_token(s);
+			continue;
+		}
+		if (TOK_SEMICOLON == tok && 0 == depth) break;
+		return syntax_error(s, tok);
+	}
+	if (NULL != h->end_tree) h->end_tree(h->param);
+
+	return PARSER_STATUS_OK;
+}
+
+enum parser_status_type parse_newick_events(struct newick_stream *s,
+		struct newick_handlers *h)
+{
+	PROFILE_START(PROFILE_EVENTS);
+	enum parser_status_type status = parse_events(s, h);
+	PROFILE_END(PROFILE_EVENTS);
+	if (PARSER_STATUS_OK == status) PROFILE_TREES(1);
+	return status;
+}
@@ -0,0 +1,79 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/** \file
+ * Event-driven Newick parsing. Instead of building a tree of rnodes, the
+ * parser calls a function for each clade opening, leaf, clade closing, and
+ * tree end, in input order. Memory use does not depend on tree size, so this
+ * suits programs that only need labels, lengths or counts: they can handle
+ * the largest trees at the speed at which they can be read. The lexical rules
+ * are the same as for parse_tree(). */
+
+#include <stdio.h>
+
+#include "parser.h"
+
+struct newick_stream;
+
+/** The callbacks. Any of them may be NULL. 'label' and 'length' are "" when
+ * absent. They point into the stream's buffer: they are only valid during
+ * the call, but may be modified in place (e.g. truncated). */
+
+struct newick_handlers {
+	/** An opening parenthesis */
+	void (*open_clade)(void *param);
+	/** A leaf, with its label and the length of its parent edge */
+	void (*leaf)(void *param, char *label, char *length);
+	/** A closing parenthesis, with the clade's label and length */
+	void (*close_clade)(void *param, char *label, char *length);
+	/** The terminating semicolon */
+	void (*end_tree)(void *param);
+	/** Passed to all callbacks */
+	void *param;
+};
+
+/** Creates a stream that reads Newick from 'in'. Returns NULL in case of
+ * malloc() problems. */
+
+struct newick_stream *create_newick_stream(FILE *in);
+
+/** Parses the next tree from 'stream', calling the handlers as it goes.
+ * Returns PARSER_STATUS_OK after a complete tree, PARSER_STATUS_EMPTY if
+ * there are no more trees, or PARSER_STATUS_PARSE_ERROR if the tree is
+ * malformed (an error message is printed, and the rest of the tree is
+ * skipped; events for the part before the error will have been sent), or
+ * PARSER_STATUS_MALLOC_ERROR if a label too long for the buffer could not be
+ * accommodated. Read errors are fatal, as with parse_tree(). */
+
+enum parser_status_type parse_newick_events(struct newick_stream *stream,
+		struct newick_handlers *handlers);
+
+/** Frees the stream (but does not close its FILE) */
+
+void destroy_newick_stream(struct newick_stream *stream);
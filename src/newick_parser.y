@@ -43,7 +43,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * grammar is unambiguous. According to the test suite, Bison resolves the
  * conflicts correctly anyway. */
 
-#define YYMAXDEPTH 100000
+/* Bison's stack grows by one entry per open clade, and its default limit of
+ * 10000 entries would reject deeply nested trees (e.g. caterpillars). The
+ * stack is heap-allocated and doubles as needed, so memory is the only
+ * practical limit. */
+
+#define YYMAXDEPTH 1000000000
 
 extern struct llist *nodes_in_order;
 extern struct rnode *root;
@@ -29,6 +29,12 @@ import os
 from ctypes import *
 from ctypes.util import find_library
 
+# NumPy is only needed for TreeArrays
+try:
+	import numpy
+except ImportError:
+	numpy = None
+
 ################################################################
 # Find and load library -- NOTE: the lib must have been installed (make
 # install)
@@ -71,20 +77,72 @@ class hash(Structure):
 
 class rnode(Structure):
 	pass
-rnode._fields_ = [('parent', POINTER(rnode)),
+rnode._fields_ = [('label', c_char_p),
+		  ('label_id', c_int),
 		  ('edge_length_as_string', c_char_p),
 		  ('edge_length', c_double),
-		  ('children', POINTER(llist)),
-		  ('label', c_char_p),
-		  ('data', c_void_p)]
+		  ('length_parsed', c_bool),
+		  ('data', c_void_p),
+		  ('parent', POINTER(rnode)),
+		  ('next_sibling', POINTER(rnode)),
+		  ('child_count', c_int),
+		  ('first_child', POINTER(rnode)),
+		  ('last_child', POINTER(rnode)),
+		  ('current_child', POINTER(rnode)),
+		  ('seen', c_bool),
+		  ('linked', c_bool)]
 
 class rooted_tree(Structure):
 	_fields_ = [('root', POINTER(rnode)),
-		    ('nodes_in_order', POINTER(llist))]
+		    ('nodes_in_order', POINTER(llist)),
+		    ('type', c_int)]
+
+# tree_arrays.h - only the public members
+class tree_arrays(Structure):
+	_fields_ = [('node_count', c_int),
+		    ('tree_count', c_int),
+		    ('tree_offsets', POINTER(c_int)),
+		    ('tree', POINTER(c_int)),
+		    ('parent', POINTER(c_int)),
+		    ('child_offsets', POINTER(c_int)),
+		    ('children', POINTER(c_int)),
+		    ('edge_length', POINTER(c_double)),
+		    ('depth', POINTER(c_double)),
+		    ('label_offsets', POINTER(c_int)),
+		    ('labels', c_void_p)]
+
+# Arrow C data interface
+class ArrowSchema(Structure):
+	pass
+ArrowSchema._fields_ = [('format', c_char_p),
+			('name', c_char_p),
+			('metadata', c_char_p),
+			('flags', c_int64),
+			('n_children', c_int64),
+			('children', POINTER(POINTER(ArrowSchema))),
+			('dictionary', POINTER(ArrowSchema)),
+			('release', c_void_p),
+			('private_data', c_void_p)]
+
+class ArrowArray(Structure):
+	pass
+ArrowArray._fields_ = [('length', c_int64),
+		       ('null_count', c_int64),
+		       ('offset', c_int64),
+		       ('n_buffers', c_int64),
+		       ('n_children', c_int64),
+		       ('buffers', POINTER(c_void_p)),
+		       ('children', POINTER(POINTER(ArrowArray))),
+		       ('dictionary', POINTER(ArrowArray)),
+		       ('release', c_void_p),
+		       ('private_data', c_void_p)]
 
 ################################################################
 # C enums mapped to Python constants
 
+# common.h
+(FAILURE, SUCCESS) = (0, 1)
+
 # tree.h
 (TREE_TYPE_UNKNOWN, TREE_TYPE_CLADOGRAM, TREE_TYPE_PHYLOGRAM,
 		TREE_TYPE_NEITHER) = xrange(4)
@@ -113,6 +171,10 @@ libnw.dump_newick.restype = None
 
 libnw.is_leaf.argtypes = [POINTER(rnode)]
 libnw.children_count.argtypes = [POINTER(rnode)]
+libnw.has_edge_length.argtypes = [POINTER(rnode)]
+libnw.has_edge_length.restype = c_bool
+libnw.get_edge_length.argtypes = [POINTER(rnode)]
+libnw.get_edge_length.restype = c_double
 
 libnw.lca_from_labels_multi.argtypes = [POINTER(rooted_tree), POINTER(llist)]
 libnw.lca_from_labels_multi.restype = POINTER(rnode)
@@ -123,9 +185,29 @@ libnw.reroot_tree.argtypes = [POINTER(rooted_tree), POINTER(rnode)]
 libnw.create_label2node_map.argtypes = [POINTER(llist)]
 libnw.create_label2node_map.restype = POINTER(hash)
 
+libnw.create_tree_arrays.restype = POINTER(tree_arrays)
+libnw.tree_arrays_append.argtypes = [POINTER(tree_arrays),
+		POINTER(rooted_tree)]
+libnw.parse_tree_arrays.argtypes = [c_int]
+libnw.parse_tree_arrays.restype = POINTER(tree_arrays)
+libnw.destroy_tree_arrays.argtypes = [POINTER(tree_arrays)]
+libnw.destroy_tree_arrays.restype = None
+libnw.export_tree_arrays_arrow.argtypes = [POINTER(tree_arrays),
+		POINTER(ArrowSchema), POINTER(ArrowArray)]
+
 ################################################################
 # User-land Python classes
 
+def set_parser_input(source, type):
+	'''Sets the parser's input: a file (stdin if 'source' is empty) if
+	'type' is 'filename', or the string 'source' if 'type' is 'string'.'''
+	if type == 'filename': 
+		if source != '':	# a named file; otherwise uses stdin
+			libnw.set_parser_input_filename(source)
+	elif type == 'string':
+		libnw.newick_scanner_set_string_input(source)
+	else:
+		raise RuntimeError("Unknown type '%s'" % type)
 
 class Llist(object):
 
@@ -191,11 +273,10 @@ class Rnode(object):
 
 	def get_edge_length(self):
 		if not hasattr(self, 'edge_length'):
-			edge_length = self.rnode.edge_length_as_string
-			if edge_length == '':
-				self.edge_length = None
+			if libnw.has_edge_length(self.rnode):
+				self.edge_length = libnw.get_edge_length(self.rnode)
 			else:
-				self.edge_length = float(edge_length)
+				self.edge_length = None
 		return self.edge_length
 	
 	def is_leaf(self):
@@ -216,14 +297,7 @@ class Tree(object):
 			# parse a string:
 			parse_newick_input('((A,B),C);', type='string')
 		'''
-		# Set input source
-		if type == 'filename': 
-			if source != '':	# a named file; otherwise uses stdin
-				libnw.set_parser_input_filename(source)
-		elif type == 'string':
-			libnw.newick_scanner_set_string_input(source)
-		else:
-			raise RuntimeError("Unknown type '%s'" % type)
+		set_parser_input(source, type)
 		# Yield trees
 		while True:
 			tree = libnw.parse_tree()
@@ -257,6 +331,18 @@ class Tree(object):
 		'''Dumps the tree as Newick to stdout (fast)'''
 		libnw.dump_newick(self.tree.root)
 
+	def to_arrays(self):
+		'''Returns a TreeArrays holding this tree, for fast processing with
+		NumPy or Arrow (get_nodes() and friends make a ctypes call for
+		every node and field).'''
+		c_arrays = libnw.create_tree_arrays()
+		if not bool(c_arrays):
+			raise MemoryError
+		arrays = TreeArrays(c_arrays)
+		if libnw.tree_arrays_append(c_arrays, self.tree) == FAILURE:
+			raise MemoryError
+		return arrays
+
 	def get_nodes(self):
 		'''Returns an iterator over all the tree's nodes, in post-order'''
 		nodes_in_order = Llist(self.tree.nodes_in_order.contents)
@@ -344,3 +430,112 @@ class Tree(object):
 			if label not in self.label2nodes:
 				self.label2nodes[label] = []
 			self.label2nodes[label].append(node)
+
+class _ArraysOwner(object):
+
+	'''Owns a C tree_arrays structure, and frees it when the last NumPy array
+	made from it goes away (NumPy arrays keep a reference to it through
+	_ArrayView).'''
+
+	def __init__(self, c_arrays_p):
+		self.c_arrays_p = c_arrays_p
+
+	def __del__(self):
+		libnw.destroy_tree_arrays(self.c_arrays_p)
+
+class _ArrayView(object):
+
+	'''Exposes a C array to NumPy without copying it.'''
+
+	def __init__(self, owner, address, count, typestr):
+		self.owner = owner
+		self.__array_interface__ = {
+				'data': (address, False),
+				'shape': (count,),
+				'typestr': typestr,
+				'version': 3 }
+
+class TreeArrays(object):
+
+	'''A columnar copy of one or more trees, with one entry per node (see
+	tree_arrays.h for details). Nodes are numbered in preorder across all
+	trees. The columns are NumPy arrays that share memory with the C
+	structure, so they cost no copying:
+		tree_offsets	nodes of tree t: tree_offsets[t] to tree_offsets[t+1]-1
+		tree		tree of each node
+		parent		parent of each node, -1 for roots
+		child_offsets	children of node i: children[child_offsets[i]] to
+		children	  children[child_offsets[i+1]-1]
+		edge_length	NaN if undefined
+		depth		distance from the root
+		label_offsets	label of node i: labels[label_offsets[i]] to
+		labels		  labels[label_offsets[i+1]-1] (bytes, uint8)
+	The table can also be exported to Arrow, see to_arrow().'''
+
+	@classmethod
+	def parse_newick_input(cls, source='', type='filename', max_trees=0):
+		'''Parses up to 'max_trees' trees (all of them if 0) into a single
+		TreeArrays. The arguments are those of Tree.parse_newick_input().
+		This is much faster than parsing Tree objects and calling
+		to_arrays() on each.'''
+		set_parser_input(source, type)
+		c_arrays = libnw.parse_tree_arrays(max_trees)
+		if not bool(c_arrays):
+			raise MemoryError
+		return TreeArrays(c_arrays)
+
+	def __init__(self, c_arrays_p):
+		'''Do not call this function directly. Use
+		TreeArrays.parse_newick_input() or Tree.to_arrays().'''
+		self.owner = _ArraysOwner(c_arrays_p)
+
+	def __getattr__(self, name):
+		# The C arrays may be reallocated until the table is complete, so
+		# the views are only made on first use.
+		if numpy is None:
+			raise ImportError('NumPy is needed for TreeArrays columns')
+		arrays = self.owner.c_arrays_p.contents
+		n = arrays.node_count
+		sizes = {
+				'tree_offsets': (arrays.tree_count + 1, '<i4'),
+				'tree': (n, '<i4'),
+				'parent': (n, '<i4'),
+				'child_offsets': (n + 1, '<i4'),
+				'children': (n - arrays.tree_count, '<i4'),
+				'edge_length': (n, '<f8'),
+				'depth': (n, '<f8'),
+				'label_offsets': (n + 1, '<i4'),
+				'labels': (arrays.label_offsets[n], '|u1') }
+		if name not in sizes:
+			raise AttributeError(name)
+		count, typestr = sizes[name]
+		address = cast(getattr(arrays, name), c_void_p).value
+		column = numpy.asarray(_ArrayView(self.owner, address, count,
+			typestr))
+		column.flags.writeable = False
+		setattr(self, name, column)
+		return column
+
+	def __len__(self):
+		return self.owner.c_arrays_p.contents.node_count
+
+	def get_tree_count(self):
+		return self.owner.c_arrays_p.contents.tree_count
+
+	def get_label(self, i):
+		'''Returns the label of node 'i' (as bytes).'''
+		offsets = self.label_offsets
+		return self.labels[offsets[i]:offsets[i+1]].tobytes()
+
+	def to_arrow(self):
+		'''Returns a pyarrow RecordBatch with one row per node and the
+		columns tree, parent, children (a list of node indices),
+		edge_length, depth and label. The data are not copied.'''
+		import pyarrow
+		schema = ArrowSchema()
+		array = ArrowArray()
+		if libnw.export_tree_arrays_arrow(self.owner.c_arrays_p,
+				byref(schema), byref(array)) == FAILURE:
+			raise MemoryError
+		return pyarrow.RecordBatch._import_from_c(addressof(array),
+				addressof(schema))
@@ -93,10 +93,8 @@ struct h_data set_node_depth_cb(struct rooted_tree *tree,
 	/* set the root's depth */
 	elem = nodes_in_reverse_order->head;
 	node = (struct rnode *) elem->data;
-	if (0 == strcmp("", node->edge_length_as_string))
-		set_node_depth(node, 0.0);
-	else
-		set_node_depth(node, atof(node->edge_length_as_string));
+	/* an empty length counts as 0 */
+	set_node_depth(node, get_edge_length(node));
 
 	/* now traverse node list, setting each node's depth to the sum of its
 	 * parent edge's length and its parent node's depth. */
@@ -105,12 +103,10 @@ struct h_data set_node_depth_cb(struct rooted_tree *tree,
 		node =  elem->data;
 		struct rnode *parent_node = node->parent;
 
-		if (0 == strcmp("", node->edge_length_as_string))
-			node->edge_length = 1.0;
-		else
-			node->edge_length = atof(node->edge_length_as_string);
+		double edge_length = has_edge_length(node) ?
+			get_edge_length(node) : 1.0;
 
-		double node_depth = node->edge_length +
+		double node_depth = edge_length +
 			get_node_depth(parent_node);
 
 		set_node_depth(node, node_depth);
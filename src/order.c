@@ -33,7 +33,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
 
 #include "tree.h"
 #include "parser.h"
@@ -41,8 +40,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "list.h"
 #include "rnode.h"
 #include "order_tree.h"
+#include "profile.h"
+#include "compressed_io.h"
 
-enum order_criterion { ORDER_ALNUM_LBL, ORDER_NUM_DESCENDANTS, ORDER_DELADDERIZE };
 enum sort_order { ORDER_DIRECT, ORDER_REVERSE };
 
 struct parameters {
@@ -58,7 +58,7 @@ void help (char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-c:hn] <newick trees filename|->\n"
+"%s [-c:hnz:] <newick trees filename|->\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -87,6 +87,9 @@ void help (char *argv[])
 "        those with more)\n"
 "        The default (i.e., if option -c is not given) is 'a'.\n"
 "    -h: print this message and exit\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -112,22 +115,6 @@ void help (char *argv[])
 	       );
 }
 
-int get_criterion(char *optarg)
-{
-	switch (optarg[0]) {
-	case 'a':
-		return ORDER_ALNUM_LBL;
-	case 'd':
-		return ORDER_DELADDERIZE;
-	case 'n':
-		return ORDER_NUM_DESCENDANTS;
-	default:
-		fprintf(stderr, "WARNING: unrecognized option '%s', defaulting to 'a'\n",
-				optarg);
-	}
-	return ORDER_ALNUM_LBL;
-}
-
 struct parameters get_params(int argc, char *argv[])
 {
 
@@ -135,17 +122,24 @@ struct parameters get_params(int argc, char *argv[])
 	params.criterion = ORDER_ALNUM_LBL;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "c:hr")) != -1) {
+	while ((opt_char = getopt(argc, argv, "c:hrz:")) != -1) {
 		switch (opt_char) {
 		case 'h':
 			help(argv);
 			exit(EXIT_SUCCESS);
 		case 'c':
-			params.criterion = get_criterion(optarg);
+			params.criterion = get_order_criterion(optarg);
 			break;
 		case 'r':
 			params.order = ORDER_REVERSE;
 			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
 			exit (EXIT_FAILURE);
@@ -155,7 +149,7 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -171,35 +165,15 @@ struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
-/* Counts the number of descendants of the tree, using the data pointer of each
- * node. */
-
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params = get_params(argc, argv);
-	int (*comparator)(const void*,const void*);
-	int (*sort_field_setter)(struct rnode *);
-
-	switch(params.criterion) {
-	case ORDER_ALNUM_LBL:
-		comparator = lbl_comparator;
-		sort_field_setter = set_sort_field_label;
-		break;
-	case ORDER_DELADDERIZE:
-		comparator = num_desc_deladderize;
-		sort_field_setter = set_sort_field_num_desc;
-		break;
-	case ORDER_NUM_DESCENDANTS:
-		comparator = num_desc_comparator;
-		sort_field_setter = set_sort_field_num_desc;
-		break;
-	default:
-		assert(0); // programmer error
-	}
 
 	while (NULL != (tree = parse_tree())) {
-		if (! order_tree (tree, comparator, sort_field_setter)) {
+		if (! order_tree(tree, params.criterion)) {
 			perror(NULL);
 			exit(EXIT_FAILURE);
 		}
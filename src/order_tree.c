@@ -25,7 +25,6 @@ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
 CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
 */
 /* order_tree.c - do not confuse with order.c, which is the ordering program.
  * This is just the implementation of functions used by it (and others, which
@@ -33,65 +32,43 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "rnode.h"
 #include "tree.h"
 #include "list.h"
-#include "link.h"
 #include "common.h"
 #include "order_tree.h"
 
-int order_tree(struct rooted_tree *tree,
-		int (*comparator)(const void*,const void*),
-		int (*sort_field_setter)(struct rnode *))
-{
-	struct list_elem *elem;
-
-	/* the rnode->data member is used to store the sort field. This is set
-	 * by the set_sort_field_num_desc callback.*/
-
-	for (elem=tree->nodes_in_order->head; NULL!=elem; elem=elem->next) {
-		struct rnode *current = elem->data;
-		if (is_leaf(current)) {
-			sort_field_setter(current);
-		} else {
-			/* Since all children have been visited (because we're
-			 * traversing the tree in postorder), we can
-			 * just order the children on their sort field. */
-			struct rnode ** kids_array;
-			int count = current->child_count;
-			kids_array = (struct rnode **)
-				children_array(current);
-			if (NULL == kids_array) return FAILURE;
+/* Nodes with at most this many children are sorted by insertion sort, others
+ * are passed to qsort(). */
 
-			qsort(kids_array, count, sizeof(struct rnode *),
-					comparator);
+#define INSERTION_SORT_MAX 16
 
-			remove_children(current);
-			int i;
-			for (i = 0; i < count; i++)
-				add_child(current, kids_array[i]);
-			current->last_child->next_sibling = NULL;
+/* A node and its sort field. The field is either a pointer to a label (no
+ * copy is made) or a number of descendants, depending on the criterion. */
 
-			sort_field_setter(current);
-			free(kids_array);
-		}
-	}
+struct sort_entry {
+	struct rnode *node;
+	union {
+		char *label;
+		int num_desc;
+	} key;
+};
 
-	return SUCCESS;
-}
+/* Comparators. These are passed to qsort(), and called directly by the
+ * insertion sort. */
 
-int order_tree_lbl(struct rooted_tree *tree)
+static int lbl_comparator(const void *a, const void *b)
 {
-	return order_tree(tree, lbl_comparator, set_sort_field_label);
+	return strcmp(((struct sort_entry *) a)->key.label,
+			((struct sort_entry *) b)->key.label);
 }
 
-int num_desc_comparator(const void *a, const void *b)
+static int num_desc_comparator(const void *a, const void *b)
 {
-	struct rnode *rnode_a = *((struct rnode **) a);
-	struct rnode *rnode_b = *((struct rnode **) b);
-	int a_num_desc = *((int *) rnode_a->data);
-	int b_num_desc = *((int *) rnode_b->data);
+	int a_num_desc = ((struct sort_entry *) a)->key.num_desc;
+	int b_num_desc = ((struct sort_entry *) b)->key.num_desc;
 
 	if (a_num_desc > b_num_desc)
 		return 1;
@@ -100,86 +77,160 @@ int num_desc_comparator(const void *a, const void *b)
 	return 0;
 }
 
-int num_desc_deladderize(const void *a, const void *b)
+/* This comparator is like num_desc_comparator(), but it reverses the
+ * comparison every two nodes, breaking any ladder. */
+
+static int num_desc_deladderize(const void *a, const void *b)
 {
-	static int orientation = -1;
+	/* per thread, as nw_pipe orders several trees at once */
+	static __thread int orientation = -1;
 
 	/* This changes sign at every invocation, therefore one call considers
 	 * a heavy node greater than a light node (in terms of number of
 	 * descendants), but the next call does the opposite. */
 	orientation *= -1;
 
-	struct rnode *rnode_a = *((struct rnode **) a);
-	struct rnode *rnode_b = *((struct rnode **) b);
-	int a_num_desc = *((int *) rnode_a->data);
-	int b_num_desc = *((int *) rnode_b->data);
-
-	if (a_num_desc > b_num_desc)
-		return orientation;
-	if (a_num_desc < b_num_desc)
-		return -orientation;
-	return 0;
+	return orientation * num_desc_comparator(a, b);
 }
 
-int lbl_comparator(const void *a, const void *b)
-{
-	/* I really have trouble understanding how qsort() passes the
-	 * comparands to the comparator... but thanks to GDB I figured out this
-	 * one. */	
-	char *a_lbl = (*(struct rnode **)a)->data;
-	char *b_lbl = (*(struct rnode **)b)->data;
-
-	int cmp = strcmp(a_lbl, b_lbl);
-	// printf ("%s <=> %s: %d\n", a_lbl, b_lbl, cmp);
-
-	return cmp;
-}
+/* Stable, and faster than qsort() for the small arrays that make up the vast
+ * majority of sibling sets. */
 
-int order_tree_num_desc(struct rooted_tree *tree)
+static void insertion_sort(struct sort_entry *entries, int count,
+		int (*comparator)(const void*,const void*))
 {
-	return order_tree(tree, num_desc_comparator, set_sort_field_num_desc);
+	int i, j;
+	for (i = 1; i < count; i++) {
+		struct sort_entry entry = entries[i];
+		for (j = i; j > 0 && comparator(&entries[j-1], &entry) > 0; j--)
+			entries[j] = entries[j-1];
+		entries[j] = entry;
+	}
 }
 
-int order_tree_deladderize(struct rooted_tree *tree)
+/* Makes the nodes in 'kids' (which must be all of 'parent''s children) the
+ * children of 'parent', in array order. */
+
+static void relink_children(struct rnode *parent, struct sort_entry *kids,
+		int count)
 {
-	return order_tree(tree, num_desc_deladderize, set_sort_field_num_desc);
+	int i;
+	parent->first_child = kids[0].node;
+	for (i = 1; i < count; i++)
+		kids[i-1].node->next_sibling = kids[i].node;
+	kids[count-1].node->next_sibling = NULL;
+	parent->last_child = kids[count-1].node;
 }
 
-int set_sort_field_label(struct rnode *node)
+/* The nodes are visited in postorder, and their sort entries are kept on a
+ * stack. When an inner node with n children is visited, the top n entries
+ * of the stack are those of its children, in order: they are sorted and
+ * replaced by the node's own entry. The stack is the only memory allocated,
+ * and it is reused for all nodes. */
+
+int order_tree(struct rooted_tree *tree, enum order_criterion criterion)
 {
-	/* If the node has a non-empty label, or if it is a leaf (or both), we
-	 * just use the label as sort field. Otherwise, we use the first
-	 * child's sort field.  */
+	int (*comparator)(const void*,const void*);
+	switch (criterion) {
+	case ORDER_ALNUM_LBL:
+		comparator = lbl_comparator;
+		break;
+	case ORDER_NUM_DESCENDANTS:
+		comparator = num_desc_comparator;
+		break;
+	case ORDER_DELADDERIZE:
+		comparator = num_desc_deladderize;
+		break;
+	default:
+		return FAILURE;
+	}
 
-	if (is_leaf(node) || (strcmp(node->label, "") != 0))
-		node->data = strdup(node->label);
-	else 
-		node->data = strdup((char *) node->first_child->data);
+	int stack_size = 64;
+	int top = 0;	/* number of entries on the stack */
+	struct sort_entry *stack = malloc(stack_size * sizeof(struct sort_entry));
+	if (NULL == stack) return FAILURE;
 
-	if (NULL == node->data)
-		return FAILURE;
+	struct list_elem *elem;
+	for (elem=tree->nodes_in_order->head; NULL!=elem; elem=elem->next) {
+		struct rnode *current = elem->data;
+		struct sort_entry entry;
+		entry.node = current;
+
+		if (is_leaf(current)) {
+			if (ORDER_ALNUM_LBL == criterion)
+				entry.key.label = current->label;
+			else
+				entry.key.num_desc = 1;	/* counts as one */
+		} else {
+			/* Since all children have been visited (because we're
+			 * traversing the tree in postorder), their entries
+			 * are on top of the stack. */
+			int count = current->child_count;
+			struct sort_entry *kids = stack + top - count;
+			if (count <= INSERTION_SORT_MAX)
+				insertion_sort(kids, count, comparator);
+			else
+				qsort(kids, count, sizeof(struct sort_entry),
+						comparator);
+			relink_children(current, kids, count);
+
+			if (ORDER_ALNUM_LBL == criterion) {
+				/* Unlabeled inner nodes use their first
+				 * child's sort field. */
+				if (strcmp(current->label, "") != 0)
+					entry.key.label = current->label;
+				else
+					entry.key.label = kids[0].key.label;
+			} else {
+				int i, sum = 0;
+				for (i = 0; i < count; i++)
+					sum += kids[i].key.num_desc;
+				entry.key.num_desc = sum;
+			}
+			top -= count;
+		}
 
+		if (top == stack_size) {
+			stack_size *= 2;
+			struct sort_entry *new_stack = realloc(stack,
+					stack_size * sizeof(struct sort_entry));
+			if (NULL == new_stack) { free(stack); return FAILURE; }
+			stack = new_stack;
+		}
+		stack[top++] = entry;
+	}
+
+	free(stack);
 	return SUCCESS;
 }
 
-int set_sort_field_num_desc(struct rnode *node)
+int order_tree_lbl(struct rooted_tree *tree)
 {
+	return order_tree(tree, ORDER_ALNUM_LBL);
+}
 
-	/* node's descendant count is 1 + the sum of the descendant counts of
-	 * its children */
+int order_tree_num_desc(struct rooted_tree *tree)
+{
+	return order_tree(tree, ORDER_NUM_DESCENDANTS);
+}
 
-	node->data = malloc(sizeof(int));
-	if (NULL == node->data) return FAILURE;
+int order_tree_deladderize(struct rooted_tree *tree)
+{
+	return order_tree(tree, ORDER_DELADDERIZE);
+}
 
-	if (is_leaf(node)) {
-		*((int *) node->data) = 1;	/* counts as one */
-	} else {
-		int sum = 0;
-		struct rnode *kid = node->first_child;
-		for(; NULL != kid; kid = kid->next_sibling)
-			sum += *((int *) kid->data);
-		*((int *) node->data) = sum;
+enum order_criterion get_order_criterion(const char *arg)
+{
+	switch (arg[0]) {
+	case 'a':
+		return ORDER_ALNUM_LBL;
+	case 'd':
+		return ORDER_DELADDERIZE;
+	case 'n':
+		return ORDER_NUM_DESCENDANTS;
+	default:
+		fprintf(stderr, "WARNING: unrecognized option '%s', defaulting to 'a'\n",
+				arg);
 	}
-
-	return SUCCESS;
+	return ORDER_ALNUM_LBL;
 }
@@ -25,48 +25,36 @@ SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
 CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
-
 */
 /* order_tree.h: functions for ordering trees */
 
 struct rooted_tree;
 
+/* Ordering criteria */
+
+enum order_criterion { ORDER_ALNUM_LBL, ORDER_NUM_DESCENDANTS, ORDER_DELADDERIZE };
 
 int order_tree_lbl(struct rooted_tree *);
 int order_tree_num_desc(struct rooted_tree *);
-
-/* A general-purpose sort function. Arguments are a tree, a node comparator
- * function, and a sort field setter function. The comparator is used by
- * qsort() to sort the children of a node, and the setter function sets the
- * node's sort field once its children have been sorted. See also
- * order_tree_lbl() and order_tree_num_desc(), which are
+int order_tree_deladderize(struct rooted_tree *);
+
+/* A general-purpose sort function. Arguments are a tree and an ordering
+ * criterion. The children of every inner node are sorted on a sort field,
+ * which is: for ORDER_ALNUM_LBL, the node's label for leaves and labeled inner
+ * nodes, and the first child's sort field otherwise; for the other criteria,
+ * the node's number of descendant leaves (ORDER_NUM_DESCENDANTS puts nodes
+ * with fewer descendants first, ORDER_DELADDERIZE alternates). Sort fields are
+ * kept in a single scratch buffer (not in the nodes' 'data' member), and
+ * siblings are relinked in place. The tree's 'nodes_in_order' must be up to
+ * date; it is NOT updated (the order of the nodes changes, but not the
+ * topology). See also order_tree_lbl() and order_tree_num_desc(), which are
  * canned, easy-to-remember calls to this function. */
+/* Returns SUCCESS unless there was a memory problem. */
 
-int order_tree(struct rooted_tree *tree,
-		int (*comparator)(const void*,const void*),
-		int (*sort_field_setter)(struct rnode *));
-
-/* Comparators */
-
-/* This compares node labels. */
-
-int lbl_comparator(const void *, const void *);
-
-/* Idem, but for ordering children by increasing number of descendants. Node
- * data must point to an int that holds the number of descendants. */
-
-int num_desc_comparator(const void *a, const void *b);
-
-/* This comparator is like num_desc_comparator(), but it reverses the
- * comparison every two nodes, breaking any ladder. */
-
-int num_desc_deladderize(const void *a, const void *b);
-
-/* Sort field setters. These return SUCCESS unless there was a memory problem.
- * */
+int order_tree(struct rooted_tree *tree, enum order_criterion criterion);
 
-/* Sets a node's sort field as the label of its first child */
-int set_sort_field_label(struct rnode *);
+/* Returns the criterion for option argument 'arg': 'a' (ORDER_ALNUM_LBL),
+ * 'd' (ORDER_DELADDERIZE) or 'n' (ORDER_NUM_DESCENDANTS). Warns and defaults
+ * to ORDER_ALNUM_LBL for anything else. */
 
-/* Sets a node's sort field as the number of its descendants */
-int set_sort_field_num_desc(struct rnode *);
+enum order_criterion get_order_criterion(const char *arg);
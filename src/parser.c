@@ -35,6 +35,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "tree.h"
 #include "parser.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 struct llist *nodes_in_order;
 struct rnode *root;
@@ -45,14 +47,14 @@ int nwsparse();
 int set_parser_input_filename (char *filename)
 {
 	extern FILE *nwsin;
-	FILE *fin = fopen(filename, "r");
+	FILE *fin = open_input_file(filename);
 	if (NULL == fin) return FAILURE;
 	nwsin = fin;
 
 	return SUCCESS;
 }
 
-struct rooted_tree *parse_tree()
+static struct rooted_tree *parse()
 {
 	struct rooted_tree *tree;
 
@@ -71,6 +73,15 @@ struct rooted_tree *parse_tree()
 	/* calls the YACC (Bison, in fact) parser. This sets 'root' and
 	 * 'newick_parser_status'. */
 	nwsparse();
+
+	/* The Flex scanner stops the program on read errors, but let's not
+	 * count on it: an error must not look like the end of input (e.g.
+	 * with a truncated compressed file, see compressed_io.h). */
+	extern FILE *nwsin;
+	if (NULL == root && NULL != nwsin && ferror(nwsin)) {
+		fprintf(stderr, "Could not read input - aborting.\n");
+		exit(EXIT_FAILURE);
+	}
 	
 	if (NULL != root) {
 		tree->root = root;
@@ -85,3 +96,12 @@ struct rooted_tree *parse_tree()
 		return NULL;
 	}
 }
+
+struct rooted_tree *parse_tree()
+{
+	PROFILE_START(PROFILE_PARSE);
+	struct rooted_tree *tree = parse();
+	PROFILE_END(PROFILE_PARSE);
+	if (NULL != tree) PROFILE_TREES(1);
+	return tree;
+}
@@ -0,0 +1,707 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* nw_pipe - applies a chain of nw_* programs' processing to each tree, in
+ * memory */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "tree.h"
+#include "parser.h"
+#include "to_newick.h"
+#include "rnode.h"
+#include "list.h"
+#include "hash.h"
+#include "readline.h"
+#include "label_intern.h"
+#include "common.h"
+#include "order_tree.h"
+#include "prune_tree.h"
+#include "rename_map.h"
+#include "reroot_outgroup.h"
+#include "compressed_io.h"
+
+enum stage_type { STAGE_ORDER, STAGE_PRUNE, STAGE_RENAME, STAGE_REROOT,
+	STAGE_TOPOLOGY };
+
+struct rename_params {
+	struct id_map map;
+	bool only_leaves;
+};
+
+struct topology_params {
+	bool show_inner_labels;
+	bool show_leaf_labels;
+	bool show_branch_lengths;
+};
+
+/* A stage is one program's processing, with its options */
+
+struct stage {
+	enum stage_type type;
+	char *spec;	/* the words of the stage's argument point into this */
+	union {
+		enum order_criterion order;
+		struct prune_params prune;
+		struct rename_params rename;
+		struct reroot_params reroot;
+		struct topology_params topology;
+	} params;
+};
+
+struct parameters {
+	struct stage *stages;
+	int nb_stages;
+	int nb_threads;
+	FILE *input;
+};
+
+/* A batch is read before being processed, and freed after its trees are
+ * printed. Batches are kept small (a few trees per thread), since processing
+ * is much faster while the trees are still in the cache. */
+
+static const int BATCH_TREES_PER_THREAD = 16;
+static const int BATCH_NODES_PER_THREAD = 1 << 12;
+
+/* Rerooting creates an rnode, which is not thread-safe (see rnode.c), so
+ * reroot_tree() is called with this lock held. Finding the outgroup, which is
+ * most of the work, is done without it. */
+static pthread_mutex_t rnode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void help(char *argv[])
+{
+	printf (
+"Applies a chain of programs to trees, without re-parsing between them\n"
+"\n"
+"Synopsis\n"
+"--------\n"
+"\n"
+"%s [-ht:z:] <newick trees filename|-> <stage>+\n"
+"\n"
+"Input\n"
+"-----\n"
+"\n"
+"First argument is the name of a file that contains Newick trees, or '-' (in\n"
+"which case trees are read from standard input).\n"
+"\n"
+"Each further argument is a stage, i.e. the name of a program (without\n"
+"'nw_'), followed by its options and arguments but without the input file,\n"
+"all in a single argument (so it must be quoted). The stages are:\n"
+"\n"
+"    'order [-c <criterion>]': see nw_order\n"
+"    'prune [-v] <label>+' or 'prune [-v] -f <label file>': see nw_prune\n"
+"    'rename [-l] <map file>' or 'rename [-l] <old> <new>': see nw_rename\n"
+"    'reroot [-dls] [<label>+]': see nw_reroot\n"
+"    'topology [-bIL]': see nw_topology\n"
+"\n"
+"Words in a stage are separated by whitespace, so labels cannot contain\n"
+"any (but see prune -f and rename's map file).\n"
+"\n"
+"Output\n"
+"------\n"
+"\n"
+"Each tree is parsed once, passed through the stages in order, and printed\n"
+"once. The output is the same as that of the corresponding pipeline of\n"
+"programs (e.g. 'nw_reroot - A | nw_order -'), but without parsing and\n"
+"printing the tree at every step. A tree that a stage rejects (e.g. one\n"
+"that cannot be rerooted) is not printed.\n"
+"\n"
+"Options\n"
+"-------\n"
+"\n"
+"    -h: print this message and exit\n"
+"    -t <int>: process trees with this many threads (default: 1). Trees are\n"
+"        still printed in input order, so this does not change the output,\n"
+"        except that 'order -c d' may then order trees differently (its\n"
+"        alternation carries over from one tree to the next).\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
+"\n"
+"Examples\n"
+"--------\n"
+"\n"
+"# Reroot on Cebus, drop humans, and make a cladogram, ordering the nodes\n"
+"$ %s data/catarrhini_wrong 'reroot Cebus' 'prune Homo' order topology\n"
+"\n"
+"# The same as\n"
+"$ nw_reroot data/catarrhini_wrong Cebus | nw_prune - Homo | nw_order - \\\n"
+"  | nw_topology -\n"
+"\n"
+"# Rename, then order by number of descendants, with 4 threads\n"
+"$ %s -t 4 data/falconiformes 'rename data/falc_map' 'order -c n'\n",
+	argv[0],
+	argv[0],
+	argv[0]
+	);
+}
+
+/**************** Stages ****************/
+
+/* Splits 'spec' into words, in place. Returns the number of words, which are
+ * in 'words' (it has room for all of them, plus a NULL). */
+
+static int split_words(char *spec, char ***words)
+{
+	int max_words = strlen(spec) / 2 + 2;
+	*words = malloc(max_words * sizeof(char *));
+	if (NULL == *words) { perror(NULL); exit(EXIT_FAILURE); }
+
+	int count = 0;
+	char *save;
+	char *word;
+	for (word = strtok_r(spec, " \t\n", &save); NULL != word;
+			word = strtok_r(NULL, " \t\n", &save))
+		(*words)[count++] = word;
+	(*words)[count] = NULL;
+
+	return count;
+}
+
+static void stage_usage(const char *usage)
+{
+	fprintf(stderr, "Usage: %s\n", usage);
+	exit(EXIT_FAILURE);
+}
+
+static void parse_order_stage(struct stage *stage, int argc, char *argv[])
+{
+	stage->params.order = ORDER_ALNUM_LBL;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "c:")) != -1) {
+		switch (opt_char) {
+		case 'c':
+			stage->params.order = get_order_criterion(optarg);
+			break;
+		default:
+			stage_usage("order [-c <criterion>]");
+		}
+	}
+	if (optind != argc) stage_usage("order [-c <criterion>]");
+}
+
+static void parse_prune_stage(struct stage *stage, int argc, char *argv[])
+{
+	const char *USAGE =
+		"prune [-v] <label>+ or prune [-v] -f <label file>";
+	enum prune_mode mode = PRUNE_DIRECT;
+	bool in_file = false;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "fv")) != -1) {
+		switch (opt_char) {
+		case 'f':
+			in_file = true;
+			break;
+		case 'v':
+			mode = PRUNE_REVERSE;
+			break;
+		default:
+			stage_usage(USAGE);
+		}
+	}
+	if (optind == argc || (in_file && optind != argc - 1))
+		stage_usage(USAGE);
+
+	struct prune_params *params = &stage->params.prune;
+	init_prune_params(params, mode);
+	if (! in_file) {
+		for (; optind < argc; optind++)
+			if (! add_prune_label(&params->labels, argv[optind])) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		return;
+	}
+
+	FILE* lbl_src = fopen(argv[optind], "r");
+	if (NULL == lbl_src) {
+		fprintf(stderr, "%s: ", argv[optind]);
+		perror(NULL);
+		exit(EXIT_FAILURE);
+	}
+	char *label;
+	while (NULL != (label = read_line(lbl_src))) {
+		if (! add_prune_label(&params->labels, label)) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		free(label);
+	}
+	if (READLINE_ERROR == read_line_status) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+	fclose(lbl_src);
+}
+
+static void parse_rename_stage(struct stage *stage, int argc, char *argv[])
+{
+	const char *USAGE = "rename [-l] <map file> or rename [-l] <old> <new>";
+	stage->params.rename.only_leaves = false;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "l")) != -1) {
+		switch (opt_char) {
+		case 'l':
+			stage->params.rename.only_leaves = true;
+			break;
+		default:
+			stage_usage(USAGE);
+		}
+	}
+
+	struct hash *rename_map;
+	switch (argc - optind) {
+	case 1:
+		rename_map = read_map(argv[optind]);
+		break;
+	case 2:
+		rename_map = create_hash(1);
+		if (NULL == rename_map) { perror(NULL); exit(EXIT_FAILURE); }
+		char *new_label = strdup(argv[optind+1]);
+		if (NULL == new_label ||
+			! hash_set(rename_map, argv[optind], new_label)) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		break;
+	default:
+		stage_usage(USAGE);
+	}
+
+	/* The map is only needed as label IDs */
+	stage->params.rename.map = index_map_by_label_id(rename_map);
+
+	struct llist *keys = hash_keys(rename_map);
+	if (NULL == keys) { perror(NULL); exit(EXIT_FAILURE); }
+	struct list_elem *e;
+	for (e = keys->head; NULL != e; e = e->next)
+		free(hash_get(rename_map, (char *) e->data));
+	destroy_llist(keys);
+	destroy_hash(rename_map);
+}
+
+static void parse_reroot_stage(struct stage *stage, int argc, char *argv[])
+{
+	struct reroot_params *params = &stage->params.reroot;
+	params->try_ingroup = false;
+	params->deroot = false;
+	params->i_node_lbl_as_support = false;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "dls")) != -1) {
+		switch (opt_char) {
+		case 'd':
+			params->deroot = true;
+			break;
+		case 'l':
+			params->try_ingroup = true;
+			break;
+		case 's':
+			params->i_node_lbl_as_support = true;
+			break;
+		default:
+			stage_usage("reroot [-dls] [<label>+]");
+		}
+	}
+
+	params->labels = create_llist();
+	if (NULL == params->labels) { perror(NULL); exit(EXIT_FAILURE); }
+	for (; optind < argc; optind++)
+		if (! append_element(params->labels, argv[optind])) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+}
+
+static void parse_topology_stage(struct stage *stage, int argc, char *argv[])
+{
+	struct topology_params *params = &stage->params.topology;
+	params->show_inner_labels = true;
+	params->show_leaf_labels = true;
+	params->show_branch_lengths = false;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "bIL")) != -1) {
+		switch (opt_char) {
+		case 'b':
+			params->show_branch_lengths = true;
+			break;
+		case 'I':
+			params->show_inner_labels = false;
+			break;
+		case 'L':
+			params->show_leaf_labels = false;
+			break;
+		default:
+			stage_usage("topology [-bIL]");
+		}
+	}
+	if (optind != argc) stage_usage("topology [-bIL]");
+}
+
+/* Parses a stage argument, e.g. "prune -v Homo Pan". */
+
+static void parse_stage(struct stage *stage, const char *arg)
+{
+	stage->spec = strdup(arg);
+	if (NULL == stage->spec) { perror(NULL); exit(EXIT_FAILURE); }
+	char **words;
+	int nb_words = split_words(stage->spec, &words);
+	if (0 == nb_words) {
+		fprintf(stderr, "Empty stage.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	optind = 0;	/* makes GNU getopt() start afresh on 'words' */
+	if (0 == strcmp("order", words[0])) {
+		stage->type = STAGE_ORDER;
+		parse_order_stage(stage, nb_words, words);
+	} else if (0 == strcmp("prune", words[0])) {
+		stage->type = STAGE_PRUNE;
+		/* These two stages look labels up by ID */
+		if (! enable_label_interning()) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		parse_prune_stage(stage, nb_words, words);
+	} else if (0 == strcmp("rename", words[0])) {
+		stage->type = STAGE_RENAME;
+		if (! enable_label_interning()) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+		parse_rename_stage(stage, nb_words, words);
+	} else if (0 == strcmp("reroot", words[0])) {
+		stage->type = STAGE_REROOT;
+		parse_reroot_stage(stage, nb_words, words);
+	} else if (0 == strcmp("topology", words[0])) {
+		stage->type = STAGE_TOPOLOGY;
+		parse_topology_stage(stage, nb_words, words);
+	} else {
+		fprintf(stderr, "Unknown stage '%s'.\n", words[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	free(words);
+}
+
+static void destroy_stage(struct stage *stage)
+{
+	switch (stage->type) {
+	case STAGE_PRUNE:
+		destroy_prune_params(&stage->params.prune);
+		break;
+	case STAGE_RENAME:
+		free(stage->params.rename.map.new_id);
+		break;
+	case STAGE_REROOT:
+		destroy_llist(stage->params.reroot.labels);
+		break;
+	default:
+		break;
+	}
+	free(stage->spec);
+}
+
+struct parameters get_params(int argc, char *argv[])
+{
+
+	struct parameters params;
+
+	params.nb_threads = 1;
+	params.input = stdin;
+
+	int opt_char;
+	/* '+': stop at the first stage, whose options are its own */
+	while ((opt_char = getopt(argc, argv, "+ht:z:")) != -1) {
+		switch (opt_char) {
+		case 'h':
+			help(argv);
+			exit(EXIT_SUCCESS);
+		case 't':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -t must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* check arguments */
+	if ((argc - optind) < 2) {
+		fprintf(stderr, "Usage: %s [-ht:] <filename|-> <stage>+\n",
+				argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if (0 != strcmp("-", argv[optind])) {
+		FILE *fin = open_input_file(argv[optind]);
+		if (NULL == fin) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		params.input = fin;
+	}
+
+	int first_stage = optind + 1;
+	params.nb_stages = argc - first_stage;
+	params.stages = malloc(params.nb_stages * sizeof(struct stage));
+	if (NULL == params.stages) { perror(NULL); exit(EXIT_FAILURE); }
+	int i;
+	for (i = 0; i < params.nb_stages; i++)
+		parse_stage(&params.stages[i], argv[first_stage + i]);
+
+	return params;
+}
+
+/**************** Processing ****************/
+
+/* The tree-building counterpart of nw_topology, which works on the Newick
+ * text instead (see topology.c). */
+
+static int strip_tree(struct rooted_tree *tree, struct topology_params *params)
+{
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = el->data;
+		bool show_label = is_leaf(current) ?
+			params->show_leaf_labels : params->show_inner_labels;
+		if (! show_label && '\0' != current->label[0]) {
+			free(current->label);
+			current->label = strdup("");
+			if (NULL == current->label) return FAILURE;
+			current->label_id = label_interning_enabled() ?
+				EMPTY_LABEL_ID : -1;
+		}
+		if (! params->show_branch_lengths && has_edge_length(current))
+			if (! set_edge_length_string(current, ""))
+				return FAILURE;
+	}
+	return SUCCESS;
+}
+
+/* Some stages splice nodes out but leave them in 'nodes_in_order' */
+
+static void update_nodes_in_order(struct rooted_tree *tree)
+{
+	destroy_llist(tree->nodes_in_order);
+	tree->nodes_in_order = get_nodes_in_order(tree->root);
+	if (NULL == tree->nodes_in_order) { perror(NULL); exit(EXIT_FAILURE); }
+}
+
+static bool run_reroot_stage(struct rooted_tree *tree,
+		struct reroot_params *params)
+{
+	if (params->deroot) {
+		enum deroot_status status = deroot(tree);
+		if (DEROOT_OK != status) {
+			print_deroot_error(status);
+			return false;
+		}
+		update_nodes_in_order(tree);
+		return true;
+	}
+
+	enum reroot_status status;
+	struct rnode *outgroup_root = find_outgroup_root(tree, params, &status);
+	if (NULL == outgroup_root) {
+		print_reroot_error(status);
+		return false;
+	}
+	pthread_mutex_lock(&rnode_lock);
+	int result = reroot_tree(tree, outgroup_root,
+			params->i_node_lbl_as_support);
+	pthread_mutex_unlock(&rnode_lock);
+	if (! result) { perror(NULL); exit(EXIT_FAILURE); }
+
+	return true;
+}
+
+/* Passes 'tree' through all stages, and returns its Newick, or NULL if a
+ * stage rejected it. */
+
+static char *run_stages(struct rooted_tree *tree, struct parameters *params)
+{
+	int i;
+	for (i = 0; i < params->nb_stages; i++) {
+		struct stage *stage = &params->stages[i];
+		switch (stage->type) {
+		case STAGE_ORDER:
+			if (! order_tree(tree, stage->params.order)) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+			break;
+		case STAGE_PRUNE:
+			prune_tree(tree, &stage->params.prune);
+			update_nodes_in_order(tree);
+			break;
+		case STAGE_RENAME:
+			if (! rename_tree(tree, &stage->params.rename.map,
+					stage->params.rename.only_leaves)) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+			break;
+		case STAGE_REROOT:
+			if (! run_reroot_stage(tree, &stage->params.reroot))
+				return NULL;
+			break;
+		case STAGE_TOPOLOGY:
+			if (! strip_tree(tree, &stage->params.topology)) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			assert(0);
+		}
+	}
+
+	char *newick = to_newick(tree->root);
+	if (NULL == newick) { perror(NULL); exit(EXIT_FAILURE); }
+	return newick;
+}
+
+struct batch {
+	struct parameters *params;
+	struct rooted_tree **trees;
+	char **newicks;
+	int count;
+	int next;	/* index of the next tree to process */
+	pthread_mutex_t lock;
+};
+
+static void *run_worker(void *arg)
+{
+	struct batch *batch = arg;
+	for (;;) {
+		pthread_mutex_lock(&batch->lock);
+		int i = batch->next++;
+		pthread_mutex_unlock(&batch->lock);
+		if (i >= batch->count) break;
+		batch->newicks[i] = run_stages(batch->trees[i], batch->params);
+	}
+	return NULL;
+}
+
+/* Trees are read one batch at a time (parsing is not thread-safe), then
+ * processed by all threads, and printed in input order. */
+
+static void process_trees(struct parameters *params)
+{
+	extern FILE *nwsin;
+	nwsin = params->input;
+
+	int nb_threads = params->nb_threads;
+	int max_trees = nb_threads * BATCH_TREES_PER_THREAD;
+	int max_nodes = nb_threads * BATCH_NODES_PER_THREAD;
+	pthread_t *threads = malloc(nb_threads * sizeof(pthread_t));
+	struct batch batch;
+	batch.params = params;
+	batch.trees = malloc(max_trees * sizeof(struct rooted_tree *));
+	batch.newicks = malloc(max_trees * sizeof(char *));
+	if (NULL == threads || NULL == batch.trees || NULL == batch.newicks) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init(&batch.lock, NULL);
+
+	int watermark = rnode_watermark();
+	/* the stages' labels stay interned, those of the trees go with them */
+	int label_watermark = interned_label_count();
+	bool eof = false;
+	while (! eof) {
+		struct rooted_tree *tree;
+		batch.count = 0;
+		while (batch.count < max_trees &&
+			rnode_watermark() - watermark < max_nodes) {
+			if (NULL == (tree = parse_tree())) {
+				eof = true;
+				break;
+			}
+			batch.trees[batch.count++] = tree;
+		}
+		if (0 == batch.count) break;
+
+		batch.next = 0;
+		int t;
+		/* the main thread is a worker too */
+		for (t = 1; t < nb_threads; t++)
+			if (0 != pthread_create(&threads[t], NULL, run_worker,
+						&batch)) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		run_worker(&batch);
+		for (t = 1; t < nb_threads; t++)
+			pthread_join(threads[t], NULL);
+
+		int i;
+		for (i = 0; i < batch.count; i++) {
+			if (NULL != batch.newicks[i]) {
+				puts(batch.newicks[i]);
+				free(batch.newicks[i]);
+			}
+			destroy_tree(batch.trees[i]);
+		}
+		destroy_rnodes_since(watermark, NULL);
+		forget_labels_since(label_watermark);
+	}
+
+	pthread_mutex_destroy(&batch.lock);
+	free(batch.trees);
+	free(batch.newicks);
+	free(threads);
+}
+
+int main(int argc, char *argv[])
+{
+	/* No profile_init(): the profiling counters are not thread-safe. */
+	struct parameters params = get_params(argc, argv);
+
+	process_trees(&params);
+
+	int i;
+	for (i = 0; i < params.nb_stages; i++)
+		destroy_stage(&params.stages[i]);
+	free(params.stages);
+	destroy_all_rnodes(NULL);
+	destroy_label_interner();
+
+	return 0;
+}
@@ -0,0 +1,261 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* Times are taken with clock_gettime(): CLOCK_MONOTONIC for wall time, and
+ * CLOCK_PROCESS_CPUTIME_ID for CPU time. Bytes in and out are the 'rchar' and
+ * 'wchar' counts of /proc/self/io, so that I/O need not be instrumented; they
+ * are not reported where that file does not exist. The counters are not
+ * thread-safe, but libnw's instrumented functions are only called from one
+ * thread. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+
+bool nw_profiling = false;
+
+static const char *phase_names[PROFILE_PHASE_COUNT] = {
+	"parse", "events", "output"
+};
+
+struct phase_stats {
+	double wall;	/* total, in seconds */
+	double cpu;
+	long calls;
+	double wall_start;
+	double cpu_start;
+	int depth;	/* phases may nest (e.g. recursive calls) */
+};
+
+static struct phase_stats phases[PROFILE_PHASE_COUNT];
+static const char *prog_name = "";
+static char *json_file = NULL;	/* NULL means a text report on stderr */
+static double run_wall_start;
+static double run_cpu_start;
+/* I/O done before profile_init() (e.g. the loader reading shared libraries) */
+static long long run_bytes_in_start;
+static long long run_bytes_out_start;
+static long tree_count = 0;
+static long node_count = 0;
+static long alloc_count = 0;
+static long long alloc_bytes = 0;
+
+static double clock_seconds(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void profile_phase_start(enum profile_phase phase)
+{
+	struct phase_stats *p = &phases[phase];
+	if (0 == p->depth++) {
+		p->wall_start = clock_seconds(CLOCK_MONOTONIC);
+		p->cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+	}
+}
+
+void profile_phase_end(enum profile_phase phase)
+{
+	struct phase_stats *p = &phases[phase];
+	if (0 == --p->depth) {
+		p->wall += clock_seconds(CLOCK_MONOTONIC) - p->wall_start;
+		p->cpu += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) -
+			p->cpu_start;
+		p->calls++;
+	}
+}
+
+void profile_add_trees(long trees) { tree_count += trees; }
+
+void profile_add_nodes(long nodes) { node_count += nodes; }
+
+void profile_add_alloc(size_t bytes)
+{
+	alloc_count++;
+	alloc_bytes += bytes;
+}
+
+/* Reads the bytes read and written by this process so far. Sets both to -1 if
+ * this cannot be found out. The counts are for the whole process, so the
+ * report subtracts those read at startup. */
+
+static void read_io_counts(long long *bytes_in, long long *bytes_out)
+{
+	*bytes_in = *bytes_out = -1;
+	FILE *io = fopen("/proc/self/io", "r");
+	if (NULL == io) return;
+	char line[128];
+	while (NULL != fgets(line, sizeof(line), io)) {
+		if (0 == strncmp(line, "rchar: ", 7))
+			*bytes_in = atoll(line + 7);
+		else if (0 == strncmp(line, "wchar: ", 7))
+			*bytes_out = atoll(line + 7);
+	}
+	fclose(io);
+}
+
+static void print_text_report(double wall, double cpu, double other_wall,
+		double other_cpu, long long bytes_in, long long bytes_out,
+		long peak_rss)
+{
+	int i;
+	fprintf(stderr, "%s profile:\n", prog_name);
+	fprintf(stderr, "  %-8s %10s %10s %10s\n", "phase", "wall (s)",
+			"cpu (s)", "calls");
+	for (i = 0; i < PROFILE_PHASE_COUNT; i++) {
+		if (0 == phases[i].calls) continue;
+		fprintf(stderr, "  %-8s %10.3f %10.3f %10ld\n", phase_names[i],
+			phases[i].wall, phases[i].cpu, phases[i].calls);
+	}
+	fprintf(stderr, "  %-8s %10.3f %10.3f\n", "other", other_wall,
+			other_cpu);
+	fprintf(stderr, "  %-8s %10.3f %10.3f\n", "total", wall, cpu);
+	fprintf(stderr, "  trees: %ld, nodes: %ld\n", tree_count, node_count);
+	fprintf(stderr, "  allocations: %ld (%lld bytes)\n", alloc_count,
+			alloc_bytes);
+	if (bytes_in >= 0)
+		fprintf(stderr, "  bytes in: %lld, bytes out: %lld\n",
+				bytes_in, bytes_out);
+	fprintf(stderr, "  peak RSS: %ld kB\n", peak_rss);
+}
+
+static void print_json_report(FILE *out, double wall, double cpu,
+		double other_wall, double other_cpu, long long bytes_in,
+		long long bytes_out, long peak_rss)
+{
+	int i;
+	fprintf(out, "{\"program\": \"%s\", \"phases\": {", prog_name);
+	for (i = 0; i < PROFILE_PHASE_COUNT; i++)
+		fprintf(out, "\"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f, "
+			"\"calls\": %ld}, ", phase_names[i], phases[i].wall,
+			phases[i].cpu, phases[i].calls);
+	fprintf(out, "\"other\": {\"wall_s\": %.6f, \"cpu_s\": %.6f}}, ",
+			other_wall, other_cpu);
+	fprintf(out, "\"wall_s\": %.6f, \"cpu_s\": %.6f, ", wall, cpu);
+	fprintf(out, "\"trees\": %ld, \"nodes\": %ld, ", tree_count,
+			node_count);
+	fprintf(out, "\"allocations\": %ld, \"allocated_bytes\": %lld, ",
+			alloc_count, alloc_bytes);
+	if (bytes_in >= 0)
+		fprintf(out, "\"bytes_in\": %lld, \"bytes_out\": %lld, ",
+				bytes_in, bytes_out);
+	fprintf(out, "\"peak_rss_kb\": %ld}\n", peak_rss);
+}
+
+static void profile_report()
+{
+	/* so that wchar includes the output still in stdio's buffer */
+	fflush(stdout);
+
+	double wall = clock_seconds(CLOCK_MONOTONIC) - run_wall_start;
+	double cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - run_cpu_start;
+	double other_wall = wall, other_cpu = cpu;
+	int i;
+	for (i = 0; i < PROFILE_PHASE_COUNT; i++) {
+		other_wall -= phases[i].wall;
+		other_cpu -= phases[i].cpu;
+	}
+	if (other_wall < 0) other_wall = 0;
+	if (other_cpu < 0) other_cpu = 0;
+
+	long long bytes_in, bytes_out;
+	read_io_counts(&bytes_in, &bytes_out);
+	if (bytes_in >= 0 && run_bytes_in_start >= 0) {
+		bytes_in -= run_bytes_in_start;
+		bytes_out -= run_bytes_out_start;
+	}
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	if (NULL == json_file) {
+		print_text_report(wall, cpu, other_wall, other_cpu,
+				bytes_in, bytes_out, usage.ru_maxrss);
+		return;
+	}
+	FILE *out = fopen(json_file, "w");
+	if (NULL == out) {
+		perror(json_file);
+		return;
+	}
+	print_json_report(out, wall, cpu, other_wall, other_cpu, bytes_in,
+			bytes_out, usage.ru_maxrss);
+	fclose(out);
+}
+
+int profile_init(int argc, char *argv[])
+{
+	bool requested = false;
+	const char *env = getenv("NW_PROFILE");
+	if (NULL != env && '\0' != env[0]) {
+		requested = true;
+		if (0 != strcmp("1", env)) json_file = (char *) env;
+	}
+
+	/* remove --profile[=<file>] from argv */
+	int i, kept = 1;
+	for (i = 1; i < argc; i++) {
+		if (0 == strcmp("--profile", argv[i])) {
+			requested = true;
+			json_file = NULL;
+		} else if (0 == strncmp("--profile=", argv[i], 10)) {
+			requested = true;
+			json_file = argv[i] + 10;
+		} else {
+			argv[kept++] = argv[i];
+		}
+	}
+	argv[kept] = NULL;
+
+	if (! requested) return kept;
+
+	prog_name = strrchr(argv[0], '/');
+	prog_name = (NULL == prog_name) ? argv[0] : prog_name + 1;
+	run_wall_start = clock_seconds(CLOCK_MONOTONIC);
+	run_cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+	/* Reading /proc/self/io counts as input too. Reading it twice tells how
+	 * much, so that the snapshot itself is not counted. */
+	long long bytes_in, bytes_out;
+	read_io_counts(&bytes_in, &bytes_out);
+	read_io_counts(&run_bytes_in_start, &run_bytes_out_start);
+	if (bytes_in >= 0)
+		run_bytes_in_start += run_bytes_in_start - bytes_in;
+	if (0 != atexit(profile_report)) return kept;
+	nw_profiling = true;
+
+	return kept;
+}
@@ -0,0 +1,85 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/** \file
+ * Run-time profiling. When an app is run with '--profile' (or
+ * '--profile=<file>'), or with the NW_PROFILE environment variable set, it
+ * reports at exit where its time went: the wall and CPU time of each phase
+ * (parsing, Newick events, output), the number of trees, nodes and
+ * allocations, the bytes read and written, and the peak RSS. The report goes
+ * to stderr as text, or to <file> as JSON (NW_PROFILE=<file> does the same;
+ * NW_PROFILE=1 means stderr).
+ *
+ * The instrumentation points in libnw are the PROFILE_*() macros below. When
+ * profiling is off, each one reduces to a test of a global flag, and nothing
+ * else runs. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Phases timed by the profiler. */
+
+enum profile_phase {
+	PROFILE_PARSE,	/**< parse_tree(): lexing and tree building */
+	PROFILE_EVENTS,	/**< parse_newick_events(), including the handlers */
+	PROFILE_OUTPUT,	/**< to_newick(), to_newick_i() and dump_newick() */
+	PROFILE_PHASE_COUNT
+};
+
+/** True IFF profiling is on. Read-only outside profile.c. */
+
+extern bool nw_profiling;
+
+/** Turns profiling on if requested, by '--profile' or '--profile=<file>' on
+ * the command line, or by NW_PROFILE. The option is removed from 'argv', so
+ * that the app's own option parsing never sees it. Call this first thing in
+ * main(), as 'argc = profile_init(argc, argv);'. If profiling is on, the
+ * report is printed at exit. Returns the new argc. */
+
+int profile_init(int argc, char *argv[]);
+
+/* These are called through the macros below, so that they cost nothing when
+ * profiling is off. */
+
+void profile_phase_start(enum profile_phase phase);
+void profile_phase_end(enum profile_phase phase);
+void profile_add_trees(long trees);
+void profile_add_nodes(long nodes);
+void profile_add_alloc(size_t bytes);
+
+#define PROFILE_START(phase) \
+	do { if (nw_profiling) profile_phase_start(phase); } while (0)
+#define PROFILE_END(phase) \
+	do { if (nw_profiling) profile_phase_end(phase); } while (0)
+#define PROFILE_TREES(n) \
+	do { if (nw_profiling) profile_add_trees(n); } while (0)
+#define PROFILE_NODES(n) \
+	do { if (nw_profiling) profile_add_nodes(n); } while (0)
+#define PROFILE_ALLOC(bytes) \
+	do { if (nw_profiling) profile_add_alloc(bytes); } while (0)
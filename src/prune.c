@@ -42,20 +42,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "to_newick.h"
 #include "rnode.h"
 #include "link.h"
-#include "set.h"
 #include "list.h"
 #include "readline.h"
+#include "label_intern.h"
+#include "common.h"
+#include "profile.h"
+#include "prune_tree.h"
+#include "compressed_io.h"
 
-enum prune_mode { PRUNE_DIRECT, PRUNE_REVERSE };
 enum label_source { COMMAND_LINE, IN_FILE }; /* can't use FILE... */
 
-struct prune_data {
-	bool kept_descendant;
-};
-
 struct parameters {
-	set_t 	*prune_labels;
-	enum prune_mode mode;
+	struct prune_params prune;	/* the labels passed as arguments */
 	enum label_source lbl_src;
 };
 
@@ -67,7 +65,7 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-f:hv] <newick trees filename|-> <label> [label+]\n"
+"%s [-f:hvz:] <newick trees filename|-> <label> [label+]\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -104,6 +102,9 @@ void help(char *argv[])
 "---------------------------\n"
 "\n"
 "Labels are assumed to be unique. \n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -137,11 +138,11 @@ struct parameters get_params(int argc, char *argv[])
 "Usage: nw_prune [-hv] <filename|-> <label> [label+]\n"
 "or     nw_prune [-hv] -f <filename|-> <label_filename>";
 	struct parameters params;
-	params.mode = PRUNE_DIRECT;
+	enum prune_mode mode = PRUNE_DIRECT;
 	params.lbl_src = COMMAND_LINE;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "fhv")) != -1) {
+	while ((opt_char = getopt(argc, argv, "fhvz:")) != -1) {
 		switch (opt_char) {
 		case 'f':
 			params.lbl_src = IN_FILE;
@@ -150,7 +151,14 @@ struct parameters get_params(int argc, char *argv[])
 			help(argv);
 			exit (EXIT_SUCCESS);
 		case 'v':
-			params.mode = PRUNE_REVERSE;
+			mode = PRUNE_REVERSE;
+			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
 			break;
 		default:
 			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
@@ -164,7 +172,7 @@ struct parameters get_params(int argc, char *argv[])
 
 	if ((argc - optind) >= 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				fprintf(stderr, "%s: ", argv[optind]);
@@ -175,10 +183,12 @@ struct parameters get_params(int argc, char *argv[])
 		}
 	}
 
-	/* Get prune labels */
+	/* Get prune labels. These are interned, as will be all the labels in
+	 * the trees, so that we can test nodes by label ID. */
 
-	set_t *prune_labels = create_set();
-	if (NULL == prune_labels) { perror(NULL); exit(EXIT_FAILURE); }
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
+	init_prune_params(&params.prune, mode);
+	struct label_id_set *prune_labels = &params.prune.labels;
 
 	optind++;	
 	if (COMMAND_LINE == params.lbl_src) {
@@ -188,7 +198,7 @@ struct parameters get_params(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 		}
 		for (; optind < argc; optind++) {
-			if (set_add(prune_labels, argv[optind]) < 0) {
+			if (! add_prune_label(prune_labels, argv[optind])) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
@@ -210,10 +220,11 @@ struct parameters get_params(int argc, char *argv[])
 		}
 		char *label = NULL;
 		while (NULL != (label = read_line(lbl_src))) {
-			if (set_add(prune_labels, label) < 0) {
+			if (! add_prune_label(prune_labels, label)) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
+			free(label);
 		}
 		switch(read_line_status) {
 		case READLINE_EOF:
@@ -232,157 +243,31 @@ struct parameters get_params(int argc, char *argv[])
 		assert(0);
 	}
 
-	params.prune_labels = prune_labels;
 	return params;
 }
 
-/* We buld a hash of the passed labels, and visit the tree, unlinking nodes as
- * needed. In Direct mode, we traverse in reverse order, unlinking nodes to
- * prune. In Reverse mode, things are a bit more hairy because we need to keep
- * not just the nodes passed as argument, but also their ancestors. So we pass
- * through th etree first in direct order, marking nodes to keep and their
- * ancestors. Then we go back in reverse order, pruning. */
-
-static struct rooted_tree * process_tree_direct(
-		struct rooted_tree *tree, set_t *prune_labels)
-{
-	struct llist *rev_nodes = llist_reverse(tree->nodes_in_order);
-	struct list_elem *el;
-	struct rnode *current;
-	char *label;
-
-	for (el = rev_nodes->head; NULL != el; el = el->next) {
-		current = el->data;
-		label = current->label;
-		/* skip this node iff parent is marked ("seen") */
-		if (!is_root(current) && current->parent->seen) {
-			current->seen = true;	/* inherit mark */
-			continue;
-		}
-		if (set_has_element(prune_labels, label)) {
-			unlink_rnode(current);
-			current->seen = true;
-		}
-	}
-
-	destroy_llist(rev_nodes);
-	reset_seen(tree);
-	return tree;
-}
-
-/* Prune predicate: retains the nodes passed on CL, but discards their
- * children. */
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-
-// TODO: this might be a useful prune predicate, add option to use it.
-
-bool prune_predicate_trim_kids(struct rnode *node, void *param)
-{
-	if (node->seen) {
-		/* ancestor of a passed node */
-		return true;
-	}
-
-	return false;
-}
-
-/* Prune predicate: retains the nodes passed on CL and their children. */
-
-bool prune_predicate_keep_clade(struct rnode *node, void *param)
-{
-	// TODO: is this used?
-	// set_t *prune_labels = (set_t *) param;
-
-	if (node->seen) {
-		return true;
-	}
-	/* Node isn't an ancestor of a passed node. Node can be a _descendant_
-	 * of a passed node, though, in which case we must keep it as well. */
-	if (!is_root(node)) {
-		if (NULL != node->parent->data) {
-			struct prune_data *pdata = node->parent->data;
-			if (pdata->kept_descendant) {
-				struct prune_data *pdata =
-					malloc(sizeof(struct prune_data));
-				if (NULL == pdata) {
-					perror(NULL); exit(EXIT_FAILURE);
-				}
-				pdata->kept_descendant = true;
-				node->data = pdata;
-				return true;
-			}
-		}
-	}
-	
-	/* neither an ancestor nor a descendant of a passed node - drop. */
-	return false;
-}
-
-static struct rooted_tree * process_tree_reverse(
-		struct rooted_tree *tree, set_t *prune_labels)
-{
-	struct list_elem *el = tree->nodes_in_order->head;
-	struct rnode *current;
-	char *label;
-
-	for (; NULL != el; el = el->next) {
-		current = el->data;
-		if (is_root(current)) break;
-		label = current->label;
-		/* mark this node (to keep it) if its label is on the CL */
-		if (set_has_element(prune_labels, label)) {
-			current->seen = true;
-			struct prune_data *pdata =
-				malloc(sizeof(struct prune_data));
-			if (NULL == pdata) {perror(NULL); exit(EXIT_FAILURE); }
-			pdata->kept_descendant = true;
-			current->data = pdata;
-		}
-		/* and propagate 'seen' to parent (kept_descendant is
-		 * propagated to children (not parents), see
-		 * prune_predicate_keep_clade() */
-		if (current->seen) {
-			current->parent->seen = true;	/* inherit mark */
-		}
-	}
-
-	struct rooted_tree *pruned = clone_tree_cond(tree,
-			prune_predicate_keep_clade, prune_labels);	
-	destroy_tree(tree);
-	return pruned;
-}
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params;
-	static struct rooted_tree * (*process_tree)(struct rooted_tree *, set_t *);
 	
 	params = get_params(argc, argv);
-
-	switch (params.mode) {
-	case PRUNE_DIRECT:
-		process_tree = process_tree_direct;
-		break;
-	case PRUNE_REVERSE:
-		process_tree = process_tree_reverse;
-		break;
-	default:
-		assert (0);
-	}
+	/* only the prune labels need to stay interned */
+	int label_watermark = interned_label_count();
 
 	while (NULL != (tree = parse_tree())) {
-		tree = process_tree(tree, params.prune_labels);
+		tree = prune_tree(tree, &params.prune);
 		dump_newick(tree->root);
 		destroy_all_rnodes(NULL);
 		destroy_tree(tree);
+		forget_labels_since(label_watermark);
 	}
 
-	destroy_set(params.prune_labels);
+	destroy_prune_params(&params.prune);
+	destroy_label_interner();
 
 	return 0;
 }
-
-#pragma GCC diagnostic pop
@@ -0,0 +1,244 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* prune_tree.c - do not confuse with prune.c, which is the pruning program.
+ * This is the pruning itself, which is also used by nw_pipe. */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "tree.h"
+#include "rnode.h"
+#include "link.h"
+#include "list.h"
+#include "label_intern.h"
+#include "common.h"
+#include "prune_tree.h"
+
+void init_prune_params(struct prune_params *params, enum prune_mode mode)
+{
+	params->labels.has_id = NULL;
+	params->labels.size = 0;
+	params->mode = mode;
+}
+
+int add_prune_label(struct label_id_set *set, const char *label)
+{
+	int id = intern_label(label);
+	if (id < 0) return FAILURE;
+	if (id >= set->size) {
+		int new_size = interned_label_count();
+		bool *has_id = realloc(set->has_id, new_size * sizeof(bool));
+		if (NULL == has_id) return FAILURE;
+		for (; set->size < new_size; set->size++)
+			has_id[set->size] = false;
+		set->has_id = has_id;
+	}
+	set->has_id[id] = true;
+
+	return SUCCESS;
+}
+
+void destroy_prune_params(struct prune_params *params)
+{
+	free(params->labels.has_id);
+	params->labels.has_id = NULL;
+	params->labels.size = 0;
+}
+
+/* Returns true IFF 'node''s label is in 'set' */
+
+static bool has_label(struct label_id_set *set, struct rnode *node)
+{
+	return node->label_id < set->size && set->has_id[node->label_id];
+}
+
+/* Pruning is done in place, in two passes, neither of which allocates memory
+ * (the new lengths of spliced edges are kept as numbers). The first pass visits the
+ * nodes in postorder and computes a keep flag for each node, which is stored
+ * in its 'seen' member. In Direct mode, a node is kept iff it is not passed
+ * as argument and does not lose all its children. In Reverse mode, a node is
+ * flagged iff it is passed as argument or is an ancestor of such a node; the
+ * unflagged descendants of passed nodes are kept too, but this is decided in
+ * the second pass. The second pass walks the tree from the root, relinking
+ * each visited node's children to just the kept ones, and splicing out nodes
+ * that are left with a single child out of several (like unlink_rnode()
+ * does). Subtrees that need no relinking are not visited. */
+
+static void compute_keep_flags(struct rooted_tree *tree, struct label_id_set *prune_labels,
+		enum prune_mode mode)
+{
+	struct list_elem *el;
+
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = el->data;
+		if (is_root(current)) {
+			/* the root itself is never pruned */
+			current->seen = true;
+			break;
+		}
+		bool passed = has_label(prune_labels, current);
+		bool keep;
+		if (PRUNE_DIRECT == mode)
+			/* at this point, 'seen' is true iff at least one child
+			 * is kept (see below). A node whose children are all
+			 * pruned disappears, unless it had only one (this
+			 * makes it a leaf, as unlink_rnode() does). */
+			keep = !passed && (is_leaf(current) ||
+				1 == current->child_count || current->seen);
+		else
+			keep = passed || current->seen;
+		current->seen = keep;
+		if (keep) current->parent->seen = true;
+	}
+}
+
+/* Returns true IFF 'node' is one of the nodes passed as argument in Reverse
+ * mode. Such nodes keep all their children. */
+
+static bool keeps_whole_clade(struct rnode *node, struct label_id_set *prune_labels,
+		enum prune_mode mode)
+{
+	return PRUNE_REVERSE == mode &&
+		has_label(prune_labels, node);
+}
+
+/* Returns the node that takes the place of kept node 'node' in its parent's
+ * children list: this is 'node' itself, unless it has only one kept child out
+ * of several, in which case it is spliced out and its child takes its place
+ * (this is repeated as long as needed). Spliced edges' lengths are added. */
+
+static struct rnode *splice_kept_node(struct rnode *node,
+		struct label_id_set *prune_labels, enum prune_mode mode)
+{
+	for (;;) {
+		if (node->child_count < 2) return node;
+
+		struct rnode *kid, *kept_kid = NULL;
+		int nb_kept = 0;
+		for (kid = node->first_child; NULL != kid;
+				kid = kid->next_sibling) {
+			if (kid->seen) {
+				kept_kid = kid;
+				if (++nb_kept > 1) break;
+			}
+		}
+		if (1 != nb_kept) return node;
+		if (keeps_whole_clade(node, prune_labels, mode)) return node;
+
+		add_edge_length(kept_kid, node);
+		node->linked = false;
+		node = kept_kid;
+	}
+}
+
+/* Relinks 'node''s children so that only the kept ones (all of them if
+ * 'keep_all' is true) remain, each possibly replaced by a descendant (see
+ * splice_kept_node()). */
+
+static void keep_children(struct rnode *node, bool keep_all,
+		struct label_id_set *prune_labels, enum prune_mode mode)
+{
+	struct rnode *kid = node->first_child;
+	struct rnode *next;
+
+	node->first_child = node->last_child = NULL;
+	node->child_count = 0;
+	for (; NULL != kid; kid = next) {
+		next = kid->next_sibling;
+		if (keep_all || kid->seen) {
+			struct rnode *kept = splice_kept_node(kid,
+					prune_labels, mode);
+			kept->next_sibling = NULL;
+			add_child(node, kept);
+		} else {
+			kid->linked = false;
+		}
+	}
+}
+
+/* Returns true IFF the subtree rooted at 'node' may still need relinking. In
+ * Reverse mode, unflagged nodes are kept along with all their descendants. */
+
+static bool needs_visit(struct rnode *node, enum prune_mode mode)
+{
+	if (is_leaf(node)) return false;
+	return PRUNE_DIRECT == mode || node->seen;
+}
+
+struct rooted_tree *prune_tree(struct rooted_tree *tree,
+		struct prune_params *params)
+{
+	struct label_id_set *prune_labels = &params->labels;
+	enum prune_mode mode = params->mode;
+	struct rnode *orig_root = tree->root;
+	struct rnode *node = orig_root;
+
+	compute_keep_flags(tree, prune_labels, mode);
+
+	/* Preorder walk, without a stack: we go down to the first child that
+	 * needs visiting, or else to the next such sibling of the node or of
+	 * its closest ancestor. */
+	for (;;) {
+		int orig_child_count = node->child_count;
+		bool keep_all = node != orig_root &&
+			keeps_whole_clade(node, prune_labels, mode);
+		keep_children(node, keep_all, prune_labels, mode);
+
+		/* In Reverse mode, the root itself is spliced out if it is
+		 * left with one child (the clone-based version did this). */
+		if (PRUNE_REVERSE == mode && node == tree->root &&
+		    1 == node->child_count && orig_child_count > 1) {
+			struct rnode *kid = node->first_child;
+			add_edge_length(kid, node);
+			kid->parent = NULL;
+			tree->root = kid;
+			node = kid;
+			continue;
+		}
+
+		struct rnode *next;
+		for (next = node->first_child; NULL != next;
+				next = next->next_sibling)
+			if (needs_visit(next, mode)) break;
+		while (NULL == next && node != tree->root) {
+			for (next = node->next_sibling; NULL != next;
+					next = next->next_sibling)
+				if (needs_visit(next, mode)) break;
+			if (NULL == next) node = node->parent;
+		}
+		if (NULL == next) break;
+		node = next;
+	}
+
+	/* The nodes list is not updated, but all nodes are still in it, so
+	 * we can still use it to clear the flags. */
+	reset_seen(tree);
+	return tree;
+}
@@ -0,0 +1,75 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* prune_tree.h: pruning of trees by label, as done by nw_prune (and nw_pipe)
+ * */
+
+#include <stdbool.h>
+
+struct rooted_tree;
+struct rnode;
+
+enum prune_mode { PRUNE_DIRECT, PRUNE_REVERSE };
+
+/* The labels to prune (or to keep, in Reverse mode), as flags indexed by label
+ * ID. Labels first seen after the set was filled have IDs beyond 'size', and
+ * are not in the set. Label interning must be on (see label_intern.h). */
+
+struct label_id_set {
+	bool *has_id;
+	int size;
+};
+
+struct prune_params {
+	struct label_id_set labels;
+	enum prune_mode mode;
+};
+
+/* Initializes 'params' with an empty label set */
+
+void init_prune_params(struct prune_params *params, enum prune_mode mode);
+
+/* Interns 'label' and adds it to 'set'. Returns SUCCESS, or FAILURE in case of
+ * malloc() problems. */
+
+int add_prune_label(struct label_id_set *set, const char *label);
+
+/* Releases the memory held by 'params' (but not 'params' itself). */
+
+void destroy_prune_params(struct prune_params *params);
+
+/* Prunes 'tree' in place, according to 'params'. In Direct mode, the nodes
+ * whose labels are in the set are removed; in Reverse mode, only those nodes
+ * and their ancestors and descendants are kept. Nodes left with a single
+ * child out of several are spliced out. No memory is allocated; the removed
+ * nodes are merely unlinked, and are freed with all the others (see
+ * destroy_all_rnodes()). The tree's 'nodes_in_order' is NOT updated. Returns
+ * the tree (whose root may have changed). */
+
+struct rooted_tree *prune_tree(struct rooted_tree *tree,
+		struct prune_params *params);
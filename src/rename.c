@@ -28,21 +28,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 /* reroot: rename tree nodes according to a map */
+
+#define _GNU_SOURCE	/* for memrchr() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <pthread.h>
 
-#include "tree.h"
-#include "parser.h"
-#include "to_newick.h"
 #include "hash.h"
 #include "list.h"
-#include "rnode.h"
 #include "readline.h"
 #include "common.h"
+#include "label_intern.h"
+#include "profile.h"
+#include "rename_map.h"
+#include "compressed_io.h"
 
 
 struct parameters {
@@ -53,8 +57,13 @@ struct parameters {
 	char *old_label;
 	char *new_label;
 	bool only_leaves;
+	int nb_threads;
+	FILE *input;
 };
 
+/* Input is processed in blocks of about this size per thread */
+static const size_t RENAME_BLOCK_SIZE = 4 << 20;
+
 void help(char *argv[])
 {
 	printf (
@@ -63,9 +72,9 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-hl] <newick trees filename|-> <map filename>\n"
+"%s [-hlt:z:] <newick trees filename|-> <map filename>\n"
 "or\n"
-"%s [-hl] <newick trees filename|-> <old-label> <new-label>\n"
+"%s [-hlt:z:] <newick trees filename|-> <old-label> <new-label>\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -95,6 +104,7 @@ void help(char *argv[])
 "------\n"
 "\n"
 "Prints the tree, after replacing all old names by the specified new name.\n"
+"Everything else (branch lengths, comments, whitespace) is copied unchanged.\n"
 "\n"
 "Options\n"
 "-------\n"
@@ -103,6 +113,11 @@ void help(char *argv[])
 "    -l: only replace leaf labels. This is useful if all labels are numeric,\n"
 "        but inner labels represent bootstraps, and you don't want to\n"
 "        accidentally modify bootstrap values.\n"
+"    -t <int>: use this many threads (default: 1). This does not change\n"
+"        the output.\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -133,59 +148,6 @@ void help(char *argv[])
 	);
 }
 
-// TODO: this f() has been duplicated in condense.c. It should be removed from
-// there and from here, and moved to hash.c
-
-struct hash *read_map(const char *filename)
-{
-	const unsigned int HASH_SIZE = 1000;	/* most trees will have fewer nodes */
-	const double LOAD_THRESHOLD = 0.8;
-	const unsigned RESIZE_FACTOR = 10;
-
-	FILE *map_file = fopen(filename, "r");
-	if (NULL == map_file) { perror(NULL); exit(EXIT_FAILURE); }
-
-	//struct hash *map = create_hash(HASH_SIZE);
-	struct hash *map = create_dynamic_hash(HASH_SIZE,
-			LOAD_THRESHOLD, RESIZE_FACTOR);
-	if (NULL == map) { perror(NULL); exit(EXIT_FAILURE); }
-
-	char *line;
-	while (NULL != (line = read_line(map_file))) {
-		/* Skip comments and lines that are empty or all whitespace */
-		if ('#' == line[0] || is_all_whitespace(line)) {
-			free(line);
-			continue;
-		}
-
-		char *key, *value;
-		struct word_tokenizer *wtok = create_word_tokenizer(line);
-		if (NULL == wtok) { perror(NULL); exit(EXIT_FAILURE); }
-		key = wt_next(wtok);	/* find first whitespace */
-		if (NULL == key) {
-			fprintf (stderr,
-				"Wrong format in line '%s' - aborting.\n",
-				line);
-			exit(EXIT_FAILURE);
-		}
-		value = wt_next(wtok);
-		if (NULL == value) {
-			/* If 2nd token is NULL, replace label with empty
-			 * string */
-			value = strdup("");
-		}
-		if (! hash_set(map, key, (void *) value)) {
-			perror(NULL);
-			exit(EXIT_FAILURE);
-		}
-		destroy_word_tokenizer(wtok);
-		free(key); /* copied by hash_set(), so can be free()d now */
-		free(line);
-	}
-
-	return map;
-}
-
 struct parameters get_params(int argc, char *argv[])
 {
 
@@ -195,9 +157,11 @@ struct parameters get_params(int argc, char *argv[])
 	params.map_filename = NULL;
 	params.old_label = NULL;
 	params.new_label = NULL;
+	params.nb_threads = 1;
+	params.input = stdin;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "hl")) != -1) {
+	while ((opt_char = getopt(argc, argv, "hlt:z:")) != -1) {
 		switch (opt_char) {
 		case 'h':
 			help(argv);
@@ -205,24 +169,38 @@ struct parameters get_params(int argc, char *argv[])
 		case 'l':
 			params.only_leaves = true;
 			break;
+		case 't':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -t must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		}
 	}
 
 	/* check arguments */
 	if ((argc - optind) < 2)	{
-		fprintf(stderr, "Usage: %s [-hl] <filename|-> <map_filename>\n",
-				argv[0]);
+		fprintf(stderr, "Usage: %s [-hlt:z:] <filename|-> "
+				"<map_filename>\n", argv[0]);
 		exit(EXIT_FAILURE);
 	} 
 
 	if (0 != strcmp("-", argv[optind])) {
-		FILE *fin = fopen(argv[optind], "r");
-		extern FILE *nwsin;
+		FILE *fin = open_input_file(argv[optind]);
 		if (NULL == fin) {
 			perror(NULL);
 			exit(EXIT_FAILURE);
 		}
-		nwsin = fin;
+		params.input = fin;
 	}
 	if ((argc - optind) == 2)
 		params.map_filename = argv[optind+1];
@@ -234,23 +212,278 @@ struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
-void process_tree(struct rooted_tree *tree, struct hash *rename_map,
-		struct parameters params)
+/* Renaming does not need the tree structure: a label is a leaf's unless it
+ * follows a ')', and any text that follows a ':' is a length. So we scan the
+ * Newick text for labels and copy it to the output, replacing only the
+ * labels found in the map. The lexical rules are those of the parser. */
+
+enum { CC_LABEL, CC_SPACE, CC_PUNCT, CC_QUOTE, CC_COMMENT, CC_OTHER };
+
+static unsigned char char_class[256];
+
+static void init_char_classes()
+{
+	int c;
+	for (c = 0; c < 256; c++)
+		char_class[c] = ((c > ' ' && c < 127) || c > 127) ?
+			CC_LABEL : CC_OTHER;
+	char_class[' '] = CC_SPACE;
+	char_class['('] = char_class[')'] = char_class[','] = CC_PUNCT;
+	char_class[':'] = char_class[';'] = CC_PUNCT;
+	char_class['\''] = CC_QUOTE;
+	char_class['['] = CC_COMMENT;
+	char_class[']'] = CC_OTHER;
+}
+
+/* A run of whole trees, renamed by one thread. Trees never straddle jobs, so
+ * the scanner can start each job in its initial state. */
+
+struct rename_job {
+	const struct id_map *map;
+	bool only_leaves;
+	char *in;
+	size_t in_len;
+	char *out;
+	size_t out_len;
+	size_t out_size;
+	int status;
+};
+
+static int append_bytes(struct rename_job *job, const char *bytes, size_t n)
+{
+	if (job->out_len + n > job->out_size) {
+		size_t new_size = 2 * job->out_size;
+		if (new_size < job->out_len + n) new_size = job->out_len + n;
+		char *grown = realloc(job->out, new_size);
+		if (NULL == grown) return FAILURE;
+		job->out = grown;
+		job->out_size = new_size;
+	}
+	memcpy(job->out + job->out_len, bytes, n);
+	job->out_len += n;
+	return SUCCESS;
+}
+
+/* Returns the end of the label that starts at 'pos' (quoted or not). As in
+ * the parser, spaces inside an unquoted label are changed to underscores. */
+
+static size_t label_end(char *in, size_t pos, size_t len)
+{
+	if ('\'' == in[pos]) {
+		do {
+			pos++;	/* opening quote */
+			while (pos < len && '\'' != in[pos]) pos++;
+			if (pos < len) pos++;	/* closing quote */
+		} while (pos < len && '\'' == in[pos]);
+		return pos;
+	}
+
+	for (;;) {
+		while (pos < len && CC_LABEL == char_class[(unsigned char) in[pos]])
+			pos++;
+		size_t spaces = pos;
+		while (pos < len && ' ' == in[pos]) pos++;
+		if (pos == spaces || pos == len ||
+			CC_LABEL != char_class[(unsigned char) in[pos]])
+			return spaces;
+		memset(in + spaces, '_', pos - spaces);
+		fprintf(stderr, "WARNING: spaces found in label - "
+				"converting to underscores.\n");
+	}
+}
+
+/* Returns the replacement for the label in[start..end), or NULL if it is to
+ * be kept. The label is looked up in place, hence not const: in[end] is
+ * briefly set to '\0'. This byte is never in another job's trees, since a
+ * job ends with a ';' (or at the end of the buffer, which has room for it). */
+
+static const char *new_label(const struct id_map *map, char *in, size_t start,
+		size_t end)
+{
+	char saved = in[end];
+	in[end] = '\0';
+	int id = find_label_id(in + start);
+	in[end] = saved;
+	if (id < 0 || id >= map->size || -1 == map->new_id[id])
+		return NULL;
+	return interned_label(map->new_id[id]);
+}
+
+static void *run_job(void *arg)
 {
-	/* visit each node, and change name if needed */
-	struct list_elem *elem;
-	for (elem = tree->nodes_in_order->head; NULL != elem; elem = elem->next) {
-		struct rnode *current = (struct rnode *) elem->data;
-		if (params.only_leaves && ! is_leaf(current)) { continue; }
-		char *label = current->label;
-		char *new_label = hash_get(rename_map, label);
-		if (NULL != new_label) {
-			current->label = strdup(new_label);
-			free(label);
+	struct rename_job *job = arg;
+	char *in = job->in;
+	size_t len = job->in_len;
+	size_t pos = 0;
+	size_t copied = 0;	/* in[copied..pos) is yet to be output */
+	char last_punct = ';';
+
+	job->out_len = 0;
+	job->status = SUCCESS;
+	while (pos < len) {
+		switch (char_class[(unsigned char) in[pos]]) {
+		case CC_PUNCT:
+			last_punct = in[pos++];
+			continue;
+		case CC_COMMENT:
+			while (pos < len && ']' != in[pos]) pos++;
+			if (pos < len) pos++;
+			continue;
+		case CC_LABEL:
+		case CC_QUOTE:
+			break;
+		default:
+			pos++;
+			continue;
 		}
+		size_t start = pos;
+		pos = label_end(in, pos, len);
+		if (':' == last_punct) {
+			last_punct = '\0';	/* a length, not a label */
+			continue;
+		}
+		if (job->only_leaves && ')' == last_punct) continue;
+		const char *label = new_label(job->map, in, start, pos);
+		if (NULL == label) continue;
+		if (! append_bytes(job, in + copied, start - copied) ||
+			! append_bytes(job, label, strlen(label))) {
+			job->status = FAILURE;
+			break;
+		}
+		copied = pos;
 	}
+	if (! append_bytes(job, in + copied, len - copied))
+		job->status = FAILURE;
 
-	dump_newick(tree->root);
+	return NULL;
+}
+
+/* Cuts buf[0..len) into 'nb_cuts' runs of whole trees of about the same size:
+ * cuts[k] is the end of run k (and the start of run k+1). Runs may be empty.
+ * Tree ends are the ';' outside quotes and comments. Returns the end of the
+ * last tree. */
+
+static size_t cut_at_tree_ends(const char *buf, size_t len, size_t *cuts,
+		int nb_cuts)
+{
+	size_t last_end = 0;
+	size_t pos = 0;
+	int k = 0;
+
+	/* Without quotes or comments, every ';' ends a tree, and the cuts can
+	 * be found with memrchr(), which is much faster than scanning. */
+	if (NULL == memchr(buf, '\'', len) && NULL == memchr(buf, '[', len)) {
+		for (k = 0; k < nb_cuts; k++) {
+			size_t target = (k < nb_cuts - 1) ?
+				(k + 1) * (len / nb_cuts) : len;
+			const char *semicolon = memrchr(buf, ';', target);
+			cuts[k] = (NULL == semicolon) ? 0 : semicolon - buf + 1;
+		}
+		return cuts[nb_cuts - 1];
+	}
+
+	while (pos < len) {
+		switch (buf[pos]) {
+		case ';':
+			last_end = pos + 1;
+			break;
+		case '\'':
+			for (pos++; pos < len && '\'' != buf[pos]; pos++)
+				;
+			break;
+		case '[':
+			for (pos++; pos < len && ']' != buf[pos]; pos++)
+				;
+			break;
+		}
+		pos++;
+		while (k < nb_cuts - 1 && pos >= (k + 1) * (len / nb_cuts))
+			cuts[k++] = last_end;
+	}
+	while (k < nb_cuts) cuts[k++] = last_end;
+
+	return last_end;
+}
+
+static void rename_stream(struct parameters params, struct id_map *map)
+{
+	int nb_threads = params.nb_threads;
+	struct rename_job *jobs = malloc(nb_threads * sizeof(struct rename_job));
+	pthread_t *threads = malloc(nb_threads * sizeof(pthread_t));
+	size_t *cuts = malloc(nb_threads * sizeof(size_t));
+	size_t buf_size = nb_threads * RENAME_BLOCK_SIZE;
+	char *buf = malloc(buf_size + 1);
+	if (NULL == jobs || NULL == threads || NULL == cuts || NULL == buf) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+	int t;
+	for (t = 0; t < nb_threads; t++) {
+		jobs[t].map = map;
+		jobs[t].only_leaves = params.only_leaves;
+		jobs[t].out_size = RENAME_BLOCK_SIZE;
+		jobs[t].out = malloc(jobs[t].out_size);
+		if (NULL == jobs[t].out) { perror(NULL); exit(EXIT_FAILURE); }
+	}
+
+	size_t len = 0;
+	bool eof = false;
+	while (! eof || len > 0) {
+		while (! eof && len < buf_size) {
+			size_t nread = fread(buf + len, 1, buf_size - len,
+					params.input);
+			if (0 == nread) {
+				if (ferror(params.input)) {
+					fprintf(stderr, "Could not read input - "
+							"aborting.\n");
+					exit(EXIT_FAILURE);
+				}
+				eof = true;
+			}
+			len += nread;
+		}
+		size_t end = cut_at_tree_ends(buf, len, cuts, nb_threads);
+		if (eof) end = cuts[nb_threads - 1] = len;
+		if (0 == end) {
+			/* a tree larger than the buffer */
+			char *grown = realloc(buf, 2 * buf_size + 1);
+			if (NULL == grown) { perror(NULL); exit(EXIT_FAILURE); }
+			buf = grown;
+			buf_size *= 2;
+			continue;
+		}
+
+		size_t start = 0;
+		for (t = 0; t < nb_threads; t++) {
+			jobs[t].in = buf + start;
+			jobs[t].in_len = cuts[t] - start;
+			start = cuts[t];
+		}
+		/* the main thread runs the first job itself */
+		for (t = 1; t < nb_threads; t++)
+			if (0 != pthread_create(&threads[t], NULL, run_job,
+						&jobs[t])) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+		run_job(&jobs[0]);
+		for (t = 1; t < nb_threads; t++)
+			pthread_join(threads[t], NULL);
+
+		for (t = 0; t < nb_threads; t++) {
+			if (! jobs[t].status) {
+				perror(NULL); exit(EXIT_FAILURE);
+			}
+			fwrite(jobs[t].out, 1, jobs[t].out_len, stdout);
+		}
+		memmove(buf, buf + end, len - end);
+		len -= end;
+	}
+
+	for (t = 0; t < nb_threads; t++)
+		free(jobs[t].out);
+	free(jobs);
+	free(threads);
+	free(cuts);
+	free(buf);
 }
 
 struct hash *set_map(struct parameters params)
@@ -271,7 +504,8 @@ struct hash *set_map(struct parameters params)
 
 int main(int argc, char *argv[])
 {
-	struct rooted_tree *tree;	
+	argc = profile_init(argc, argv);
+
 	struct hash *rename_map;
 	struct parameters params;
 	
@@ -279,11 +513,15 @@ int main(int argc, char *argv[])
 
 	rename_map = set_map(params);
 
-	while (NULL != (tree = parse_tree())) {
-		process_tree(tree, rename_map, params);
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
-	}
+	/* Labels are looked up by label ID. */
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
+	struct id_map id_map = index_map_by_label_id(rename_map);
+
+	init_char_classes();
+	rename_stream(params, &id_map);
+
+	free(id_map.new_id);
+	destroy_label_interner();
 
 	struct llist *keys = hash_keys(rename_map);
 	if (NULL == keys) { perror(NULL); exit(EXIT_FAILURE); }
@@ -0,0 +1,145 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* rename_map.c: label rename maps, for nw_rename and nw_pipe */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "list.h"
+#include "readline.h"
+#include "rnode.h"
+#include "tree.h"
+#include "common.h"
+#include "label_intern.h"
+#include "rename_map.h"
+
+// TODO: this f() has been duplicated in condense.c, which should use this
+// one.
+
+struct hash *read_map(const char *filename)
+{
+	const unsigned int HASH_SIZE = 1000;	/* most trees will have fewer nodes */
+	const double LOAD_THRESHOLD = 0.8;
+	const unsigned RESIZE_FACTOR = 10;
+
+	FILE *map_file = fopen(filename, "r");
+	if (NULL == map_file) { perror(NULL); exit(EXIT_FAILURE); }
+
+	//struct hash *map = create_hash(HASH_SIZE);
+	struct hash *map = create_dynamic_hash(HASH_SIZE,
+			LOAD_THRESHOLD, RESIZE_FACTOR);
+	if (NULL == map) { perror(NULL); exit(EXIT_FAILURE); }
+
+	char *line;
+	while (NULL != (line = read_line(map_file))) {
+		/* Skip comments and lines that are empty or all whitespace */
+		if ('#' == line[0] || is_all_whitespace(line)) {
+			free(line);
+			continue;
+		}
+
+		char *key, *value;
+		struct word_tokenizer *wtok = create_word_tokenizer(line);
+		if (NULL == wtok) { perror(NULL); exit(EXIT_FAILURE); }
+		key = wt_next(wtok);	/* find first whitespace */
+		if (NULL == key) {
+			fprintf (stderr,
+				"Wrong format in line '%s' - aborting.\n",
+				line);
+			exit(EXIT_FAILURE);
+		}
+		value = wt_next(wtok);
+		if (NULL == value) {
+			/* If 2nd token is NULL, replace label with empty
+			 * string */
+			value = strdup("");
+		}
+		if (! hash_set(map, key, (void *) value)) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		destroy_word_tokenizer(wtok);
+		free(key); /* copied by hash_set(), so can be free()d now */
+		free(line);
+	}
+
+	return map;
+}
+
+struct id_map index_map_by_label_id(struct hash *rename_map)
+{
+	struct llist *keys = hash_keys(rename_map);
+	if (NULL == keys) { perror(NULL); exit(EXIT_FAILURE); }
+	struct list_elem *e;
+	for (e = keys->head; NULL != e; e = e->next) {
+		char *key = (char *) e->data;
+		if (intern_label(key) < 0 ||
+			intern_label(hash_get(rename_map, key)) < 0) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	}
+
+	struct id_map map;
+	map.size = interned_label_count();
+	map.new_id = malloc(map.size * sizeof(int));
+	if (NULL == map.new_id) { perror(NULL); exit(EXIT_FAILURE); }
+	int id;
+	for (id = 0; id < map.size; id++) map.new_id[id] = -1;
+	for (e = keys->head; NULL != e; e = e->next) {
+		char *key = (char *) e->data;
+		map.new_id[find_label_id(key)] =
+			find_label_id(hash_get(rename_map, key));
+	}
+	destroy_llist(keys);
+
+	return map;
+}
+
+int rename_tree(struct rooted_tree *tree, const struct id_map *map,
+		bool only_leaves)
+{
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = el->data;
+		if (only_leaves && ! is_leaf(current)) continue;
+		int id = current->label_id;
+		if (id < 0 || id >= map->size || -1 == map->new_id[id])
+			continue;
+		char *label = strdup(interned_label(map->new_id[id]));
+		if (NULL == label) return FAILURE;
+		free(current->label);
+		current->label = label;
+		current->label_id = map->new_id[id];
+	}
+
+	return SUCCESS;
+}
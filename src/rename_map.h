@@ -0,0 +1,64 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* rename_map.h: label rename maps, as used by nw_rename (and nw_pipe) */
+
+#include <stdbool.h>
+
+struct hash;
+struct rooted_tree;
+
+/* Reads a rename map from 'filename': one (old-label, new-label) pair per
+ * line, separated by whitespace. A missing new label means the empty label.
+ * Empty lines and lines starting with '#' are skipped. Returns a label -> new
+ * label hash. Exits in case of problems. */
+
+struct hash *read_map(const char *filename);
+
+/* A rename map indexed by label ID: new_id[id] is the ID of the new label for
+ * nodes labelled 'id', or -1 if they keep their label. Labels first seen after
+ * the map was built have IDs beyond 'size', and are not renamed. */
+
+struct id_map {
+	int *new_id;
+	int size;
+};
+
+/* Converts a label -> new label hash into an id_map. This interns all the
+ * labels in the map, so label interning must be on. Exits in case of malloc()
+ * problems. */
+
+struct id_map index_map_by_label_id(struct hash *rename_map);
+
+/* Renames the nodes of 'tree' (only the leaves if 'only_leaves' is true)
+ * according to 'map'. Labels and label IDs are kept in step. No label is
+ * interned, so different trees may be renamed in parallel. Returns SUCCESS,
+ * or FAILURE in case of malloc() problems. */
+
+int rename_tree(struct rooted_tree *tree, const struct id_map *map,
+		bool only_leaves);
@@ -45,16 +45,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "hash.h"
 #include "common.h"
 #include "link.h"
-
-enum reroot_status { REROOT_OK, LCA_IS_TREE_ROOT, NOT_PHYLOGRAM };
-enum deroot_status { DEROOT_OK, BALANCED, NOT_BIFURCATING, MEM_PROB };
-
-struct parameters {
-	struct llist *labels;
-	bool try_ingroup;
-	bool deroot;
-	bool i_node_lbl_as_support;	/* Treat inner node labels as support values */
-};
+#include "profile.h"
+#include "reroot_outgroup.h"
+#include "compressed_io.h"
 
 void help(char *argv[])
 {
@@ -64,7 +57,7 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-dhls] <newick trees filename|-> [label*]\n"
+"%s [-dhlsz:] <newick trees filename|-> [label*]\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -100,6 +93,9 @@ void help(char *argv[])
 "        edges, and are treated differently from clade labels, which are\n"
 "        really properties of nodes. The \"Rerooting\" section of the manual\n"
 "        has more details.\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -118,17 +114,17 @@ void help(char *argv[])
 	);
 }
 
-struct parameters get_params(int argc, char *argv[])
+struct reroot_params get_params(int argc, char *argv[])
 {
 
-	struct parameters params;
+	struct reroot_params params;
 
 	params.try_ingroup = false;
 	params.deroot = false;
 	params.i_node_lbl_as_support = false;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "dhls")) != -1) {
+	while ((opt_char = getopt(argc, argv, "dhlsz:")) != -1) {
 		switch (opt_char) {
 		case '?':
 			// TODO what is this case for?
@@ -145,6 +141,13 @@ struct parameters get_params(int argc, char *argv[])
 		case 's':
 			params.i_node_lbl_as_support = true;
 			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
 			exit (EXIT_FAILURE);
@@ -161,7 +164,7 @@ struct parameters get_params(int argc, char *argv[])
 	}
 	/* read arguments */
 	if (0 != strcmp("-", argv[optind])) {
-		FILE *fin = fopen(argv[optind], "r");
+		FILE *fin = open_input_file(argv[optind]);
 		extern FILE *nwsin;
 		if (NULL == fin) {
 			perror(NULL);
@@ -183,293 +186,34 @@ struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
-/* Returns the node whose length is the longest. Returns NULL if it finds a
- * node with an undefined length (i.e., the tree is not a strict phylogram).
- * The root is not considered (although technically Newick allows edge lengths
- * on the root) */
-
-struct rnode *node_with_longest_edge(struct rooted_tree *tree)
-{
-	double max = 0; /* some branch lengths can be < 0, but not all */
-	struct rnode *result = NULL;
-
-	struct list_elem *el;
-	/* NULL != el->next: stops the iteration _just before_ the root,
-	 * since we don't need to consider it. */
-	for (el = tree->nodes_in_order->head; NULL != el->next;
-			el = el->next) {
-		struct rnode *current = el->data;
-		if (strcmp(current->edge_length_as_string, "") == 0)
-			return NULL;
-		double len = atof(current->edge_length_as_string);
-		if (len > max) {
-			max = len;
-			result = current;
-		}
-	}
-
-	return result;
-}
-
-/* given the labels of the outgroup nodes, returns the nodes themselves, as a
- * llist. */
-
-struct llist * get_outgroup_nodes(struct rooted_tree *tree, struct llist *labels)
-{
-	struct hash *map;
-	struct llist *outgroup_nodes;
-	struct list_elem *el;
-
-	map = create_label2node_map(tree->nodes_in_order);	
-	outgroup_nodes = create_llist();
-	if (NULL == outgroup_nodes) { perror(NULL); exit(EXIT_FAILURE); }
-	for (el = labels->head; NULL != el; el = el->next) {
-		struct rnode *desc;
-		desc = hash_get(map, (char *) el->data);
-		if (NULL == desc) {
-			fprintf (stderr, "WARNING: label '%s' does not occur in tree\n",
-					(char *) el->data);
-		} else {
-			if (! append_element(outgroup_nodes, desc)) {
-				perror(NULL);
-				exit(EXIT_FAILURE);
-			}
-		}
-	}
-        destroy_hash(map);
-
-	return outgroup_nodes;
-}
-
-/* Performs the rerooting itself. 'outgroup_nodes' usually means just that,
- * but may also mean ingroup nodes, if option -l was passed and rerooting on
- * outgroup failed. */
+/* Reroots on the outgroup (or, with -l, on the ingroup if this fails), or
+ * deroots, then prints the tree. */
 
-int reroot(struct rooted_tree *tree, struct llist *outgroup_nodes,
-		bool i_node_lbl_as_support)
+void process_tree(struct rooted_tree *tree, struct reroot_params *params)
 {
-	struct rnode *outgroup_root;
-	if (0 == outgroup_nodes->count) {
-		outgroup_root = node_with_longest_edge(tree);
-		if (NULL == outgroup_root)
-			return NOT_PHYLOGRAM;
-	}
-	else {
-		outgroup_root = lca_from_nodes(tree, outgroup_nodes);
-		if (NULL == outgroup_root) { perror(NULL); exit(EXIT_FAILURE); }
-	}
-
-	if (tree->root == outgroup_root) {
-		return LCA_IS_TREE_ROOT;
-	}
-	if (! reroot_tree (tree, outgroup_root, i_node_lbl_as_support)) {
-		perror(NULL);
-		exit(EXIT_FAILURE);
-	}
-
-	return REROOT_OK;
-}
-
-/* De-roots a tree, in the sense that the top node must contain 3 (or more if
- * the tree isn't strictly bifurcating) children. */
-
-enum deroot_status deroot(struct rooted_tree *tree)
-{
-	if (2 != tree->root->child_count)
-		return NOT_BIFURCATING;
-	struct rnode *left_kid = tree->root->first_child;
-	struct rnode *right_kid = tree->root->last_child;
-
-	struct llist *left_desc = get_nodes_in_order(left_kid);
-	if (NULL == left_desc) return MEM_PROB; 
-	struct llist *right_desc = get_nodes_in_order(right_kid);
-	if (NULL == right_desc) return MEM_PROB; 
-
-	/* We splice out the left or right kid of the root, and also free() it.
-	 * However, a simple splicing-out would result in incorrect branch
-	 * lengths in this case (which is admittedly rather special). For this
-	 * reason, we have to correct them.  */
-
-	struct rnode *ingroup = NULL, *outgroup = NULL;
-	char *ingroup_len = NULL, *outgroup_len = NULL;
-
-	if (left_desc->count < right_desc->count) {
-		ingroup = right_kid;
-		outgroup = left_kid;
-	}
-	else if (left_desc->count > right_desc->count) {
-		ingroup = left_kid;
-		outgroup = right_kid;
-	}
-	else 
-		return BALANCED;
-
-	ingroup_len = ingroup->edge_length_as_string;
-	outgroup_len = outgroup->edge_length_as_string;
-
-	if ( (0 != strcmp("", ingroup_len)) &&
-	     (0 != strcmp("", outgroup_len)) ) {
-		char *og_new_len = add_len_strings(ingroup_len, outgroup_len); 
-		free(ingroup->edge_length_as_string);
-		ingroup->edge_length_as_string = strdup("0");
-		free(outgroup->edge_length_as_string);
-		outgroup->edge_length_as_string = strdup(og_new_len);
-		free(og_new_len);
-	}
-	if (! splice_out_rnode(ingroup)) {
-		perror(NULL); exit(EXIT_FAILURE);
-	}
-
-	return DEROOT_OK;
-}
-
-/* Returns true IFF arguments (cast to char*) are equal - IOW, the negation
- * of strcmp(). See llist_index_of() in list.h */
-
-bool string_eq(void *list_data, void *target)
-{
-	return (strcmp((char *) list_data, (char *) target) == 0);
-}
-
-/* Return a list of leaves whose labels are NOT found in
- * 'excluded_labels' */ 
-
-struct llist *get_ingroup_leaves(struct rooted_tree *tree,
-		struct llist *excluded_labels)
-{
-	struct llist *result = create_llist();
-	if (NULL == result) { perror(NULL); exit(EXIT_FAILURE); }
-	struct hash *excluded_lbl_hash = create_hash(excluded_labels->count);
-	if (NULL == excluded_lbl_hash) { perror(NULL); exit(EXIT_FAILURE); }
-	struct list_elem *el;
-
-	/* Make a hash with all excluded labels. */
-	for (el = excluded_labels->head; NULL != el; el = el->next)  {
-		if (! hash_set(excluded_lbl_hash, 
-					(char *) el->data,
-					(void *) "member")) {
-			perror(NULL);
-			exit(EXIT_FAILURE);
-		}
-	}
-
-	/* add nodes to result iff i) node is a leaf, ii) node's label is not
-	 * among 'excluded_lbl_hash' */ 
-	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
-		struct rnode *current = (struct rnode *) el->data;
-		if (is_leaf(current)) {
-			bool add = false;
-			if (strcmp ("", current->label) == 0)
-				add = true;	
-			else  {
-				if (NULL == hash_get(excluded_lbl_hash,
-						current->label))
-					add = true;
-			}
-			if (add) {
-				if (! append_element(result, current)) {
-					perror(NULL);
-					exit(EXIT_FAILURE);
-				}
-			}
-			
-		}
-	}
-
-	destroy_hash(excluded_lbl_hash);
-	return result;
-}
-
-void try_ingroup(struct rooted_tree *tree, struct parameters params)
-{
-	/* we will try to insert the root above the ingroup - for this we'll
-	 * need all leaves that are NOT in the outgroup. We don't need the
-	 * inner nodes, though, since tha leaves are sufficient for determining
-	 * the ingroup's LCA. This also works if some leaf labels are empty
-	 * (see test case 'nolbl_ingrp' in test_nw_reroot_args) */
-	struct llist *ingroup_leaves;
-	ingroup_leaves = get_ingroup_leaves(tree, params.labels);
-	enum reroot_status result = reroot(tree, ingroup_leaves,
-			params.i_node_lbl_as_support);
-	switch (result) {
-		case REROOT_OK:
+	if (! params->deroot) {
+		enum reroot_status result = reroot_on_outgroup(tree, params);
+		if (REROOT_OK == result)
 			dump_newick(tree->root);
-			break;
-		case LCA_IS_TREE_ROOT:
-			fprintf (stderr, "LCA is still tree's root "
-				"- be sure to include ALL outgroup "
-				"leaves with -l");
-			break;
-	}
-	destroy_llist(ingroup_leaves);
-}
-
-/* Tries to reroot 'directly', i.e. using outgroup. If this fails (because the
- * outgroup's LCA is the tree's root) and 'try_ingroup' is true (option -l),
- * tries with the ingroup */
-
-void process_tree(struct rooted_tree *tree, struct parameters params)
-{
-	struct llist *outgroup_nodes = get_outgroup_nodes(tree, params.labels);
-	if (! params.deroot) {
-		/* re-root according to outgroup nodes */
-		enum reroot_status result = reroot(tree, outgroup_nodes, 
-				params.i_node_lbl_as_support);
-		switch (result) {
-		case REROOT_OK:
-			dump_newick(tree->root);
-			break;
-		case LCA_IS_TREE_ROOT:
-			if (params.try_ingroup)
-				try_ingroup(tree, params);
-			else {
-				fprintf (stderr,
-					"ERROR: Outgroup's LCA is tree's root "
-					"- cannot reroot. Try -l.\n");
-			}
-			break;
-		case NOT_PHYLOGRAM:
-			fprintf (stderr, 
-				"ERROR: Tree must be a phylogram, but some "
-				"branch lengths are not defined - aborting.\n");
-			break;
-		default:
-			assert(0);
-		}
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
+		else
+			print_reroot_error(result);
 	} else {
 		enum deroot_status result = deroot(tree);
-		switch (result) {
-		case DEROOT_OK:
+		if (DEROOT_OK == result)
 			dump_newick(tree->root);
-			break;
-		case NOT_BIFURCATING:
-			fprintf (stderr,
-				"ERROR: tree is already unrooted, or root"
-				" has only 1 child - cannot deroot.\n");
-			break;
-		case BALANCED:
-			fprintf (stderr,
-				"ERROR: can't decide which of root's "
-				"children is the outgroup.\n");
-			break;
-		case MEM_PROB:
-			perror(NULL);
-			break;
-		default:
-			assert(0);
-		}
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
+		else
+			print_deroot_error(result);
 	}
-	destroy_llist(outgroup_nodes);
+	destroy_all_rnodes(NULL);
+	destroy_tree(tree);
 }
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
-	struct parameters params;
+	struct reroot_params params;
 	
 	params = get_params(argc, argv);
 	while (NULL != (tree = parse_tree())) {
@@ -478,7 +222,7 @@ int main(int argc, char *argv[])
 		 * destroy_tree()), but rerooting is not. */
 		// TODO: why not? Can this be obsolete now that rnodes are
 		// free()d at the end? 
-		process_tree(tree, params);
+		process_tree(tree, &params);
 	}
 
 	destroy_llist(params.labels);
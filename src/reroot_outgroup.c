@@ -0,0 +1,316 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* reroot_outgroup.c - the rerooting done by nw_reroot (see reroot.c), also
+ * used by nw_pipe */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "tree.h"
+#include "nodemap.h"
+#include "list.h"
+#include "lca.h"
+#include "rnode.h"
+#include "hash.h"
+#include "common.h"
+#include "link.h"
+#include "reroot_outgroup.h"
+
+/* Returns the node whose length is the longest. Returns NULL if it finds a
+ * node with an undefined length (i.e., the tree is not a strict phylogram).
+ * The root is not considered (although technically Newick allows edge lengths
+ * on the root) */
+
+static struct rnode *node_with_longest_edge(struct rooted_tree *tree)
+{
+	double max = 0; /* some branch lengths can be < 0, but not all */
+	struct rnode *result = NULL;
+
+	struct list_elem *el;
+	/* NULL != el->next: stops the iteration _just before_ the root,
+	 * since we don't need to consider it. */
+	for (el = tree->nodes_in_order->head; NULL != el->next;
+			el = el->next) {
+		struct rnode *current = el->data;
+		if (! has_edge_length(current))
+			return NULL;
+		double len = get_edge_length(current);
+		if (len > max) {
+			max = len;
+			result = current;
+		}
+	}
+
+	return result;
+}
+
+/* given the labels of the outgroup nodes, returns the nodes themselves, as a
+ * llist. */
+
+static struct llist * get_outgroup_nodes(struct rooted_tree *tree,
+		struct llist *labels)
+{
+	struct hash *map;
+	struct llist *outgroup_nodes;
+	struct list_elem *el;
+
+	map = create_label2node_map(tree->nodes_in_order);	
+	if (NULL == map) { perror(NULL); exit(EXIT_FAILURE); }
+	outgroup_nodes = create_llist();
+	if (NULL == outgroup_nodes) { perror(NULL); exit(EXIT_FAILURE); }
+	for (el = labels->head; NULL != el; el = el->next) {
+		struct rnode *desc;
+		desc = hash_get(map, (char *) el->data);
+		if (NULL == desc) {
+			fprintf (stderr, "WARNING: label '%s' does not occur in tree\n",
+					(char *) el->data);
+		} else {
+			if (! append_element(outgroup_nodes, desc)) {
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+        destroy_hash(map);
+
+	return outgroup_nodes;
+}
+
+/* Return a list of leaves whose labels are NOT found in
+ * 'excluded_labels' */ 
+
+static struct llist *get_ingroup_leaves(struct rooted_tree *tree,
+		struct llist *excluded_labels)
+{
+	struct llist *result = create_llist();
+	if (NULL == result) { perror(NULL); exit(EXIT_FAILURE); }
+	struct hash *excluded_lbl_hash = create_hash(excluded_labels->count);
+	if (NULL == excluded_lbl_hash) { perror(NULL); exit(EXIT_FAILURE); }
+	struct list_elem *el;
+
+	/* Make a hash with all excluded labels. */
+	for (el = excluded_labels->head; NULL != el; el = el->next)  {
+		if (! hash_set(excluded_lbl_hash, 
+					(char *) el->data,
+					(void *) "member")) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* add nodes to result iff i) node is a leaf, ii) node's label is not
+	 * among 'excluded_lbl_hash' */ 
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = (struct rnode *) el->data;
+		if (is_leaf(current)) {
+			bool add = false;
+			if (strcmp ("", current->label) == 0)
+				add = true;	
+			else  {
+				if (NULL == hash_get(excluded_lbl_hash,
+						current->label))
+					add = true;
+			}
+			if (add) {
+				if (! append_element(result, current)) {
+					perror(NULL);
+					exit(EXIT_FAILURE);
+				}
+			}
+			
+		}
+	}
+
+	destroy_hash(excluded_lbl_hash);
+	return result;
+}
+
+/* Returns the LCA of 'nodes', or the node with the longest edge if 'nodes' is
+ * empty. Returns NULL (and sets 'status') if there is no such node. */
+
+static struct rnode *lca_or_longest_edge(struct rooted_tree *tree,
+		struct llist *nodes, enum reroot_status *status)
+{
+	struct rnode *result;
+	if (0 == nodes->count) {
+		result = node_with_longest_edge(tree);
+		if (NULL == result)
+			*status = NOT_PHYLOGRAM;
+	}
+	else {
+		result = lca_from_nodes(tree, nodes);
+		if (NULL == result) { perror(NULL); exit(EXIT_FAILURE); }
+	}
+	return result;
+}
+
+struct rnode *find_outgroup_root(struct rooted_tree *tree,
+		struct reroot_params *params, enum reroot_status *status)
+{
+	struct llist *outgroup_nodes = get_outgroup_nodes(tree, params->labels);
+	struct rnode *outgroup_root = lca_or_longest_edge(tree,
+			outgroup_nodes, status);
+	destroy_llist(outgroup_nodes);
+	if (NULL == outgroup_root) return NULL;
+	*status = REROOT_OK;
+	if (tree->root != outgroup_root) return outgroup_root;
+
+	if (! params->try_ingroup) {
+		*status = LCA_IS_TREE_ROOT;
+		return NULL;
+	}
+
+	/* we will try to insert the root above the ingroup - for this we'll
+	 * need all leaves that are NOT in the outgroup. We don't need the
+	 * inner nodes, though, since tha leaves are sufficient for determining
+	 * the ingroup's LCA. This also works if some leaf labels are empty
+	 * (see test case 'nolbl_ingrp' in test_nw_reroot_args) */
+	struct llist *ingroup_leaves = get_ingroup_leaves(tree, params->labels);
+	outgroup_root = lca_or_longest_edge(tree, ingroup_leaves, status);
+	destroy_llist(ingroup_leaves);
+	if (NULL == outgroup_root) return NULL;
+	if (tree->root == outgroup_root) {
+		*status = INGROUP_LCA_IS_TREE_ROOT;
+		return NULL;
+	}
+
+	return outgroup_root;
+}
+
+enum reroot_status reroot_on_outgroup(struct rooted_tree *tree,
+		struct reroot_params *params)
+{
+	enum reroot_status status;
+	struct rnode *outgroup_root = find_outgroup_root(tree, params, &status);
+	if (NULL == outgroup_root) return status;
+
+	if (! reroot_tree(tree, outgroup_root, params->i_node_lbl_as_support)) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
+	}
+
+	return REROOT_OK;
+}
+
+enum deroot_status deroot(struct rooted_tree *tree)
+{
+	if (2 != tree->root->child_count)
+		return NOT_BIFURCATING;
+	struct rnode *left_kid = tree->root->first_child;
+	struct rnode *right_kid = tree->root->last_child;
+
+	struct llist *left_desc = get_nodes_in_order(left_kid);
+	if (NULL == left_desc) return MEM_PROB; 
+	struct llist *right_desc = get_nodes_in_order(right_kid);
+	if (NULL == right_desc) return MEM_PROB; 
+
+	/* We splice out the left or right kid of the root, and also free() it.
+	 * However, a simple splicing-out would result in incorrect branch
+	 * lengths in this case (which is admittedly rather special). For this
+	 * reason, we have to correct them.  */
+
+	struct rnode *ingroup = NULL, *outgroup = NULL;
+	int left_count = left_desc->count;
+	int right_count = right_desc->count;
+	destroy_llist(left_desc);
+	destroy_llist(right_desc);
+
+	if (left_count < right_count) {
+		ingroup = right_kid;
+		outgroup = left_kid;
+	}
+	else if (left_count > right_count) {
+		ingroup = left_kid;
+		outgroup = right_kid;
+	}
+	else 
+		return BALANCED;
+
+	if (has_edge_length(ingroup) && has_edge_length(outgroup)) {
+		add_edge_length(outgroup, ingroup);
+		set_edge_length(ingroup, 0.0);
+	}
+	if (! splice_out_rnode(ingroup)) {
+		perror(NULL); exit(EXIT_FAILURE);
+	}
+
+	return DEROOT_OK;
+}
+
+void print_reroot_error(enum reroot_status status)
+{
+	switch (status) {
+	case REROOT_OK:
+		break;
+	case LCA_IS_TREE_ROOT:
+		fprintf (stderr,
+			"ERROR: Outgroup's LCA is tree's root "
+			"- cannot reroot. Try -l.\n");
+		break;
+	case INGROUP_LCA_IS_TREE_ROOT:
+		fprintf (stderr, "LCA is still tree's root "
+			"- be sure to include ALL outgroup "
+			"leaves with -l\n");
+		break;
+	case NOT_PHYLOGRAM:
+		fprintf (stderr, 
+			"ERROR: Tree must be a phylogram, but some "
+			"branch lengths are not defined - aborting.\n");
+		break;
+	default:
+		assert(0);
+	}
+}
+
+void print_deroot_error(enum deroot_status status)
+{
+	switch (status) {
+	case DEROOT_OK:
+		break;
+	case NOT_BIFURCATING:
+		fprintf (stderr,
+			"ERROR: tree is already unrooted, or root"
+			" has only 1 child - cannot deroot.\n");
+		break;
+	case BALANCED:
+		fprintf (stderr,
+			"ERROR: can't decide which of root's "
+			"children is the outgroup.\n");
+		break;
+	case MEM_PROB:
+		perror(NULL);
+		break;
+	default:
+		assert(0);
+	}
+}
@@ -0,0 +1,78 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* reroot_outgroup.h: rerooting on an outgroup, and derooting, as done by
+ * nw_reroot (and nw_pipe) */
+
+#include <stdbool.h>
+
+struct rooted_tree;
+struct rnode;
+struct llist;
+
+enum reroot_status { REROOT_OK, LCA_IS_TREE_ROOT, INGROUP_LCA_IS_TREE_ROOT,
+	NOT_PHYLOGRAM };
+enum deroot_status { DEROOT_OK, BALANCED, NOT_BIFURCATING, MEM_PROB };
+
+struct reroot_params {
+	struct llist *labels;	/* outgroup labels (char *) */
+	bool try_ingroup;	/* reroot on the ingroup if the outgroup fails */
+	bool deroot;
+	bool i_node_lbl_as_support;	/* Treat inner node labels as support values */
+};
+
+/* Returns the node above which 'tree' must be rerooted: the LCA of the nodes
+ * labelled by 'params->labels', or the node with the longest edge if there
+ * are no labels. If the LCA is the tree's root and 'params->try_ingroup' is
+ * true, the LCA of the other leaves is tried. If there is no suitable node,
+ * returns NULL and sets 'status' to the reason. The tree is not modified, and
+ * no rnode is created, so this may be called on different trees in parallel.
+ * Exits in case of malloc() problems. */
+
+struct rnode *find_outgroup_root(struct rooted_tree *tree,
+		struct reroot_params *params, enum reroot_status *status);
+
+/* Finds the outgroup (see find_outgroup_root()) and reroots 'tree' above it.
+ * Returns REROOT_OK, or the reason the tree could not be rerooted. Exits in
+ * case of malloc() problems. */
+
+enum reroot_status reroot_on_outgroup(struct rooted_tree *tree,
+		struct reroot_params *params);
+
+/* De-roots a tree, in the sense that the top node must contain 3 (or more if
+ * the tree isn't strictly bifurcating) children. */
+
+enum deroot_status deroot(struct rooted_tree *tree);
+
+/* Prints an error message for 'status' on stderr (nothing for REROOT_OK) */
+
+void print_reroot_error(enum reroot_status status);
+
+/* Same, for deroot() */
+
+void print_deroot_error(enum deroot_status status);
@@ -38,6 +38,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "common.h"
 #include "list.h"
 #include "link.h"
+#include "label_intern.h"
+#include "profile.h"
 
 /* These variables are for keeping track of all allocated rnodes, so that we
  * can free them all (one call to free them all :-) */
@@ -65,7 +67,20 @@ struct rnode *create_rnode(char *label, char *length_as_string)
 		length_as_string = "";
 	}
 	node->label = strdup(label);
+	node->label_id = -1;
+	if (label_interning_enabled()) {
+		node->label_id = intern_label(label);
+		if (node->label_id < 0) {
+			free(node->label);
+			free(node);
+			return NULL;
+		}
+	}
 	node->edge_length_as_string = strdup(length_as_string);
+	PROFILE_NODES(1);
+	PROFILE_ALLOC(sizeof(struct rnode));
+	PROFILE_ALLOC(strlen(label) + 1);
+	PROFILE_ALLOC(strlen(length_as_string) + 1);
 	node->parent = NULL;
 	node->next_sibling = NULL;
 	node->first_child = NULL;
@@ -78,6 +93,7 @@ struct rnode *create_rnode(char *label, char *length_as_string)
 	 * length_as_string, which will be an empty string ("") if the length
 	 * is not defined (as in cladograms). */
 	node->edge_length = -1;	
+	node->length_parsed = false;
 	/* These are used when iterating on the tree structure. See
 	 * rnode_iterator.c */
 	node->current_child = NULL;
@@ -118,15 +134,100 @@ void destroy_rnode(struct rnode *node, void (*free_data)(void *))
 	free(node);
 }
 
-void destroy_all_rnodes(void (*free_data)(void *))
+int rnode_watermark() { return rnode_count; }
+
+void destroy_rnodes_since(int watermark, void (*free_data)(void *))
 {
-	while (rnode_count > 0)
+	while (rnode_count > watermark)
 		destroy_rnode(rnode_array[--rnode_count], free_data);
+}
+
+void destroy_all_rnodes(void (*free_data)(void *))
+{
+	destroy_rnodes_since(0, free_data);
 	free(rnode_array);
 	rnode_array_size = 0;
 	rnode_array = NULL;
 }
 
+bool has_edge_length(struct rnode *node)
+{
+	return NULL == node->edge_length_as_string ||
+		'\0' != node->edge_length_as_string[0];
+}
+
+double get_edge_length(struct rnode *node)
+{
+	if (! node->length_parsed) {
+		/* atof("") is 0, which is what we want for undefined
+		 * lengths */
+		node->edge_length = atof(node->edge_length_as_string);
+		node->length_parsed = true;
+	}
+	return node->edge_length;
+}
+
+void set_edge_length(struct rnode *node, double length)
+{
+	free(node->edge_length_as_string);
+	node->edge_length_as_string = NULL;
+	node->edge_length = length;
+	node->length_parsed = true;
+}
+
+int set_edge_length_string(struct rnode *node, const char *length_as_string)
+{
+	char *copy = strdup(length_as_string);
+	if (NULL == copy) return FAILURE;
+	free(node->edge_length_as_string);
+	node->edge_length_as_string = copy;
+	node->length_parsed = false;
+	return SUCCESS;
+}
+
+const char *edge_length_string(struct rnode *node)
+{
+	if (NULL == node->edge_length_as_string) {
+		char buf[EDGE_LENGTH_BUFSIZE];
+		format_edge_length(buf, node->edge_length);
+		node->edge_length_as_string = strdup(buf);
+	}
+	return node->edge_length_as_string;
+}
+
+/* Fewer significant digits never read back as the same number once more
+ * digits don't, so we can bisect on the precision. Like "%g", we only use an
+ * exponent for very small or large numbers, but trailing zeroes are never
+ * needed, so this is also where "%g" has to stop using plain notation. */
+
+int format_edge_length(char *buf, double length)
+{
+	int lo = 1, hi = 17;	/* 17 digits always suffice for a double */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		snprintf(buf, EDGE_LENGTH_BUFSIZE, "%.*e", mid - 1, length);
+		if (strtod(buf, NULL) == length)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	int written = snprintf(buf, EDGE_LENGTH_BUFSIZE, "%.*e", lo - 1, length);
+	char *e = strchr(buf, 'e');
+	if (NULL == e) return written;	/* inf or nan */
+	int exponent = atoi(e + 1);
+	if (exponent < -4 || exponent >= 16) return written;
+	int decimals = lo - 1 - exponent;
+	if (decimals < 0) decimals = 0;
+	return snprintf(buf, EDGE_LENGTH_BUFSIZE, "%.*f", decimals, length);
+}
+
+void add_edge_length(struct rnode *node, struct rnode *other)
+{
+	if (! has_edge_length(node) && ! has_edge_length(other)) return;
+	set_edge_length(node, get_edge_length(node) + get_edge_length(other));
+}
+
 void show_all_rnodes()
 {
 	struct rnode **rnode_h;
@@ -183,9 +284,15 @@ bool all_children_have_same_label(struct rnode *node, char **label)
 	 * */
 
 	*label = NULL;
-	for (curr = curr->next_sibling; NULL != curr; curr = curr->next_sibling)
-		if (0 != strcmp(ref_label, curr->label))
+	int ref_id = node->first_child->label_id;
+	for (curr = curr->next_sibling; NULL != curr; curr = curr->next_sibling) {
+		/* interned labels are equal IFF their IDs are */
+		if (ref_id >= 0 && curr->label_id >= 0) {
+			if (ref_id != curr->label_id)
+				return 0;
+		} else if (0 != strcmp(ref_label, curr->label))
 			return 0; /* found a different label */
+	}
 
 	*label = ref_label;
 	return 1;
@@ -197,8 +304,8 @@ void dump_rnode(void *arg)
 
 	printf ("\nrnode at %p\n", node);
 	printf ("  label at %p = '%s'\n", node->label, node->label);
-	printf ("  edge length = '%s'\n", node->edge_length_as_string);
-	printf ("              = %f\n", node->edge_length);
+	printf ("  edge length = '%s'\n", edge_length_string(node));
+	printf ("              = %f\n", get_edge_length(node));
 	printf ("  1st child   = %p\n", node->first_child);
 	printf ("  data    = %p\n", node->data);
 }
@@ -275,53 +382,112 @@ struct llist *get_nodes_in_order(struct rnode *root)
 	return nodes_in_order;
 }
 
-/* One could get this one by passing a constantly true predicate to
- * clone_rnode_cond() - but this will be a bit faster. */
+/* Both cloning functions walk the target with an explicit stack rather than
+ * by recursion, so that the depth of the tree they can handle is bounded by
+ * memory, not by the C stack (caterpillars with millions of levels are not
+ * unheard of). A frame holds a target node, its clone, and the next child of
+ * the target that remains to be looked at. */
 
-struct rnode *clone_rnode(struct rnode *target)
+struct clone_frame {
+	struct rnode *target;
+	struct rnode *clone;
+	struct rnode *kid;
+};
+
+/* Copies the edge length of 'target' to 'clone', without formatting it if it
+ * was set as a number. */
+
+static void copy_edge_length(struct rnode *clone, struct rnode *target)
+{
+	if (NULL == target->edge_length_as_string)
+		set_edge_length(clone, target->edge_length);
+}
+
+/* Creates a childless copy of 'target'. */
+
+static struct rnode *clone_single_rnode(struct rnode *target)
 {
 	struct rnode *result = create_rnode(target->label,
 			target->edge_length_as_string);
 	if (NULL == result) return NULL;
-	struct rnode *kid = target->first_child;
-	for (; NULL != kid; kid = kid->next_sibling) {
-		struct rnode *kid_clone = clone_rnode(kid);
-		if (NULL == kid_clone) return NULL;
-		add_child(result, kid_clone);
-	}
-
+	copy_edge_length(result, target);
 	return result;
 }
 
-struct rnode *clone_rnode_cond(struct rnode *target,
+/* Does the work of clone_rnode() and clone_rnode_cond(). A NULL 'predicate'
+ * accepts every child and disables the collapsing of single-child clones. */
+
+static struct rnode *clone_nodes(struct rnode *target,
 		bool (*predicate)(struct rnode *, void *param), void *param)
 {
-	struct rnode *result = create_rnode(target->label,
-			target->edge_length_as_string);
-	if (NULL == result) return NULL;
-
-	struct rnode *kid = target->first_child;
-	for (; NULL != kid; kid = kid->next_sibling) {
-		if (predicate(kid, param)) {
-			struct rnode *kid_clone =
-				clone_rnode_cond(kid, predicate, param);
-			add_child(result, kid_clone);
+	int stack_size = 64;
+	int top = 0;
+	struct clone_frame *stack = malloc(stack_size *
+			sizeof(struct clone_frame));
+	if (NULL == stack) return NULL;
+
+	struct rnode *result = clone_single_rnode(target);
+	if (NULL == result) { free(stack); return NULL; }
+	stack[top].target = target;
+	stack[top].clone = result;
+	stack[top].kid = target->first_child;
+	top++;
+
+	while (top > 0) {
+		struct clone_frame *frame = &stack[top-1];
+		struct rnode *kid = frame->kid;
+		while (NULL != kid && NULL != predicate &&
+				! predicate(kid, param))
+			kid = kid->next_sibling;
+
+		if (NULL != kid) {
+			frame->kid = kid->next_sibling;
+			struct rnode *kid_clone = clone_single_rnode(kid);
+			if (NULL == kid_clone) { free(stack); return NULL; }
+			if (top == stack_size) {
+				stack_size *= 2;
+				struct clone_frame *new_stack = realloc(stack,
+					stack_size * sizeof(struct clone_frame));
+				if (NULL == new_stack) {
+					free(stack);
+					return NULL;
+				}
+				stack = new_stack;
+			}
+			stack[top].target = kid;
+			stack[top].clone = kid_clone;
+			stack[top].kid = kid->first_child;
+			top++;
+			continue;
 		}
-	}
 
-	if (1 == children_count(result) &&
-	    1 != children_count(target))
-	{
-		char *new_edge_len_s = add_len_strings(
-			result->first_child->edge_length_as_string,
-			result->edge_length_as_string);
-		if (NULL == new_edge_len_s) return NULL;
-		free(result->first_child->edge_length_as_string);
-		result->first_child->edge_length_as_string = new_edge_len_s;
-		return result->first_child;
+		/* all children of this frame's target have been cloned */
+		struct rnode *done = frame->clone;
+		if (NULL != predicate && 1 == children_count(done) &&
+		    1 != children_count(frame->target)) {
+			add_edge_length(done->first_child, done);
+			done = done->first_child;
+		}
+		top--;
+		if (0 == top)
+			result = done;
+		else
+			add_child(stack[top-1].clone, done);
 	}
 
+	free(stack);
 	return result;
 }
 
+struct rnode *clone_rnode(struct rnode *target)
+{
+	return clone_nodes(target, NULL, NULL);
+}
+
+struct rnode *clone_rnode_cond(struct rnode *target,
+		bool (*predicate)(struct rnode *, void *param), void *param)
+{
+	return clone_nodes(target, predicate, param);
+}
+
 int _get_rnode_count() { return rnode_count; }
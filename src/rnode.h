@@ -39,15 +39,23 @@ struct hash;
 struct rnode {
 
 	char *label;	/**< The node's label. May be "", but is never NULL. */
+	/** The label's ID if label interning is on (see label_intern.h),
+	 * otherwise -1. Apps that turn interning on must keep this in step
+	 * with 'label' when they change it. */
+	int label_id;
 	/** The length of edge that leads to the parent (if any). Its value is
 	 * numeric, and it can be zero or even negative (NJ trees), it can also
 	 * be undefined (cladograms).  Therefore we store it as a string, with
 	 * "" indicating an undefined length. This is how Newick does it
-	 * anyway. */
+	 * anyway. The string is NULL when the length was last set as a number
+	 * (see set_edge_length()) and has not been formatted since, so use
+	 * the edge length functions below rather than reading it directly. */
 	char *edge_length_as_string;	
-	/** Used when we need the numerical value of the length
-	 * (which is not very frequent, but does happen). */
+	/** The numerical value of the length, valid IFF 'length_parsed' is
+	 * true. It is parsed on demand by get_edge_length(), since most apps
+	 * never need it. */
 	double edge_length;
+	bool length_parsed;
 	/** App-specific data. Any application-specific data (height, depth,
 	 * etc) can be put into a structure which is pointed to by this
 	 * member. See e.g. struct svg_data in svg_graph_common.h. */
@@ -84,6 +92,65 @@ struct rnode *create_rnode(char *label, char *length_as_string);
 
 void destroy_all_rnodes();
 
+/* Returns a watermark for the rnodes allocated so far, for use with
+ * destroy_rnodes_since(). */
+
+int rnode_watermark();
+
+/* Frees the rnodes allocated since rnode_watermark() returned 'watermark',
+ * and keeps the older ones. This lets an app keep a tree for the whole run
+ * (e.g. nw_match's pattern) and still free every input tree once it is
+ * processed, so that memory depends on the largest tree rather than on the
+ * length of the input. Each node's data is passed to 'free_data', or to free()
+ * if 'free_data' is NULL. */
+
+void destroy_rnodes_since(int watermark, void (*free_data)(void *));
+
+/* Size of a buffer large enough for format_edge_length() */
+
+#define EDGE_LENGTH_BUFSIZE 32
+
+/* Returns true IFF the edge leading to 'node' has a length (cladograms have
+ * none). */
+
+bool has_edge_length(struct rnode *node);
+
+/* Returns the numerical length of the edge leading to 'node' (0 if undefined).
+ * The string is parsed only once. */
+
+double get_edge_length(struct rnode *node);
+
+/* Sets the length of the edge leading to 'node'. The string form is only
+ * produced when needed, e.g. for output. */
+
+void set_edge_length(struct rnode *node, double length);
+
+/* Sets the length of the edge leading to 'node' from a string ("" means
+ * undefined). The string is copied. Returns SUCCESS, or FAILURE in case of
+ * malloc() problems. */
+
+int set_edge_length_string(struct rnode *node, const char *length_as_string);
+
+/* Returns the length of the edge leading to 'node' as a string ("" if
+ * undefined). A length that was set as a number is formatted as by
+ * format_edge_length(). The string belongs to the node. Returns NULL in case
+ * of malloc() problems. */
+
+const char *edge_length_string(struct rnode *node);
+
+/* Writes 'length' into 'buf' (which must have room for EDGE_LENGTH_BUFSIZE
+ * chars), using the fewest digits that still read back as exactly 'length'.
+ * Returns the number of characters written. */
+
+int format_edge_length(char *buf, double length);
+
+/* Adds the length of the edge leading to 'other' to that of the edge leading
+ * to 'node', as when 'other' is spliced out between 'node' and its parent. An
+ * undefined length counts as zero, but the result is undefined if both are.
+ * */
+
+void add_edge_length(struct rnode *node, struct rnode *other);
+
 /* returns the number of children a node has. */
 
 int children_count(struct rnode *node);
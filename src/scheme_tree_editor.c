@@ -57,6 +57,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "common.h"
 #include "masprintf.h"
 #include "rnode_smob.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 struct rnode *current_node;
 
@@ -308,7 +310,7 @@ static struct parameters get_params(int argc, char *argv[])
 	if (2 >= (argc - optind) &&
 	    argc > 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -403,9 +405,9 @@ static void reverse_parse_order_traversal(struct rooted_tree *tree)
 		if (parent_data->is_depth_defined) {
 			double edge_length;
 			char *endptr;
-			edge_length = strtod(node->edge_length_as_string,
-					&endptr);
-			if (endptr == node->edge_length_as_string) {
+			const char *length_s = edge_length_string(node);
+			edge_length = strtod(length_s, &endptr);
+			if (endptr == length_s) {
 				/* no conversion: depth is undefined */
 				rndata->is_depth_defined = false;
 			} else {
@@ -454,7 +456,7 @@ static void set_predefined_variables(struct rnode *node)
 {
 	SCM label = scm_from_locale_string(node->label);
 	SCM edge_length_as_scm_string  = scm_from_locale_string(
-			node->edge_length_as_string);
+			edge_length_string(node));
 	scm_c_define("lbl", label);
 
 	/* N: current node */
@@ -486,7 +488,7 @@ static void set_predefined_variables(struct rnode *node)
 		scm_c_define("l", SCM_BOOL_F);
 
 	/* L: parent edge's length */
-	if (strcmp ("", node->edge_length_as_string) == 0) 
+	if (! has_edge_length(node)) 
 		scm_c_define("L", SCM_UNDEFINED);
 	else	
 		scm_c_define("L", scm_string_to_number(
@@ -583,8 +585,6 @@ static SCM scm_set_label(SCM node, SCM label)
 
 static SCM scm_set_length(SCM edge_length)
 {
-	size_t buffer_length;	/* storage for length as string */
-
 	/* If edge_length is a string, we first try to convert it to a number.
 	 * If this fails, the edge length is undefined. */
 	if (scm_is_string(edge_length)) {
@@ -601,24 +601,14 @@ static SCM scm_set_length(SCM edge_length)
 	 * set the node's edge length to "" (i.e., unspecified) */
 
 	if (SCM_UNDEFINED == edge_length) {
-		free(current_node->edge_length_as_string);
-		current_node->edge_length_as_string = strdup("");
+		set_edge_length_string(current_node, "");
 		return SCM_UNSPECIFIED;
 	}
 
-	/* edge_length is a number. We convert it to a string, and set the edge
-	 * length to this value. */
+	/* edge_length is a number: it is only converted to a string when
+	 * needed. */
 
-	SCM edge_length_as_scm_string = scm_number_to_string(edge_length,
-			SCM_UNDEFINED);
-	buffer_length = scm_c_string_length(edge_length_as_scm_string);
-	char *buffer = calloc(buffer_length + 1, 'c');	/* +1: '\0' */
-	scm_to_locale_stringbuf(edge_length_as_scm_string, buffer, buffer_length);
-	buffer[buffer_length] = '\0';
-
-	/* Set the allocated buffer as the current node's length-as-string */
-	free(current_node->edge_length_as_string);
-	current_node->edge_length_as_string = buffer;
+	set_edge_length(current_node, scm_to_double(edge_length));
 
 	return SCM_UNSPECIFIED;
 }
@@ -910,6 +900,7 @@ static void inner_main(void *closure, int argc, char* argv[])
 
 int main(int argc, char* argv[])
 {
+       	argc = profile_init(argc, argv);
        	scm_boot_guile (argc, argv, inner_main, 0);
        	return 0; /* never reached */
 }
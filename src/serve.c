@@ -0,0 +1,876 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/* serve.c: answer queries about a set of trees over a Unix domain socket */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "tree.h"
+#include "parser.h"
+#include "rnode.h"
+#include "list.h"
+#include "to_newick.h"
+#include "tree_arrays.h"
+#include "prune_tree.h"
+#include "label_intern.h"
+#include "readline.h"
+#include "masprintf.h"
+#include "common.h"
+#include "compressed_io.h"
+
+/* Accepted connections wait in a queue of this size until a worker is free */
+enum { QUEUE_SIZE = 64 };
+
+struct parameters {
+	char *socket_path;
+	FILE *input;		/* NULL in client mode */
+	int nb_threads;
+};
+
+/* A loaded tree and its indexes. Nodes are numbered in preorder, as in struct
+ * tree_arrays, which supplies the parents and edge lengths. */
+
+struct served_tree {
+	struct rooted_tree *tree;
+	struct tree_arrays *arrays;
+	struct rnode **nodes;	/* by index */
+	int *level;		/* number of edges from the root */
+	/* distance from the root; as in nw_distance, undefined lengths
+	 * count as 1 (not as 0, like arrays->depth) */
+	double *depth;
+	/* jump[k][i] is the ancestor of node i 2^k levels up, or -1; jump[0]
+	 * is arrays->parent. */
+	int **jump;
+	int jump_count;
+	int *first_with_label;	/* by label ID: lowest index, or -1 */
+	int *next_with_label;	/* by index: next one with the same label */
+};
+
+struct connection_queue {
+	int fds[QUEUE_SIZE];
+	int head;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+};
+
+static struct served_tree *trees;
+static int tree_count;
+static int label_count;
+
+/* Queries that edit a tree (prune, reroot) work on a clone. Creating rnodes is
+ * not thread-safe, so they are serialized by holding this lock for writing;
+ * the clone's nodes are freed with destroy_rnodes_since(loaded_watermark).
+ * Creating rnodes may also intern labels (e.g. the new root's), so label
+ * lookups hold it for reading (see lookup_label()). The other queries only
+ * read the trees and indexes, and run concurrently. */
+static pthread_rwlock_t edit_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int loaded_watermark;
+
+static struct connection_queue queue = {
+	.head = 0, .count = 0,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.not_empty = PTHREAD_COND_INITIALIZER,
+	.not_full = PTHREAD_COND_INITIALIZER
+};
+
+/* for the signal handler */
+static const char *listening_path = NULL;
+
+void help(char *argv[])
+{
+	printf (
+"Answers queries about trees over a Unix domain socket\n"
+"\n"
+"Synopsis\n"
+"--------\n"
+"\n"
+"%s [-ht:] <socket> <newick trees filename|->\n"
+"or\n"
+"%s -c <socket>\n"
+"\n"
+"Input\n"
+"-----\n"
+"\n"
+"In the first form, the program loads the trees in the file (or standard\n"
+"input if the filename is '-'), indexes them, and then listens on the\n"
+"socket, answering queries until it is killed. Loading and indexing are\n"
+"done only once, so queries are much faster than running the corresponding\n"
+"nw_* program, which has to parse the whole tree every time.\n"
+"\n"
+"In the second form (-c), the program is a client: it sends each line of\n"
+"standard input as a query to the server listening on the socket, and\n"
+"prints the responses.\n"
+"\n"
+"Queries\n"
+"-------\n"
+"\n"
+"A query is one line of words separated by whitespace. The first word is\n"
+"the command, optionally followed by '@<n>' to query the n-th tree of the\n"
+"file (default: the first); the other words are labels:\n"
+"\n"
+"    clade <label>+: the clade defined by the labels (see nw_clade)\n"
+"    lca <label>+: the label of the labelled nodes' last common ancestor\n"
+"    distance <label> <label>: the distance between two nodes (see\n"
+"        nw_distance)\n"
+"    prune <label>+: the tree without the labelled nodes and their\n"
+"        descendants (see nw_prune)\n"
+"    reroot <label>+: the tree, rerooted on the labelled nodes' LCA (see\n"
+"        nw_reroot)\n"
+"    trees: the number of trees\n"
+"\n"
+"Labels need not be unique, except for 'distance': all nodes with a given\n"
+"label are used.\n"
+"\n"
+"Output\n"
+"------\n"
+"\n"
+"Each query gets a one-line response, either 'OK <result>' (trees are in\n"
+"Newick), or 'ERR <message>'. Connections are handled concurrently, and\n"
+"each one can send any number of queries.\n"
+"\n"
+"Options\n"
+"-------\n"
+"\n"
+"    -c: client mode, see above\n"
+"    -h: print this message and exit\n"
+"    -t <int>: use this many worker threads (default: 4); this is the\n"
+"        number of connections served at the same time.\n"
+"\n"
+"Examples\n"
+"--------\n"
+"\n"
+"# Serve the HRV tree, and query it\n"
+"\n"
+"$ %s /tmp/hrv.sock data/HRV.nw &\n"
+"$ echo 'clade HRV16 HRV1B' | %s -c /tmp/hrv.sock\n"
+"$ echo 'distance HRV16 HRV1B' | %s -c /tmp/hrv.sock\n",
+	argv[0],
+	argv[0],
+	argv[0],
+	argv[0],
+	argv[0]
+	);
+}
+
+struct parameters get_params(int argc, char *argv[])
+{
+
+	struct parameters params;
+	bool client = false;
+
+	params.nb_threads = 4;
+	params.input = stdin;
+
+	int opt_char;
+	while ((opt_char = getopt(argc, argv, "cht:")) != -1) {
+		switch (opt_char) {
+		case 'c':
+			client = true;
+			break;
+		case 'h':
+			help(argv);
+			exit(EXIT_SUCCESS);
+		case 't':
+			params.nb_threads = atoi(optarg);
+			if (params.nb_threads < 1) {
+				fprintf(stderr, "Argument to -t must be "
+						"positive.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* check arguments */
+	if (client) {
+		if ((argc - optind) != 1) {
+			fprintf(stderr, "Usage: %s -c <socket>\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+		params.socket_path = argv[optind];
+		params.input = NULL;
+		return params;
+	}
+	if ((argc - optind) != 2) {
+		fprintf(stderr, "Usage: %s [-ht:] <socket> <filename|->\n",
+				argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	params.socket_path = argv[optind];
+	if (0 != strcmp("-", argv[optind+1])) {
+		FILE *fin = open_input_file(argv[optind+1]);
+		if (NULL == fin) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		params.input = fin;
+	}
+
+	return params;
+}
+
+/**************** Indexes ****************/
+
+/* Fills 'served->nodes' in the same (pre)order as tree_arrays_append(). */
+
+static void number_nodes(struct served_tree *served)
+{
+	struct rnode *root = served->tree->root;
+	struct rnode *node = root;
+	int i = 0;
+	for (;;) {
+		served->nodes[i++] = node;
+		if (NULL != node->first_child) {
+			node = node->first_child;
+			continue;
+		}
+		while (node != root && NULL == node->next_sibling)
+			node = node->parent;
+		if (node == root) break;
+		node = node->next_sibling;
+	}
+}
+
+/* Indexes a tree. Must be called after all trees are loaded, so that
+ * 'label_count' is final. Returns SUCCESS, or FAILURE in case of malloc()
+ * problems. */
+
+static int index_tree(struct served_tree *served)
+{
+	struct tree_arrays *arrays = create_tree_arrays();
+	if (NULL == arrays) return FAILURE;
+	served->arrays = arrays;
+	if (! tree_arrays_append(arrays, served->tree)) return FAILURE;
+
+	int n = arrays->node_count;
+	served->nodes = malloc(n * sizeof(struct rnode *));
+	served->level = malloc(n * sizeof(int));
+	served->depth = malloc(n * sizeof(double));
+	served->next_with_label = malloc(n * sizeof(int));
+	served->first_with_label = malloc(label_count * sizeof(int));
+	if (NULL == served->nodes || NULL == served->level ||
+	    NULL == served->depth || NULL == served->next_with_label ||
+	    NULL == served->first_with_label)
+		return FAILURE;
+	number_nodes(served);
+
+	int i, max_level = 0;
+	served->level[0] = 0;
+	served->depth[0] = 0;
+	for (i = 1; i < n; i++) {
+		int parent = arrays->parent[i];
+		double length = arrays->edge_length[i];
+		served->level[i] = served->level[parent] + 1;
+		served->depth[i] = served->depth[parent] +
+			(isnan(length) ? 1.0 : length);
+		if (served->level[i] > max_level)
+			max_level = served->level[i];
+	}
+
+	/* Labels: walking backwards makes each chain start at the lowest
+	 * index. */
+	for (i = 0; i < label_count; i++) served->first_with_label[i] = -1;
+	for (i = n - 1; i >= 0; i--) {
+		int id = served->nodes[i]->label_id;
+		served->next_with_label[i] = served->first_with_label[id];
+		served->first_with_label[id] = i;
+	}
+
+	/* Jump pointers, for finding LCAs in O(log(depth)) */
+	served->jump_count = 1;
+	while ((1 << served->jump_count) <= max_level) served->jump_count++;
+	served->jump = malloc(served->jump_count * sizeof(int *));
+	if (NULL == served->jump) return FAILURE;
+	served->jump[0] = arrays->parent;
+	int k;
+	for (k = 1; k < served->jump_count; k++) {
+		int *up = served->jump[k-1];
+		int *jump = malloc(n * sizeof(int));
+		if (NULL == jump) return FAILURE;
+		for (i = 0; i < n; i++)
+			jump[i] = (-1 == up[i]) ? -1 : up[up[i]];
+		served->jump[k] = jump;
+	}
+
+	return SUCCESS;
+}
+
+static int lca(struct served_tree *served, int a, int b)
+{
+	int k;
+	if (served->level[a] < served->level[b]) {
+		int tmp = a; a = b; b = tmp;
+	}
+	int climb = served->level[a] - served->level[b];
+	for (k = 0; climb > 0; k++, climb >>= 1)
+		if (climb & 1) a = served->jump[k][a];
+	if (a == b) return a;
+	for (k = served->jump_count - 1; k >= 0; k--) {
+		if (served->jump[k][a] != served->jump[k][b]) {
+			a = served->jump[k][a];
+			b = served->jump[k][b];
+		}
+	}
+	return served->jump[0][a];
+}
+
+static void load_trees(FILE *input)
+{
+	extern FILE *nwsin;
+	nwsin = input;
+
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
+
+	int size = 16;
+	trees = malloc(size * sizeof(struct served_tree));
+	if (NULL == trees) { perror(NULL); exit(EXIT_FAILURE); }
+	struct rooted_tree *tree;
+	while (NULL != (tree = parse_tree())) {
+		if (tree_count == size) {
+			size *= 2;
+			trees = realloc(trees,
+					size * sizeof(struct served_tree));
+			if (NULL == trees) { perror(NULL); exit(EXIT_FAILURE); }
+		}
+		trees[tree_count].tree = tree;
+		tree_count++;
+	}
+	if (PARSER_STATUS_OK != newick_parser_status &&
+	    PARSER_STATUS_EMPTY != newick_parser_status) {
+		fprintf(stderr, "Could not load trees - aborting.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (0 == tree_count) {
+		fprintf(stderr, "No tree to serve - aborting.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	label_count = interned_label_count();
+	int t;
+	for (t = 0; t < tree_count; t++)
+		if (! index_tree(&trees[t])) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+	loaded_watermark = rnode_watermark();
+}
+
+/**************** Queries ****************/
+
+/* The words of a query, after the command */
+
+struct query {
+	struct served_tree *tree;
+	char **labels;
+	int label_count;
+};
+
+/* Returns the ID of 'label', or -1 if no loaded node has it. Must not be
+ * called with 'edit_lock' held. */
+
+static int lookup_label(const char *label)
+{
+	pthread_rwlock_rdlock(&edit_lock);
+	int id = find_label_id(label);
+	pthread_rwlock_unlock(&edit_lock);
+	/* labels interned since loading (e.g. by edits) are in no index */
+	if (id >= label_count) return -1;
+	return id;
+}
+
+/* Returns the LCA of all nodes that bear one of the query's labels. Returns
+ * -1 and sets '*error' if a label is not found. */
+
+static int query_lca(struct query *query, char **error)
+{
+	struct served_tree *served = query->tree;
+	int result = -1;
+	int l;
+	for (l = 0; l < query->label_count; l++) {
+		int id = lookup_label(query->labels[l]);
+		int i = (-1 == id) ? -1 : served->first_with_label[id];
+		if (-1 == i) {
+			*error = masprintf("ERR label '%s' not found",
+					query->labels[l]);
+			return -1;
+		}
+		for (; -1 != i; i = served->next_with_label[i])
+			result = (-1 == result) ? i : lca(served, result, i);
+	}
+	return result;
+}
+
+static char *ok_newick(struct rnode *node)
+{
+	char *newick = to_newick(node);
+	if (NULL == newick) return NULL;
+	char *response = masprintf("OK %s", newick);
+	free(newick);
+	return response;
+}
+
+static char *do_clade(struct query *query)
+{
+	char *error = NULL;
+	int node = query_lca(query, &error);
+	if (-1 == node) return error;
+	return ok_newick(query->tree->nodes[node]);
+}
+
+static char *do_lca(struct query *query)
+{
+	char *error = NULL;
+	int node = query_lca(query, &error);
+	if (-1 == node) return error;
+	return masprintf("OK %s", query->tree->nodes[node]->label);
+}
+
+static char *do_distance(struct query *query)
+{
+	struct served_tree *served = query->tree;
+	int ends[2];
+	int l;
+
+	if (2 != query->label_count)
+		return strdup("ERR distance takes two labels");
+	for (l = 0; l < 2; l++) {
+		int id = lookup_label(query->labels[l]);
+		int i = (-1 == id) ? -1 : served->first_with_label[id];
+		if (-1 == i)
+			return masprintf("ERR label '%s' not found",
+					query->labels[l]);
+		if (-1 != served->next_with_label[i])
+			return masprintf("ERR label '%s' is not unique",
+					query->labels[l]);
+		ends[l] = i;
+	}
+	double *depth = served->depth;
+	int ancestor = lca(served, ends[0], ends[1]);
+	return masprintf("OK %g", depth[ends[0]] + depth[ends[1]] -
+			2 * depth[ancestor]);
+}
+
+/* Must be called with 'edit_lock' held. Labels that are not in the loaded
+ * trees are not interned, as a long-running server would otherwise keep every
+ * label it was ever sent. */
+
+static char *prune_clone(struct query *query)
+{
+	struct prune_params params;
+	init_prune_params(&params, PRUNE_DIRECT);
+	params.labels.has_id = calloc(label_count, sizeof(bool));
+	if (NULL == params.labels.has_id) return NULL;
+	params.labels.size = label_count;
+	int l;
+	for (l = 0; l < query->label_count; l++) {
+		int id = find_label_id(query->labels[l]);
+		if (-1 != id) params.labels.has_id[id] = true;
+	}
+
+	char *response = NULL;
+	struct rooted_tree *clone = clone_tree(query->tree->tree);
+	if (NULL != clone && NULL != clone->nodes_in_order) {
+		/* same pruning as nw_prune */
+		clone = prune_tree(clone, &params);
+		response = ok_newick(clone->root);
+		destroy_tree(clone);
+	} else {
+		free(clone);
+	}
+	destroy_prune_params(&params);
+	return response;
+}
+
+/* Returns the node of 'clone' that corresponds to 'node' of the tree it was
+ * cloned from, by following the same path of child ranks from the root. */
+
+static struct rnode *corresponding_node(struct rooted_tree *clone,
+		struct rnode *node)
+{
+	int depth = 0;
+	struct rnode *n;
+	for (n = node; NULL != n->parent; n = n->parent) depth++;
+	int *ranks = malloc((depth + 1) * sizeof(int));
+	if (NULL == ranks) return NULL;
+	int d = depth;
+	for (n = node; NULL != n->parent; n = n->parent) {
+		int rank = 0;
+		struct rnode *sib;
+		for (sib = n->parent->first_child; sib != n;
+				sib = sib->next_sibling)
+			rank++;
+		ranks[--d] = rank;
+	}
+	struct rnode *target = clone->root;
+	for (d = 0; d < depth; d++) {
+		target = target->first_child;
+		int rank;
+		for (rank = ranks[d]; rank > 0; rank--)
+			target = target->next_sibling;
+	}
+	free(ranks);
+	return target;
+}
+
+/* Must be called with 'edit_lock' held */
+
+static char *reroot_clone(struct query *query, struct rnode *outgroup)
+{
+	struct rooted_tree *clone = clone_tree(query->tree->tree);
+	if (NULL == clone) return NULL;
+	struct rnode *clone_outgroup = corresponding_node(clone, outgroup);
+	char *response = NULL;
+	if (NULL != clone_outgroup &&
+	    reroot_tree(clone, clone_outgroup, false))
+		response = ok_newick(clone->root);
+	destroy_tree(clone);
+	return response;
+}
+
+static char *do_edit(struct query *query, bool reroot)
+{
+	struct rnode *outgroup = NULL;
+	if (0 == query->label_count)
+		return strdup("ERR no labels");
+	if (reroot) {
+		char *error = NULL;
+		int node = query_lca(query, &error);
+		if (-1 == node) return error;
+		if (0 == node)
+			return strdup("ERR outgroup's LCA is the tree's root");
+		outgroup = query->tree->nodes[node];
+	}
+
+	pthread_rwlock_wrlock(&edit_lock);
+	char *response = reroot ? reroot_clone(query, outgroup) :
+		prune_clone(query);
+	destroy_rnodes_since(loaded_watermark, NULL);
+	pthread_rwlock_unlock(&edit_lock);
+
+	return response;
+}
+
+/* Answers a query. Returns the response (without end of line), which the
+ * caller must free(), or NULL in case of malloc() problems. */
+
+static char *answer(char *line)
+{
+	struct word_tokenizer *tokenizer = create_word_tokenizer(line);
+	if (NULL == tokenizer) return NULL;
+	int size = 16;
+	char **words = malloc(size * sizeof(char *));
+	int count = 0;
+	int w;
+	char *word;
+	while (NULL != words && NULL != (word = wt_next(tokenizer))) {
+		if (count == size) {
+			size *= 2;
+			char **more = realloc(words, size * sizeof(char *));
+			if (NULL == more) {
+				free(word);
+				for (w = 0; w < count; w++) free(words[w]);
+				free(words);
+				words = NULL;
+				break;
+			}
+			words = more;
+		}
+		words[count++] = word;
+	}
+	destroy_word_tokenizer(tokenizer);
+	if (NULL == words) return NULL;
+
+	char *response;
+	struct query query = { &trees[0], words + 1, count - 1 };
+	char *command = count > 0 ? words[0] : "";
+	char *at = strchr(command, '@');
+	if (NULL != at) {
+		*at = '\0';
+		int t = atoi(at + 1);
+		query.tree = (t >= 1 && t <= tree_count) ? &trees[t-1] : NULL;
+	}
+
+	if (0 == count)
+		response = strdup("ERR empty query");
+	else if (NULL == query.tree)
+		response = masprintf("ERR no tree '%s'", at + 1);
+	else if (0 == strcmp("trees", command))
+		response = masprintf("OK %d", tree_count);
+	else if (0 == query.label_count)
+		response = masprintf("ERR %s needs labels", command);
+	else if (0 == strcmp("clade", command))
+		response = do_clade(&query);
+	else if (0 == strcmp("lca", command))
+		response = do_lca(&query);
+	else if (0 == strcmp("distance", command))
+		response = do_distance(&query);
+	else if (0 == strcmp("prune", command))
+		response = do_edit(&query, false);
+	else if (0 == strcmp("reroot", command))
+		response = do_edit(&query, true);
+	else
+		response = masprintf("ERR unknown command '%s'", command);
+
+	for (w = 0; w < count; w++) free(words[w]);
+	free(words);
+	return response;
+}
+
+/**************** Server ****************/
+
+/* Returns the next line of 'stream', without its end of line, or NULL at the
+ * end of input or in case of error. The line must be free()d. Unlike
+ * read_line(), this works on streams that cannot seek, like sockets and
+ * pipes. */
+
+static char *next_line(FILE *stream)
+{
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len = getline(&line, &size, stream);
+	if (-1 == len) {
+		free(line);
+		return NULL;
+	}
+	if (len > 0 && '\n' == line[len-1]) line[len-1] = '\0';
+	return line;
+}
+
+static void serve_connection(int fd)
+{
+	FILE *in = fdopen(fd, "r");
+	int out_fd = dup(fd);
+	FILE *out = (-1 == out_fd) ? NULL : fdopen(out_fd, "w");
+	if (NULL == in || NULL == out) {
+		perror(NULL);
+		if (NULL != in) fclose(in); else close(fd);
+		if (NULL != out) fclose(out); else if (-1 != out_fd)
+			close(out_fd);
+		return;
+	}
+
+	char *line;
+	while (NULL != (line = next_line(in))) {
+		char *response = answer(line);
+		free(line);
+		if (NULL == response) response = strdup("ERR out of memory");
+		bool sent = NULL != response &&
+			fprintf(out, "%s\n", response) >= 0 &&
+			0 == fflush(out);
+		free(response);
+		if (! sent) break;
+	}
+
+	fclose(in);
+	fclose(out);
+}
+
+static void *run_worker(void *unused)
+{
+	(void) unused;
+	for (;;) {
+		pthread_mutex_lock(&queue.lock);
+		while (0 == queue.count)
+			pthread_cond_wait(&queue.not_empty, &queue.lock);
+		int fd = queue.fds[queue.head];
+		queue.head = (queue.head + 1) % QUEUE_SIZE;
+		queue.count--;
+		pthread_cond_signal(&queue.not_full);
+		pthread_mutex_unlock(&queue.lock);
+
+		serve_connection(fd);
+	}
+	return NULL;
+}
+
+static void enqueue(int fd)
+{
+	pthread_mutex_lock(&queue.lock);
+	while (QUEUE_SIZE == queue.count)
+		pthread_cond_wait(&queue.not_full, &queue.lock);
+	queue.fds[(queue.head + queue.count) % QUEUE_SIZE] = fd;
+	queue.count++;
+	pthread_cond_signal(&queue.not_empty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+static void stop(int sig)
+{
+	(void) sig;
+	if (NULL != listening_path) unlink(listening_path);
+	_exit(EXIT_SUCCESS);
+}
+
+static int socket_address(const char *path, struct sockaddr_un *addr)
+{
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		fprintf(stderr, "Socket path '%s' is too long.\n", path);
+		return FAILURE;
+	}
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return SUCCESS;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	if (! socket_address(path, &addr)) exit(EXIT_FAILURE);
+
+	/* A socket left over by a previous run is in the way, but anything
+	 * else at that path is not ours to remove. */
+	struct stat st;
+	if (0 == stat(path, &st) && S_ISSOCK(st.st_mode)) unlink(path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == fd ||
+	    -1 == bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    -1 == listen(fd, SOMAXCONN)) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+static void serve(struct parameters params)
+{
+	load_trees(params.input);
+
+	/* A client that goes away must not kill the server. */
+	signal(SIGPIPE, SIG_IGN);
+
+	int listen_fd = listen_on(params.socket_path);
+	listening_path = params.socket_path;
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	int t;
+	for (t = 0; t < params.nb_threads; t++) {
+		pthread_t thread;
+		if (0 != pthread_create(&thread, NULL, run_worker, NULL)) {
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		pthread_detach(thread);
+	}
+
+	for (;;) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (-1 == fd) {
+			if (EINTR == errno || ECONNABORTED == errno) continue;
+			perror(NULL);
+			exit(EXIT_FAILURE);
+		}
+		enqueue(fd);
+	}
+}
+
+/**************** Client ****************/
+
+/* Connects to the server, waiting a bit for it to start listening. */
+
+static int connect_to(const char *path)
+{
+	struct sockaddr_un addr;
+	if (! socket_address(path, &addr)) exit(EXIT_FAILURE);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == fd) { perror(NULL); exit(EXIT_FAILURE); }
+
+	const struct timespec pause = { 0, 50000000 };	/* 50 ms */
+	int attempts;
+	for (attempts = 100; attempts > 0; attempts--) {
+		if (0 == connect(fd, (struct sockaddr *) &addr, sizeof(addr)))
+			return fd;
+		if (ENOENT != errno && ECONNREFUSED != errno) break;
+		nanosleep(&pause, NULL);
+	}
+	perror(path);
+	exit(EXIT_FAILURE);
+}
+
+static void run_client(const char *path)
+{
+	int fd = connect_to(path);
+	FILE *from_server = fdopen(fd, "r");
+	FILE *to_server = fdopen(dup(fd), "w");
+	if (NULL == from_server || NULL == to_server) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
+	}
+
+	char *line;
+	while (NULL != (line = next_line(stdin))) {
+		fprintf(to_server, "%s\n", line);
+		fflush(to_server);
+		free(line);
+		char *response = next_line(from_server);
+		if (NULL == response) {
+			fprintf(stderr, "Connection closed by server.\n");
+			exit(EXIT_FAILURE);
+		}
+		printf("%s\n", response);
+		free(response);
+	}
+
+	fclose(to_server);
+	fclose(from_server);
+}
+
+int main(int argc, char *argv[])
+{
+	/* No profile_init(): the profiling counters are not thread-safe. */
+	struct parameters params = get_params(argc, argv);
+
+	if (NULL == params.input)
+		run_client(params.socket_path);
+	else
+		serve(params);
+
+	return 0;
+}
@@ -35,11 +35,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdbool.h>
 
-#include "parser.h"
-#include "list.h"
+#include "newick_events.h"
 #include "tree.h"
-#include "rnode.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 enum stats_output_format {STATS_OUTPUT_LINE, STATS_OUTPUT_COLUMN};
 
@@ -56,6 +56,20 @@ struct parameters {
 	enum stats_output_format output_format;
 	void (* output_function)(struct tree_properties *);
 	bool headers;
+	FILE *input;
+};
+
+/* The properties are computed as the parser reads the tree, so no tree is
+ * built. Besides the counts, we only need the number of children of each
+ * clade that is still open, in a stack that grows with the tree's depth. */
+
+struct stats_counter {
+	struct tree_properties props;
+	int num_lengths;
+	bool root_has_length;
+	int *child_counts;
+	int depth;
+	int stack_size;
 };
 
 static void help(char *argv[])
@@ -152,6 +166,7 @@ static struct parameters get_params(int argc, char *argv[])
 	params.output_function = print_column;
 	params.output_format = STATS_OUTPUT_COLUMN;
 	params.headers = false;
+	params.input = stdin;
 
 	int opt_char;
 	while ((opt_char = getopt(argc, argv, "f:Hh")) != -1) {
@@ -186,13 +201,12 @@ static struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
-			extern FILE *nwsin;
+			FILE *fin = open_input_file(argv[optind]);
 			if (NULL == fin) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
-			nwsin = fin;
+			params.input = fin;
 		}
 	} else {
 		fprintf(stderr, "Usage: %s [-fHh] <filename|->\n", argv[0]);
@@ -202,58 +216,113 @@ static struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
-/* Iterate once over all nodes, updating various statistics */
+static void reset_counter(struct stats_counter *counter)
+{
+	memset(&counter->props, 0, sizeof(struct tree_properties));
+	counter->num_lengths = 0;
+	counter->depth = 0;
+}
+
+/* Counts a node that has just been read (leaf or end of clade) */
 
-static int get_properties(struct rooted_tree *tree,
-		struct tree_properties *props)
+static void count_node(struct stats_counter *counter, int num_kids,
+		char *label, char *length)
 {
-	props->num_dichotomies = 0;
-	props->num_leaf_labels = 0;
-	props->num_inner_labels = 0;
-
-	struct list_elem *el;
-	for (el = tree->nodes_in_order->head; NULL != el; el =el->next) {
-		struct rnode *current = (struct rnode *) el->data;
-		int num_kids = current->child_count;
-		/* tests */
-		if (2 == num_kids)
-			props->num_dichotomies++;
-		if (0 != strcmp("", current->label)) {
-			if (is_leaf(current))
-				props->num_leaf_labels++;
-			if (is_inner_node(current))
-				props->num_inner_labels++;
-		}
+	struct tree_properties *props = &(counter->props);
+	props->num_nodes++;
+	if (0 == num_kids) props->num_leaves++;
+	if (2 == num_kids) props->num_dichotomies++;
+	if ('\0' != label[0]) {
+		if (0 == num_kids)
+			props->num_leaf_labels++;
+		else if (counter->depth > 0)	/* root is not an inner node */
+			props->num_inner_labels++;
 	}
-	return SUCCESS;
+	if ('\0' != length[0]) counter->num_lengths++;
+	counter->root_has_length = ('\0' != length[0]);
+	if (counter->depth > 0)
+		counter->child_counts[counter->depth - 1]++;
 }
 
-static void process_tree(struct rooted_tree *tree,
-		void(* output_function)(struct tree_properties *))
+static void open_clade(void *param)
 {
-	struct tree_properties props;
-
-	props.type = get_tree_type(tree);
-	props.num_nodes = tree->nodes_in_order->count;
-	props.num_leaves = leaf_count(tree);
-	if (! get_properties(tree, &props)) {
-		perror("Could not get tree properties");
-		exit(EXIT_FAILURE);
+	struct stats_counter *counter = param;
+	if (counter->depth == counter->stack_size) {
+		int new_size = 2 * counter->stack_size;
+		int *grown = realloc(counter->child_counts,
+				new_size * sizeof(int));
+		if (NULL == grown) { perror(NULL); exit(EXIT_FAILURE); }
+		counter->child_counts = grown;
+		counter->stack_size = new_size;
 	}
-	output_function(&props);
+	counter->child_counts[counter->depth++] = 0;
+}
+
+static void leaf(void *param, char *label, char *length)
+{
+	count_node(param, 0, label, length);
+}
+
+static void close_clade(void *param, char *label, char *length)
+{
+	struct stats_counter *counter = param;
+	int num_kids = counter->child_counts[--counter->depth];
+	count_node(counter, num_kids, label, length);
+}
+
+/* Same rules as get_tree_type(): the root's length does not matter for a
+ * phylogram. The last node counted is the root. */
+
+static enum tree_type tree_type(struct stats_counter *counter)
+{
+	int num_nodes = counter->props.num_nodes;
+	if (0 == counter->num_lengths)
+		return TREE_TYPE_CLADOGRAM;
+	else if (num_nodes == counter->num_lengths)
+		return TREE_TYPE_PHYLOGRAM;
+	else if (num_nodes - 1 == counter->num_lengths
+			&& ! counter->root_has_length)
+		return TREE_TYPE_PHYLOGRAM;
+	else
+		return TREE_TYPE_NEITHER;
+}
+
+static void end_tree(void *param)
+{
+	struct stats_counter *counter = param;
+	counter->props.type = tree_type(counter);
 }
 
 int main (int argc, char* argv[])
 {
+	argc = profile_init(argc, argv);
 
 	struct parameters params = get_params(argc, argv);
 
-	struct rooted_tree *tree;
-	while ((tree = parse_tree()) != NULL) {
-		process_tree(tree, params.output_function);
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
+	struct stats_counter counter;
+	counter.stack_size = 64;
+	counter.child_counts = malloc(counter.stack_size * sizeof(int));
+	if (NULL == counter.child_counts) { perror(NULL); exit(EXIT_FAILURE); }
+	reset_counter(&counter);
+
+	struct newick_handlers handlers = {
+		open_clade, leaf, close_clade, end_tree, &counter };
+	struct newick_stream *stream = create_newick_stream(params.input);
+	if (NULL == stream) { perror(NULL); exit(EXIT_FAILURE); }
+
+	/* like the other programs, we stop at the first faulty tree */
+	enum parser_status_type status;
+	while ((status = parse_newick_events(stream, &handlers))
+			== PARSER_STATUS_OK) {
+		params.output_function(&counter.props);
+		reset_counter(&counter);
+	}
+	if (PARSER_STATUS_MALLOC_ERROR == status) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
 	}
 
+	destroy_newick_stream(stream);
+	free(counter.child_counts);
 	return 0;
 }
@@ -46,10 +46,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "node_set.h"
 #include "to_newick.h"
 #include "common.h"
+#include "label_intern.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 extern FILE *nwsin;
 
-static struct hash *lbl2num = NULL;
+/* Leaf numbers, indexed by label ID. Labels first seen after the first tree
+ * have IDs beyond lbl2num_size, and no number. */
+static int *lbl2num = NULL;
+static int lbl2num_size = 0;
 static struct hash *bipart_counts = NULL;
 static int num_leaves;
 
@@ -132,7 +138,7 @@ struct parameters get_params(int argc, char *argv[])
 	/* get arguments */
 	if (2 == (argc - optind))	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *ttf = fopen(argv[optind], "r");
+			FILE *ttf = open_input_file(argv[optind]);
 			if (NULL == ttf) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
@@ -141,7 +147,7 @@ struct parameters get_params(int argc, char *argv[])
 		} else {
 			params.target_tree_file = stdin;
 		}
-		FILE *rtf = fopen(argv[optind+1], "r");
+		FILE *rtf = open_input_file(argv[optind+1]);
 		if (NULL == rtf) {
 			perror(NULL);
 			exit(EXIT_FAILURE);
@@ -158,24 +164,32 @@ struct parameters get_params(int argc, char *argv[])
 int init_lbl2num(struct rooted_tree *tree)
 {
 	struct list_elem *el;
-	lbl2num = create_hash(num_leaves);
+	lbl2num_size = interned_label_count();
+	lbl2num = malloc(lbl2num_size * sizeof(int));
 	if (NULL == lbl2num) return FAILURE;
+	int i;
+	for (i = 0; i < lbl2num_size; i++) lbl2num[i] = -1;
 	int n = 0;
 
 	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
 		struct rnode *current = (struct rnode *) el->data;
 		if (! is_leaf(current)) { continue; }
-		int *num = malloc(sizeof(int));
-		if (NULL == num) return FAILURE;
-		*num = n;
-		if (! hash_set(lbl2num, current->label, num))
-			return FAILURE;
+		lbl2num[current->label_id] = n;
 		n++;
 	}	
 
 	return SUCCESS;
 }
 
+/* Returns the leaf number of 'node' (see init_lbl2num()), or -1 if its label
+ * was not in the first tree. */
+
+static int leaf_number(struct rnode *node)
+{
+	if (node->label_id >= lbl2num_size) return -1;
+	return lbl2num[node->label_id];
+}
+
 /* This could also be done with node_set_union(), but it's easier to write with
  * 'result' as an accumulator. */
 
@@ -220,8 +234,8 @@ void compute_bipartitions(struct rooted_tree *tree)
 		struct rnode *current = (struct rnode *) el->data;
 		node_set set;
 		if (is_leaf(current)) {
-			int *num = hash_get(lbl2num, current->label);
-			if (NULL == num) {
+			int num = leaf_number(current);
+			if (-1 == num) {
 				fprintf(stderr,
 					"Label '%s' not found - aborting\n",
 					current->label);
@@ -229,7 +243,7 @@ void compute_bipartitions(struct rooted_tree *tree)
 			}
 			set = create_node_set(num_leaves);
 			if (NULL == set) {perror(NULL); exit(EXIT_FAILURE);}
-			node_set_add(set, *num, num_leaves);
+			node_set_add(set, num, num_leaves);
 		} else {
 			set = union_of_child_node_sets(current);
 			char *node_set_string = node_set_to_s(set, num_leaves);
@@ -258,6 +272,8 @@ int process_tree(struct rooted_tree *tree)
 	compute_bipartitions(tree);
 	destroy_all_rnodes(NULL);
 	destroy_tree(tree);
+	/* only the first tree's labels are looked up later */
+	forget_labels_since(lbl2num_size);
 
 	return SUCCESS;
 }
@@ -286,26 +302,24 @@ int qsort_strcmp(const void *s1, const void *s2)
 
 void show_label_numbers()
 {
-	struct llist *keys = hash_keys(lbl2num);
-	struct list_elem *el;
-	int i = 0;
-	assert(NULL != keys);
-	assert(0 != keys->count);
+	int count = 0;
+	int id;
 
-	char **labels = malloc(keys->count * sizeof(char *));
+	const char **labels = malloc(lbl2num_size * sizeof(char *));
 	if (NULL == labels) {
 		perror(NULL);
 		exit(EXIT_FAILURE);
 	}
-	for (el = keys->head; NULL != el; el = el->next) {
-		char * key = (char *) el->data;
-		labels[i++] = key;
+	for (id = 0; id < lbl2num_size; id++) {
+		if (-1 != lbl2num[id])
+			labels[count++] = interned_label(id);
 	}
-	qsort(labels, keys->count, sizeof(char *), qsort_strcmp);
-	for (i = 0; i < keys->count; i++) {
+	assert(0 != count);
+	qsort(labels, count, sizeof(char *), qsort_strcmp);
+	int i;
+	for (i = 0; i < count; i++) {
 		printf ("%d: %s\n", i, labels[i]);
 	}
-	destroy_llist(keys);
 	free(labels);
 }
 
@@ -328,11 +342,11 @@ void attribute_support_to_target_tree(struct rooted_tree *tree, int rep_count)
 		struct rnode *current = (struct rnode *) el->data;
 		node_set set;
 		if (is_leaf(current)) {
-			int *num = (int *) hash_get(lbl2num, current->label);
-			assert (NULL != num);
+			int num = leaf_number(current);
+			assert (-1 != num);
 			set = create_node_set(num_leaves);
 			if (NULL == set) {perror(NULL); exit(EXIT_FAILURE);}
-			node_set_add(set, *num, num_leaves);
+			node_set_add(set, num, num_leaves);
 		} else {
 			set = union_of_child_node_sets(current);
 			char *node_set_string = node_set_to_s(set, num_leaves);
@@ -363,6 +377,7 @@ void attribute_support_to_target_tree(struct rooted_tree *tree, int rep_count)
 				sprintf (lbl, "%d", count);
 			}
 			current->label = lbl;
+			current->label_id = intern_label(lbl);
 			free(node_set_string);
 		}
 		current->data = set;
@@ -371,8 +386,15 @@ void attribute_support_to_target_tree(struct rooted_tree *tree, int rep_count)
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params = get_params(argc, argv);
+
+	/* Replicates share their labels, so we intern the first one's and look
+	 * leaves up by label ID. Labels first seen in later trees are forgotten
+	 * after each tree, so that memory does not grow with the input. */
+	if (! enable_label_interning()) { perror(NULL); exit(EXIT_FAILURE); }
 	
 	/* Build the bipartition counts hash, and counts the number of
 	 * replicates. */
@@ -399,10 +421,13 @@ int main(int argc, char *argv[])
 		if (params.show_label_numbers) show_label_numbers();
 		destroy_all_rnodes(NULL);
 		destroy_tree(tree);
+		forget_labels_since(lbl2num_size);
 	}
 
 	fclose(params.target_tree_file);
 	fclose(params.rep_trees_file);
+	free(lbl2num);
+	destroy_label_interner();
 
 	return 0;
 }
@@ -51,9 +51,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "svg_graph.h"
 #include "svg_graph_ortho.h"
 #include "svg_graph_radial.h"
+#include "svg_graph_tiles.h"
 #include "tree.h"
 #include "xml_utils.h"
 #include "error.h"
+#include "label_intern.h"
 
 enum { INDIVIDUAL, CLADE, LABEL, UNKNOWN };
 
@@ -86,6 +88,8 @@ static bool init_done = false;
 static FILE *url_map_file = NULL;
 static FILE *clade_css_map_file = NULL;
 static FILE *ornament_map_file = NULL;
+static char *tile_dir = NULL;
+static int tile_threads = 1;
 static char *leaf_label_style = NULL;
 static char *inner_label_style = NULL;
 static char *edge_label_style = NULL;
@@ -93,6 +97,14 @@ static char *plain_node_style = NULL;
 static struct llist *css_map = NULL;
 static struct llist *ornament_map = NULL;
 
+/* The labels of the CSS and ornament maps are interned before any tree is
+ * read (see svg_init()), so they have the lowest label IDs, i.e. below
+ * mapped_label_count. For each tree, index_map_label_nodes() finds all nodes
+ * that bear these labels in one pass, and the map elements look them up by
+ * label ID, rather than each element building its own label -> nodes hash. */
+static int mapped_label_count = 0;
+static struct llist **nodes_by_label_id = NULL;
+
 int scale_bar_height = 30;	/* px */
 struct hash *url_map = NULL;
 /* If positive, means graph width (and should be integer); if negative, means
@@ -112,6 +124,8 @@ void set_width(double width) { graph_width = width; }
 void set_URL_map_file(FILE * map) { url_map_file = map; }
 void set_clade_CSS_map_file(FILE * map) { clade_css_map_file = map; }
 void set_ornament_map_file(FILE * map) { ornament_map_file = map; }
+void set_tile_dir(char *dir) { tile_dir = dir; }
+void set_tile_threads(int threads) { tile_threads = threads; }
 void set_leaf_label_style(char *style) { leaf_label_style = style; }
 void set_inner_label_style(char *style) { inner_label_style = style; }
 void set_inner_label_pos(enum inner_lbl_pos pos) { inner_label_pos = pos; }
@@ -123,25 +137,25 @@ void add_to_label_space(int correction) { label_space += correction; }
 
 /************************** functions *****************************/
 
-static void svg_CSS_stylesheet()
+void svg_CSS_stylesheet(FILE *out)
 {
 	struct list_elem *el;
 
-	printf ("<defs><style type='text/css'><![CDATA[\n");
+	fprintf (out, "<defs><style type='text/css'><![CDATA[\n");
 	if (NULL != plain_node_style)
-		printf (" .clade_0 {%s}\n", plain_node_style);
+		fprintf (out, " .clade_0 {%s}\n", plain_node_style);
 	if (css_map) {
 		for (el = css_map->head; NULL != el; el = el->next) {
 			struct css_map_element *css_el = el->data;
 			// TODO: this should no longer be called 'calde' but m.b. 'set' or 'group'
-			printf(" .clade_%d {%s}\n", css_el->group_nb,
+			fprintf(out, " .clade_%d {%s}\n", css_el->group_nb,
 					css_el->style);
 		}
 	}
-	printf (" .leaf-label {%s}\n", leaf_label_style);
-	printf (" .inner-label {%s}\n", inner_label_style);
-	printf (" .edge-label {%s}\n", edge_label_style);
-	printf ("]]></style></defs>");
+	fprintf (out, " .leaf-label {%s}\n", leaf_label_style);
+	fprintf (out, " .inner-label {%s}\n", inner_label_style);
+	fprintf (out, " .edge-label {%s}\n", edge_label_style);
+	fprintf (out, "]]></style></defs>");
 }
 
 
@@ -407,6 +421,117 @@ static struct hash *read_url_map()
 	}	
 }
 
+static int intern_map_labels(struct llist *labels)
+{
+	struct list_elem *el;
+	for (el = labels->head; NULL != el; el = el->next)
+		if (intern_label(el->data) < 0) return FAILURE;
+	return SUCCESS;
+}
+
+/* Interns the labels of the CSS and ornament maps, and allocates the per-label
+ * node lists. */
+
+static int init_map_label_index()
+{
+	set_last_error_code(ERR_NOMEM);
+	if (! enable_label_interning()) return FAILURE;
+
+	struct list_elem *el;
+	if (NULL != css_map)
+		for (el = css_map->head; NULL != el; el = el->next) {
+			struct css_map_element *css_el = el->data;
+			if (! intern_map_labels(css_el->labels))
+				return FAILURE;
+		}
+	if (NULL != ornament_map)
+		for (el = ornament_map->head; NULL != el; el = el->next) {
+			struct ornament_map_element *oel = el->data;
+			if (! intern_map_labels(oel->labels))
+				return FAILURE;
+		}
+
+	mapped_label_count = interned_label_count();
+	nodes_by_label_id = malloc(mapped_label_count *
+			sizeof(struct llist *));
+	if (NULL == nodes_by_label_id) return FAILURE;
+	int id;
+	for (id = 0; id < mapped_label_count; id++) {
+		nodes_by_label_id[id] = create_llist();
+		if (NULL == nodes_by_label_id[id]) return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/* Fills the node lists of the map labels with the tree's nodes */
+
+static int index_map_label_nodes(struct rooted_tree *tree)
+{
+	int id;
+	for (id = 0; id < mapped_label_count; id++)
+		clear_llist(nodes_by_label_id[id]);
+
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *node = el->data;
+		id = node->label_id;
+		if (id < 0 || id >= mapped_label_count) continue;
+		if (! append_element(nodes_by_label_id[id], node))
+			return FAILURE;
+	}
+
+	return SUCCESS;
+}
+
+/* Returns the nodes that have the map label 'label', or NULL if there are
+ * none. */
+
+static struct llist *map_label_nodes(char *label)
+{
+	int id = find_label_id(label);
+	if (id < 0 || id >= mapped_label_count) return NULL;
+	struct llist *nodes = nodes_by_label_id[id];
+	return 0 == nodes->count ? NULL : nodes;
+}
+
+/* Same as lca_from_labels_multi(), but with the map label index */
+
+static struct rnode *lca_from_map_labels(struct rooted_tree *tree,
+		struct llist *labels)
+{
+	set_last_error_code(ERR_NOMEM);
+
+	struct llist *descendants = create_llist();
+	if (NULL == descendants) return NULL;
+	struct list_elem *elem;
+	for (elem = labels->head; NULL != elem; elem = elem->next) {
+		char *label = elem->data;
+		struct llist *nodes_list = map_label_nodes(label);
+		if (NULL == nodes_list)
+			fprintf (stderr, "WARNING: label '%s' not found.\n",
+					label);
+		else  {
+			struct llist *copy = shallow_copy(nodes_list);
+			if (NULL == copy) return NULL;
+			append_list (descendants, copy);
+			free(copy); 	/* NOT destroy_llist(): the list
+					   elements are in descendants. */
+		}
+	}
+
+	if (0 == descendants->count) {
+		set_last_error_code(ERR_NO_MATCHING_NODES);
+		destroy_llist(descendants);
+		return NULL;
+	}
+
+	struct rnode *result = lca_from_nodes (tree, descendants);
+	destroy_llist(descendants);
+
+	return result;
+}
+
 /* Call this function before calling display_svg_tree(). Resist the temptation
  * to put it inside display_svg_tree(): it is kept separate because its job is
  * not directly to draw trees*/
@@ -439,7 +564,7 @@ static int set_group_numbers(struct rooted_tree *tree)
 		css_el = elem->data;
 		if (CLADE != css_el->group_type) continue;
 		struct llist *labels = css_el->labels;
-		struct rnode *lca = lca_from_labels_multi(tree, labels);
+		struct rnode *lca = lca_from_map_labels(tree, labels);
 		if (NULL == lca) {
 			enum error_codes err = get_last_error_code();
 			switch (err) {
@@ -477,10 +602,6 @@ static int set_group_numbers(struct rooted_tree *tree)
 	}
 	destroy_llist(nodes_in_reverse_order);
 
-	/* INDIVIDUAL and LABEL need a label->node map */
-	struct hash *map = create_label2node_list_map(tree->nodes_in_order);
-	if (NULL == map) return FAILURE;
-
 	/* Now iterate through the INDIVIDUAL style map elements. They also
 	 * contain a list of labels. Each label is matched by at least 1 node.
 	 * All of these nodes get the map element's number (cf above, in which
@@ -501,7 +622,7 @@ static int set_group_numbers(struct rooted_tree *tree)
 			// process the nodes within this loop, as we do for
 			// LABEL, below?
 			struct llist *nodes_of_label;
-			nodes_of_label = hash_get(map, label);
+			nodes_of_label = map_label_nodes(label);
 			if (NULL == nodes_of_label) {
 				fprintf (stderr, "WARNING: label '%s' "
 						"not found - ignored.\n",
@@ -538,7 +659,7 @@ static int set_group_numbers(struct rooted_tree *tree)
 		for (el = labels->head; NULL != el; el = el->next) {
 			char *label = el->data;
 			struct llist *nodes_of_label;
-			nodes_of_label = hash_get(map, label);
+			nodes_of_label = map_label_nodes(label);
 			if (NULL == nodes_of_label) {
 				fprintf (stderr, "WARNING: label '%s' "
 						"not found - ignored.\n",
@@ -556,8 +677,6 @@ static int set_group_numbers(struct rooted_tree *tree)
 		}
 	}
 
-	destroy_label2node_list_map(map);
-
 	return SUCCESS;
 }
 
@@ -583,7 +702,7 @@ static int set_ornaments(struct rooted_tree *tree)
 		oel = elem->data;
 		if (CLADE != oel->group_type) continue;
 		struct llist *labels = oel->labels;
-		struct rnode *lca = lca_from_labels_multi(tree, labels);
+		struct rnode *lca = lca_from_map_labels(tree, labels);
 		if (NULL == lca) return FAILURE;
 		struct svg_data *lca_data = lca->data;
 		lca_data->ornament = strdup(oel->ornament);
@@ -593,8 +712,6 @@ static int set_ornaments(struct rooted_tree *tree)
 	 * contain a list of labels. Each label is matched by at least 1 node.
 	 * All of these nodes get the ornament. */
 
-	struct hash *map = create_label2node_list_map(tree->nodes_in_order);
-	if (NULL == map) return FAILURE;
 	for (elem = ornament_map->head; NULL != elem; elem = elem->next) {
 		oel = elem->data;
 		if (INDIVIDUAL != oel->group_type) continue;
@@ -607,7 +724,7 @@ static int set_ornaments(struct rooted_tree *tree)
 		for (el = labels->head; NULL != el; el = el->next) {
 			char *label = el->data;
 			struct llist *nodes_of_label;
-			nodes_of_label = hash_get(map, label);
+			nodes_of_label = map_label_nodes(label);
 			if (NULL == nodes_of_label) {
 				fprintf (stderr, "WARNING: label '%s' "
 						"not found - ignored.\n",
@@ -628,7 +745,6 @@ static int set_ornaments(struct rooted_tree *tree)
 		}
 		destroy_llist(group_nodes);
 	}
-	destroy_label2node_list_map(map);
 
 	return SUCCESS;
 }
@@ -651,11 +767,21 @@ int svg_alloc_node_pos(struct rooted_tree *tree)
 		svgd->group_nb = UNSTYLED_CLADE;	
 		svgd->lbl_group_nb = UNSTYLED_CLADE;
 		svgd->ornament = NULL;
+		svgd->collapsed = false;
 		node->data = svgd;
 	}
 	return SUCCESS;
 }
 
+void svg_set_collapsed_clades(struct llist *leaves)
+{
+	struct list_elem *el;
+	for (el = leaves->head; NULL != el; el = el->next) {
+		struct rnode *leaf = el->data;
+		((struct svg_data *) leaf->data)->collapsed = true;
+	}
+}
+
 void svg_set_node_top (struct rnode *node, double top)
 {
 	((struct svg_data *) node->data)->top = top;
@@ -708,8 +834,15 @@ void draw_grid()
 	printf ("</g>");
 }
 
+/* The SVG is written one element at a time, so stdout gets a large buffer.
+ * This must be done before anything is printed. */
+
+#define SVG_OUTPUT_BUFFER_SIZE (1 << 20)	/* bytes */
+
 int svg_init()
 {
+	setvbuf(stdout, NULL, _IOFBF, SVG_OUTPUT_BUFFER_SIZE);
+
 	if (NULL != clade_css_map_file) {
 		css_map = read_css_map();
 		if (NULL == css_map)
@@ -720,6 +853,9 @@ int svg_init()
 		if (NULL == ornament_map)
 			return FAILURE;
 	}
+	if (NULL != css_map || NULL != ornament_map)
+		if (! init_map_label_index())
+			return FAILURE;
 	if (NULL != url_map_file) {
 		url_map = read_url_map();
 		if (NULL == url_map)
@@ -770,7 +906,7 @@ void svg_header(int nb_leaves, bool with_scale_bar, enum graph_style style,
 		"xmlns='http://www.w3.org/2000/svg' "
 		"xmlns:xlink='http://www.w3.org/1999/xlink' >",
 		width, height);
-	svg_CSS_stylesheet();
+	svg_CSS_stylesheet(stdout);
 }
 
 
@@ -836,6 +972,10 @@ enum display_status display_svg_tree(
 {	
 	assert(init_done);
 
+	if (css_map || ornament_map)
+		if (! index_map_label_nodes(tree))
+			return DISPLAY_MEM_ERROR;
+
 	if (css_map)
 		if (! set_group_numbers(tree))
 			return DISPLAY_MEM_ERROR;
@@ -846,7 +986,10 @@ enum display_status display_svg_tree(
 
  	prettify_labels(tree);
 
-	if (SVG_ORTHOGONAL == style)
+	if (NULL != tile_dir && SVG_ORTHOGONAL == style)
+		return display_svg_tree_tiles(tree, hd, align_leaves,
+				tile_dir, tile_threads);
+	else if (SVG_ORTHOGONAL == style)
 		display_svg_tree_orthogonal(tree, hd, align_leaves,
 				with_scale_bar, branch_length_unit);
 	else if (SVG_RADIAL == style)
@@ -41,6 +41,7 @@ enum graph_style { SVG_ORTHOGONAL, SVG_RADIAL };
 
 struct rooted_tree;
 struct h_data;
+struct llist;
 
 /* The following are for setting parameters for the SVG job. */
 
@@ -51,6 +52,8 @@ void set_URL_map_file(FILE *);
 void set_label_angle_correction(double);
 void set_left_label_angle_correction(double);
 void set_scalebar_zero_at_root(bool);
+void set_tile_dir(char *);
+void set_tile_threads(int);
 
 /* Call this before calling svg_header(), etc, but _after_ the set_svg*()
  * functions. It will launch the initializations liek reading the color map,
@@ -61,6 +64,12 @@ int svg_init();
 
 int svg_alloc_node_pos(struct rooted_tree *tree);
 
+/* Marks leaves that stand for collapsed clades (see collapse_clades()), so
+ * that they are drawn as triangles (orthogonal) or wedges (radial). Call after
+ * svg_alloc_node_pos(). */
+
+void svg_set_collapsed_clades(struct llist *leaves);
+
 void svg_set_node_top (struct rnode *node, double top);
 void svg_set_node_bottom (struct rnode *node, double bottom);
 double svg_get_node_top (struct rnode *node);
@@ -76,7 +85,9 @@ void svg_header(int nb_leaves, bool with_scale_bar, enum graph_style style,
 /* Writes a tree into a <g> object. If 'align_leaves' is true, the leaves will
  * be aligned (use this for cladograms). If 'with_scale_bar' is true, a sclae
  * bar will be drawn. The string 'branch_length_unit' is used as a label in the
- * scale bar (e.g., "substitutions/site"). */
+ * scale bar (e.g., "substitutions/site"). If a tile directory was set (see
+ * set_tile_dir()), an orthogonal tree is instead written there as tiles (see
+ * display_svg_tree_tiles()), without a scale bar, and nothing is printed. */
 
 enum display_status display_svg_tree(struct rooted_tree *,
 		enum graph_style style, bool align_leaves,
@@ -30,11 +30,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /* Declarations used by SVG code, but not restricted to a single module. */
 
+#include <stdbool.h>
+
 #define ROOT_SPACE 10			/* pixels */
 #define LBL_VOFFSET 4			/* pixels */
 #define INNER_LBL_SPACE 4		/* pixels */
 #define edge_length_v_offset -4 	/* pixels */
 #define URL_MAP_SIZE 100		/* bins */
+#define COLLAPSED_CLADE_WIDTH 0.6	/* fraction of space between leaves */
 #define UNSTYLED_CLADE 0	// TODO: rename to UNSTYLED_SET (or _GROUP, etc - used not only for clades)
 
 extern struct hash *url_map;
@@ -62,6 +65,7 @@ struct svg_data {
 	int group_nb;		/**< For attributing CSS styles (class=...) to lines */
 	int lbl_group_nb;	/**< For attributing styles to labels */ 
 	char *ornament;		/**< SVG decorations */
+	bool collapsed;		/**< leaf stands for a collapsed clade */
 	/* ... other node properties ... */
 };
 
@@ -81,6 +85,10 @@ void set_root_length(int);
 void set_label_char_width(double);
 void add_to_label_space(int);
 
+/* Prints the CSS stylesheet (of the CSS map and label styles) */
+
+void svg_CSS_stylesheet(FILE *);
+
 /* Returns the largest power of ten not greater than argument */
 
 double largest_PoT_lte(double);
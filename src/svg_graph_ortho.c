@@ -106,10 +106,26 @@ void draw_branches_ortho (struct rooted_tree *tree, const double h_scale,
 			struct svg_data *parent_data = node->parent->data;
 			double svg_parent_h_pos = ROOT_SPACE + (
 				h_scale * parent_data->depth);
-			printf ("<line class='clade_%d' "
-				"x1='%.4f' y1='%.4f' x2='%.4f' y2='%.4f'/>",
-				node_data->group_nb, svg_parent_h_pos,
-				 svg_mid_pos, svg_h_pos, svg_mid_pos);
+			if (node_data->collapsed) {
+				/* triangle from the clade's root to its
+				 * deepest leaf */
+				double half_width =
+					0.5 * COLLAPSED_CLADE_WIDTH * v_scale;
+				printf ("<path class='clade_%d' "
+					"style='fill:lightgrey' "
+					"d='M%.4f,%.4f L%.4f,%.4f "
+					"L%.4f,%.4f Z'/>",
+					node_data->group_nb,
+					svg_parent_h_pos, svg_mid_pos,
+					svg_h_pos, svg_mid_pos - half_width,
+					svg_h_pos, svg_mid_pos + half_width);
+			} else {
+				printf ("<line class='clade_%d' "
+					"x1='%.4f' y1='%.4f' "
+					"x2='%.4f' y2='%.4f'/>",
+					node_data->group_nb, svg_parent_h_pos,
+					 svg_mid_pos, svg_h_pos, svg_mid_pos);
+			}
 		}
 		/* draw ornament, if any */
 		if (NULL != node_data->ornament) {
@@ -241,14 +257,14 @@ void draw_text_ortho (struct rooted_tree *tree, const double h_scale,
 			double svg_parent_h_pos = ROOT_SPACE + (
 				h_scale * parent_data->depth);
 			/* Print branch length IFF it is nonempty AND 
-			 * requested size is not 0 */
-			if (0 != strcmp(node->edge_length_as_string,
-						"")) {
+			 * requested size is not 0 (and not for collapsed
+			 * clades, whose "length" is the clade's height) */
+			if (has_edge_length(node) && ! node_data->collapsed) {
 				printf("<text class='edge-label' "
 					"x='%4f' y='%4f'>%s</text>",
 					(svg_h_pos + svg_parent_h_pos) / 2.0,
 					edge_length_v_offset + svg_mid_pos,
-					node->edge_length_as_string);
+					edge_length_string(node));
 			}
 		}
 
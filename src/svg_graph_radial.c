@@ -184,32 +184,29 @@ static void prepend_transform(xmlNodePtr node, char *transform)
 
 /* adds a translation(x,y) to the element */
 
-static void translate(xmlNodePtr node, double x, double y)
+static void translate(xmlNodePtr node, const char *x, const char *y)
 {
-	char *translation = masprintf("translate(%g,%g)", x, y);
+	char *translation = masprintf("translate(%s,%s)", x, y);
 	prepend_transform(node, translation);
 	free(translation);
 }
 
 /* adds a rotation(angle_deg) to the element */
 
-static void rotate(xmlNodePtr node, double angle_deg)
+static void rotate(xmlNodePtr node, const char *angle_deg)
 {
-	// NOTE: if tests fail due to rounding errors in rotation angles,
-	// change the %g below into %f.
-	// char *rotation = masprintf("rotate(%.2f)", angle_deg);
-	char *rotation = masprintf("rotate(%g)", angle_deg);
+	char *rotation = masprintf("rotate(%s)", angle_deg);
 	prepend_transform(node, rotation);
 	free(rotation);
 }
 
 /* special transforms for <text> elements */
 
-static void text_transforms(xmlNodePtr node, double angle_deg,
-		double x, double y)
+static void text_transforms(xmlNodePtr node, bool left_side,
+		const char *x, const char *y)
 {
 	nudge_baseline(node); /* so text can be read */
-	if (angle_deg <= 90 || angle_deg >= 270) {
+	if (! left_side) {
 		// right side (cos >= 0) 
 		/* ensure end-anchoring */
 		xmlChar *style_attr = (xmlChar*) "style";
@@ -227,7 +224,7 @@ static void text_transforms(xmlNodePtr node, double angle_deg,
 		}
 	} else {
 		// left side (cos < 0)
-		char * half_turn = masprintf("rotate(180,%g,%g)", x, y);
+		char * half_turn = masprintf("rotate(180,%s,%s)", x, y);
 		prepend_transform(node, half_turn);
 		free(half_turn);
 		/* the rotation causes any x value to have wrong sign, so: */
@@ -290,24 +287,25 @@ static void shift_one_width_leafwards(xmlNodePtr node)
 	xmlFree(width_value);
 }	
 
-static void image_transforms(xmlNodePtr node, double angle_deg,
-		double x, double y)
+static void image_transforms(xmlNodePtr node, bool left_side,
+		const char *x, const char *y)
 {
 	center_vertically(node);
 	/* if the image is on the left side, we i) rotate it 180° around the
 	 * node (tip of the parent edge)(so that it is not upside-down), and
 	 * ii) shift it one image length leafwards (to correct for the
 	 * rootwards shift caused by rotation) */
-	if (angle_deg > 90 && angle_deg < 270) {
+	if (left_side) {
 		// left side (cos < 0)
-		char * half_turn = masprintf("rotate(180,%g,%g)", x, y);
+		char * half_turn = masprintf("rotate(180,%s,%s)", x, y);
 		prepend_transform(node, half_turn);
 		free(half_turn);
 		shift_one_width_leafwards(node);
 	}
 }
 
-void apply_transforms(xmlDocPtr doc, double angle_deg, double x, double y)
+void apply_transforms(xmlDocPtr doc, bool left_side, const char *angle_deg,
+		const char *x, const char *y)
 {
 	xmlNodePtr cur = xmlDocGetRootElement(doc)->xmlChildrenNode;
 	while (NULL != cur) {
@@ -315,9 +313,9 @@ void apply_transforms(xmlDocPtr doc, double angle_deg, double x, double y)
 		rotate(cur, angle_deg);
 		translate(cur, x, y);
 		if (strcmp("text", (char *) cur->name) == 0)
-			text_transforms(cur, angle_deg, x, y);
+			text_transforms(cur, left_side, x, y);
 		else if (strcmp("image", (char *) cur->name) == 0)
-			image_transforms(cur, angle_deg, x, y);
+			image_transforms(cur, left_side, x, y);
 
 		cur = cur->next;	/* sibling */
 	}
@@ -352,6 +350,249 @@ static char *unwrap_snippet(xmlDocPtr doc)
 	return tweaked_svg;
 }
 
+/* Parses an ornament snippet, applies the transforms for the given side of
+ * the tree, and returns the transformed snippet (which you must free), or
+ * NULL in case of failure. The angle and position are passed as strings, so
+ * that they can be placeholders (see compile_ornament()). */
+
+static char *transform_ornament_doc(const char *ornaments, bool left_side,
+		const char *angle_deg, const char *x, const char *y)
+{
+	xmlDocPtr doc;
+
+	char *wrapped_orn = wrap_in_dummy_doc(ornaments);
+	if (NULL == wrapped_orn) return NULL;
+
+	/* parse SVG from string */
+	doc = xmlParseMemory(wrapped_orn, strlen(wrapped_orn));
+	free(wrapped_orn);
+	if (NULL == doc) {
+		fprintf(stderr, "Failed to parse document\n");
+		return NULL;
+	}
+
+	/* tweak according to element type */
+	apply_transforms(doc, left_side, angle_deg, x, y);
+
+	/* now get the altered snipped, unwrapped (will be NULL if there was a
+	 * problem).  */
+	char *tweaked_svg = unwrap_snippet(doc);
+	xmlFreeDoc(doc);
+
+	return tweaked_svg;
+}
+
+/* Ornament templates. Parsing and transforming an ornament through libxml is
+ * expensive, and the same ornament is typically drawn at many nodes. Since the
+ * transforms only depend on the node's angle and position (and on which side
+ * of the tree the node is), each distinct ornament is transformed only once
+ * per side, with placeholders instead of the angle and coordinates. The
+ * resulting snippet is then cut at the placeholders into a list of fragments,
+ * and instantiating the template at a node just means printing the fragments
+ * with the node's values in between. */
+
+/* The placeholders must survive serialization unchanged, and should not occur
+ * in real ornaments. */
+
+static const char *ANGLE_PLACEHOLDER = "#nw-angle#";
+static const char *X_PLACEHOLDER = "#nw-x#";
+static const char *Y_PLACEHOLDER = "#nw-y#";
+
+enum orn_slot { SLOT_NONE, SLOT_ANGLE, SLOT_X, SLOT_Y };
+enum orn_side { RIGHT_SIDE, LEFT_SIDE };
+
+/* A piece of literal text, followed by the value of a slot (if any) */
+
+struct orn_fragment {
+	char *text;
+	enum orn_slot slot;
+};
+
+/* Fragment arrays are terminated by a fragment whose text is NULL. */
+
+struct ornament_template {
+	struct orn_fragment *fragments[2];	/* indexed by enum orn_side */
+};
+
+/* Ornament templates, by ornament string. Ornaments come from the ornament
+ * map, so there are few of them, and the cache is kept across trees. */
+
+static struct hash *ornament_templates = NULL;
+
+#define ORNAMENT_TEMPLATES_SIZE 100	/* bins */
+
+static enum orn_side ornament_side(double angle_deg)
+{
+	if (angle_deg > 90 && angle_deg < 270)
+		return LEFT_SIDE;
+	else
+		return RIGHT_SIDE;
+}
+
+static void destroy_fragments(struct orn_fragment *fragments)
+{
+	if (NULL == fragments) return;
+	struct orn_fragment *frag;
+	for (frag = fragments; NULL != frag->text; frag++)
+		free(frag->text);
+	free(fragments);
+}
+
+static void destroy_ornament_template(struct ornament_template *tmpl)
+{
+	destroy_fragments(tmpl->fragments[RIGHT_SIDE]);
+	destroy_fragments(tmpl->fragments[LEFT_SIDE]);
+	free(tmpl);
+}
+
+/* Finds the leftmost placeholder in 'snippet'. Returns a pointer to it (or
+ * NULL if there is none), and sets 'slot' and 'length' accordingly. */
+
+static char *next_placeholder(char *snippet, enum orn_slot *slot,
+		size_t *length)
+{
+	char *angle = strstr(snippet, ANGLE_PLACEHOLDER);
+	char *x = strstr(snippet, X_PLACEHOLDER);
+	char *y = strstr(snippet, Y_PLACEHOLDER);
+	char *first = NULL;
+
+	if (NULL != angle) {
+		first = angle;
+		*slot = SLOT_ANGLE;
+		*length = strlen(ANGLE_PLACEHOLDER);
+	}
+	if (NULL != x && (NULL == first || x < first)) {
+		first = x;
+		*slot = SLOT_X;
+		*length = strlen(X_PLACEHOLDER);
+	}
+	if (NULL != y && (NULL == first || y < first)) {
+		first = y;
+		*slot = SLOT_Y;
+		*length = strlen(Y_PLACEHOLDER);
+	}
+	return first;
+}
+
+/* Cuts a transformed snippet at its placeholders. Returns the array of
+ * fragments, or NULL in case of failure. */
+
+static struct orn_fragment *split_at_placeholders(char *snippet)
+{
+	/* there cannot be more fragments than placeholders + 1 */
+	int max_frags = 2;
+	char *p;
+	for (p = strchr(snippet, '#'); NULL != p; p = strchr(p + 1, '#'))
+		max_frags++;
+	struct orn_fragment *fragments = malloc(
+			max_frags * sizeof(struct orn_fragment));
+	if (NULL == fragments) return NULL;
+
+	int nb_frags = 0;
+	char *start = snippet;
+	for (;;) {
+		enum orn_slot slot = SLOT_NONE;
+		size_t ph_length = 0;
+		char *ph = next_placeholder(start, &slot, &ph_length);
+		size_t text_length = (NULL == ph) ? strlen(start) : ph - start;
+		char *text = malloc(text_length + 1);
+		if (NULL == text) {
+			fragments[nb_frags].text = NULL;
+			destroy_fragments(fragments);
+			return NULL;
+		}
+		memcpy(text, start, text_length);
+		text[text_length] = '\0';
+		fragments[nb_frags].text = text;
+		fragments[nb_frags].slot = slot;
+		nb_frags++;
+		if (NULL == ph) break;
+		start = ph + ph_length;
+	}
+	fragments[nb_frags].text = NULL;
+
+	return fragments;
+}
+
+/* Builds the template of an ornament. Returns NULL in case of failure. */
+
+static struct ornament_template *compile_ornament(const char *ornaments)
+{
+	struct ornament_template *tmpl = malloc(
+			sizeof(struct ornament_template));
+	if (NULL == tmpl) return NULL;
+	tmpl->fragments[RIGHT_SIDE] = NULL;
+	tmpl->fragments[LEFT_SIDE] = NULL;
+
+	enum orn_side side;
+	for (side = RIGHT_SIDE; side <= LEFT_SIDE; side++) {
+		char *snippet = transform_ornament_doc(ornaments,
+				LEFT_SIDE == side, ANGLE_PLACEHOLDER,
+				X_PLACEHOLDER, Y_PLACEHOLDER);
+		if (NULL == snippet) {
+			destroy_ornament_template(tmpl);
+			return NULL;
+		}
+		tmpl->fragments[side] = split_at_placeholders(snippet);
+		free(snippet);
+		if (NULL == tmpl->fragments[side]) {
+			destroy_ornament_template(tmpl);
+			return NULL;
+		}
+	}
+
+	return tmpl;
+}
+
+/* Returns the (cached) template for an ornament, or NULL in case of
+ * failure. */
+
+static struct ornament_template *get_ornament_template(const char *ornaments)
+{
+	if (NULL == ornament_templates) {
+		ornament_templates = create_hash(ORNAMENT_TEMPLATES_SIZE);
+		if (NULL == ornament_templates) return NULL;
+	}
+	struct ornament_template *tmpl = hash_get(ornament_templates,
+			ornaments);
+	if (NULL != tmpl) return tmpl;
+
+	tmpl = compile_ornament(ornaments);
+	if (NULL == tmpl) return NULL;
+	if (! hash_set(ornament_templates, ornaments, tmpl)) {
+		destroy_ornament_template(tmpl);
+		return NULL;
+	}
+	return tmpl;
+}
+
+static double slot_value(enum orn_slot slot, double angle_deg, double x,
+		double y)
+{
+	switch (slot) {
+	case SLOT_ANGLE: return angle_deg;
+	case SLOT_X: return x;
+	case SLOT_Y: return y;
+	default: assert(0);
+	}
+	return 0;	/* not reached */
+}
+
+/* Prints an instance of the template at the given angle and position. */
+
+static void print_ornament(FILE *out, const struct ornament_template *tmpl,
+		double angle_deg, double x, double y)
+{
+	const struct orn_fragment *frag;
+	for (frag = tmpl->fragments[ornament_side(angle_deg)];
+			NULL != frag->text; frag++) {
+		fputs(frag->text, out);
+		if (SLOT_NONE != frag->slot)
+			fprintf(out, "%g", slot_value(frag->slot,
+						angle_deg, x, y));
+	}
+}
+
 /* Transforms SVG elements by parsing XML. Argument is the ornaments string as
  * in the ornament file (i.e., an SVG snippet). Returns (and allocates - you
  * must free it) another SVG snippet in which the elements have been
@@ -364,6 +605,9 @@ static char *unwrap_snippet(xmlDocPtr doc)
  *	o further rotation and translation (images - so that they are oriented
  *	  right)
  *
+ * The snippet is built from the ornament's template, just like the ornaments
+ * printed by draw_ornament().
+ *
  * This f() is not static because it needs to be tested directly (in
  * test_svg_graph_radial); but it is not in any header file either, because it
  * is not meant to be used outside this module.
@@ -372,27 +616,23 @@ static char *unwrap_snippet(xmlDocPtr doc)
 char *xml_transform_ornaments(const char *ornaments, double angle_deg, double x,
 		double y)
 {
-
-	xmlDocPtr doc;
-
-	char *wrapped_orn = wrap_in_dummy_doc(ornaments);
-	if (NULL == wrapped_orn) return NULL;
-
-	/* parse SVG from string */
-	doc = xmlParseMemory(wrapped_orn, strlen(wrapped_orn));
-	if (NULL == doc) {
-		fprintf(stderr, "Failed to parse document\n");
-		return NULL;
+	struct ornament_template *tmpl = compile_ornament(ornaments);
+	if (NULL == tmpl) return NULL;
+
+	char *tweaked_svg = strdup("");
+	const struct orn_fragment *frag;
+	for (frag = tmpl->fragments[ornament_side(angle_deg)];
+			NULL != frag->text && NULL != tweaked_svg; frag++) {
+		char *longer;
+		if (SLOT_NONE == frag->slot)
+			longer = masprintf("%s%s", tweaked_svg, frag->text);
+		else
+			longer = masprintf("%s%s%g", tweaked_svg, frag->text,
+				slot_value(frag->slot, angle_deg, x, y));
+		free(tweaked_svg);
+		tweaked_svg = longer;
 	}
-	free(wrapped_orn);
-
-	/* tweak according to element type */
-	apply_transforms(doc, angle_deg, x, y);
-
-	/* now get the altered snipped, unwrapped (will be NULL if there was a
-	 * problem).  */
-	char *tweaked_svg = unwrap_snippet(doc);
-	xmlFreeDoc(doc);
+	destroy_ornament_template(tmpl);
 
 	return tweaked_svg;
 }
@@ -425,18 +665,25 @@ static char *embed_transform_ornaments(const char *svg_ornaments, double angle_d
 	return result;
 }
 
-/* A dispatcher function, will call the XML-parsing transform function if
- * libXml is available, or the simpler string-embedding function if not.
- * Returns NULL in case of problem. */
+/* A dispatcher function: prints the ornament using its (cached) XML template
+ * if libXml is available, or the simpler string-embedding function if not.
+ * Returns FAILURE in case of problem. */
 
-static char *transform_ornaments(const char *svg_ornaments, double angle_deg,
-		double x, double y)
+static int print_transformed_ornaments(const char *svg_ornaments,
+		double angle_deg, double x, double y)
 {
 #if USE_LIBXML2
-	return xml_transform_ornaments(svg_ornaments, angle_deg, x, y);
+	struct ornament_template *tmpl = get_ornament_template(svg_ornaments);
+	if (NULL == tmpl) return FAILURE;
+	print_ornament(stdout, tmpl, angle_deg, x, y);
 #else
-	return embed_transform_ornaments(svg_ornaments, angle_deg, x, y);
+	char *transformed_ornaments = embed_transform_ornaments(
+			svg_ornaments, angle_deg, x, y);
+	if (NULL == transformed_ornaments) return FAILURE;
+	printf("%s", transformed_ornaments);
+	free(transformed_ornaments);
 #endif
+	return SUCCESS;
 }
 
 /* Draws the arc for inner nodes, including root */
@@ -483,6 +730,28 @@ static void draw_radial_line(struct rnode *node, const double r_scale,
 		par_x_pos, par_y_pos);
 }
 
+/* Draws a collapsed clade as a wedge, from the clade's root to its deepest
+ * leaf */
+
+static void draw_collapsed_wedge(struct rnode *node, const double r_scale,
+		const double a_scale, double mid_angle, double radius,
+		int group_nb)
+{
+	struct svg_data *parent_data = node->parent->data;
+	double parent_radius = root_length + (
+		r_scale * parent_data->depth);
+	double half_angle = 0.5 * COLLAPSED_CLADE_WIDTH * a_scale;
+	double top_angle = mid_angle - half_angle;
+	double bottom_angle = mid_angle + half_angle;
+	printf("<path class='clade_%d' style='fill:lightgrey'"
+	       " d='M%.4f,%.4f L%.4f,%.4f A%4f,%4f 0 0 1 %.4f %.4f Z'/>",
+		group_nb,
+		parent_radius * cos(mid_angle), parent_radius * sin(mid_angle),
+		radius * cos(top_angle), radius * sin(top_angle),
+		radius, radius,
+		radius * cos(bottom_angle), radius * sin(bottom_angle));
+}
+
 /* Draws the ornament associated with node_data. Does NOT check for NULL --
  * this should be done by the caller. */
 
@@ -494,15 +763,10 @@ static int draw_ornament (struct svg_data *node_data,
 	 * file and still see the text. */
 	printf("<g style='stroke:none;fill:black'>");
 
-	char *transformed_ornaments = transform_ornaments(
-			node_data->ornament,
+	if (! print_transformed_ornaments(node_data->ornament,
 			mid_angle / (2*PI) * 360,
-			mid_x_pos, mid_y_pos);
-	if (NULL != transformed_ornaments)
-		printf("%s", transformed_ornaments);
-	else 
+			mid_x_pos, mid_y_pos))
 		return FAILURE;
-	free(transformed_ornaments);
 
 	printf("</g>");
 
@@ -550,6 +814,9 @@ static int draw_branches_radial (
 		if (is_root(node)) {
 			printf("<line x1='0' y1='0' x2='%.4f' y2='%.4f'/>",
 				mid_x_pos, mid_y_pos);
+		} else if (node_data->collapsed) {
+			draw_collapsed_wedge(node, r_scale, a_scale,
+					mid_angle, radius, group_nb);
 		} else {
 			draw_radial_line(node, r_scale, mid_angle,
 					mid_x_pos, mid_y_pos,
@@ -700,14 +967,14 @@ static void draw_text_radial (struct rooted_tree *tree, const double r_scale,
 		if (0 != strcmp(node->label, ""))
 			draw_label(node, radius, mid_angle, r_scale);
 
-		/* draw edge length (except for root) */
-		if ((! is_root(node)) &&
-			(0 != strcmp("", node->edge_length_as_string))) {
+		/* draw edge length (except for root and collapsed clades) */
+		if ((! is_root(node)) && (! node_data->collapsed) &&
+			has_edge_length(node)) {
 			struct svg_data *parent_data = node->parent->data;
 			double parent_radius = root_length + (
 				r_scale * parent_data->depth);
 			radius = 0.5 * (radius + parent_radius);
-			place_label(node->edge_length_as_string, radius,
+			place_label(edge_length_string(node), radius,
 					mid_angle, true, "edge-label");
 		}
 	}
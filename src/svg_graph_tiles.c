@@ -0,0 +1,753 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* svg_graph_tiles.c - writes an orthogonal tree as a pyramid of SVG tiles,
+ * plus a small HTML page that shows them. */
+
+/* The tree is laid out once, in "leaf units" vertically (as set by
+ * set_node_vpos_cb()) and in px horizontally. A zoom level only sets how many
+ * px a leaf unit is worth. To find what a tile shows, the nodes are kept
+ * sorted by vertical position: the edges, labels, etc. that a node draws at
+ * its own height are found by binary search, and so are the vertical lines
+ * that start within the tile. Those that start above a row of tiles and cross
+ * it are found for all rows of a level in one sweep. A tile thus costs about
+ * as much as what it shows.
+ *
+ * On coarse levels, a clade that would be shorter than MIN_CLADE_PX is drawn
+ * as a triangle (like the clades collapsed by option -m), and its nodes are
+ * not visited at all. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "common.h"
+#include "graph_common.h"
+#include "list.h"
+#include "masprintf.h"
+#include "node_pos_alloc.h"
+#include "rnode.h"
+#include "svg_graph_common.h"
+#include "svg_graph_ortho.h"
+#include "svg_graph_tiles.h"
+#include "tree.h"
+
+#define TILE_SIZE 256		/* px, both ways */
+#define TILE_V_MARGIN 20	/* px, above the first leaf and below the last */
+#define MIN_CLADE_PX 4		/* shorter clades are drawn as triangles */
+#define MIN_LABEL_VSKIP 12	/* px between leaves, for text to be drawn */
+#define LABEL_V_REACH 16	/* px, how far text may be from its node */
+
+extern enum inner_lbl_pos inner_label_pos;
+extern const int KNEE_NODE_V_NUDGE;
+extern const int INNER_LBL_H_NUDGE;
+
+/* A node's place in the pyramid. Vertical positions are in leaf units,
+ * horizontal ones in px. */
+
+struct tile_node {
+	struct rnode *node;
+	int parent;		/* index in pyramid.nodes, -1 for the root */
+	double top;		/* of the node's vertical line */
+	double bottom;
+	double mid;		/* of the node's edge */
+	double first_leaf;	/* of the clade */
+	double last_leaf;
+	double h_pos;
+	double parent_h_pos;
+	double max_h_pos;	/* of the clade's leaves */
+	int group_nb;
+	int lbl_group_nb;
+	bool collapsed;
+	const char *edge_length;	/* NULL if not shown */
+	int open_from;		/* first level where the clade isn't a
+				   triangle */
+};
+
+struct pyramid {
+	struct tile_node *nodes;	/* in Newick order */
+	int node_count;
+	int leaf_count;
+	struct tile_node **by_mid;	/* all nodes */
+	struct tile_node **by_top;	/* inner nodes */
+	int inner_count;
+	int width;			/* px */
+	int level_count;
+	char *dir;			/* of this tree */
+};
+
+/* What is drawn on one level, and which of its tiles are done */
+
+struct level {
+	const struct pyramid *pyramid;
+	int number;
+	double vskip;			/* px per leaf unit */
+	int height;			/* px */
+	int rows;
+	int cols;
+	struct tile_node **by_mid;	/* nodes that are drawn */
+	int mid_count;
+	struct tile_node **by_top;	/* nodes whose vertical line is drawn */
+	int top_count;
+	/* Vertical lines that start above a row and reach into it: those of
+	 * row r are crossing[row_crossing[r]] to crossing[row_crossing[r+1]-1],
+	 * in Newick order (i.e., bottom-up). */
+	struct tile_node **crossing;
+	int *row_crossing;
+	int next_tile;
+	pthread_mutex_t lock;
+};
+
+static int tree_number = 0;
+
+static bool is_open(const struct tile_node *tn, int level)
+{
+	return level >= tn->open_from;
+}
+
+/* A node is drawn unless it is in a clade drawn as a triangle */
+
+static bool is_drawn(const struct pyramid *pyramid,
+		const struct tile_node *tn, int level)
+{
+	return -1 == tn->parent ||
+		is_open(&pyramid->nodes[tn->parent], level);
+}
+
+static double level_vskip(const struct pyramid *pyramid, int level)
+{
+	return leaf_vskip * pow(2, level - (pyramid->level_count - 1));
+}
+
+static int compare_mids(const void *a, const void *b)
+{
+	const struct tile_node *tn_a = *(struct tile_node * const *) a;
+	const struct tile_node *tn_b = *(struct tile_node * const *) b;
+	return (tn_a->mid > tn_b->mid) - (tn_a->mid < tn_b->mid);
+}
+
+static int compare_tops(const void *a, const void *b)
+{
+	const struct tile_node *tn_a = *(struct tile_node * const *) a;
+	const struct tile_node *tn_b = *(struct tile_node * const *) b;
+	return (tn_a->top > tn_b->top) - (tn_a->top < tn_b->top);
+}
+
+/* Nodes are in Newick order in pyramid.nodes */
+
+static int compare_newick_order(const void *a, const void *b)
+{
+	const struct tile_node *tn_a = *(struct tile_node * const *) a;
+	const struct tile_node *tn_b = *(struct tile_node * const *) b;
+	return (tn_a > tn_b) - (tn_a < tn_b);
+}
+
+/* Returns SUCCESS unless the directory can't be made (it may exist) */
+
+static int make_dir(const char *path)
+{
+	if (0 == mkdir(path, 0777) || EEXIST == errno)
+		return SUCCESS;
+	return FAILURE;
+}
+
+/* Lays the tree out, in one pass over the nodes. The children of a node are
+ * the last entries on a stack of node indexes. Returns FAILURE iff memory is
+ * short. */
+
+static int lay_out(struct pyramid *pyramid, struct rooted_tree *tree,
+		struct h_data hd, int align_leaves)
+{
+	double h_scale;
+	if (0.0 == hd.d_max) { hd.d_max = 1; } 	/* one-node trees */
+	if (graph_width > 0) {
+		h_scale = ((int) graph_width
+				- label_char_width * hd.l_max
+				- ROOT_SPACE
+				- label_space
+			) / hd.d_max;
+		pyramid->width = rint(graph_width);
+	} else {
+		/* a negative width is interpreted as a fixed scale */
+		h_scale = -graph_width;
+		pyramid->width = rint(-graph_width * hd.d_max
+				+ label_char_width * hd.l_max);
+	}
+
+	int n = tree->nodes_in_order->count;
+	pyramid->node_count = n;
+	pyramid->nodes = malloc(n * sizeof(struct tile_node));
+	pyramid->by_mid = malloc(n * sizeof(struct tile_node *));
+	pyramid->by_top = malloc(n * sizeof(struct tile_node *));
+	int *stack = malloc(n * sizeof(int));
+	if (NULL == pyramid->nodes || NULL == pyramid->by_mid ||
+	    NULL == pyramid->by_top || NULL == stack) {
+		free(stack);
+		return FAILURE;
+	}
+
+	struct list_elem *el;
+	int height = 0;		/* of stack */
+	int i;
+	pyramid->leaf_count = pyramid->inner_count = 0;
+	for (i = 0, el = tree->nodes_in_order->head; NULL != el;
+			el = el->next, i++) {
+		struct rnode *node = el->data;
+		struct svg_data *node_data = node->data;
+		struct tile_node *tn = &pyramid->nodes[i];
+		/* For cladograms */
+		if (align_leaves && is_leaf(node))
+			node_data->depth = hd.d_max;
+		tn->node = node;
+		tn->parent = -1;
+		tn->top = node_data->top;
+		tn->bottom = node_data->bottom;
+		tn->mid = 0.5 * (node_data->top + node_data->bottom);
+		tn->h_pos = ROOT_SPACE + (h_scale * node_data->depth);
+		tn->parent_h_pos = 0;
+		tn->group_nb = node_data->group_nb;
+		tn->lbl_group_nb = node_data->lbl_group_nb;
+		tn->collapsed = node_data->collapsed;
+		tn->edge_length = NULL;
+		/* edge_length_string() caches its result, so it must not be
+		 * called by the tile-writing threads */
+		if (! is_root(node) && has_edge_length(node) &&
+				! tn->collapsed)
+			tn->edge_length = edge_length_string(node);
+		if (is_leaf(node)) {
+			tn->first_leaf = tn->last_leaf = tn->top;
+			tn->max_h_pos = tn->h_pos;
+			pyramid->leaf_count++;
+		} else {
+			int first = height - node->child_count;
+			int c;
+			tn->first_leaf = pyramid->nodes[stack[first]].first_leaf;
+			tn->last_leaf =
+				pyramid->nodes[stack[height - 1]].last_leaf;
+			tn->max_h_pos = tn->h_pos;
+			for (c = first; c < height; c++) {
+				struct tile_node *child =
+					&pyramid->nodes[stack[c]];
+				child->parent = i;
+				child->parent_h_pos = tn->h_pos;
+				if (child->max_h_pos > tn->max_h_pos)
+					tn->max_h_pos = child->max_h_pos;
+			}
+			height = first;
+			pyramid->by_top[pyramid->inner_count++] = tn;
+		}
+		pyramid->by_mid[i] = tn;
+		stack[height++] = i;
+	}
+	free(stack);
+
+	/* Level 0 fits in one row of tiles */
+	double extent = leaf_vskip * (pyramid->leaf_count - 1);
+	pyramid->level_count = 1;
+	while (extent + 2 * TILE_V_MARGIN > TILE_SIZE) {
+		extent /= 2;
+		pyramid->level_count++;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct tile_node *tn = &pyramid->nodes[i];
+		double clade_extent = tn->last_leaf - tn->first_leaf;
+		if (is_leaf(tn->node)) {
+			tn->open_from = 0;
+			continue;
+		}
+		int level = pyramid->level_count;	/* i.e., never */
+		while (level > 0 && clade_extent *
+			level_vskip(pyramid, level - 1) >= MIN_CLADE_PX)
+			level--;
+		tn->open_from = level;
+	}
+
+	qsort(pyramid->by_mid, n, sizeof(struct tile_node *), compare_mids);
+	qsort(pyramid->by_top, pyramid->inner_count,
+			sizeof(struct tile_node *), compare_tops);
+
+	return SUCCESS;
+}
+
+/* Index of the first node whose key is at least 'min' */
+
+static int lower_bound(struct tile_node **nodes, int count, double min,
+		bool by_top)
+{
+	int low = 0, high = count;
+	while (low < high) {
+		int middle = (low + high) / 2;
+		double key = by_top ? nodes[middle]->top : nodes[middle]->mid;
+		if (key < min) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+static double y_pos(const struct level *level, double leaf_units)
+{
+	return TILE_V_MARGIN + level->vskip * leaf_units;
+}
+
+/* The top of a row of tiles, in leaf units */
+
+static double row_top(const struct level *level, int row)
+{
+	return (row * TILE_SIZE - TILE_V_MARGIN) / level->vskip;
+}
+
+/* Finds the vertical lines that cross the top of each row (see struct level).
+ * The rows are swept top to bottom: 'active' holds the lines that start above
+ * the current row, except those found to end above it. Returns FAILURE iff
+ * memory is short. */
+
+static int find_crossing_lines(struct level *level)
+{
+	int capacity = level->top_count + 1;
+	struct tile_node **active = malloc(capacity *
+			sizeof(struct tile_node *));
+	level->crossing = malloc(capacity * sizeof(struct tile_node *));
+	level->row_crossing = malloc((level->rows + 1) * sizeof(int));
+	if (NULL == active || NULL == level->crossing ||
+	    NULL == level->row_crossing) {
+		free(active);
+		return FAILURE;
+	}
+
+	int next = 0, active_count = 0, count = 0;
+	int row;
+	for (row = 0; row < level->rows; row++) {
+		double top = row_top(level, row);
+		while (next < level->top_count &&
+				level->by_top[next]->top < top)
+			active[active_count++] = level->by_top[next++];
+		int a, kept = 0;
+		for (a = 0; a < active_count; a++)
+			if (active[a]->bottom >= top)
+				active[kept++] = active[a];
+		active_count = kept;
+
+		if (count + active_count > capacity) {
+			while (count + active_count > capacity)
+				capacity *= 2;
+			struct tile_node **grown = realloc(level->crossing,
+					capacity * sizeof(struct tile_node *));
+			if (NULL == grown) { free(active); return FAILURE; }
+			level->crossing = grown;
+		}
+		level->row_crossing[row] = count;
+		memcpy(level->crossing + count, active,
+				active_count * sizeof(struct tile_node *));
+		qsort(level->crossing + count, active_count,
+				sizeof(struct tile_node *), compare_newick_order);
+		count += active_count;
+	}
+	level->row_crossing[level->rows] = count;
+
+	free(active);
+	return SUCCESS;
+}
+
+static void draw_vline(FILE *tile, const struct level *level,
+		const struct tile_node *tn, double x_min, double x_max)
+{
+	if (tn->h_pos < x_min || tn->h_pos > x_max) return;
+	fprintf(tile, "<line class='clade_%d' "
+		"x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f'/>",
+		tn->group_nb, tn->h_pos, y_pos(level, tn->top),
+		tn->h_pos, y_pos(level, tn->bottom));
+}
+
+/* Draws a node's edge, or the triangle that stands for its clade */
+
+static void draw_edge(FILE *tile, const struct level *level,
+		const struct tile_node *tn)
+{
+	double mid = y_pos(level, tn->mid);
+
+	if (tn->collapsed) {
+		/* triangle from the clade's root to its deepest leaf */
+		double half_width = 0.5 * COLLAPSED_CLADE_WIDTH * level->vskip;
+		fprintf(tile, "<path class='clade_%d' "
+			"style='fill:lightgrey' "
+			"d='M%.2f,%.2f L%.2f,%.2f L%.2f,%.2f Z'/>",
+			tn->group_nb, tn->parent_h_pos, mid,
+			tn->h_pos, mid - half_width, tn->h_pos, mid + half_width);
+		return;
+	}
+
+	if (-1 == tn->parent)
+		fprintf(tile, "<line x1='0' y1='%.2f' x2='%.2f' y2='%.2f'/>",
+			mid, tn->h_pos, mid);
+	else
+		fprintf(tile, "<line class='clade_%d' "
+			"x1='%.2f' y1='%.2f' x2='%.2f' y2='%.2f'/>",
+			tn->group_nb, tn->parent_h_pos, mid, tn->h_pos, mid);
+
+	if (! is_leaf(tn->node) && ! is_open(tn, level->number))
+		fprintf(tile, "<path class='clade_%d' "
+			"style='fill:lightgrey' "
+			"d='M%.2f,%.2f L%.2f,%.2f L%.2f,%.2f Z'/>",
+			tn->group_nb, tn->h_pos, mid,
+			tn->max_h_pos, y_pos(level, tn->first_leaf),
+			tn->max_h_pos, y_pos(level, tn->last_leaf));
+}
+
+/* Draws a node's label and edge length (see draw_label() and
+ * draw_text_ortho()) */
+
+static void draw_text(FILE *tile, const struct level *level,
+		const struct tile_node *tn)
+{
+	struct rnode *node = tn->node;
+	double mid = y_pos(level, tn->mid);
+
+	if (0 != strcmp(node->label, "") &&
+			(is_leaf(node) || is_open(tn, level->number))) {
+		double h_pos = tn->h_pos + label_space;
+		double v_pos = mid + LBL_VOFFSET;
+		bool v_nudge = 1 == children_count(node);
+		if (is_inner_node(node)) {
+			switch (inner_label_pos) {
+			case INNER_LBL_MIDDLE:
+				h_pos = 0.5 * (tn->h_pos + tn->parent_h_pos);
+				v_nudge = true;
+				break;
+			case INNER_LBL_ROOT:
+				h_pos = tn->parent_h_pos + INNER_LBL_H_NUDGE;
+				v_nudge = true;
+				break;
+			default:
+				break;
+			}
+		}
+		if (v_nudge)
+			v_pos -= KNEE_NODE_V_NUDGE;
+		fprintf(tile, "<text class='%s",
+			is_leaf(node) ? leaf_label_class : inner_label_class);
+		if (UNSTYLED_CLADE != tn->lbl_group_nb)
+			fprintf(tile, " clade_%d", tn->lbl_group_nb);
+		fprintf(tile, "' x='%.2f' y='%.2f'>%s</text>",
+			h_pos, v_pos, node->label);
+	}
+
+	if (NULL != tn->edge_length)
+		fprintf(tile, "<text class='edge-label' "
+			"x='%.2f' y='%.2f'>%s</text>",
+			(tn->h_pos + tn->parent_h_pos) / 2.0,
+			edge_length_v_offset + mid, tn->edge_length);
+}
+
+/* Writes one tile. The tile shows its part of the level's plane through its
+ * viewBox, so everything is drawn in level coordinates and the SVG viewer
+ * does the clipping. */
+
+static void write_tile(const struct level *level, int row, int col)
+{
+	const struct pyramid *pyramid = level->pyramid;
+	double y0 = row * TILE_SIZE, x0 = col * TILE_SIZE;
+	/* anything drawn outside these bounds is not visible */
+	double x_min = x0 - 1, x_max = x0 + TILE_SIZE + 1;
+	double reach = LABEL_V_REACH + level->vskip;	/* see draw_edge() */
+	double top = row_top(level, row);
+	double bottom = (y0 + TILE_SIZE - TILE_V_MARGIN) / level->vskip;
+	bool with_text = level->vskip >= MIN_LABEL_VSKIP;
+
+	char *path = masprintf("%s/%d/%d_%d.svg", pyramid->dir,
+			level->number, row, col);
+	if (NULL == path) { perror(NULL); exit(EXIT_FAILURE); }
+	FILE *tile = fopen(path, "w");
+	if (NULL == tile) { perror(path); exit(EXIT_FAILURE); }
+	free(path);
+
+	fprintf(tile, "<?xml version='1.0' standalone='no'?>"
+		"<svg width='%d' height='%d' viewBox='%g %g %d %d' "
+		"version='1.1' xmlns='http://www.w3.org/2000/svg' "
+		"xmlns:xlink='http://www.w3.org/1999/xlink' >",
+		TILE_SIZE, TILE_SIZE, x0, y0, TILE_SIZE, TILE_SIZE);
+	svg_CSS_stylesheet(tile);
+
+	fprintf(tile, "<g style='stroke:black;fill:none;stroke-width:1;"
+		"stroke-linecap:round'>");
+	/* vertical lines that start above the tile but reach into it */
+	int i;
+	for (i = level->row_crossing[row]; i < level->row_crossing[row + 1];
+			i++)
+		draw_vline(tile, level, level->crossing[i], x_min, x_max);
+	/* ...and those that start inside it */
+	i = lower_bound(level->by_top, level->top_count, top, true);
+	for (; i < level->top_count && level->by_top[i]->top < bottom; i++)
+		draw_vline(tile, level, level->by_top[i], x_min, x_max);
+
+	int first = lower_bound(level->by_mid, level->mid_count,
+			top - reach / level->vskip, false);
+	double last_mid = bottom + reach / level->vskip;
+	for (i = first; i < level->mid_count &&
+			level->by_mid[i]->mid < last_mid; i++) {
+		const struct tile_node *tn = level->by_mid[i];
+		if (tn->parent_h_pos <= x_max && tn->max_h_pos >= x_min)
+			draw_edge(tile, level, tn);
+	}
+	fprintf(tile, "</g>");
+
+	if (with_text) {
+		fprintf(tile, "<g style='stroke:none'>");
+		for (i = first; i < level->mid_count &&
+				level->by_mid[i]->mid < last_mid; i++) {
+			const struct tile_node *tn = level->by_mid[i];
+			double text_end = tn->h_pos + label_space +
+				label_char_width * strlen(tn->node->label);
+			if (tn->parent_h_pos <= x_max && text_end >= x_min)
+				draw_text(tile, level, tn);
+		}
+		fprintf(tile, "</g>");
+	}
+
+	fprintf(tile, "</svg>\n");
+	if (0 != fclose(tile)) { perror(NULL); exit(EXIT_FAILURE); }
+}
+
+static void *write_tiles(void *arg)
+{
+	struct level *level = arg;
+	int tile_count = level->rows * level->cols;
+
+	for (;;) {
+		pthread_mutex_lock(&level->lock);
+		int tile = level->next_tile++;
+		pthread_mutex_unlock(&level->lock);
+		if (tile >= tile_count) break;
+		write_tile(level, tile / level->cols, tile % level->cols);
+	}
+
+	return NULL;
+}
+
+static int level_height(const struct pyramid *pyramid, int level)
+{
+	return ceil(2 * TILE_V_MARGIN +
+		level_vskip(pyramid, level) * (pyramid->leaf_count - 1));
+}
+
+/* Writes the viewer. It keeps an <img> for each tile in view (and around it),
+ * and zooms in and out around the middle of the view. */
+
+static int write_viewer(const struct pyramid *pyramid)
+{
+	char *path = masprintf("%s/index.html", pyramid->dir);
+	if (NULL == path) return FAILURE;
+	FILE *html = fopen(path, "w");
+	free(path);
+	if (NULL == html) return FAILURE;
+
+	fprintf(html,
+"<!DOCTYPE html>\n"
+"<html><head><meta charset='utf-8'><title>Tree %d</title>\n"
+"<style>\n"
+"body { margin: 0; font-family: sans-serif; }\n"
+"#bar { position: fixed; top: 0; left: 0; right: 0; height: 30px;"
+" padding: 3px; background: #eee; }\n"
+"#view { position: absolute; top: 36px; left: 0; right: 0; bottom: 0;"
+" overflow: auto; }\n"
+"#plane { position: relative; }\n"
+"#plane img { position: absolute; }\n"
+"</style></head><body>\n"
+"<div id='bar'><button id='out'>-</button> <button id='in'>+</button>"
+" zoom level <span id='level'></span></div>\n"
+"<div id='view'><div id='plane'></div></div>\n"
+"<script>\n"
+"var tile = %d, width = %d, heights = [",
+		tree_number, TILE_SIZE, pyramid->width);
+	int level;
+	for (level = 0; level < pyramid->level_count; level++)
+		fprintf(html, "%s%d", 0 == level ? "" : ", ",
+				level_height(pyramid, level));
+	fprintf(html, "];\n"
+"var view = document.getElementById('view');\n"
+"var plane = document.getElementById('plane');\n"
+"var level = 0, shown = {};\n"
+"function show() {\n"
+"  var rows = Math.ceil(heights[level] / tile);\n"
+"  var cols = Math.ceil(width / tile);\n"
+"  var r0 = Math.max(0, Math.floor(view.scrollTop / tile) - 1);\n"
+"  var r1 = Math.min(rows - 1,\n"
+"    Math.floor((view.scrollTop + view.clientHeight) / tile) + 1);\n"
+"  var c0 = Math.max(0, Math.floor(view.scrollLeft / tile) - 1);\n"
+"  var c1 = Math.min(cols - 1,\n"
+"    Math.floor((view.scrollLeft + view.clientWidth) / tile) + 1);\n"
+"  var wanted = {}, r, c, key;\n"
+"  for (r = r0; r <= r1; r++)\n"
+"    for (c = c0; c <= c1; c++) {\n"
+"      key = r + '_' + c;\n"
+"      wanted[key] = true;\n"
+"      if (shown[key]) continue;\n"
+"      var img = new Image(tile, tile);\n"
+"      img.src = level + '/' + key + '.svg';\n"
+"      img.style.left = (c * tile) + 'px';\n"
+"      img.style.top = (r * tile) + 'px';\n"
+"      plane.appendChild(img);\n"
+"      shown[key] = img;\n"
+"    }\n"
+"  for (key in shown)\n"
+"    if (!wanted[key]) { plane.removeChild(shown[key]); delete shown[key]; }\n"
+"}\n"
+"function zoom(to) {\n"
+"  if (to < 0 || to >= heights.length) return;\n"
+"  var middle = (view.scrollTop + view.clientHeight / 2) / heights[level];\n"
+"  for (var key in shown) plane.removeChild(shown[key]);\n"
+"  shown = {};\n"
+"  level = to;\n"
+"  plane.style.width = width + 'px';\n"
+"  plane.style.height = heights[level] + 'px';\n"
+"  view.scrollTop = middle * heights[level] - view.clientHeight / 2;\n"
+"  document.getElementById('level').textContent =\n"
+"    level + ' / ' + (heights.length - 1);\n"
+"  show();\n"
+"}\n"
+"view.onscroll = show;\n"
+"window.onresize = show;\n"
+"document.getElementById('in').onclick = function () { zoom(level + 1); };\n"
+"document.getElementById('out').onclick = function () { zoom(level - 1); };\n"
+"zoom(0);\n"
+"</script></body></html>\n");
+
+	if (0 != fclose(html)) return FAILURE;
+	return SUCCESS;
+}
+
+/* Writes all the tiles of a level. The nodes to draw are picked from the
+ * pyramid's sorted lists, which keeps them sorted. */
+
+static int write_level(struct pyramid *pyramid, struct level *level,
+		int number, int threads)
+{
+	level->pyramid = pyramid;
+	level->number = number;
+	level->vskip = level_vskip(pyramid, number);
+	level->height = level_height(pyramid, number);
+	level->rows = (level->height + TILE_SIZE - 1) / TILE_SIZE;
+	level->cols = (pyramid->width + TILE_SIZE - 1) / TILE_SIZE;
+	if (0 == level->cols) level->cols = 1;
+
+	int i;
+	level->mid_count = 0;
+	for (i = 0; i < pyramid->node_count; i++)
+		if (is_drawn(pyramid, pyramid->by_mid[i], number))
+			level->by_mid[level->mid_count++] = pyramid->by_mid[i];
+	level->top_count = 0;
+	for (i = 0; i < pyramid->inner_count; i++)
+		if (is_open(pyramid->by_top[i], number))
+			level->by_top[level->top_count++] = pyramid->by_top[i];
+
+	char *path = masprintf("%s/%d", pyramid->dir, number);
+	if (NULL == path) return FAILURE;
+	int status = make_dir(path);
+	free(path);
+	if (FAILURE == status) return FAILURE;
+	if (! find_crossing_lines(level)) return FAILURE;
+
+	pthread_t *workers = malloc(threads * sizeof(pthread_t));
+	if (NULL == workers) return FAILURE;
+	level->next_tile = 0;
+	pthread_mutex_init(&level->lock, NULL);
+	int t;
+	/* the main thread writes tiles too */
+	for (t = 1; t < threads; t++)
+		if (0 != pthread_create(&workers[t], NULL, write_tiles,
+					level)) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
+	write_tiles(level);
+	for (t = 1; t < threads; t++)
+		pthread_join(workers[t], NULL);
+	pthread_mutex_destroy(&level->lock);
+	free(workers);
+	free(level->crossing);
+	free(level->row_crossing);
+	level->crossing = NULL;
+	level->row_crossing = NULL;
+
+	return SUCCESS;
+}
+
+static void destroy_pyramid(struct pyramid *pyramid)
+{
+	free(pyramid->nodes);
+	free(pyramid->by_mid);
+	free(pyramid->by_top);
+	free(pyramid->dir);
+}
+
+enum display_status display_svg_tree_tiles(struct rooted_tree *tree,
+		struct h_data hd, int align_leaves, const char *dir,
+		int threads)
+{
+	struct pyramid pyramid;
+	struct level level;
+	enum display_status status = DISPLAY_MEM_ERROR;
+
+	tree_number++;
+	memset(&pyramid, 0, sizeof(pyramid));
+	memset(&level, 0, sizeof(level));
+	if (! make_dir(dir)) return DISPLAY_MEM_ERROR;
+	pyramid.dir = masprintf("%s/%d", dir, tree_number);
+	if (NULL == pyramid.dir || ! make_dir(pyramid.dir))
+		goto done;
+	if (! lay_out(&pyramid, tree, hd, align_leaves))
+		goto done;
+
+	level.by_mid = malloc(pyramid.node_count *
+			sizeof(struct tile_node *));
+	level.by_top = malloc(pyramid.node_count *
+			sizeof(struct tile_node *));
+	if (NULL == level.by_mid || NULL == level.by_top)
+		goto done;
+	int number;
+	for (number = 0; number < pyramid.level_count; number++)
+		if (! write_level(&pyramid, &level, number, threads))
+			goto done;
+	if (! write_viewer(&pyramid))
+		goto done;
+	status = DISPLAY_OK;
+
+done:
+	free(level.by_mid);
+	free(level.by_top);
+	free(level.crossing);
+	free(level.row_crossing);
+	destroy_pyramid(&pyramid);
+	return status;
+}
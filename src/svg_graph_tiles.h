@@ -0,0 +1,48 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Interface of svg_graph_tiles.c: writes an orthogonal tree as a pyramid of
+ * SVG tiles, for trees too large for a single SVG document. */
+
+struct rooted_tree;
+struct h_data;
+
+/* Writes the tree's tiles and viewer into a new directory of 'dir', named
+ * after the tree's number (1 for the first tree, etc.). Each zoom level is a
+ * subdirectory of square tiles, named <row>_<column>.svg; index.html shows
+ * them, loading only those in view. Zoom levels differ only vertically: the
+ * last one has the usual spacing between leaves, and each one before has
+ * half the spacing of the next, down to a level that fits in one row of
+ * tiles. The tiles are written by 'threads' threads. Returns DISPLAY_OK, or
+ * DISPLAY_MEM_ERROR if memory is short or a file or directory can't be
+ * written (errno is set in both cases). */
+
+enum display_status display_svg_tree_tiles(struct rooted_tree *tree,
+		struct h_data hd, int align_leaves, const char *dir,
+		int threads);
@@ -59,29 +59,47 @@ static const char SLASHES_LOWER_ANGLE = '\\';
 
 static const int MAX_NB_TICKS = 10; 	/* never more than 10 ticks (see tick_interval()) */
 
+/* Where a node is drawn, in canvas coordinates. Its vertical line spans rows
+ * first_row to last_row, its edge is on row 'mid' and goes from column
+ * parent_h_pos to h_pos. */
+
+struct node_rows {
+	struct rnode *node;
+	int first_row;
+	int last_row;
+	int mid;
+	int h_pos;
+	int parent_mid;
+	int parent_h_pos;
+	int label_h_pos;
+};
+
 /* Changes the first char (i.e. distal or parent-side) of the edge to reflect
  * its position within the parent (top, mid, bottom, ore other); likewise with
- * the proximal (child-side) character. */
+ * the proximal (child-side) character. The edge is on canvas line 'line'. */
 
-void decorate_edge(struct canvas *canvas, struct rnode *node,
-		int mid, int h_pos, int parent_mid, int parent_h_pos,
-		enum text_graph_style style)
+static void decorate_edge(struct canvas *canvas, struct node_rows *rows,
+		int line, enum text_graph_style style)
 {
+	struct rnode *node = rows->node;
+	int h_pos = rows->h_pos;
+	int parent_h_pos = rows->parent_h_pos;
+
 	if (TEXT_STYLE_RAW == style) {
 		if (! is_root(node))
-			canvas_draw_cross(canvas, parent_h_pos, mid);
+			canvas_draw_cross(canvas, parent_h_pos, line);
 		return;
 	}
 
 	/* Decorate the child-side character */
-	canvas_draw_edge_to_node(canvas, h_pos, mid);
+	canvas_draw_edge_to_node(canvas, h_pos, line);
 
 	/* Decorates the parent-side end of the edge */
 	if (is_root(node)) 
 		return;
 
 	if (is_leaf(node))
-		canvas_decorate_leaf(canvas, h_pos, mid);
+		canvas_decorate_leaf(canvas, h_pos, line);
 
 	char upper_angle, lower_angle;
 	// Ideally, this should be computed once per run instead of once per
@@ -104,130 +122,196 @@ void decorate_edge(struct canvas *canvas, struct rnode *node,
 	}
 
 	if (node == node->parent->first_child)
-		canvas_draw_upper_corner(canvas, parent_h_pos, mid, 
+		canvas_draw_upper_corner(canvas, parent_h_pos, line, 
 				upper_angle); 
 	else if (node == node->parent->last_child)
-		canvas_draw_lower_corner(canvas, parent_h_pos, mid, 
+		canvas_draw_lower_corner(canvas, parent_h_pos, line, 
 				lower_angle);
-	else if (mid == parent_mid)
-		canvas_draw_cross(canvas, parent_h_pos, mid);
+	else if (rows->mid == rows->parent_mid)
+		canvas_draw_cross(canvas, parent_h_pos, line);
 	else
-		canvas_draw_node_to_edge(canvas, parent_h_pos, mid);
+		canvas_draw_node_to_edge(canvas, parent_h_pos, line);
 }
 
-/* Writes the nodes to the canvas. Assumes that the edges have been
+/* Computes where a node goes on the canvas. Assumes that the edges have been
  * attributed a double value in field 'length' (in this case, it is done in
  * set_node_depth()). */
 
-// TODO: refactor this f(), it's way too long
-
-void draw_tree(struct canvas *canvas, struct rooted_tree *tree,
+static void set_node_rows(struct node_rows *rows, struct rnode *node,
 		const double scale, int align_leaves, double dmax,
-		enum inner_lbl_pos inner_label_pos, enum text_graph_style style)
+		enum inner_lbl_pos inner_label_pos)
 {
-	struct list_elem *elem;
-
-	struct llist *rev_nodes = llist_reverse(tree->nodes_in_order);
+	struct simple_node_pos *pos =  node->data;
+	/* For cladograms */
+	if (align_leaves && is_leaf(node))
+		pos->depth = dmax;
+
+	rows->node = node;
+	rows->h_pos = rint(ROOT_SPACE + (scale * pos->depth));
+	rows->first_row = rint(2*pos->top);
+	rows->last_row = rint(2*pos->bottom);
+	rows->mid = rint(pos->top+pos->bottom);	/* (2*top + 2*bottom) / 2 */
+	if (is_root(node)) {
+		rows->parent_mid = -1;
+		/* parent H pos is ROOT_SPACE if root has length, or
+		 * 0 otherwise. */
+		if (0 == pos->depth) 
+			rows->parent_h_pos = 0;
+		else
+			rows->parent_h_pos = ROOT_SPACE;
+	} else {
+		struct simple_node_pos *parent_data = node->parent->data;
+		rows->parent_h_pos = rint(ROOT_SPACE +
+				(scale * parent_data->depth));
+		rows->parent_mid = rint(parent_data->top +
+				parent_data->bottom);
+	}
 
-	/* The edges and nodes are drawn first, in reverse Newick order (makes
-	 * fixing edges easier) */
-	for (elem = rev_nodes->head; NULL != elem; elem = elem->next) {
-		struct rnode *node =  elem->data;
-		struct simple_node_pos *pos =  node->data;
-		/* For cladograms */
-		if (align_leaves && is_leaf(node))
-			pos->depth = dmax;
-
-		int h_pos = rint(ROOT_SPACE + (scale * pos->depth));
-		int top = rint(2*pos->top);
-		int bottom = rint(2*pos->bottom);
-		int mid = rint(pos->top+pos->bottom);	/* (2*top + 2*bottom) / 2 */ // TODO is rint() needed
-		struct simple_node_pos *parent_data;
-		int parent_h_pos;
-		int parent_mid;
-		/* draw node */
-		canvas_draw_vline(canvas, h_pos, top, bottom);
-		if (is_root(node)) {
-			parent_data = NULL;
-			parent_mid = -1;
-			/* parent H pos is ROOT_SPACE if root has length, or
-			 * 0 otherwise. */
-			if (0 == pos->depth) 
-				parent_h_pos = 0;
-			else
-				parent_h_pos = ROOT_SPACE;
-		} else {
-			parent_data = node->parent->data;
-			parent_h_pos = rint(ROOT_SPACE +
-					(scale * parent_data->depth));
-			parent_mid = rint(parent_data->top +
-					parent_data->bottom); // see above about rint()
+	if (is_inner_node(node)) {
+		double parent_depth = (
+			(struct simple_node_pos *)
+				node->parent->data)->depth;
+		switch (inner_label_pos) {
+		case INNER_LBL_LEAVES:
+			rows->label_h_pos = rows->h_pos + LBL_SPACE;
+			break;
+		case INNER_LBL_MIDDLE:
+			rows->label_h_pos = rint(ROOT_SPACE + (scale *
+				(parent_depth + pos->depth) / 2));
+			break;
+		case INNER_LBL_ROOT:
+			rows->label_h_pos = rint(ROOT_SPACE + (scale *
+				parent_depth));
+			rows->label_h_pos += LBL_SPACE;
+			break;
+		default:
+			assert(0);
 		}
-		canvas_draw_hline(canvas, mid, parent_h_pos, h_pos);
-		decorate_edge(canvas, node, mid, h_pos, parent_mid, parent_h_pos, style);
+	} else {
+		// Root or leaves
+		rows->label_h_pos = rows->h_pos + LBL_SPACE;
 	}
+}
 
-	destroy_llist(rev_nodes);
-
-	/* Then the labels are written. This separation of label-writing from
-	 * graph-drawing allows decorate_edge() to assume that no characters are
-	 * found in the canvas besides those that describe graph structure. */
-	// TODO: check the above comment
-
-	int mid; /* used after the loop */
-	for (elem = tree->nodes_in_order->head;
-			NULL != elem; elem = elem->next) {
-		struct rnode *node =  elem->data;
-		struct simple_node_pos *pos =  node->data;
-		/* For cladograms */
-		if (align_leaves && is_leaf(node))
-			pos->depth = dmax;
-
-		int h_pos = rint(ROOT_SPACE + (scale * pos->depth));
-		// // TODO: are these used?
-		// int top = rint(2*pos->top);
-		// int bottom = rint(2*pos->bottom);
-		mid = rint(pos->top+pos->bottom);	/* (2*top + 2*bottom) / 2 */
+/* Draws row 'row' of the tree on line 0 of the canvas. 'active' holds the
+ * nodes whose vertical line crosses the row, in reverse Newick order. Within
+ * a row, things are drawn in the same order as if the whole tree were drawn
+ * at once: first the nodes and edges, in reverse Newick order (makes fixing
+ * edges easier), then the labels, in Newick order, and finally the root's
+ * decoration, which overwrites the edge decorations. Writing the labels last
+ * allows decorate_edge() to assume that no characters are found in the
+ * canvas besides those that describe graph structure. */
+
+static void draw_row(struct canvas *canvas, int row,
+		struct node_rows **active, int num_active,
+		const struct node_rows *root_rows, enum text_graph_style style)
+{
+	int i;
+
+	for (i = 0; i < num_active; i++) {
+		struct node_rows *rows = active[i];
+		canvas_draw_vline(canvas, rows->h_pos, 0, 0);
+		if (row != rows->mid) continue;
+		canvas_draw_hline(canvas, 0, rows->parent_h_pos, rows->h_pos);
+		decorate_edge(canvas, rows, 0, style);
+	}
 
+	for (i = num_active - 1; i >= 0; i--) {
+		struct node_rows *rows = active[i];
 		/* Don't bother printing label if it is "" */
-		if (strcmp(node->label, "") == 0)
+		if (row != rows->mid || strcmp(rows->node->label, "") == 0)
 			continue;
+		canvas_write(canvas, rows->label_h_pos, 0, rows->node->label);
+	}
+
+	if (row == root_rows->mid)
+		canvas_draw_root(canvas, 0, 0);
+}
 
-		/* print label */
-		if (is_inner_node(node)) {
-			double parent_depth = (
-				(struct simple_node_pos *)
-					node->parent->data)->depth;
-			switch (inner_label_pos) {
-			case INNER_LBL_LEAVES:
-				/* rint() rounds halfay, better than automatic
-				 * double->int conversion */
-				h_pos = rint(ROOT_SPACE + (scale * pos->depth));
-				h_pos += LBL_SPACE;
-				break;
-			case INNER_LBL_MIDDLE:
-				h_pos = rint(ROOT_SPACE + (scale *
-					(parent_depth + pos->depth) / 2));
-				break;
-			case INNER_LBL_ROOT:
-				h_pos = rint(ROOT_SPACE + (scale *
-					parent_depth));
-				h_pos += LBL_SPACE;
-				break;
-			default:
-				assert(0);
+static int compare_first_rows(const void *a, const void *b)
+{
+	const struct node_rows *rows_a = *(struct node_rows * const *) a;
+	const struct node_rows *rows_b = *(struct node_rows * const *) b;
+	return rows_a->first_row - rows_b->first_row;
+}
+
+/* Prints the tree one row at a time, top to bottom. A row only depends on the
+ * nodes whose vertical line crosses it (the "active" nodes), so a one-line
+ * canvas is enough: the active nodes are kept in reverse Newick order, those
+ * whose line starts on the current row are added, and those whose line ended
+ * on the previous one are dropped. The drawing memory is thus proportional to
+ * the width and depth of the tree instead of its width times its number of
+ * leaves, and rows are printed as soon as they are done. Returns FAILURE iff
+ * memory can't be allocated. */
+
+static int draw_tree(struct canvas *line, struct rooted_tree *tree,
+		int num_rows, const double scale, int align_leaves,
+		double dmax, enum inner_lbl_pos inner_label_pos,
+		enum text_graph_style style)
+{
+	int num_nodes = tree->nodes_in_order->count;
+	struct node_rows *all_rows = malloc(num_nodes *
+			sizeof(struct node_rows));
+	struct node_rows **by_first_row = malloc(num_nodes *
+			sizeof(struct node_rows *));
+	struct node_rows **active = malloc(num_nodes *
+			sizeof(struct node_rows *));
+	if (NULL == all_rows || NULL == by_first_row || NULL == active) {
+		free(all_rows); free(by_first_row); free(active);
+		return FAILURE;
+	}
+
+	/* Reverse Newick order, so that comparing pointers compares ranks */
+	struct llist *rev_nodes = llist_reverse(tree->nodes_in_order);
+	if (NULL == rev_nodes) {
+		free(all_rows); free(by_first_row); free(active);
+		return FAILURE;
+	}
+	struct list_elem *elem;
+	int i;
+	for (i = 0, elem = rev_nodes->head; NULL != elem;
+			elem = elem->next, i++) {
+		set_node_rows(&all_rows[i], elem->data, scale, align_leaves,
+				dmax, inner_label_pos);
+		by_first_row[i] = &all_rows[i];
+	}
+	destroy_llist(rev_nodes);
+	qsort(by_first_row, num_nodes, sizeof(struct node_rows *),
+			compare_first_rows);
+
+	int next = 0;	/* in by_first_row */
+	int num_active = 0;
+	int row;
+	for (row = 0; row < num_rows; row++) {
+		int kept = 0;
+		for (i = 0; i < num_active; i++)
+			if (active[i]->last_row >= row)
+				active[kept++] = active[i];
+		num_active = kept;
+		for (; next < num_nodes && by_first_row[next]->first_row <= row;
+				next++) {
+			struct node_rows *rows = by_first_row[next];
+			int low = 0, high = num_active;
+			while (low < high) {
+				int middle = (low + high) / 2;
+				if (active[middle] < rows) low = middle + 1;
+				else high = middle;
 			}
-		} else {
-			// Root or leaves
-			h_pos += LBL_SPACE;
+			memmove(active + low + 1, active + low,
+				(num_active - low) * sizeof(struct node_rows *));
+			active[low] = rows;
+			num_active++;
 		}
-		canvas_write(canvas, h_pos, mid, node->label);
+
+		clear_canvas(line);
+		draw_row(line, row, active, num_active, &all_rows[0], style);
+		canvas_dump(line);
 	}
 
-	/* The decoration of the root must be done at the end of this loop
-	 * (when node is the root), to overwrite the edge decorations done in
-	 * the previous loop. */
-	canvas_draw_root(canvas, 0, mid);
+	free(all_rows);
+	free(by_first_row);
+	free(active);
+	return SUCCESS;
 }
 
 void draw_scalebar(struct canvas *canvas, const double scale,
@@ -290,9 +374,11 @@ void draw_scalebar(struct canvas *canvas, const double scale,
 
 }
 
-/* We create a new canvas every time - we could reuse one, but this would then
-have to be passed, increasing coupling and diminishing implementation hiding.
-What's more, we can't assume that the new tree will fit in the old canvas. */
+/* We create new canvases every time - we could reuse them, but they would
+then have to be passed, increasing coupling and diminishing implementation
+hiding. What's more, we can't assume that the new tree will fit in the old
+canvas. The tree is drawn one row at a time on a one-line canvas (see
+draw_tree()), the scale bar on a canvas of its own. */
 
 enum display_status display_tree(
 		struct rooted_tree *tree,
@@ -316,12 +402,7 @@ enum display_status display_tree(
 			get_simple_node_pos_depth);
 	if (FAILURE == hd.status) return DISPLAY_MEM_ERROR;
 	double scale = -1;
-	struct canvas *canvasp;
-
-	int scalebar_space = 0;
-	if (with_scalebar)
-		scalebar_space = SCALEBAR_SPACE;
-	int height = 2 * num_leaves + scalebar_space;;
+	struct canvas *line, *scalebar = NULL;
 
 	/* create canvas and draw nodes on it */
 	if (width > 0) 
@@ -336,26 +417,35 @@ enum display_status display_tree(
 	case TEXT_STYLE_RAW:
 	case TEXT_STYLE_COMMAS:
 	case TEXT_STYLE_SLASHES:
-		canvasp = create_raw_canvas(width, height);
+		line = create_raw_canvas(width, 1);
+		if (with_scalebar)
+			scalebar = create_raw_canvas(width, SCALEBAR_SPACE);
 		break;
 	case TEXT_STYLE_VT100:
-		canvasp = create_vt100_canvas(width, height);
+		line = create_vt100_canvas(width, 1);
+		if (with_scalebar)
+			scalebar = create_vt100_canvas(width, SCALEBAR_SPACE);
 		break;
 	default:
 		assert(0);
 	}
-
-	draw_tree(canvasp, tree, scale, align_leaves, hd.d_max,
-			inner_label_pos, style);
-	if (with_scalebar)
-		draw_scalebar(canvasp, scale, hd.d_max, branch_length_units,
+	if (NULL == line || (with_scalebar && NULL == scalebar))
+		return DISPLAY_MEM_ERROR;
+
+	/* draw and output */
+	int status = draw_tree(line, tree, 2 * num_leaves, scale,
+			align_leaves, hd.d_max, inner_label_pos, style);
+	if (SUCCESS == status && with_scalebar) {
+		draw_scalebar(scalebar, scale, hd.d_max, branch_length_units,
 				scale_zero_at_root);
-
-	/* output */
-	canvas_dump(canvasp);
+		canvas_dump(scalebar);
+	}
 
 	/* release memory */
-	destroy_canvas(canvasp);
+	destroy_canvas(line);
+	if (with_scalebar) destroy_canvas(scalebar);
+
+	if (FAILURE == status) return DISPLAY_MEM_ERROR;
 
 	return DISPLAY_OK;
 }
@@ -27,6 +27,8 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
+#define _GNU_SOURCE	/* for fputs_unlocked() */
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -40,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rnode_iterator.h"
 #include "hash.h"
 #include "masprintf.h"
+#include "profile.h"
 
 static bool show_addresses = false;
 
@@ -48,71 +51,105 @@ static bool show_addresses = false;
 
 void set_show_addresses(bool show) { show_addresses = show; }
 
-/* returns the length part of a node, e.g. ":12.345" */
+/* Returns the text of a node's length, or NULL if it has none. A length that
+ * was set as a number is formatted into 'buf' (which must have room for
+ * EDGE_LENGTH_BUFSIZE chars), so that it need not be stored in the node. */
 
-char *length(struct rnode *node)
+static const char *length_text(struct rnode *node, char *buf)
 {
-	char * result = malloc(sizeof(char));
-	if (NULL == result) return NULL;
-	*result = '\0';
+	if (NULL == node->edge_length_as_string) {
+		format_edge_length(buf, node->edge_length);
+		return buf;
+	}
+	if ('\0' == node->edge_length_as_string[0]) return NULL;
+	return node->edge_length_as_string;
+}
 
-	assert(NULL != node->edge_length_as_string);
+/* A growable string, used by to_newick() to avoid the quadratic cost of
+ * concatenating each subtree's text into its parent's. */
 
-	if (strlen(node->edge_length_as_string) > 0) {
-		result = append_to(result, ":");
-		result = append_to(result,
-			       node->edge_length_as_string);	
+struct newick_buffer {
+	char *text;
+	size_t len;
+	size_t size;
+};
+
+/* Appends 's' to 'buf'. Returns FAILURE (and frees the text) if memory runs
+ * out. */
+
+static int buffer_append(struct newick_buffer *buf, const char *s)
+{
+	size_t s_len = strlen(s);
+	if (buf->len + s_len + 1 > buf->size) {
+		size_t new_size = 2 * buf->size;
+		while (buf->len + s_len + 1 > new_size) new_size *= 2;
+		char *new_text = realloc(buf->text, new_size);
+		if (NULL == new_text) {
+			free(buf->text);
+			buf->text = NULL;
+			return FAILURE;
+		}
+		buf->text = new_text;
+		buf->size = new_size;
 	}
+	memcpy(buf->text + buf->len, s, s_len + 1);
+	buf->len += s_len;
+	return SUCCESS;
+}
 
-	return result;
+/* Appends a node's label (if any) and length part, e.g. "A:12.345" */
+
+static int buffer_append_node(struct newick_buffer *buf, struct rnode *node)
+{
+	char len_buf[EDGE_LENGTH_BUFSIZE];
+
+	if (NULL != node->label)
+		if (! buffer_append(buf, node->label)) return FAILURE;
+	const char *length_s = length_text(node, len_buf);
+	if (NULL != length_s) {
+		if (! buffer_append(buf, ":")) return FAILURE;
+		if (! buffer_append(buf, length_s)) return FAILURE;
+	}
+	return SUCCESS;
 }
 
-char *subtree(struct rnode *node)
+/* Returns the Newick text of the subtree rooted at 'node', without the final
+ * ';'. The walk descends through 'first_child' and climbs back through
+ * 'parent', so it needs neither recursion nor a stack, whatever the depth of
+ * the tree. */
+
+static char *subtree(struct rnode *node)
 {
-	char * result = malloc(sizeof(char));
-	if (NULL == result) return NULL;
-	*result = '\0';
-
-	if (is_leaf(node)) {
-		result = append_to(result, node->label);
-		char *length_s = length(node);
-		if (NULL == length_s) return NULL;
-		result = append_to(result, length_s);
-		free(length_s);
-	} else {
-		struct rnode *child;
-		char * child_node_s;
-
-		result = append_to(result, "(");
-
-		/* first child */
-		child = node->first_child;
-		child_node_s = subtree(child);
-		if (NULL == child_node_s) return NULL;
-		result = append_to(result, child_node_s);
-		free(child_node_s);
-		/* other children, comma-separated */
-		for (child = child->next_sibling;
-				NULL != child; child = child->next_sibling) {
-			result = append_to(result, ",");
-			child_node_s = subtree(child);
-			if (NULL == child_node_s) return NULL;
-			result = append_to(result, child_node_s);
-			free(child_node_s);
+	struct newick_buffer buf;
+	buf.size = 64;
+	buf.len = 0;
+	buf.text = malloc(buf.size);
+	if (NULL == buf.text) return NULL;
+	buf.text[0] = '\0';
+
+	struct rnode *current = node;
+	for (;;) {
+		if (! is_leaf(current)) {
+			if (! buffer_append(&buf, "(")) return NULL;
+			current = current->first_child;
+			continue;
 		}
-		result = append_to(result, ")");
-		if (NULL != node->label) {
-			result = append_to(result, node->label);
+		if (! buffer_append_node(&buf, current)) return NULL;
+		/* close every clade of which 'current' is the last child */
+		while (current != node && NULL == current->next_sibling) {
+			current = current->parent;
+			if (! buffer_append(&buf, ")")) return NULL;
+			if (! buffer_append_node(&buf, current)) return NULL;
 		}
-		char *length_s = length(node);
-		if (NULL == length_s) return NULL;
-		result = append_to(result, length_s);
-		free(length_s);
+		if (current == node) break;
+		if (! buffer_append(&buf, ",")) return NULL;
+		current = current->next_sibling;
 	}
-	return result;
+
+	return buf.text;
 }
 
-char *to_newick(struct rnode *node)
+static char *newick_string(struct rnode *node)
 {
 	char *result;
 	result = subtree(node);
@@ -131,11 +168,12 @@ static int append_leaf(struct llist *result, struct rnode *current)
 	if (show_addresses) 
 		if (! append_element(result, masprintf("@%p", current)))
 			return FAILURE;
-	if (strcmp("", current->edge_length_as_string) != 0) {
+	char buf[EDGE_LENGTH_BUFSIZE];
+	const char *length_s = length_text(current, buf);
+	if (NULL != length_s) {
 		if (! append_element(result, strdup(":")))
 			return FAILURE;
-		if (! append_element(result,
-			strdup(current->edge_length_as_string)))
+		if (! append_element(result, strdup(length_s)))
 			return FAILURE;
 	}
 
@@ -160,11 +198,12 @@ static int append_inner_node_end(struct llist *result,
 	if (show_addresses) 
 		if (! append_element( result, masprintf("@%p", current)))
 			return FAILURE;
-	if (strcmp("", current->edge_length_as_string) != 0) {
+	char buf[EDGE_LENGTH_BUFSIZE];
+	const char *length_s = length_text(current, buf);
+	if (NULL != length_s) {
 		if (! append_element(result, strdup(":")))
 			return FAILURE;
-		if (! append_element(result,
-				strdup(current->edge_length_as_string)))
+		if (! append_element(result, strdup(length_s)))
 			return FAILURE;
 	}
 	current->seen = 0;	/* reset */
@@ -200,7 +239,7 @@ static int append_inner_node(struct rnode_iterator *it,
 	return SUCCESS;
 }
 
-struct llist *to_newick_i(struct rnode *node)
+static struct llist *newick_strings(struct rnode *node)
 {
 	struct rnode_iterator *it;
 	struct rnode *current;
@@ -234,20 +273,87 @@ struct llist *to_newick_i(struct rnode *node)
 	return result;
 }
 
-int dump_newick(struct rnode *node)
+/* Prints a node's label, address (if show_addresses is true), and length.
+ * The caller holds stdout's lock (see print_newick()). */
+
+static void print_node_end(struct rnode *node)
 {
-	struct llist *nw_strings = to_newick_i(node);
-	if (NULL == nw_strings) return FAILURE;
+	fputs_unlocked(node->label, stdout);
+	if (show_addresses)
+		printf("@%p", node);
+	char buf[EDGE_LENGTH_BUFSIZE];
+	const char *length_s = length_text(node, buf);
+	if (NULL != length_s) {
+		putchar_unlocked(':');
+		fputs_unlocked(length_s, stdout);
+	}
+}
 
-	struct list_elem *e;
+/* Same traversal as to_newick_i(), but the strings are printed as soon as
+ * they are known instead of being stored in a list. Once a process has
+ * threads (e.g. for compressed I/O), every stdio call takes the stream's
+ * lock, so we take it once for the whole tree instead. */
 
-	for (e = nw_strings->head; NULL != e; e = e->next) 
-		printf("%s", (char *) e->data);
-	printf("\n");
+static int print_newick(struct rnode *node)
+{
+	struct rnode_iterator *it;
+	struct rnode *current;
 
-	for (e = nw_strings->head; NULL != e; e = e->next) 
-		free(e->data);
-	destroy_llist(nw_strings);
+	it = create_rnode_iterator(node);
+	if (NULL == it) return FAILURE;
+
+	struct rnode *it_root = get_rnode_iterator_root(it);
+	it_root->seen = 1;
+
+	flockfile(stdout);
+	if (! is_leaf(it_root))
+		putchar_unlocked('(');
+
+	while ((current = rnode_iterator_next(it)) != NULL) {
+		if (is_leaf(current)) {
+			print_node_end(current);
+		} else if (0 == current->seen) {
+			current->seen = 1;
+			putchar_unlocked('(');
+		} else if (more_children_to_visit(it)) {
+			putchar_unlocked(',');
+		} else {
+			putchar_unlocked(')');
+			print_node_end(current);
+			current->seen = 0;
+		}
+	}
+	fputs_unlocked(";\n", stdout);
+	funlockfile(stdout);
+
+	destroy_rnode_iterator(it);
 
 	return SUCCESS;
 }
+
+/* The public functions time the output phase when profiling (see
+ * profile.h). */
+
+char *to_newick(struct rnode *node)
+{
+	PROFILE_START(PROFILE_OUTPUT);
+	char *result = newick_string(node);
+	PROFILE_END(PROFILE_OUTPUT);
+	return result;
+}
+
+struct llist *to_newick_i(struct rnode *node)
+{
+	PROFILE_START(PROFILE_OUTPUT);
+	struct llist *result = newick_strings(node);
+	PROFILE_END(PROFILE_OUTPUT);
+	return result;
+}
+
+int dump_newick(struct rnode *node)
+{
+	PROFILE_START(PROFILE_OUTPUT);
+	int result = print_newick(node);
+	PROFILE_END(PROFILE_OUTPUT);
+	return result;
+}
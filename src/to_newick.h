@@ -39,8 +39,8 @@ struct rnode;
 /** Returns a Newick representation of the tree rooted at \c root. This is
  * often, but doesn't have to be, the \c root member of a struct rooted_tree.
  * Memory is allocated, don't forget to free() it. Returns NULL in case of
- * failure (which will be a memory allocation problem). WARNING: the current
- * implementation is recursive, and hence is slow for big trees.
+ * failure (which will be a memory allocation problem). The implementation is
+ * iterative, so arbitrarily deep trees can be printed.
  * \par \c root the root of the tree to print 
  * \return a Newick-formatted string, or NULL (see text).*/
 
@@ -68,8 +68,9 @@ void set_show_addresses(bool show);
 
 struct llist *to_newick_i(struct rnode *root);
 
-/** Dumps the newick rooted at \c root to stdout. This function calls
- * to_newick_i() to get a representation of the tree as a list of strings,
- * which it prints. It is therefore iterative (and hence fast). */
+/** Dumps the newick rooted at \c root to stdout. This function traverses the
+ * tree like to_newick_i(), but prints each string as soon as it is known
+ * instead of storing it. It is therefore iterative, and allocates no memory
+ * per node. */
 
 void dump_newick(struct rnode* root);
@@ -35,17 +35,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdbool.h>
 
-#include "parser.h"
-#include "to_newick.h"
-#include "tree.h"
-#include "rnode.h"
-#include "list.h"
+#include "newick_events.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 struct parameters {
 	bool show_inner_labels;
 	bool show_leaf_labels;
 	bool show_branch_lengths;
+	FILE *input;
 };
 
 void help(char *argv[])
@@ -56,7 +55,7 @@ void help(char *argv[])
 "Synopsis\n"
 "--------\n"
 "\n"
-"%s [-bhIL] <newick trees filename|->\n"
+"%s [-bhILz:] <newick trees filename|->\n"
 "\n"
 "Input\n"
 "-----\n"
@@ -77,6 +76,9 @@ void help(char *argv[])
 "    -h: print this message and exit\n"
 "    -I: discard inner node labels\n"
 "    -L: discard leaf labels\n"
+"    -z <gz|zst>: compress the output with gzip (as BGZF blocks, which\n"
+"        gunzip reads as usual) or zstd. Compression runs on separate\n"
+"        threads.\n"
 "\n"
 "Examples\n"
 "--------\n"
@@ -104,9 +106,10 @@ struct parameters get_params(int argc, char *argv[])
 	params.show_inner_labels = true;
 	params.show_leaf_labels = true;
 	params.show_branch_lengths = false;
+	params.input = stdin;
 
 	int opt_char;
-	while ((opt_char = getopt(argc, argv, "bhIL")) != -1) {
+	while ((opt_char = getopt(argc, argv, "bhILz:")) != -1) {
 		switch (opt_char) {
 		case 'b':
 			params.show_branch_lengths = true;
@@ -120,6 +123,13 @@ struct parameters get_params(int argc, char *argv[])
 		case 'L':
 			params.show_leaf_labels = false;
 			break;
+		case 'z':
+			if (! compress_stdout(optarg)) {
+				fprintf (stderr, "-z %s: ", optarg);
+				perror(NULL);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		default:
 			fprintf (stderr, "Unknown option '-%c'\n", opt_char);
 			exit (EXIT_FAILURE);
@@ -129,13 +139,12 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 1)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
-			extern FILE *nwsin;
+			FILE *fin = open_input_file(argv[optind]);
 			if (NULL == fin) {
 				perror(NULL);
 				exit(EXIT_FAILURE);
 			}
-			nwsin = fin;
+			params.input = fin;
 		}
 	} else {
 		fprintf(stderr, "Usage: %s [-bhIL] <filename|->\n", argv[0]);
@@ -145,45 +154,78 @@ struct parameters get_params(int argc, char *argv[])
 	return params;
 }
 
-void process_tree(struct rooted_tree *tree, struct parameters params)
-{
+/* The tree is written out as the parser reads it, minus the discarded parts,
+ * so no tree is built. The only state we need is whether the next node has a
+ * left sibling (and thus must be preceded by a comma). */
 
-	struct list_elem *elem;
-	
-	for (elem = tree->nodes_in_order->head; NULL != elem; elem = elem->next) {
-		struct rnode *current = (struct rnode *) elem->data;
-		if (! params.show_branch_lengths) {
-			char *length = current->edge_length_as_string;
-			length[0] = '\0';
-		}
-		if (! params.show_inner_labels) {
-			if (! is_leaf(current)) {
-				char *label = current->label;
-				label[0] = '\0';
-			}
-		}
-		if (! params.show_leaf_labels) {
-			if (is_leaf(current)) {
-				char *label = current->label;
-				label[0] = '\0';
-			}
-		}
+struct newick_writer {
+	struct parameters *params;
+	bool after_node;
+};
+
+static void print_node_end(struct newick_writer *writer, bool show_label,
+		char *label, char *length)
+{
+	if (show_label) fputs(label, stdout);
+	if (writer->params->show_branch_lengths && '\0' != length[0]) {
+		putchar(':');
+		fputs(length, stdout);
 	}
+	writer->after_node = true;
 }
 
-int main (int argc, char* argv[])
+static void open_clade(void *param)
 {
-	struct rooted_tree *tree;
-	struct parameters params;
+	struct newick_writer *writer = param;
+	if (writer->after_node) putchar(',');
+	putchar('(');
+	writer->after_node = false;
+}
 
-	params = get_params(argc, argv);
+static void leaf(void *param, char *label, char *length)
+{
+	struct newick_writer *writer = param;
+	if (writer->after_node) putchar(',');
+	print_node_end(writer, writer->params->show_leaf_labels, label, length);
+}
+
+static void close_clade(void *param, char *label, char *length)
+{
+	struct newick_writer *writer = param;
+	putchar(')');
+	print_node_end(writer, writer->params->show_inner_labels, label,
+			length);
+}
 
-	while ((tree = parse_tree()) != NULL) {
-		process_tree(tree, params);
-		dump_newick(tree->root);
-		destroy_all_rnodes(NULL);
-		destroy_tree(tree);
+static void end_tree(void *param)
+{
+	struct newick_writer *writer = param;
+	puts(";");
+	writer->after_node = false;
+}
+
+int main (int argc, char* argv[])
+{
+	argc = profile_init(argc, argv);
+
+	struct parameters params = get_params(argc, argv);
+
+	struct newick_writer writer = { &params, false };
+	struct newick_handlers handlers = {
+		open_clade, leaf, close_clade, end_tree, &writer };
+	struct newick_stream *stream = create_newick_stream(params.input);
+	if (NULL == stream) { perror(NULL); exit(EXIT_FAILURE); }
+
+	/* like the other programs, we stop at the first faulty tree */
+	enum parser_status_type status;
+	do
+		status = parse_newick_events(stream, &handlers);
+	while (PARSER_STATUS_OK == status);
+	if (PARSER_STATUS_MALLOC_ERROR == status) {
+		perror(NULL);
+		exit(EXIT_FAILURE);
 	}
 
+	destroy_newick_stream(stream);
 	return 0;
 }
@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "hash.h"
 #include "rnode_iterator.h"
 #include "common.h"
+#include "label_intern.h"
 
 const int FREE_NODE_DATA = 1;
 const int DONT_FREE_NODE_DATA = 0;
@@ -112,6 +113,7 @@ void collapse_pure_clades(struct rooted_tree *tree)
 			 * because it will be later passed to free() */
 			free(current->label);
 			current->label = strdup(label);
+			current->label_id = current->first_child->label_id;
 			remove_children(current);
 		}
 	}
@@ -182,7 +184,7 @@ enum tree_type get_tree_type(struct rooted_tree *tree)
 	struct list_elem *el;
 	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
 		struct rnode *current = el->data;
-		if (strcmp(current->edge_length_as_string, "") == 0)	/* length is empty (NOT zero!) */
+		if (! has_edge_length(current))	/* length is empty (NOT zero!) */
 			nb_edges_without_lengths++;
 		else
 			nb_edges_with_lengths++;
@@ -193,7 +195,7 @@ enum tree_type get_tree_type(struct rooted_tree *tree)
 	else if (nb_edges_with_lengths == nb_nodes) 
 		return TREE_TYPE_PHYLOGRAM;
 	else if (nb_edges_with_lengths == nb_nodes - 1
-		&& strcmp("", tree->root->edge_length_as_string) == 0)
+		&& ! has_edge_length(tree->root))
 		return TREE_TYPE_PHYLOGRAM;
 	else
 		return TREE_TYPE_NEITHER;	/* weird, but legal */
@@ -247,6 +249,83 @@ struct llist *nodes_from_regexp(struct rooted_tree *tree, regex_t *preg)
 	return result;
 }
 
+enum memo_result { MEMO_UNKNOWN = -1, MEMO_NO_MATCH, MEMO_MATCH };
+
+struct regexp_memo {
+	regex_t *preg;
+	signed char *results;	/* by label ID; see enum memo_result */
+	int size;
+};
+
+struct regexp_memo *create_regexp_memo(regex_t *preg)
+{
+	struct regexp_memo *memo = malloc(sizeof(struct regexp_memo));
+	if (NULL == memo) return NULL;
+	memo->preg = preg;
+	memo->results = NULL;
+	memo->size = 0;
+	return memo;
+}
+
+/* Makes room for results of labels with IDs up to 'id'. */
+
+static int grow_memo(struct regexp_memo *memo, int id)
+{
+	int new_size = memo->size > 0 ? memo->size : 256;
+	while (new_size <= id) new_size *= 2;
+	signed char *results = realloc(memo->results, new_size);
+	if (NULL == results) return FAILURE;
+	memset(results + memo->size, MEMO_UNKNOWN, new_size - memo->size);
+	memo->results = results;
+	memo->size = new_size;
+	return SUCCESS;
+}
+
+static bool label_matches(struct regexp_memo *memo, struct rnode *node)
+{
+	int id = node->label_id;
+	if (id < 0)
+		return 0 == regexec(memo->preg, node->label, 0, NULL, 0);
+	if (MEMO_UNKNOWN == memo->results[id])
+		memo->results[id] =
+			(0 == regexec(memo->preg, node->label, 0, NULL, 0)) ?
+			MEMO_MATCH : MEMO_NO_MATCH;
+	return MEMO_MATCH == memo->results[id];
+}
+
+struct llist *nodes_from_regexp_memo(struct rooted_tree *tree,
+		struct regexp_memo *memo)
+{
+	/* All labels of the tree are interned by now */
+	int label_count = interned_label_count();
+	if (label_count > memo->size)
+		if (! grow_memo(memo, label_count - 1)) return NULL;
+
+	struct llist *result = create_llist();
+	if (NULL == result) return NULL;
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *node = el->data;
+		if (label_matches(memo, node))
+			if (! append_element(result, node))
+				return NULL;
+	}
+
+	return result;
+}
+
+void clear_regexp_memo(struct regexp_memo *memo)
+{
+	if (memo->size > 0)
+		memset(memo->results, MEMO_UNKNOWN, memo->size);
+}
+
+void destroy_regexp_memo(struct regexp_memo *memo)
+{
+	free(memo->results);
+	free(memo);
+}
+
 void reset_seen(struct rooted_tree *tree)
 {
 	struct list_elem *el = tree->nodes_in_order->head;
@@ -114,6 +114,33 @@ struct llist *nodes_from_regexp_string(struct rooted_tree *tree,
 struct llist *nodes_from_regexp(struct rooted_tree *tree,
 		regex_t *preg);
 
+/* A regexp together with the results of matching it against labels, indexed
+ * by label ID. In a stream of trees that share labels (e.g. bootstrap
+ * replicates), each distinct label is then matched only once. Nodes whose
+ * label is not interned (see label_intern.h) are matched every time. */
+
+struct regexp_memo;
+
+/* Returns NULL on failure. The regexp is not copied, and must outlive the
+ * memo. */
+
+struct regexp_memo *create_regexp_memo(regex_t *preg);
+
+/* Like nodes_from_regexp(), but looks up (or stores) each node's result in the
+ * memo. Returns NULL on failure. */
+
+struct llist *nodes_from_regexp_memo(struct rooted_tree *tree,
+		struct regexp_memo *memo);
+
+/* Forgets all stored results, e.g. before the interned labels they refer to
+ * are forgotten (see forget_labels_since()). */
+
+void clear_regexp_memo(struct regexp_memo *memo);
+
+/* Does not free the regexp */
+
+void destroy_regexp_memo(struct regexp_memo *memo);
+
 /* Clones a (sub)tree, given the root node of the subtree. All nodes and edges
  * are new: one can modify or delete the clone without affecting the original
  * in any way. */
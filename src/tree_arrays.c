@@ -0,0 +1,420 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "tree_arrays.h"
+#include "tree.h"
+#include "rnode.h"
+#include "list.h"
+#include "parser.h"
+#include "common.h"
+
+enum { INIT_CAPACITY = 64 };
+
+#define RESIZE(array, count) do { \
+	void *resized = realloc(array, (count) * sizeof(*(array))); \
+	if (NULL == resized) return FAILURE; \
+	array = resized; \
+} while (0)
+
+/* Makes room for 'needed' nodes. The offset arrays need one more entry than
+ * there are nodes; to keep things simple, all node arrays get it. */
+
+static int reserve_nodes(struct tree_arrays *arrays, long needed)
+{
+	if (needed <= arrays->node_capacity) return SUCCESS;
+	if (needed >= INT_MAX) return FAILURE;
+	long capacity = arrays->node_capacity;
+	if (capacity < INIT_CAPACITY) capacity = INIT_CAPACITY;
+	while (capacity < needed) capacity *= 2;
+	if (capacity >= INT_MAX) capacity = INT_MAX - 1;
+
+	RESIZE(arrays->tree, capacity + 1);
+	RESIZE(arrays->parent, capacity + 1);
+	RESIZE(arrays->child_offsets, capacity + 1);
+	RESIZE(arrays->children, capacity + 1);
+	RESIZE(arrays->edge_length, capacity + 1);
+	RESIZE(arrays->depth, capacity + 1);
+	RESIZE(arrays->label_offsets, capacity + 1);
+	arrays->node_capacity = capacity;
+	return SUCCESS;
+}
+
+static int reserve_trees(struct tree_arrays *arrays, long needed)
+{
+	if (needed <= arrays->tree_capacity) return SUCCESS;
+	if (needed >= INT_MAX) return FAILURE;
+	long capacity = arrays->tree_capacity;
+	if (capacity < INIT_CAPACITY) capacity = INIT_CAPACITY;
+	while (capacity < needed) capacity *= 2;
+	if (capacity >= INT_MAX) capacity = INT_MAX - 1;
+
+	RESIZE(arrays->tree_offsets, capacity + 1);
+	arrays->tree_capacity = capacity;
+	return SUCCESS;
+}
+
+static int reserve_labels(struct tree_arrays *arrays, long needed)
+{
+	if (needed <= arrays->label_capacity) return SUCCESS;
+	if (needed > INT_MAX) return FAILURE;
+	long capacity = arrays->label_capacity;
+	if (capacity < INIT_CAPACITY) capacity = INIT_CAPACITY;
+	while (capacity < needed) capacity *= 2;
+	if (capacity > INT_MAX) capacity = INT_MAX;
+
+	RESIZE(arrays->labels, capacity);
+	arrays->label_capacity = capacity;
+	return SUCCESS;
+}
+
+struct tree_arrays *create_tree_arrays()
+{
+	struct tree_arrays *arrays = calloc(1, sizeof(struct tree_arrays));
+	if (NULL == arrays) return NULL;
+	arrays->refcount = 1;
+
+	/* Allocating right away means that no array is NULL, even in an
+	 * empty table, which Arrow consumers may not like. */
+	if (FAILURE == reserve_nodes(arrays, 1) ||
+	    FAILURE == reserve_trees(arrays, 1) ||
+	    FAILURE == reserve_labels(arrays, 1)) {
+		destroy_tree_arrays(arrays);
+		return NULL;
+	}
+	arrays->tree_offsets[0] = 0;
+	arrays->child_offsets[0] = 0;
+	arrays->label_offsets[0] = 0;
+
+	return arrays;
+}
+
+/* One per inner node on the path from the root to the current node. */
+
+struct frame {
+	int index;	/* the node's index in the table */
+	int rank;	/* number of its children visited so far */
+};
+
+/* Copies 'node' to entry 'i'. 'frame' is that of its parent (NULL for the
+ * root). */
+
+static void add_node(struct tree_arrays *arrays, struct rnode *node, int i,
+		struct frame *frame)
+{
+	double length = has_edge_length(node) ? get_edge_length(node) : NAN;
+
+	arrays->tree[i] = arrays->tree_count;
+	arrays->edge_length[i] = length;
+	if (NULL == frame) {
+		arrays->parent[i] = -1;
+		arrays->depth[i] = 0;
+	} else {
+		int parent = frame->index;
+		arrays->parent[i] = parent;
+		arrays->children[arrays->child_offsets[parent] +
+			frame->rank++] = i;
+		arrays->depth[i] = arrays->depth[parent] +
+			(isnan(length) ? 0 : length);
+	}
+	arrays->child_offsets[i+1] = arrays->child_offsets[i] +
+		node->child_count;
+
+	size_t label_length = strlen(node->label);
+	memcpy(arrays->labels + arrays->label_offsets[i], node->label,
+			label_length);
+	arrays->label_offsets[i+1] = arrays->label_offsets[i] + label_length;
+}
+
+int tree_arrays_append(struct tree_arrays *arrays, struct rooted_tree *tree)
+{
+	long node_count = (long) arrays->node_count +
+		tree->nodes_in_order->count;
+	long label_bytes = arrays->label_offsets[arrays->node_count];
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next)
+		label_bytes += strlen(((struct rnode *) el->data)->label);
+
+	if (FAILURE == reserve_nodes(arrays, node_count)) return FAILURE;
+	if (FAILURE == reserve_trees(arrays, arrays->tree_count + 1L))
+		return FAILURE;
+	if (FAILURE == reserve_labels(arrays, label_bytes)) return FAILURE;
+
+	/* Preorder walk, without recursion so that depth is no problem (see
+	 * to_newick.c). 'stack' holds the current node's ancestors. */
+	int stack_size = INIT_CAPACITY;
+	int depth = 0;
+	struct frame *stack = malloc(stack_size * sizeof(struct frame));
+	if (NULL == stack) return FAILURE;
+
+	struct rnode *node = tree->root;
+	int i = arrays->node_count;
+	for (;;) {
+		add_node(arrays, node, i, depth > 0 ? &stack[depth-1] : NULL);
+		if (NULL != node->first_child) {
+			if (depth == stack_size) {
+				stack_size *= 2;
+				struct frame *larger = realloc(stack,
+					stack_size * sizeof(struct frame));
+				if (NULL == larger) {
+					free(stack);
+					return FAILURE;
+				}
+				stack = larger;
+			}
+			stack[depth].index = i;
+			stack[depth].rank = 0;
+			depth++;
+			node = node->first_child;
+		} else {
+			while (node != tree->root && NULL == node->next_sibling) {
+				node = node->parent;
+				depth--;
+			}
+			if (node == tree->root) break;
+			node = node->next_sibling;
+		}
+		i++;
+	}
+	free(stack);
+
+	arrays->node_count = i + 1;
+	arrays->tree_count++;
+	arrays->tree_offsets[arrays->tree_count] = arrays->node_count;
+	return SUCCESS;
+}
+
+struct tree_arrays *parse_tree_arrays(int max_trees)
+{
+	struct tree_arrays *arrays = create_tree_arrays();
+	if (NULL == arrays) return NULL;
+
+	int watermark = rnode_watermark();
+	struct rooted_tree *tree;
+	while ((max_trees <= 0 || arrays->tree_count < max_trees) &&
+			NULL != (tree = parse_tree())) {
+		int status = tree_arrays_append(arrays, tree);
+		destroy_rnodes_since(watermark, NULL);
+		destroy_tree(tree);
+		if (FAILURE == status) {
+			destroy_tree_arrays(arrays);
+			return NULL;
+		}
+	}
+
+	return arrays;
+}
+
+void destroy_tree_arrays(struct tree_arrays *arrays)
+{
+	if (--arrays->refcount > 0) return;
+
+	free(arrays->tree_offsets);
+	free(arrays->tree);
+	free(arrays->parent);
+	free(arrays->child_offsets);
+	free(arrays->children);
+	free(arrays->edge_length);
+	free(arrays->depth);
+	free(arrays->label_offsets);
+	free(arrays->labels);
+	free(arrays);
+}
+
+/* Arrow export. Every exported schema and array has its own private data, as
+ * the C data interface allows consumers to move children out of their parent
+ * and release them separately. Each exported array holds a reference to the
+ * table. */
+
+enum { TREE_COL, PARENT_COL, CHILDREN_COL, EDGE_LENGTH_COL, DEPTH_COL,
+	LABEL_COL, COLUMN_COUNT };
+
+static const char *column_names[COLUMN_COUNT] = {
+	"tree", "parent", "children", "edge_length", "depth", "label"
+};
+
+/* Format strings of the Arrow types */
+static const char *column_formats[COLUMN_COUNT] = {
+	"i", "i", "+l", "g", "g", "u"
+};
+
+struct schema_private {
+	struct ArrowSchema *child_pointers[COLUMN_COUNT];
+	struct ArrowSchema children[COLUMN_COUNT];
+};
+
+struct array_private {
+	struct tree_arrays *owner;
+	const void *buffers[3];
+	struct ArrowArray *child_pointers[COLUMN_COUNT];
+	struct ArrowArray children[COLUMN_COUNT];
+};
+
+static void release_schema(struct ArrowSchema *schema)
+{
+	int i;
+	for (i = 0; i < schema->n_children; i++) {
+		struct ArrowSchema *child = schema->children[i];
+		if (NULL != child->release) child->release(child);
+	}
+	free(schema->private_data);
+	schema->release = NULL;
+}
+
+static void release_array(struct ArrowArray *array)
+{
+	struct array_private *private = array->private_data;
+	int i;
+	for (i = 0; i < array->n_children; i++) {
+		struct ArrowArray *child = array->children[i];
+		if (NULL != child->release) child->release(child);
+	}
+	destroy_tree_arrays(private->owner);
+	free(private);
+	array->release = NULL;
+}
+
+static int init_schema(struct ArrowSchema *schema, const char *format,
+		const char *name, int n_children)
+{
+	struct schema_private *private = calloc(1,
+			sizeof(struct schema_private));
+	if (NULL == private) return FAILURE;
+	int i;
+	for (i = 0; i < n_children; i++)
+		private->child_pointers[i] = &private->children[i];
+
+	schema->format = format;
+	schema->name = name;
+	schema->metadata = NULL;
+	schema->flags = 0;
+	schema->n_children = n_children;
+	schema->children = n_children > 0 ? private->child_pointers : NULL;
+	schema->dictionary = NULL;
+	schema->release = release_schema;
+	schema->private_data = private;
+	return SUCCESS;
+}
+
+static int init_array(struct ArrowArray *array, struct tree_arrays *owner,
+		int64_t length, int n_buffers, const void *data,
+		const void *more_data, int n_children)
+{
+	struct array_private *private = calloc(1,
+			sizeof(struct array_private));
+	if (NULL == private) return FAILURE;
+	private->owner = owner;
+	owner->refcount++;
+	private->buffers[0] = NULL;	/* no validity bitmap: no nulls */
+	private->buffers[1] = data;
+	private->buffers[2] = more_data;
+	int i;
+	for (i = 0; i < n_children; i++)
+		private->child_pointers[i] = &private->children[i];
+
+	array->length = length;
+	array->null_count = 0;
+	array->offset = 0;
+	array->n_buffers = n_buffers;
+	array->n_children = n_children;
+	array->buffers = private->buffers;
+	array->children = n_children > 0 ? private->child_pointers : NULL;
+	array->dictionary = NULL;
+	array->release = release_array;
+	array->private_data = private;
+	return SUCCESS;
+}
+
+static int export_schema(struct ArrowSchema *schema)
+{
+	if (FAILURE == init_schema(schema, "+s", "", COLUMN_COUNT))
+		return FAILURE;
+	int col;
+	for (col = 0; col < COLUMN_COUNT; col++) {
+		int n_children = CHILDREN_COL == col ? 1 : 0;
+		if (FAILURE == init_schema(schema->children[col],
+				column_formats[col], column_names[col],
+				n_children))
+			goto fail;
+	}
+	if (FAILURE == init_schema(schema->children[CHILDREN_COL]->children[0],
+			"i", "item", 0))
+		goto fail;
+	return SUCCESS;
+
+fail:
+	schema->release(schema);
+	return FAILURE;
+}
+
+static int export_array(struct tree_arrays *arrays, struct ArrowArray *array)
+{
+	int64_t n = arrays->node_count;
+	struct ArrowArray **columns;
+
+	if (FAILURE == init_array(array, arrays, n, 1, NULL, NULL,
+				COLUMN_COUNT))
+		return FAILURE;
+	columns = array->children;
+	if (FAILURE == init_array(columns[TREE_COL], arrays, n, 2,
+				arrays->tree, NULL, 0) ||
+	    FAILURE == init_array(columns[PARENT_COL], arrays, n, 2,
+				arrays->parent, NULL, 0) ||
+	    FAILURE == init_array(columns[CHILDREN_COL], arrays, n, 2,
+				arrays->child_offsets, NULL, 1) ||
+	    FAILURE == init_array(columns[CHILDREN_COL]->children[0], arrays,
+				n - arrays->tree_count, 2, arrays->children,
+				NULL, 0) ||
+	    FAILURE == init_array(columns[EDGE_LENGTH_COL], arrays, n, 2,
+				arrays->edge_length, NULL, 0) ||
+	    FAILURE == init_array(columns[DEPTH_COL], arrays, n, 2,
+				arrays->depth, NULL, 0) ||
+	    FAILURE == init_array(columns[LABEL_COL], arrays, n, 3,
+				arrays->label_offsets, arrays->labels, 0)) {
+		array->release(array);
+		return FAILURE;
+	}
+	return SUCCESS;
+}
+
+int export_tree_arrays_arrow(struct tree_arrays *arrays,
+		struct ArrowSchema *schema, struct ArrowArray *array)
+{
+	if (FAILURE == export_schema(schema)) return FAILURE;
+	if (FAILURE == export_array(arrays, array)) {
+		schema->release(schema);
+		return FAILURE;
+	}
+	return SUCCESS;
+}
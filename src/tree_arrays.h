@@ -0,0 +1,146 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+/** \file
+ * Columnar export of trees. A tree (or a batch of trees) is copied into a few
+ * contiguous arrays, one entry per node, so that other languages can work on
+ * it without following rnode pointers: the Python bindings (newick_utils.py)
+ * expose the arrays as NumPy arrays, or as an Arrow record batch through the
+ * Arrow C data interface, in both cases without copying them again.
+ *
+ * Nodes are numbered in preorder, across all the trees of a batch: a node
+ * comes after its parent, and the nodes of a subtree have consecutive
+ * indices. The children of node i are children[child_offsets[i]] to
+ * children[child_offsets[i+1] - 1], and its label is labels[label_offsets[i]]
+ * to labels[label_offsets[i+1] - 1]. These are the layouts of Arrow's list
+ * and string types. */
+
+#include <stdint.h>
+
+struct rooted_tree;
+
+struct tree_arrays {
+	int node_count;
+	int tree_count;
+	/** The nodes of tree t are tree_offsets[t] to tree_offsets[t+1] - 1
+	 * (tree_count + 1 entries). */
+	int *tree_offsets;
+	int *tree;		/**< index of each node's tree */
+	int *parent;		/**< -1 for roots */
+	int *child_offsets;	/**< node_count + 1 entries */
+	int *children;		/**< node_count - tree_count entries */
+	/** NaN for undefined lengths (cladograms). */
+	double *edge_length;
+	/** Distance from the root. Undefined lengths count as 0, and the
+	 * root's own edge is ignored, so roots have depth 0. */
+	double *depth;
+	int *label_offsets;	/**< node_count + 1 entries */
+	/** The labels, back to back and NOT '\0'-terminated. */
+	char *labels;
+
+	/* The remaining members are private. */
+	int node_capacity;
+	int tree_capacity;
+	int label_capacity;
+	int refcount;
+};
+
+/** Returns an empty table, or NULL in case of malloc() problems. */
+
+struct tree_arrays *create_tree_arrays();
+
+/** Appends 'tree' to 'arrays'. Returns SUCCESS, or FAILURE in case of
+ * malloc() problems or if the table would exceed INT_MAX nodes or label
+ * bytes. */
+
+int tree_arrays_append(struct tree_arrays *arrays, struct rooted_tree *tree);
+
+/** Parses up to 'max_trees' trees (all trees if 'max_trees' <= 0) from the
+ * parser's input (see parser.h) into a single table. Each tree's nodes are
+ * freed once it has been copied, so memory depends on the table's size, not
+ * on the trees'. Stops at the end of input or at a parse error; check
+ * newick_parser_status to tell them apart. Returns NULL in case of malloc()
+ * problems. */
+
+struct tree_arrays *parse_tree_arrays(int max_trees);
+
+/** Frees the table. Arrow arrays exported from it remain valid until they are
+ * released in turn. */
+
+void destroy_tree_arrays(struct tree_arrays *arrays);
+
+/* Arrow C data interface, see
+ * https://arrow.apache.org/docs/format/CDataInterface.html. The structures
+ * are part of Arrow's stable ABI and are meant to be copied verbatim. */
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	const char *format;
+	const char *name;
+	const char *metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema **children;
+	struct ArrowSchema *dictionary;
+	void (*release)(struct ArrowSchema *);
+	void *private_data;
+};
+
+struct ArrowArray {
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void **buffers;
+	struct ArrowArray **children;
+	struct ArrowArray *dictionary;
+	void (*release)(struct ArrowArray *);
+	void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+/** Exports the table as an Arrow record batch (a struct array) with one row
+ * per node and the columns tree (int32), parent (int32), children
+ * (list<int32>), edge_length (float64), depth (float64) and label (utf8).
+ * The arrays are not copied: the batch keeps 'arrays' alive until it is
+ * released, even if destroy_tree_arrays() is called first. 'arrays' must
+ * not be appended to while the batch exists. Returns SUCCESS, or FAILURE in
+ * case of malloc() problems (in which case 'schema' and 'array' are left
+ * unset). */
+
+int export_tree_arrays_arrow(struct tree_arrays *arrays,
+		struct ArrowSchema *schema, struct ArrowArray *array);
@@ -45,6 +45,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "address_parser_status.h"
 #include "tree_editor_rnode_data.h"
 #include "common.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 void address_scanner_set_input(char *);
 void address_scanner_clear_input();
@@ -246,7 +248,7 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if (3 == (argc - optind))	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -332,7 +334,7 @@ void reverse_parse_order_traversal(struct rooted_tree *tree)
 		if (NULL == rndata) { perror(NULL); exit (EXIT_FAILURE); }
 		rndata->nb_ancestors = parent_data->nb_ancestors + 1;
 		rndata->depth = parent_data->depth +
-			atof(node->edge_length_as_string);
+			get_edge_length(node);
 
 		rndata->stop_mark = false;
 		node->data = rndata;
@@ -461,6 +463,8 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 
 int main(int argc, char* argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct parameters params = get_params(argc, argv);
 	struct rooted_tree *tree;
 
@@ -0,0 +1,582 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* tree_index.c: inverted label -> tree index, for nw_index, nw_clade and
+ * nw_match */
+
+#define _GNU_SOURCE	/* for fseeko() and ftello() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+#include "rnode.h"
+#include "list.h"
+#include "hash.h"
+#include "parser.h"
+#include "common.h"
+#include "label_intern.h"
+#include "tree_index.h"
+
+void newick_scanner_set_string_input(char *);
+void newick_scanner_clear_string_input();
+
+/* Index file layout. All numbers are unsigned varints (7 bits per byte, least
+ * significant group first, high bit set on all bytes but the last).
+ *
+ *	magic (8 bytes)
+ *	size and modification time of the indexed file
+ *	number of trees
+ *	number of labels
+ *	for each label: length, label text (not terminated), number of
+ *		trees, length (in bytes) of its posting list
+ *	the posting lists, in the same order as the labels
+ *
+ * A posting list holds the offsets of the trees that contain the label, in
+ * increasing order, each as the difference from the previous one (the first
+ * one from 0). */
+
+static const char INDEX_MAGIC[] = "NWINDEX1";
+#define INDEX_MAGIC_LENGTH 8
+
+enum tree_index_status tree_index_status = TREE_INDEX_OK;
+
+/* Varints */
+
+/* Write errors are not checked here: they are sticky (see ferror(3)), so the
+ * caller checks once at the end. */
+
+static void put_varint(FILE *out, uint64_t value)
+{
+	while (value >= 0x80) {
+		putc((int) (value & 0x7f) | 0x80, out);
+		value >>= 7;
+	}
+	putc((int) value, out);
+}
+
+static int get_varint(FILE *in, uint64_t *value)
+{
+	uint64_t result = 0;
+	int shift;
+	for (shift = 0; shift < 64; shift += 7) {
+		int c = getc(in);
+		if (EOF == c) return FAILURE;
+		result |= (uint64_t) (c & 0x7f) << shift;
+		if (! (c & 0x80)) {
+			*value = result;
+			return SUCCESS;
+		}
+	}
+	return FAILURE;
+}
+
+/* Decodes the varint at 'p' (which must not go past 'end'). Returns a pointer
+ * to the next one, or NULL if the buffer ends first. */
+
+static const unsigned char *decode_varint(const unsigned char *p,
+		const unsigned char *end, uint64_t *value)
+{
+	uint64_t result = 0;
+	int shift;
+	for (shift = 0; p < end && shift < 64; shift += 7, p++) {
+		result |= (uint64_t) (*p & 0x7f) << shift;
+		if (! (*p & 0x80)) {
+			*value = result;
+			return p + 1;
+		}
+	}
+	return NULL;
+}
+
+/* Reading trees */
+
+char *read_tree_text(FILE *trees, off_t *offset)
+{
+	tree_index_status = TREE_INDEX_OK;
+
+	int c;
+	do
+		c = getc(trees);
+	while (EOF != c && isspace(c));
+	if (EOF == c) {
+		if (ferror(trees)) tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	*offset = ftello(trees) - 1;
+
+	size_t length = 0;
+	size_t capacity = 256;
+	char *text = malloc(capacity);
+	if (NULL == text) { tree_index_status = TREE_INDEX_IO_ERROR; return NULL; }
+
+	/* Same lexical rules as the scanner: no ';' counts inside quotes or
+	 * comments, and neither can be nested. */
+	bool in_quotes = false;
+	bool in_comment = false;
+	for (; EOF != c; c = getc(trees)) {
+		if (length + 1 == capacity) {
+			capacity *= 2;
+			char *larger = realloc(text, capacity);
+			if (NULL == larger) {
+				free(text);
+				tree_index_status = TREE_INDEX_IO_ERROR;
+				return NULL;
+			}
+			text = larger;
+		}
+		text[length++] = c;
+		if (in_quotes) {
+			if ('\'' == c) in_quotes = false;
+		} else if (in_comment) {
+			if (']' == c) in_comment = false;
+		} else if ('\'' == c)
+			in_quotes = true;
+		else if ('[' == c)
+			in_comment = true;
+		else if (';' == c)
+			break;
+	}
+	text[length] = '\0';
+
+	return text;
+}
+
+struct rooted_tree *parse_tree_at(FILE *trees, off_t offset)
+{
+	if (0 != fseeko(trees, offset, SEEK_SET)) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	off_t start;
+	char *text = read_tree_text(trees, &start);
+	if (NULL == text) return NULL;
+
+	newick_scanner_set_string_input(text);
+	struct rooted_tree *tree = parse_tree();
+	newick_scanner_clear_string_input();
+	free(text);
+
+	return tree;
+}
+
+/* Building */
+
+struct posting_list {
+	unsigned char *bytes;
+	size_t length;
+	size_t capacity;
+	long count;
+	off_t last;	/* offset of the last tree added */
+};
+
+struct tree_index_builder {
+	struct posting_list *lists;	/* indexed by label ID */
+	int size;
+	long tree_count;
+};
+
+struct tree_index_builder *create_tree_index_builder()
+{
+	struct tree_index_builder *builder = malloc(
+			sizeof(struct tree_index_builder));
+	if (NULL == builder) return NULL;
+	builder->lists = NULL;
+	builder->size = 0;
+	builder->tree_count = 0;
+	return builder;
+}
+
+/* Makes room for all label IDs seen so far */
+
+static int grow_builder(struct tree_index_builder *builder)
+{
+	int size = interned_label_count();
+	if (size <= builder->size) return SUCCESS;
+	struct posting_list *lists = realloc(builder->lists,
+			size * sizeof(struct posting_list));
+	if (NULL == lists) return FAILURE;
+	memset(lists + builder->size, 0,
+			(size - builder->size) * sizeof(struct posting_list));
+	builder->lists = lists;
+	builder->size = size;
+	return SUCCESS;
+}
+
+static int add_posting(struct posting_list *list, off_t offset)
+{
+	/* a label may occur more than once in a tree */
+	if (list->count > 0 && list->last == offset) return SUCCESS;
+
+	/* a varint of up to 64 bits takes at most 10 bytes */
+	if (list->length + 10 > list->capacity) {
+		size_t capacity = list->capacity < 8 ? 16 : 2 * list->capacity;
+		unsigned char *bytes = realloc(list->bytes, capacity);
+		if (NULL == bytes) return FAILURE;
+		list->bytes = bytes;
+		list->capacity = capacity;
+	}
+	uint64_t delta = offset - (list->count > 0 ? list->last : 0);
+	while (delta >= 0x80) {
+		list->bytes[list->length++] = (delta & 0x7f) | 0x80;
+		delta >>= 7;
+	}
+	list->bytes[list->length++] = delta;
+	list->count++;
+	list->last = offset;
+
+	return SUCCESS;
+}
+
+int add_tree_to_index(struct tree_index_builder *builder,
+		struct rooted_tree *tree, off_t offset)
+{
+	if (! grow_builder(builder)) return FAILURE;
+
+	struct list_elem *el;
+	for (el = tree->nodes_in_order->head; NULL != el; el = el->next) {
+		struct rnode *current = el->data;
+		int id = current->label_id;
+		if (id <= EMPTY_LABEL_ID) continue;
+		if (! add_posting(builder->lists + id, offset))
+			return FAILURE;
+	}
+	builder->tree_count++;
+
+	return SUCCESS;
+}
+
+int write_tree_index(struct tree_index_builder *builder, FILE *trees,
+		FILE *out)
+{
+	struct stat trees_stat;
+	if (0 != fstat(fileno(trees), &trees_stat)) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return FAILURE;
+	}
+
+	long label_count = 0;
+	int id;
+	for (id = 0; id < builder->size; id++)
+		if (builder->lists[id].count > 0) label_count++;
+
+	fwrite(INDEX_MAGIC, 1, INDEX_MAGIC_LENGTH, out);
+	put_varint(out, trees_stat.st_size);
+	put_varint(out, trees_stat.st_mtime);
+	put_varint(out, builder->tree_count);
+	put_varint(out, label_count);
+	for (id = 0; id < builder->size; id++) {
+		struct posting_list *list = builder->lists + id;
+		if (0 == list->count) continue;
+		const char *label = interned_label(id);
+		size_t label_length = strlen(label);
+		put_varint(out, label_length);
+		fwrite(label, 1, label_length, out);
+		put_varint(out, list->count);
+		put_varint(out, list->length);
+	}
+	for (id = 0; id < builder->size; id++) {
+		struct posting_list *list = builder->lists + id;
+		fwrite(list->bytes, 1, list->length, out);
+	}
+
+	if (ferror(out)) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return FAILURE;
+	}
+	tree_index_status = TREE_INDEX_OK;
+	return SUCCESS;
+}
+
+void destroy_tree_index_builder(struct tree_index_builder *builder)
+{
+	int id;
+	for (id = 0; id < builder->size; id++)
+		free(builder->lists[id].bytes);
+	free(builder->lists);
+	free(builder);
+}
+
+/* Querying */
+
+struct index_entry {
+	long count;
+	uint64_t start;		/* relative to the first posting list */
+	uint64_t length;
+};
+
+struct tree_index {
+	FILE *file;
+	off_t postings_offset;
+	long tree_count;
+	struct index_entry *entries;
+	struct hash *entry_map;	/* label -> struct index_entry* */
+};
+
+void close_tree_index(struct tree_index *index)
+{
+	if (NULL != index->entry_map) destroy_hash(index->entry_map);
+	free(index->entries);
+	if (NULL != index->file) fclose(index->file);
+	free(index);
+}
+
+/* Fails with tree_index_status set to 'status', or to TREE_INDEX_IO_ERROR if
+ * there was a read error. */
+
+static struct tree_index *fail_open(struct tree_index *index,
+		enum tree_index_status status)
+{
+	if (NULL != index->file && ferror(index->file))
+		status = TREE_INDEX_IO_ERROR;
+	tree_index_status = status;
+	close_tree_index(index);
+	return NULL;
+}
+
+struct tree_index *open_tree_index(const char *filename, FILE *trees)
+{
+	const unsigned int HASH_SIZE = 1000;
+	const double LOAD_THRESHOLD = 0.8;
+	const unsigned RESIZE_FACTOR = 10;
+
+	struct tree_index *index = malloc(sizeof(struct tree_index));
+	if (NULL == index) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	index->entries = NULL;
+	index->entry_map = NULL;
+	index->file = fopen(filename, "r");
+	if (NULL == index->file) return fail_open(index, TREE_INDEX_IO_ERROR);
+
+	char magic[INDEX_MAGIC_LENGTH];
+	if (INDEX_MAGIC_LENGTH != fread(magic, 1, INDEX_MAGIC_LENGTH,
+				index->file) ||
+	    0 != memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_LENGTH))
+		return fail_open(index, TREE_INDEX_BAD_FORMAT);
+
+	uint64_t size, mtime, tree_count, label_count;
+	if (! get_varint(index->file, &size) ||
+	    ! get_varint(index->file, &mtime) ||
+	    ! get_varint(index->file, &tree_count) ||
+	    ! get_varint(index->file, &label_count))
+		return fail_open(index, TREE_INDEX_BAD_FORMAT);
+	index->tree_count = tree_count;
+
+	struct stat trees_stat;
+	if (0 != fstat(fileno(trees), &trees_stat))
+		return fail_open(index, TREE_INDEX_IO_ERROR);
+	if (size != (uint64_t) trees_stat.st_size ||
+	    mtime != (uint64_t) trees_stat.st_mtime)
+		return fail_open(index, TREE_INDEX_STALE);
+
+	index->entries = malloc(label_count * sizeof(struct index_entry));
+	index->entry_map = create_dynamic_hash(HASH_SIZE, LOAD_THRESHOLD,
+			RESIZE_FACTOR);
+	if (NULL == index->entries || NULL == index->entry_map)
+		return fail_open(index, TREE_INDEX_IO_ERROR);
+
+	char *label = NULL;
+	size_t label_capacity = 0;
+	uint64_t start = 0;
+	uint64_t i;
+	for (i = 0; i < label_count; i++) {
+		uint64_t label_length, count, length;
+		if (! get_varint(index->file, &label_length)) break;
+		if (label_length + 1 > label_capacity) {
+			label_capacity = label_length + 1;
+			char *larger = realloc(label, label_capacity);
+			if (NULL == larger) {
+				free(label);
+				return fail_open(index, TREE_INDEX_IO_ERROR);
+			}
+			label = larger;
+		}
+		if (label_length != fread(label, 1, label_length, index->file))
+			break;
+		label[label_length] = '\0';
+		if (! get_varint(index->file, &count) ||
+		    ! get_varint(index->file, &length))
+			break;
+		struct index_entry *entry = index->entries + i;
+		entry->count = count;
+		entry->start = start;
+		entry->length = length;
+		start += length;
+		if (! hash_set(index->entry_map, label, entry)) {
+			free(label);
+			return fail_open(index, TREE_INDEX_IO_ERROR);
+		}
+	}
+	free(label);
+	if (i < label_count) return fail_open(index, TREE_INDEX_BAD_FORMAT);
+	index->postings_offset = ftello(index->file);
+
+	tree_index_status = TREE_INDEX_OK;
+	return index;
+}
+
+long indexed_tree_count(struct tree_index *index)
+{
+	return index->tree_count;
+}
+
+/* Reads an entry's posting list (still encoded). Returns NULL in case of
+ * problems. */
+
+static unsigned char *read_postings(struct tree_index *index,
+		struct index_entry *entry)
+{
+	unsigned char *bytes = malloc(entry->length > 0 ? entry->length : 1);
+	if (NULL == bytes) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	if (0 != fseeko(index->file, index->postings_offset + entry->start,
+				SEEK_SET)) {
+		free(bytes);
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	if (entry->length != fread(bytes, 1, entry->length, index->file)) {
+		free(bytes);
+		tree_index_status = ferror(index->file) ?
+			TREE_INDEX_IO_ERROR : TREE_INDEX_BAD_FORMAT;
+		return NULL;
+	}
+	return bytes;
+}
+
+static int compare_counts(const void *a, const void *b)
+{
+	long count_a = (*(struct index_entry **) a)->count;
+	long count_b = (*(struct index_entry **) b)->count;
+	return (count_a > count_b) - (count_a < count_b);
+}
+
+off_t *trees_with_labels(struct tree_index *index, struct llist *labels,
+		long *count)
+{
+	*count = 0;
+	tree_index_status = TREE_INDEX_OK;
+
+	struct index_entry **entries = malloc(
+			labels->count * sizeof(struct index_entry *));
+	if (NULL == entries) {
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+	int n = 0;
+	bool all_found = true;
+	struct list_elem *el;
+	for (el = labels->head; NULL != el; el = el->next) {
+		struct index_entry *entry = hash_get(index->entry_map,
+				(char *) el->data);
+		if (NULL == entry) { all_found = false; break; }
+		entries[n++] = entry;
+	}
+	/* Intersect the shortest list first, so that the candidates can only
+	 * shrink from there. */
+	qsort(entries, n, sizeof(struct index_entry *), compare_counts);
+
+	long size = (all_found && n > 0) ? entries[0]->count : 0;
+	off_t *offsets = malloc((size > 0 ? size : 1) * sizeof(off_t));
+	if (NULL == offsets) {
+		free(entries);
+		tree_index_status = TREE_INDEX_IO_ERROR;
+		return NULL;
+	}
+
+	int e;
+	for (e = 0; e < n && (0 == e || size > 0); e++) {
+		unsigned char *bytes = read_postings(index, entries[e]);
+		if (NULL == bytes) { free(offsets); free(entries); return NULL; }
+		const unsigned char *p = bytes;
+		const unsigned char *end = bytes + entries[e]->length;
+		off_t offset = 0;
+		long kept = 0;	/* merged in place: kept <= i */
+		long i = 0;
+		long j;
+		for (j = 0; j < entries[e]->count && i < size; j++) {
+			uint64_t delta;
+			p = decode_varint(p, end, &delta);
+			if (NULL == p) {
+				free(bytes); free(offsets); free(entries);
+				tree_index_status = TREE_INDEX_BAD_FORMAT;
+				return NULL;
+			}
+			offset += delta;
+			if (0 == e) {
+				offsets[i++] = offset;
+				kept++;
+				continue;
+			}
+			while (i < size && offsets[i] < offset) i++;
+			if (i < size && offsets[i] == offset) {
+				offsets[kept++] = offset;
+				i++;
+			}
+		}
+		size = kept;
+		free(bytes);
+	}
+
+	free(entries);
+	*count = size;
+	return offsets;
+}
+
+void print_tree_index_error(const char *filename)
+{
+	switch (tree_index_status) {
+	case TREE_INDEX_OK:
+		break;
+	case TREE_INDEX_IO_ERROR:
+		perror(filename);
+		break;
+	case TREE_INDEX_BAD_FORMAT:
+		fprintf (stderr, "%s: not a tree index, or truncated.\n",
+				filename);
+		break;
+	case TREE_INDEX_STALE:
+		fprintf (stderr, "%s: the indexed file has changed - please "
+				"rebuild the index (see nw_index).\n",
+				filename);
+		break;
+	default:
+		fprintf (stderr, "Unknown tree index status %d\n",
+				tree_index_status);
+	}
+}
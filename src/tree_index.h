@@ -0,0 +1,122 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+/* tree_index.h: inverted label -> tree index over a Newick file, as built by
+ * nw_index and used by nw_clade and nw_match (option -i) */
+
+/* The index maps each label to the (byte) offsets of the trees in which it
+ * occurs, so that a query on a few labels need only parse the trees that
+ * contain them all. Offsets are stored in increasing order, as varint-encoded
+ * differences. The index records the size and modification time of the
+ * indexed file, and is refused if they have changed. */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+struct llist;
+struct rooted_tree;
+
+enum tree_index_status {
+	TREE_INDEX_OK,
+	TREE_INDEX_IO_ERROR,	/* see errno */
+	TREE_INDEX_BAD_FORMAT,	/* not an index, or truncated */
+	TREE_INDEX_STALE	/* indexed file has changed since */
+};
+
+/* Set by the functions below that can fail */
+
+extern enum tree_index_status tree_index_status;
+
+/* Reads the text of the next tree from 'trees', up to and including the ';'.
+ * Semicolons in quoted labels and comments are skipped, as in the parser.
+ * Sets 'offset' to the offset of the first non-blank character. Returns an
+ * allocated buffer, which must be free()d, or NULL if there is no tree left
+ * or in case of problems (then tree_index_status is not TREE_INDEX_OK). */
+
+char *read_tree_text(FILE *trees, off_t *offset);
+
+/* Parses the tree at 'offset' in 'trees'. Returns NULL if there is no tree at
+ * that offset, or if it could not be parsed (see newick_parser_status). Uses
+ * the scanner's string input, so the caller must call
+ * newick_scanner_set_file_input() if it later parses trees from a file. */
+
+struct rooted_tree *parse_tree_at(FILE *trees, off_t offset);
+
+/* Building an index: create a builder, add the trees one at a time (in file
+ * order), then write it. Label interning must be on. */
+
+struct tree_index_builder;
+
+/* Returns NULL in case of malloc() problems */
+
+struct tree_index_builder *create_tree_index_builder();
+
+/* Adds the labels of 'tree', which starts at 'offset' in the indexed file.
+ * Empty labels are not indexed. Returns SUCCESS, or FAILURE in case of
+ * malloc() problems. */
+
+int add_tree_to_index(struct tree_index_builder *, struct rooted_tree *tree,
+		off_t offset);
+
+/* Writes the index to 'out'. 'trees' is the indexed file; its size and
+ * modification time are recorded. Returns SUCCESS or FAILURE (see
+ * tree_index_status). */
+
+int write_tree_index(struct tree_index_builder *, FILE *trees, FILE *out);
+
+void destroy_tree_index_builder(struct tree_index_builder *);
+
+/* Querying an index */
+
+struct tree_index;
+
+/* Reads the index's label directory from file 'filename' (postings are read
+ * only when queried). 'trees' is the indexed file, which is checked against
+ * the index. Returns NULL in case of problems (see tree_index_status). */
+
+struct tree_index *open_tree_index(const char *filename, FILE *trees);
+
+/* Returns the number of trees in the indexed file */
+
+long indexed_tree_count(struct tree_index *);
+
+/* Returns the offsets (in increasing order) of the trees that contain all the
+ * labels in 'labels' (a list of char*), and sets 'count' to their number. A
+ * label that is not in the index matches no tree. Returns NULL in case of
+ * problems (see tree_index_status); the returned array (which may be empty)
+ * must be free()d. */
+
+off_t *trees_with_labels(struct tree_index *, struct llist *labels,
+		long *count);
+
+void close_tree_index(struct tree_index *);
+
+/* Prints a message about the last problem (see tree_index_status) with index
+ * file 'filename' on stderr */
+
+void print_tree_index_error(const char *filename);
@@ -29,259 +29,299 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 /* functions for tree models */
 
+/* Trees are grown in an arena of nodes rather than as rnodes: every inner
+ * node has exactly two children, which are created together and are therefore
+ * adjacent in the arena. Since children are appended to the arena, it also
+ * serves as the queue of nodes that have yet to grow (breadth-first). The
+ * finished tree is written directly as Newick into the generator's output
+ * buffer. */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
-#include <stdio.h>
 #include <stdbool.h>
 
-#include "list.h"
-#include "rnode.h"
 #include "common.h"
-#include "link.h"
-#include "to_newick.h"
+#include "prng.h"
 #include "tree_models.h"
-#include "masprintf.h"
 
-#define UNUSED -1
+#define NO_CHILD -1
+#define INIT_ARENA_SIZE 64	/* nodes */
+#define INIT_OUTPUT_SIZE 4096	/* bytes */
+#define MAX_NODE_TEXT 64	/* bytes: ')', label and ':' + edge length */
+
+enum label_style { GEOMETRIC_LABELS, RUNNING_NUMBER_LABELS };
+
+struct gen_node {
+	int first_child;	/* second child is next in arena */
+	double length;		/* of parent edge (time-limited trees) */
+	double alloted_time;	/* time left for growing (time-limited) */
+};
+
+struct tree_generator {
+	struct gen_node *nodes;
+	int nb_nodes;
+	int nodes_size;
+	/* for writing Newick: a stack of nodes and the number of children
+	 * already written for each */
+	int *stack;
+	int *nb_kids_written;
+	int stack_size;
+	char *output;
+	size_t output_length;
+	size_t output_size;
+};
+
+struct tree_generator *create_tree_generator()
+{
+	struct tree_generator *gen = malloc(sizeof(struct tree_generator));
+	if (NULL == gen) return NULL;
+	gen->nodes = malloc(INIT_ARENA_SIZE * sizeof(struct gen_node));
+	gen->nb_nodes = 0;
+	gen->nodes_size = INIT_ARENA_SIZE;
+	gen->stack = malloc(INIT_ARENA_SIZE * sizeof(int));
+	gen->nb_kids_written = malloc(INIT_ARENA_SIZE * sizeof(int));
+	gen->stack_size = INIT_ARENA_SIZE;
+	gen->output = malloc(INIT_OUTPUT_SIZE);
+	gen->output_length = 0;
+	gen->output_size = INIT_OUTPUT_SIZE;
+	if (NULL == gen->nodes || NULL == gen->stack ||
+			NULL == gen->nb_kids_written || NULL == gen->output) {
+		destroy_tree_generator(gen);
+		return NULL;
+	}
+	return gen;
+}
 
-static int running_number()
+void destroy_tree_generator(struct tree_generator *gen)
 {
-	static int n = 0;
-	return n++;
+	free(gen->nodes);
+	free(gen->stack);
+	free(gen->nb_kids_written);
+	free(gen->output);
+	free(gen);
 }
 
-/******************************************************************/
-/* Geometric model */
+const char *generated_trees(struct tree_generator *gen, size_t *length)
+{
+	*length = gen->output_length;
+	return gen->output;
+}
+
+void clear_generated_trees(struct tree_generator *gen)
+{
+	gen->output_length = 0;
+}
+
+/* Appends a pair of (leaf) nodes to the arena. Returns the index of the first
+ * one, or NO_CHILD in case of malloc() problem. */
 
+static int new_node_pair(struct tree_generator *gen)
+{
+	if (gen->nb_nodes + 2 > gen->nodes_size) {
+		int new_size = 2 * gen->nodes_size;
+		struct gen_node *nodes = realloc(gen->nodes,
+				new_size * sizeof(struct gen_node));
+		if (NULL == nodes) return NO_CHILD;
+		gen->nodes = nodes;
+		gen->nodes_size = new_size;
+	}
+	int first = gen->nb_nodes;
+	int i;
+	for (i = first; i < first + 2; i++) {
+		gen->nodes[i].first_child = NO_CHILD;
+		gen->nodes[i].length = 0.0;
+		gen->nodes[i].alloted_time = 0.0;
+	}
+	gen->nb_nodes += 2;
+	return first;
+}
 
-/* Determines if a node is to have children, based on a pseudorandom number */
+/* Starts a new tree, whose root is node 0 */
 
-static bool geo_has_children(double prob_node_has_children)
+static void new_tree(struct tree_generator *gen)
 {
-	double rn = (double) rand() / RAND_MAX;
+	gen->nb_nodes = 1;
+	gen->nodes[0].first_child = NO_CHILD;
+	gen->nodes[0].length = 0.0;
+	gen->nodes[0].alloted_time = 0.0;
+}
+
+/* Makes sure there is room for 'length' more bytes of output */
 
-	if (rn <= prob_node_has_children)
-		return true;
-	else
-		return false;
+static int reserve_output(struct tree_generator *gen, size_t length)
+{
+	if (gen->output_length + length <= gen->output_size)
+		return SUCCESS;
+	size_t new_size = gen->output_size;
+	while (gen->output_length + length > new_size)
+		new_size *= 2;
+	char *output = realloc(gen->output, new_size);
+	if (NULL == output) return FAILURE;
+	gen->output = output;
+	gen->output_size = new_size;
+	return SUCCESS;
 }
 
-/* Visits a leaf: probabilistically adds children to the leaf, and adds those
- * children to the leaves queue (since they are new leaves) */
+/* Writes a node's label and parent edge length. The root has no parent edge,
+ * and geometric trees have no lengths at all. Assumes MAX_NODE_TEXT bytes have
+ * been reserved. */
 
-static int geo_visit_leaf(struct rnode *leaf, double prob_node_has_children,
-		struct llist *leaves_queue)
+static void write_node(struct tree_generator *gen, int i,
+		enum label_style style)
 {
-	// printf ("visiting leaf %p (%s)\n", leaf, leaf->label);
-	if (geo_has_children(prob_node_has_children)) {
-		// printf (" gets children\n");
-		struct rnode *kid1 = create_rnode("kid1", "");	
-		if (NULL == kid1) return FAILURE;
-		struct rnode *kid2 = create_rnode("kid2", "");	
-		if (NULL == kid2) return FAILURE;
-		add_child(leaf, kid1);
-		add_child(leaf, kid2);
-		if (! append_element(leaves_queue, kid1)) return FAILURE;
-		if (! append_element(leaves_queue, kid2)) return FAILURE;
+	char *end = gen->output + gen->output_length;
+	size_t room = gen->output_size - gen->output_length;
+	int written;
+	if (GEOMETRIC_LABELS == style) {
+		/* kids come in pairs, starting at index 1 */
+		if (0 == i)
+			written = snprintf(end, room, "root");
+		else
+			written = snprintf(end, room, "kid%d", 2 - i % 2);
+	} else if (0 == i) {
+		written = snprintf(end, room, "n0");
 	} else {
-		// printf (" gets no children\n");
+		written = snprintf(end, room, "n%d:%g", i,
+				gen->nodes[i].length);
 	}
-
-	return SUCCESS;
+	gen->output_length += written;
 }
 
-/* Generate a tree using the geometric model */
+/* Writes the tree in the arena as Newick (non-recursive, so that deep trees
+ * are no problem) */
 
-int geometric_tree(double prob_node_has_children)
+static int write_tree(struct tree_generator *gen, enum label_style style)
 {
-	struct llist *leaves_queue = create_llist();
-	if (NULL == leaves_queue) return FAILURE;
-	struct rnode *root = create_rnode("root", "");
-	if (NULL == root) return FAILURE;
-
-	if (! append_element(leaves_queue, root)) return FAILURE;
-
-	/* The queue contains any newly added leaves. We visit them in turn,
-	 * possibly adding new leaves to the queue. The process stops when no
-	 * new leaves have been added. */
-
-	while (leaves_queue->count > 0) {
-		int nb_leaves_to_visit = leaves_queue->count;
-		/* Iterate over leaves. Note that new leaves can be added at
-		 * the end of the queue */
-		for (; nb_leaves_to_visit > 0; nb_leaves_to_visit--) {
-			struct rnode *current_leaf = shift(leaves_queue);
-			if (! geo_visit_leaf(current_leaf, prob_node_has_children,
-					leaves_queue))
-				return FAILURE;
+	int depth = 1;
+	gen->stack[0] = 0;
+	gen->nb_kids_written[0] = 0;
+
+	while (depth > 0) {
+		if (! reserve_output(gen, MAX_NODE_TEXT)) return FAILURE;
+		int i = gen->stack[depth-1];
+		int first_child = gen->nodes[i].first_child;
+		if (NO_CHILD != first_child && gen->nb_kids_written[depth-1] < 2) {
+			int nb_written = gen->nb_kids_written[depth-1]++;
+			gen->output[gen->output_length++] =
+				(0 == nb_written) ? '(' : ',';
+			if (depth == gen->stack_size) {
+				int new_size = 2 * gen->stack_size;
+				int *stack = realloc(gen->stack,
+						new_size * sizeof(int));
+				if (NULL == stack) return FAILURE;
+				gen->stack = stack;
+				int *nb_kids = realloc(gen->nb_kids_written,
+						new_size * sizeof(int));
+				if (NULL == nb_kids) return FAILURE;
+				gen->nb_kids_written = nb_kids;
+				gen->stack_size = new_size;
+			}
+			gen->stack[depth] = first_child + nb_written;
+			gen->nb_kids_written[depth] = 0;
+			depth++;
+			continue;
 		}
+		if (NO_CHILD != first_child)
+			gen->output[gen->output_length++] = ')';
+		write_node(gen, i, style);
+		depth--;
 	}
 
-	dump_newick(root);
-	destroy_llist(leaves_queue);
+	if (! reserve_output(gen, 2)) return FAILURE;
+	gen->output[gen->output_length++] = ';';
+	gen->output[gen->output_length++] = '\n';
 
 	return SUCCESS;
 }
 
 /******************************************************************/
-/* Time-limited model */
+/* Geometric model */
 
-double _reciprocal_exponential_CDF(double x, double k)
+/* Generate a tree using the geometric model */
+
+int geometric_tree(struct tree_generator *gen, struct prng *prng,
+		double prob_node_has_children)
 {
-	return - (log(1 - x)/k);
+	new_tree(gen);
+
+	/* Each node in turn (including those added on the way) gets two
+	 * children with probability 'prob_node_has_children'. The process
+	 * stops when no new leaves have been added. */
+	int i;
+	for (i = 0; i < gen->nb_nodes; i++) {
+		if (prng_uniform(prng) < prob_node_has_children) {
+			int kid = new_node_pair(gen);
+			if (NO_CHILD == kid) return FAILURE;
+			gen->nodes[i].first_child = kid;
+		}
+	}
+
+	return write_tree(gen, GEOMETRIC_LABELS);
 }
 
-/* Returns a random number 0 <= rn < 1 */
+/******************************************************************/
+/* Time-limited model */
 
-double random_lt_1()
+double _reciprocal_exponential_CDF(double x, double k)
 {
-	double rn;
-	do {
-		rn = rand() / (double) RAND_MAX;
-	} while (1.0 == rn);
-
-	return rn;
+	return - (log(1 - x)/k);
 }
 
-/* "Grows" a node by setting a length (measured in time units) to its parent
- * edge. The length is randomly drawn from an exponential distribution, but it
- * cannot exceed a certain threshold, which must be stored in the node's data.
- * The function returns the remaining time (threshold - randomly drawn length)
- * If the function fails for some reason (e.g. no RAM left), it returns -1 */
+/* "Grows" a node by drawing a length (measured in time units) for its parent
+ * edge. The length is drawn from an exponential distribution, but it cannot
+ * exceed the time alloted to the node. */
 
-double _tlt_grow_node(struct rnode *leaf, double branch_termination_rate,
-		double alt_random)
+double _tlt_grow_node(double alloted_time, double branch_termination_rate,
+		double rn, double *length)
 {
-	double rn;
-       	if (alt_random < 0) {
-		rn = random_lt_1();
-	}
-       	else
-	       rn = alt_random;
-
-	double length = _reciprocal_exponential_CDF(rn, 
-			branch_termination_rate);
+	*length = _reciprocal_exponential_CDF(rn, branch_termination_rate);
 
 	/* The remaining time is the node's alloted time minus the branch
 	 * length we just drew from the distribution */
-	double alloted_time = *((double*)leaf->data);
-	double remaining_time = alloted_time - length;
+	double remaining_time = alloted_time - *length;
 
 	/* Add remaining time if it's negative: this caps the branch at the
 	 * time threshold. That way the tree is ultrametric, unless branches
 	 * evolve at different rates. */
 	if (remaining_time < 0)
-		length += remaining_time;
+		*length += remaining_time;
 
-	char *length_s = masprintf("%g", length);
-	free(leaf->edge_length_as_string);
-	leaf->edge_length_as_string = length_s;	/* NULL if masprintf() fails - check in caller */
-
-	/* Return the remaining time so caller f() can take action based on
-	 * whether there is time left or not */
 	return remaining_time;
 }
 
-/* Creates a node with the specified time limit. */ 
-
-struct rnode *create_child_with_time_limit(double time_limit)
-{
-	char *label = masprintf("n%d", running_number());
-	if (NULL == label) 
-		return NULL;
-	struct rnode *kid = create_rnode(label, "");
-	if (NULL == kid) return NULL;
-	free(label);
-	double *limit_p = malloc(sizeof(double));
-	if (NULL == limit_p)
-		return NULL;
-	*limit_p = time_limit;
-
-	kid->data = limit_p;
-
-	return kid;
-}
+/* Gives node i two children, each with the specified time limit. */ 
 
-void free_data(struct llist *leaves_queue,
-		 struct llist *all_children)
+static int add_children_with_time_limit(struct tree_generator *gen, int i,
+		double time_limit)
 {
-	struct rnode *kid;
-
-	destroy_llist(leaves_queue);
-
-	//destroy_rnode(root, NULL);
-	struct list_elem *elem;
-	for (elem = all_children->head; NULL != elem; elem = elem->next) {
-		kid = elem->data;
-		free(kid->edge_length_as_string);
-		free(kid->label);
-	       	free(kid->data);
-		free(kid);
-	}
-	destroy_llist(all_children);
+	int kid = new_node_pair(gen);
+	if (NO_CHILD == kid) return FAILURE;
+	gen->nodes[kid].alloted_time = time_limit;
+	gen->nodes[kid+1].alloted_time = time_limit;
+	gen->nodes[i].first_child = kid;
+	return SUCCESS;
 }
 
-int time_limited_tree(double branch_termination_rate, double duration)
+int time_limited_tree(struct tree_generator *gen, struct prng *prng,
+		double branch_termination_rate, double duration)
 {
-	/* create root */
-	char *label = masprintf("n%d", running_number());
-	if (NULL == label) { return FAILURE; }
-	struct rnode *root = create_rnode(label, "");
-	free(label);
-
-	/* This list remembers all children nodes created, for purposes of
-	 * freeing */
-	struct llist *all_children = create_llist();
-	if (NULL == all_children) return FAILURE;
-
-	/* This list stores children who have yet to grow (and maybe have
-	 * children of their own) */
-	struct llist *leaves_queue = create_llist();
-	if (NULL == leaves_queue) return FAILURE;
-	struct rnode *kid;
-
-	/* 1st child */
-	kid = create_child_with_time_limit(duration);
-	if (NULL == kid) return FAILURE;
-	/* add_child(...): length is determined below */
-	add_child(root, kid);
-	if (! append_element(leaves_queue, kid)) return FAILURE;
-	if (! append_element(all_children, kid)) return FAILURE;
-
-	/* 2nd child */
-	kid = create_child_with_time_limit(duration);
-	if (NULL == kid) return FAILURE;
-	add_child(root, kid);
-	if (! append_element(leaves_queue, kid)) return FAILURE;
-	if (! append_element(all_children, kid)) return FAILURE;
-
-
-	while (0 != leaves_queue->count) {
-		struct rnode *current = shift(leaves_queue);
-		double remaining_time = _tlt_grow_node(current,
-				branch_termination_rate, UNUSED); 
-		/* length is set by tlt_grow_node(), NULL means error */
-		if (NULL == current->edge_length_as_string)
-			return FAILURE;
-		if (remaining_time > 0) {
-			kid = create_child_with_time_limit(remaining_time);
-			if (NULL == kid) return FAILURE;
-			add_child(current, kid);
-			if (! append_element(leaves_queue, kid)) return FAILURE;
-			if (! append_element(all_children, kid)) return FAILURE;
-
-			kid = create_child_with_time_limit(remaining_time);
-			if (NULL == kid) return FAILURE;
-			add_child(current, kid);
-			if (! append_element(leaves_queue, kid)) return FAILURE;
-			if (! append_element(all_children, kid)) return FAILURE;
-		} 
+	new_tree(gen);
+	if (! add_children_with_time_limit(gen, 0, duration)) return FAILURE;
+
+	int i;
+	for (i = 1; i < gen->nb_nodes; i++) {
+		double length;
+		double remaining_time = _tlt_grow_node(
+				gen->nodes[i].alloted_time,
+				branch_termination_rate,
+				prng_uniform(prng), &length);
+		gen->nodes[i].length = length;
+		if (remaining_time > 0)
+			if (! add_children_with_time_limit(gen, i,
+						remaining_time))
+				return FAILURE;
 	}
 
-	dump_newick(root);
-
-	free_data(leaves_queue, all_children);
-
-	return SUCCESS;
+	return write_tree(gen, RUNNING_NUMBER_LABELS);
 }
@@ -27,50 +27,70 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
-
 /** \file
  * Different models of tree generation */
 
-struct rnode;
+#include <stddef.h>
+
+struct prng;
+
+/** A tree generator. Holds the node arena and the output buffer, which are
+ * reused from one tree to the next. A generator is not meant to be shared
+ * between threads, but each thread can have its own. */
+
+struct tree_generator;
+
+/** Creates a tree generator, or returns NULL in case of malloc() problem */
+
+struct tree_generator *create_tree_generator();
 
-/** Prints a random tree grown using a geometric model. A pretty simple model
- * where each node has a fixed probability of having 2 children. If set to >
- * 0.5, the expected number of leaves is infnite and the program will probably
- * not stop of its own. 
+void destroy_tree_generator(struct tree_generator *);
+
+/** Returns the Newick text of the trees generated since the last call to
+ * clear_generated_trees() (one tree per line), and sets 'length' to its length
+ * in bytes. The text is owned by the generator. */
+
+const char *generated_trees(struct tree_generator *, size_t *length);
+
+/** Empties the generator's output buffer. */
+
+void clear_generated_trees(struct tree_generator *);
+
+/** Generates a random tree grown using a geometric model, and appends it to
+ * the generator's output. A pretty simple model where each node has a fixed
+ * probability of having 2 children. If set to > 0.5, the expected number of
+ * leaves is infnite and the program will probably not stop of its own. 
  \arg \c prob_node_has_children the probability of node having (2) children
  \return FAILURE if there was a problem (most probably malloc()) 
- \todo: should return the tree instead of directly dumping it.
  */
 
-int geometric_tree(double prob_node_has_children);
+int geometric_tree(struct tree_generator *, struct prng *,
+		double prob_node_has_children);
 
-/** Prints a random time-limited tree. A more complicated model (WRT
- * geometric_tree())  where each branch's length is exponentially distributed
- * (up to a duration threshold).  The 1st parameter is the
- * exponential distribution's rate parameter, which is the inverse of the mean. 
+/** Generates a random time-limited tree, and appends it to the generator's
+ * output. A more complicated model (WRT geometric_tree())  where each branch's
+ * length is exponentially distributed (up to a duration threshold).  The 1st
+ * parameter is the exponential distribution's rate parameter, which is the
+ * inverse of the mean. 
  * \arg \c branch_termination_rate see text
  * \arg \c duration see text
  * \return FAILURE (0) IFF there is any problem (which will be memory
- * allocation errors). 
- \todo: should return the tree instead of directly dumping it.  */
+ * allocation errors). */
 
-int time_limited_tree(double branch_termination_rate, double duration);
+int time_limited_tree(struct tree_generator *, struct prng *,
+		double branch_termination_rate, double duration);
 
 /** \cond -- The following functions are public only so they can be tested;
  * they should not be used outside tree_models.c (hence the leading _ in their
  * names). */
 
-/**  Attributes length to the parent edge (exponentially distributed with
- * parameter 'branch_termination_rate'), capped by duration threshold stored in
- * node's data pointer. Returns the remaining time (which can be negative) The
- * 'alt_random' parameter is used (if > 0) for testing the function by
- * supplying a known "random" value.
- * If the function fails for some reason (e.g. no RAM left), it returns -1. 
- * Note: we only keep this function public so it can be tested, hence the
- * leading  _. */
-
-double _tlt_grow_node(struct rnode *, double branch_termination_rate,
-		double alt_random);
+/**  Draws the length of a node's parent edge (exponentially distributed with
+ * parameter 'branch_termination_rate', using the uniform random number 'rn'),
+ * capped by the time alloted to the node. Stores the length in 'length' and
+ * returns the remaining time (which can be negative). */
+
+double _tlt_grow_node(double alloted_time, double branch_termination_rate,
+		double rn, double *length);
 
 
 /** The reciprocal (i.e., quantile function) of an exponential CDF with
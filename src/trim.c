@@ -39,10 +39,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "to_newick.h"
 #include "tree.h"
 #include "parser.h"
-#include "masprintf.h"
 #include "rnode.h"
 #include "list.h"
 #include "link.h"
+#include "profile.h"
+#include "compressed_io.h"
 
 enum {DEPTH_DISTANCE, DEPTH_ANCESTORS};
 
@@ -138,7 +139,7 @@ struct parameters get_params(int argc, char *argv[])
 	/* check arguments */
 	if ((argc - optind) == 2)	{
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -153,7 +154,7 @@ struct parameters get_params(int argc, char *argv[])
 			params.threshold -= 1;
 	} else if ((argc - optind) == 1) {
 		if (0 != strcmp("-", argv[optind])) {
-			FILE *fin = fopen(argv[optind], "r");
+			FILE *fin = open_input_file(argv[optind]);
 			extern FILE *nwsin;
 			if (NULL == fin) {
 				perror(NULL);
@@ -177,11 +178,7 @@ void trim(struct rnode *node, struct parameters params)
 	if (DEPTH_DISTANCE == params.depth_type) {
 		/* Shrink parent edge length */
 		double excess = ndata->distance_depth - params.threshold;
-		double trimmed_edge_length = node->edge_length - excess;
-		free(node->edge_length_as_string);
-		char *new_length = masprintf("%g", trimmed_edge_length);
-		if (NULL == new_length) { perror(NULL); exit(EXIT_FAILURE); }
-		node->edge_length_as_string = new_length;
+		set_edge_length(node, get_edge_length(node) - excess);
 	}
 
 	remove_children(node);	/* no effect on leaves */
@@ -197,8 +194,9 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 
 	/* Simple case: trim root */
 	if (TRIM_UNDEFINED == params.threshold) {
-		free(tree->root->edge_length_as_string);
-		tree->root->edge_length_as_string = strdup("");
+		if (! set_edge_length_string(tree->root, "")) {
+			perror(NULL); exit(EXIT_FAILURE);
+		}
 		return;
 	} 
 
@@ -238,8 +236,7 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 		/* Parent not trimmed: See if we must trim this node. */
 	
 		/* compute this node's depth measures */
-		double edge_length = atof(node->edge_length_as_string);
-		node->edge_length = edge_length;
+		double edge_length = get_edge_length(node);
 		ndata->distance_depth = edge_length + parent_data->distance_depth;
 		ndata->ancestry_depth = 1 + parent_data->ancestry_depth;
 
@@ -264,6 +261,8 @@ void process_tree(struct rooted_tree *tree, struct parameters params)
 
 int main(int argc, char *argv[])
 {
+	argc = profile_init(argc, argv);
+
 	struct rooted_tree *tree;	
 	struct parameters params;
 	
@@ -228,6 +228,32 @@ int test_cross()
 	return 0;
 }
 
+int test_clear()
+{
+	const char *test_name = __func__;
+
+	struct canvas *cp;
+	const char *blank = "     ";
+	int i;
+
+	cp = create_vt100_canvas(5, 2);
+	canvas_draw_hline(cp, 0, 0, 4);
+	canvas_write(cp, 1, 1, "abc");
+	clear_canvas(cp);
+
+	for (i = 0; i < 2; i++)  {
+		if (strcmp(_get_canvas_line(cp, i), blank) != 0) {
+			printf ("%s: expected '%s', got '%s' (line %d)\n",
+				test_name, blank, _get_canvas_line(cp, i), i);
+			return 1;
+		}
+	}
+
+	destroy_canvas(cp);
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
 int main()
 {
 	int failures = 0;
@@ -238,6 +264,7 @@ int main()
 	failures += test_draw_v();
 	failures += test_write();
 	failures += test_cross();
+	failures += test_clear();
 	if (0 == failures) {
 		printf("All tests ok.\n");
 	} else {
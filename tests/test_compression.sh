@@ -0,0 +1,100 @@
+#!/bin/sh
+
+# Checks compressed input and output (see compressed_io.h). The fixtures hold
+# 2500 copies of the sample tree, compressed with gzip, as BGZF (three blocks
+# of data and the end-of-file block, as bgzip writes them) and with zstd. Each
+# must read the same as the uncompressed trees, trees written with -z must
+# read back unchanged, and a truncated file must make the programs fail, after
+# passing on what could be read.
+
+# These variables are set differently depending on the build system. With GNU
+# autotools, we use defaults; with CMake they are passed as arguments.
+
+TEST_SRC_DIR=${1:-.}
+TEST_OUT_DIR=${2:-.}
+PROG_BIN_DIR=${3:-../src}
+
+order=${PROG_BIN_DIR}/nw_order
+labels=${PROG_BIN_DIR}/nw_labels
+rename=${PROG_BIN_DIR}/nw_rename
+
+plain=$TEST_OUT_DIR/test_compression.nw
+expected=$TEST_OUT_DIR/test_compression.exp
+out=$TEST_OUT_DIR/test_compression.out
+compressed=$TEST_OUT_DIR/test_compression.z
+truncated=$TEST_OUT_DIR/test_compression.trunc
+
+awk '{ for (i = 0; i < 2500; i++) print }' $TEST_SRC_DIR/hominidae.nw > $plain
+$order $plain > $expected
+
+# Returns true iff this build can read the file (zlib and libzstd are
+# optional).
+
+supported()
+{
+	! $order $1 2>&1 > /dev/null | grep 'does not support' > /dev/null
+}
+
+pass=TRUE
+
+for fixture in hominidae_x2500.nw.gz hominidae_x2500.bgzf.gz \
+		hominidae_x2500.nw.zst ; do
+	file=$TEST_SRC_DIR/$fixture
+	if ! supported $file ; then
+		echo "$fixture: not supported by this build - skipping."
+		continue
+	fi
+
+	echo -n "read $fixture - "
+	$order $file > $out
+	if diff $out $expected > /dev/null &&
+			[ $($labels $file | wc -l) -eq $((2500 * 7)) ] ; then
+		echo "pass"
+	else
+		echo "FAIL"
+		pass=FALSE
+	fi
+
+	# Cut in the last data block (the BGZF end-of-file block is 28 bytes)
+	size=$(wc -c < $file)
+	head -c $((size - 40)) $file > $truncated
+	echo -n "truncated $fixture - "
+	truncated_pass=TRUE
+	$order $truncated > /dev/null 2>&1 && truncated_pass=FALSE
+	$labels $truncated > /dev/null 2>&1 && truncated_pass=FALSE
+	$rename $truncated Homo Human > /dev/null 2>&1 && truncated_pass=FALSE
+	# The complete BGZF blocks are passed on before the error.
+	if [ $fixture = hominidae_x2500.bgzf.gz ] ; then
+		$order $truncated 2> /dev/null > $out
+		[ $(wc -l < $out) -lt 1600 ] && truncated_pass=FALSE
+	fi
+	if test $truncated_pass = TRUE ; then
+		echo "pass"
+	else
+		echo "FAIL"
+		pass=FALSE
+	fi
+done
+
+for format in gz zst ; do
+	echo -n "-z $format round trip - "
+	if ! $order -z $format $plain > $compressed 2> /dev/null ; then
+		echo "not supported by this build - skipping."
+		continue
+	fi
+	$order $compressed > $out
+	if diff $out $expected > /dev/null ; then
+		echo "pass"
+	else
+		echo "FAIL"
+		pass=FALSE
+	fi
+done
+
+rm -f $plain $expected $out $compressed $truncated
+
+if test $pass = FALSE ; then
+	exit 1
+else
+	exit 0
+fi
@@ -0,0 +1,197 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* Tests the tree routines that must cope with extremely deep trees, such as
+ * caterpillars with millions of levels: the parser, clone_rnode(),
+ * clone_rnode_cond() and to_newick(). These used to recurse (or, in the
+ * parser's case, to cap the stack depth), and would crash or fail on such
+ * trees. If passed a depth as argument, the program also reports the time and
+ * peak memory of each step, and can thus be used as a benchmark, e.g.
+ * './test_deep_tree 10000000'. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "rnode.h"
+#include "tree.h"
+#include "parser.h"
+#include "to_newick.h"
+
+/* Default depth: well beyond the parser's former limit, and deep enough to
+ * overflow a typical 8 MB stack with the former recursive functions. */
+
+static const int default_depth = 200000;
+
+static bool report = false;
+static clock_t step_start;
+
+static void start_step() { step_start = clock(); }
+
+static void end_step(const char *step)
+{
+	if (! report) return;
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	printf("%-20s %8.2f s  peak RSS %8ld kB\n", step,
+		(double) (clock() - step_start) / CLOCKS_PER_SEC,
+		usage.ru_maxrss);
+}
+
+/* Returns the Newick of a caterpillar with leaves l<first> to l<last>,
+ * e.g. "((l0,l1),l2);" for 0 and 2. */
+
+static char *caterpillar(int first, int last)
+{
+	size_t size = 2 * (last - first) + 16 * (last - first + 1) + 2;
+	char *newick = malloc(size);
+	if (NULL == newick) return NULL;
+
+	char *p = newick;
+	int i;
+	for (i = first; i < last; i++) *p++ = '(';
+	p += sprintf(p, "l%d", first);
+	for (i = first + 1; i <= last; i++)
+		p += sprintf(p, ",l%d)", i);
+	strcpy(p, ";");
+
+	return newick;
+}
+
+static bool not_first_leaf(struct rnode *node, void *param)
+{
+	param = param;	/* suppresses warning about unused param */
+	return strcmp(node->label, "l0") != 0;
+}
+
+static int check_newick(const char *test_name, const char *step,
+		struct rnode *root, const char *exp)
+{
+	start_step();
+	char *obt = to_newick(root);
+	end_step("to_newick()");
+	if (NULL == obt) {
+		printf("%s: %s: to_newick() failed\n", test_name, step);
+		return 1;
+	}
+	if (strcmp(exp, obt) != 0) {
+		printf("%s: %s: Newick differs from expected (lengths %zu "
+			"and %zu)\n", test_name, step, strlen(obt),
+			strlen(exp));
+		free(obt);
+		return 1;
+	}
+	free(obt);
+	return 0;
+}
+
+int test_deep_caterpillar(int depth)
+{
+	const char *test_name = __func__;
+	extern FILE *nwsin;
+
+	char *newick = caterpillar(0, depth);
+	if (NULL == newick) {
+		printf("%s: memory error\n", test_name);
+		return 1;
+	}
+	FILE *input = tmpfile();
+	if (NULL == input) {
+		printf("%s: could not create temp file\n", test_name);
+		return 1;
+	}
+	fputs(newick, input);
+	rewind(input);
+	nwsin = input;
+
+	start_step();
+	struct rooted_tree *tree = parse_tree();
+	end_step("parse_tree()");
+	fclose(input);
+	if (NULL == tree) {
+		printf("%s: could not parse tree of depth %d\n", test_name,
+				depth);
+		return 1;
+	}
+	if (check_newick(test_name, "parsed", tree->root, newick)) return 1;
+
+	start_step();
+	struct rnode *clone = clone_rnode(tree->root);
+	end_step("clone_rnode()");
+	if (NULL == clone) {
+		printf("%s: clone_rnode() failed\n", test_name);
+		return 1;
+	}
+	if (check_newick(test_name, "clone", clone, newick)) return 1;
+
+	/* Dropping l0 leaves its parent with a single child, which
+	 * clone_rnode_cond() must splice out. */
+	start_step();
+	clone = clone_rnode_cond(tree->root, not_first_leaf, NULL);
+	end_step("clone_rnode_cond()");
+	if (NULL == clone) {
+		printf("%s: clone_rnode_cond() failed\n", test_name);
+		return 1;
+	}
+	free(newick);
+	newick = caterpillar(1, depth);
+	if (check_newick(test_name, "conditional clone", clone, newick))
+		return 1;
+
+	free(newick);
+	destroy_tree(tree);
+	destroy_all_rnodes(NULL);
+
+	printf("%s: ok.\n", test_name);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int failures = 0;
+	int depth = default_depth;
+	if (argc > 1) {
+		depth = atoi(argv[1]);
+		report = true;
+	}
+	printf("Starting deep tree test...\n");
+	failures += test_deep_caterpillar(depth);
+	if (0 == failures) {
+		printf("All tests ok.\n");
+	} else {
+		printf("%d test(s) FAILED.\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,204 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "label_intern.h"
+#include "rnode.h"
+
+int test_disabled()
+{
+	const char *test_name = __func__;
+
+	if (label_interning_enabled()) {
+		printf ("%s: interning should be off by default.\n", test_name);
+		return 1;
+	}
+	if (-1 != intern_label("Zorg")) {
+		printf ("%s: expected -1 when interning is off.\n", test_name);
+		return 1;
+	}
+	struct rnode *node = create_rnode("Zorg", "");
+	if (-1 != node->label_id) {
+		printf ("%s: expected label ID -1, got %d.\n", test_name,
+				node->label_id);
+		return 1;
+	}
+	destroy_all_rnodes(NULL);
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_intern()
+{
+	const char *test_name = __func__;
+
+	enable_label_interning();
+
+	if (EMPTY_LABEL_ID != find_label_id("")) {
+		printf ("%s: expected \"\" to have ID %d.\n", test_name,
+				EMPTY_LABEL_ID);
+		return 1;
+	}
+	int zorg = intern_label("Zorg");
+	int blarg = intern_label("Blarg");
+	if (zorg == blarg) {
+		printf ("%s: different labels should have different IDs.\n",
+				test_name);
+		return 1;
+	}
+	char zorg_copy[] = "Zorg";
+	if (zorg != intern_label(zorg_copy)) {
+		printf ("%s: equal labels should have the same ID.\n",
+				test_name);
+		return 1;
+	}
+	if (0 != strcmp("Blarg", interned_label(blarg))) {
+		printf ("%s: expected 'Blarg', got '%s'.\n", test_name,
+				interned_label(blarg));
+		return 1;
+	}
+	if (-1 != find_label_id("Gnu")) {
+		printf ("%s: 'Gnu' should not be interned.\n", test_name);
+		return 1;
+	}
+	if (3 != interned_label_count()) {
+		printf ("%s: expected 3 labels, got %d.\n", test_name,
+				interned_label_count());
+		return 1;
+	}
+
+	destroy_label_interner();
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_many()
+{
+	const char *test_name = __func__;
+	const int n = 10000;	/* enough for the table to grow a few times */
+	char label[20];
+	int i;
+
+	enable_label_interning();
+
+	for (i = 0; i < n; i++) {
+		sprintf(label, "L%d", i);
+		intern_label(label);
+	}
+	for (i = 0; i < n; i++) {
+		sprintf(label, "L%d", i);
+		int id = find_label_id(label);
+		if (id < 0 || 0 != strcmp(label, interned_label(id))) {
+			printf ("%s: label '%s' lost.\n", test_name, label);
+			return 1;
+		}
+	}
+	if (n + 1 != interned_label_count()) {
+		printf ("%s: expected %d labels, got %d.\n", test_name, n + 1,
+				interned_label_count());
+		return 1;
+	}
+
+	destroy_label_interner();
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_forget()
+{
+	const char *test_name = __func__;
+	const int n = 5000;	/* enough for the table to grow */
+	char label[20];
+	int i, round;
+
+	enable_label_interning();
+	int kept = intern_label("Kept");
+	int watermark = interned_label_count();
+
+	/* each round interns new labels, then forgets them */
+	for (round = 0; round < 3; round++) {
+		for (i = 0; i < n; i++) {
+			sprintf(label, "R%dL%d", round, i);
+			if (watermark + i != intern_label(label)) {
+				printf ("%s: expected forgotten IDs to be "
+					"given again.\n", test_name);
+				return 1;
+			}
+		}
+		forget_labels_since(watermark);
+		if (watermark != interned_label_count()) {
+			printf ("%s: expected %d labels, got %d.\n",
+				test_name, watermark, interned_label_count());
+			return 1;
+		}
+		sprintf(label, "R%dL%d", round, n / 2);
+		if (-1 != find_label_id(label)) {
+			printf ("%s: '%s' should be forgotten.\n", test_name,
+					label);
+			return 1;
+		}
+		if (kept != find_label_id("Kept") ||
+		    EMPTY_LABEL_ID != find_label_id("")) {
+			printf ("%s: labels before the watermark should be "
+				"kept.\n", test_name);
+			return 1;
+		}
+	}
+
+	destroy_label_interner();
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_rnode_label_id()
+{
+	const char *test_name = __func__;
+
+	enable_label_interning();
+
+	struct rnode *n1 = create_rnode("Homo", "");
+	struct rnode *n2 = create_rnode("Pan", "");
+	struct rnode *n3 = create_rnode("Homo", "");
+	struct rnode *n4 = create_rnode(NULL, "");
+
+	if (n1->label_id != n3->label_id) {
+		printf ("%s: nodes labelled 'Homo' should have the same ID.\n",
+				test_name);
+		return 1;
+	}
+	if (n1->label_id == n2->label_id) {
+		printf ("%s: 'Homo' and 'Pan' should have different IDs.\n",
+				test_name);
+		return 1;
+	}
+	if (EMPTY_LABEL_ID != n4->label_id) {
+		printf ("%s: unlabelled node should have ID %d, got %d.\n",
+				test_name, EMPTY_LABEL_ID, n4->label_id);
+		return 1;
+	}
+
+	destroy_all_rnodes(NULL);
+	destroy_label_interner();
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int main()
+{
+	int failures = 0;
+	printf("Starting label interning test...\n");
+	failures += test_disabled();
+	failures += test_intern();
+	failures += test_many();
+	failures += test_forget();
+	failures += test_rnode_label_id();
+	if (0 == failures) {
+		printf("All tests ok.\n");
+	} else {
+		printf("%d test(s) FAILED.\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
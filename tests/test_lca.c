@@ -270,6 +270,62 @@ int test_lca_from_labels_multi()
 
 #pragma GCC diagnostic pop
 
+int test_lca_table()
+{
+	const char *test_name = "test_lca_table";
+
+	/* (((D,D)e,D)f,((C,B)g,(B,A)h)i)j; */
+	struct rooted_tree tree = tree_9();
+	struct lca_table *table = create_lca_table(tree.root);
+	const char *preorder = "jfeDDDigCBhBA";
+	int n = strlen(preorder);
+
+	if (n != table->node_count) {
+		printf ("%s: expected %d nodes, got %d\n", test_name, n,
+				table->node_count);
+		return 1;
+	}
+	int i, j;
+	for (i = 0; i < n; i++) {
+		if (preorder[i] != table->nodes[i]->label[0]) {
+			printf ("%s: expected '%c' as node %d, got '%s'\n",
+				test_name, preorder[i], i,
+				table->nodes[i]->label);
+			return 1;
+		}
+	}
+	/* j has all 13 nodes, f 5, g 3 */
+	if (13 != table->subtree_size[0] || 5 != table->subtree_size[1] ||
+	    3 != table->subtree_size[7]) {
+		printf ("%s: wrong subtree sizes\n", test_name);
+		return 1;
+	}
+	/* check against lca2(), for all pairs */
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			struct rnode *expected = lca2(&tree, table->nodes[i],
+					table->nodes[j]);
+			struct rnode *lca = table->nodes[
+				lca_table_query(table, i, j)];
+			if (expected != lca) {
+				printf ("%s: expected '%s' as LCA of nodes %d "
+					"and %d, got '%s'\n", test_name,
+					expected->label, i, j, lca->label);
+				return 1;
+			}
+		}
+	}
+	if (! lca_table_is_descendant(table, 9, 7) ||
+	    lca_table_is_descendant(table, 10, 7)) {
+		printf ("%s: wrong descendance\n", test_name);
+		return 1;
+	}
+
+	destroy_lca_table(table);
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
 int main()
 {
 	int failures = 0;
@@ -278,6 +334,7 @@ int main()
 	failures += test_lca_from_labels();
 	failures += test_lca_from_labels_multi();
 	failures += test_lca_from_nodes();
+	failures += test_lca_table();
 	if (0 == failures) {
 		printf("All tests ok.\n");
 	} else {
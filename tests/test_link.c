@@ -103,17 +103,17 @@ int test_add_3_children()
 		return 1;
 	}
 	node = parent->first_child;
-	if (strcmp(node->edge_length_as_string, length1) != 0) {
+	if (strcmp(edge_length_string(node), length1) != 0) {
 		printf("%s: length should be %s.\n", test_name, length1);
 		return 1;
 	}
 	node = node->next_sibling;
-	if (strcmp(node->edge_length_as_string, length2) != 0) {
+	if (strcmp(edge_length_string(node), length2) != 0) {
 		printf("%s: length should be %s.\n", test_name, length2);
 		return 1;
 	}
 	node = node->next_sibling;
-	if (strcmp(node->edge_length_as_string, length3) != 0) {
+	if (strcmp(edge_length_string(node), length3) != 0) {
 		printf("%s: length should be %s.\n", test_name, length3);
 		return 1;
 	}
@@ -1188,7 +1188,7 @@ int test_swap_nodes()
 				node_h->parent->label);
 		return 1;
 	}
-	h_length = strdup(node_h->edge_length_as_string);	/* will be free()d during swap */
+	h_length = strdup(edge_length_string(node_h));	/* will be free()d during swap */
 
 	swap_nodes(node_h);
 
@@ -1204,9 +1204,9 @@ int test_swap_nodes()
 				node_h->parent->label);
 		return 1;
 	}
-	if (strcmp(node_i->edge_length_as_string, h_length) != 0) {
+	if (strcmp(edge_length_string(node_i), h_length) != 0) {
 		printf ("%s: i's length should be %s, but is %s\n", test_name,
-				h_length, node_i->edge_length_as_string);
+				h_length, edge_length_string(node_i));
 		return 1;
 	}
 	if (! node_i->linked) {
@@ -0,0 +1,78 @@
+#!/bin/sh
+
+# Checks that the programs run in bounded memory, i.e. that they free each tree
+# (and its labels) once it is processed instead of accumulating them. Each
+# program listed in test_memory_args is fed a stream of trees (100,000 by
+# default, or $NW_MEMORY_TREES), then one half as long, and the peak RSS of
+# both runs must not differ by more than $NW_MEMORY_SLACK kB. Both streams are
+# long enough to fill the programs' I/O buffers (e.g. nw_rename's 4 MB blocks),
+# so any difference comes from memory that grows with the number of trees. The
+# peak RSS is measured by peak_rss (see peak_rss.c).
+
+# These variables are set differently depending on the build system. With GNU
+# autotools, we use defaults; with CMake they are passed as arguments.
+
+TEST_SRC_DIR=${1:-.}
+TEST_OUT_DIR=${2:-.}
+PROG_BIN_DIR=${3:-../src}
+
+long_count=${NW_MEMORY_TREES:-100000}
+short_count=$((long_count / 2))
+slack=${NW_MEMORY_SLACK:-1024}
+
+args_file=$TEST_SRC_DIR/test_memory_args
+peak_rss=$TEST_OUT_DIR/peak_rss
+short_input=$TEST_OUT_DIR/test_memory_short.out
+long_input=$TEST_OUT_DIR/test_memory_long.out
+
+# Writes $1 copies of the sample tree to $2. In each copy, the inner labels
+# Hominini and Homininae get the copy's number as a suffix, so that every tree
+# brings new labels: memory that is kept per distinct label (e.g. interned
+# labels) must not grow either. Leaf labels are left alone, since some programs
+# need the same leaves in all trees (e.g. nw_support).
+
+make_stream()
+{
+	awk -v n=$1 '{
+		split($0, part, /Hominini|Homininae/)
+		for (i = 0; i < n; i++)
+			print part[1] "Hominini" i part[2] "Homininae" i part[3]
+	}' $TEST_SRC_DIR/hominidae.nw > $2
+}
+
+make_stream $short_count $short_input
+make_stream $long_count $long_input
+
+pass=TRUE
+while IFS=':' read prog args ; do
+	echo $prog | grep '^#' > /dev/null && continue
+	# nw_sched and nw_luaed are optional
+	if [ ! -x ${PROG_BIN_DIR}/$prog ] ; then
+		echo "$prog not built - skipping."
+		continue
+	fi
+	IFS='' cmd="$peak_rss ${PROG_BIN_DIR}/$prog $args"
+	short_rss=$(cd $TEST_SRC_DIR; eval $cmd < $short_input)
+	long_rss=$(cd $TEST_SRC_DIR; eval $cmd < $long_input)
+	if [ -z "$short_rss" -o -z "$long_rss" ] ; then
+		echo "$prog $args: could not measure peak RSS - FAIL"
+		pass=FALSE
+		continue
+	fi
+	echo -n "$prog $args: $short_rss kB ($short_count trees), "
+	echo -n "$long_rss kB ($long_count trees) - "
+	if [ $long_rss -gt $((short_rss + slack)) ] ; then
+		echo "FAIL"
+		pass=FALSE
+	else
+		echo "pass"
+	fi
+done < $args_file
+
+rm -f $short_input $long_input
+
+if test $pass = FALSE ; then
+	exit 1
+else
+	exit 0
+fi
@@ -0,0 +1,266 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "newick_events.h"
+
+/* The handlers write a compact trace of the events: '(' for a clade start,
+ * 'L' or ')' followed by <label:length> for a leaf or clade end, and ';' for
+ * the end of a tree. */
+
+static char trace[1000];
+
+static void append(const char *s)
+{
+	if (strlen(trace) + strlen(s) < sizeof(trace))
+		strcat(trace, s);
+}
+
+static void trace_node(char kind, char *label, char *length)
+{
+	char event[200];
+	sprintf(event, "%c<%s:%s>", kind, label, length);
+	append(event);
+}
+
+static void on_open(void *param) { append("("); }
+static void on_leaf(void *param, char *label, char *length)
+{
+	trace_node('L', label, length);
+}
+static void on_close(void *param, char *label, char *length)
+{
+	trace_node(')', label, length);
+}
+static void on_end(void *param) { append(";"); }
+
+static struct newick_handlers tracer = {
+	on_open, on_leaf, on_close, on_end, NULL
+};
+
+/* Parses the first tree in 'newick' and checks the status and trace. */
+
+static int check_events(const char *test_name, const char *newick,
+		enum parser_status_type exp_status, const char *exp_trace)
+{
+	FILE *in = fmemopen((void *) newick, strlen(newick), "r");
+	struct newick_stream *stream = create_newick_stream(in);
+	trace[0] = '\0';
+	enum parser_status_type status = parse_newick_events(stream, &tracer);
+	destroy_newick_stream(stream);
+	fclose(in);
+
+	if (exp_status != status) {
+		printf ("%s: expected status %d, got %d for '%s'.\n",
+				test_name, exp_status, status, newick);
+		return 1;
+	}
+	if (0 != strcmp(exp_trace, trace)) {
+		printf ("%s: expected events '%s', got '%s'.\n", test_name,
+				exp_trace, trace);
+		return 1;
+	}
+	return 0;
+}
+
+int test_simple()
+{
+	const char *test_name = __func__;
+
+	if (check_events(test_name, "((A,B)f,C)g;", PARSER_STATUS_OK,
+		"(" "(" "L<A:>" "L<B:>" ")<f:>" "L<C:>" ")<g:>" ";"))
+		return 1;
+	if (check_events(test_name, "A;", PARSER_STATUS_OK, "L<A:>;"))
+		return 1;
+	if (check_events(test_name, "(,(,));", PARSER_STATUS_OK,
+		"(L<:>(L<:>L<:>)<:>)<:>;"))
+		return 1;
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_lengths()
+{
+	const char *test_name = __func__;
+
+	if (check_events(test_name, "((A:1,:2.5)f:3e-2,C)g:0;",
+		PARSER_STATUS_OK,
+		"((L<A:1>L<:2.5>)<f:3e-2>L<C:>)<g:0>;"))
+		return 1;
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_lexical()
+{
+	const char *test_name = __func__;
+
+	/* quotes, comments, whitespace and newlines */
+	if (check_events(test_name,
+		"( 'A b' [a comment]\n , 'it''s' )\t'x;y' ;",
+		PARSER_STATUS_OK,
+		"(L<'A b':>L<'it''s':>)<'x;y':>;"))
+		return 1;
+	/* spaces inside unquoted labels become underscores */
+	if (check_events(test_name, "(Homo sapiens ,B);", PARSER_STATUS_OK,
+		"(L<Homo_sapiens:>L<B:>)<:>;"))
+		return 1;
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_errors()
+{
+	const char *test_name = __func__;
+
+	if (check_events(test_name, "", PARSER_STATUS_EMPTY, ""))
+		return 1;
+	if (check_events(test_name, " \n[only a comment]\n",
+		PARSER_STATUS_EMPTY, ""))
+		return 1;
+	if (check_events(test_name, "(A,B", PARSER_STATUS_PARSE_ERROR,
+		"(L<A:>L<B:>"))
+		return 1;
+	if (check_events(test_name, "(A,B));", PARSER_STATUS_PARSE_ERROR,
+		"(L<A:>L<B:>)<:>"))
+		return 1;
+	if (check_events(test_name, "A,B;", PARSER_STATUS_PARSE_ERROR,
+		"L<A:>"))
+		return 1;
+	if (check_events(test_name, "(A:,B);", PARSER_STATUS_PARSE_ERROR,
+		"("))
+		return 1;
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_several_trees()
+{
+	const char *test_name = __func__;
+	/* the second tree is faulty: the parser should resume after it */
+	const char *newick = "(A,B);\n(C;\n(D,E)f;\n";
+	FILE *in = fmemopen((void *) newick, strlen(newick), "r");
+	struct newick_stream *stream = create_newick_stream(in);
+
+	enum parser_status_type exp[] = { PARSER_STATUS_OK,
+		PARSER_STATUS_PARSE_ERROR, PARSER_STATUS_OK,
+		PARSER_STATUS_EMPTY };
+	int i;
+	trace[0] = '\0';
+	for (i = 0; i < 4; i++) {
+		enum parser_status_type status =
+			parse_newick_events(stream, &tracer);
+		if (exp[i] != status) {
+			printf ("%s: tree %d: expected status %d, got %d.\n",
+				test_name, i, exp[i], status);
+			return 1;
+		}
+	}
+	destroy_newick_stream(stream);
+	fclose(in);
+
+	const char *exp_trace = "(L<A:>L<B:>)<:>;" "(L<C:>" "(L<D:>L<E:>)<f:>;";
+	if (0 != strcmp(exp_trace, trace)) {
+		printf ("%s: expected events '%s', got '%s'.\n", test_name,
+				exp_trace, trace);
+		return 1;
+	}
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+struct counts { int leaves; int clades; int max_depth; int depth;
+	bool labels_ok; };
+
+static void count_open(void *param)
+{
+	struct counts *c = param;
+	if (++c->depth > c->max_depth) c->max_depth = c->depth;
+}
+static void count_leaf(void *param, char *label, char *length)
+{
+	struct counts *c = param;
+	char expected[20];
+	sprintf(expected, "leaf%d", c->leaves);
+	if (0 != strcmp(expected, label) || 0 != strcmp("0.125", length))
+		c->labels_ok = false;
+	c->leaves++;
+}
+static void count_close(void *param, char *label, char *length)
+{
+	struct counts *c = param;
+	c->depth--;
+	c->clades++;
+}
+
+/* A tree much larger than the input buffer, so that tokens straddle refills */
+
+int test_large_tree()
+{
+	const char *test_name = __func__;
+	const int n = 200000;
+	FILE *in = tmpfile();
+	int i;
+	/* a caterpillar: (((leaf0,leaf1),leaf2),...) */
+	for (i = 1; i < n; i++) fputc('(', in);
+	fprintf(in, "leaf0:0.125");
+	for (i = 1; i < n; i++) fprintf(in, ",leaf%d:0.125)", i);
+	fprintf(in, ";\n");
+	rewind(in);
+
+	struct counts counts = { 0, 0, 0, 0, true };
+	struct newick_handlers handlers = {
+		count_open, count_leaf, count_close, NULL, &counts };
+	struct newick_stream *stream = create_newick_stream(in);
+	enum parser_status_type status = parse_newick_events(stream, &handlers);
+	destroy_newick_stream(stream);
+	fclose(in);
+
+	if (PARSER_STATUS_OK != status) {
+		printf ("%s: expected status OK, got %d.\n", test_name, status);
+		return 1;
+	}
+	if (n != counts.leaves || n - 1 != counts.clades) {
+		printf ("%s: expected %d leaves and %d clades, got %d and %d.\n",
+			test_name, n, n - 1, counts.leaves, counts.clades);
+		return 1;
+	}
+	if (n - 1 != counts.max_depth) {
+		printf ("%s: expected depth %d, got %d.\n", test_name, n - 1,
+				counts.max_depth);
+		return 1;
+	}
+	if (! counts.labels_ok) {
+		printf ("%s: wrong leaf label or length.\n", test_name);
+		return 1;
+	}
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int main()
+{
+	int failures = 0;
+	printf("Starting Newick event parser test...\n");
+	failures += test_simple();
+	failures += test_lengths();
+	failures += test_lexical();
+	failures += test_errors();
+	failures += test_several_trees();
+	failures += test_large_tree();
+	if (0 == failures) {
+		printf("All tests ok.\n");
+	} else {
+		printf("%d test(s) FAILED.\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -92,6 +92,56 @@ class TestTree (unittest.TestCase):
 		expected = '((A:2,B:1.5)f:0.5,(C:0.5,(D:1,E:1)h:3.5)g:0.5);'
 		self.assertEqual(expected, post_reroot_newick)
 
+class TestTreeArrays (unittest.TestCase):
+
+	def setUp(self):
+		if numpy is None:
+			self.skipTest('NumPy not available')
+		self.arrays = TreeArrays.parse_newick_input(
+				'((A:1,B:2)C:3,D)E;(X,Y);', type='string')
+
+	def test_sizes(self):
+		self.assertEqual(8, len(self.arrays))
+		self.assertEqual(2, self.arrays.get_tree_count())
+		self.assertEqual([0, 5, 8], list(self.arrays.tree_offsets))
+
+	def test_structure(self):
+		self.assertEqual([-1, 0, 1, 1, 0, -1, 5, 5],
+				list(self.arrays.parent))
+		self.assertEqual([0, 2, 4, 4, 4, 4, 6, 6, 6],
+				list(self.arrays.child_offsets))
+		self.assertEqual([1, 4, 2, 3, 6, 7], list(self.arrays.children))
+
+	def test_lengths(self):
+		self.assertEqual(3, self.arrays.edge_length[1])
+		self.assertTrue(numpy.isnan(self.arrays.edge_length[0]))
+		self.assertEqual([0, 3, 4, 5, 0, 0, 0, 0],
+				list(self.arrays.depth))
+
+	def test_labels(self):
+		self.assertEqual('A', self.arrays.get_label(2))
+		self.assertEqual('', self.arrays.get_label(5))
+
+	def test_outlives_table(self):
+		parent = self.arrays.parent
+		del self.arrays
+		self.assertEqual(5, parent[7])
+
+	def test_tree_to_arrays(self):
+		tree = Tree.parse_newick_input('((A:1,B:2)C:3,D:4)E;',
+				type='string').next()
+		arrays = tree.to_arrays()
+		self.assertEqual(5.0, arrays.depth.max())
+
+	def test_to_arrow(self):
+		try:
+			import pyarrow
+		except ImportError:
+			self.skipTest('pyarrow not available')
+		batch = self.arrays.to_arrow()
+		self.assertEqual(8, batch.num_rows)
+		self.assertEqual([1, 4], batch.column(2)[0].as_py())
+		self.assertEqual('Y', batch.column(5)[7].as_py())
 
 if __name__ == '__main__':
 	unittest.main()
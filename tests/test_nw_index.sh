@@ -0,0 +1,41 @@
+#!/bin/sh
+
+# Checks nw_index: the sample trees are indexed, and the queries in
+# test_nw_index_queries are run with the index (option -i). Their output must
+# be the same as test_nw_index.exp.
+
+# These variables are set differently depending on the build system. With GNU
+# autotools, we use defaults; with CMake they are passed as arguments.
+
+TEST_SRC_DIR=${1:-.}
+TEST_OUT_DIR=${2:-.}
+PROG_BIN_DIR=${3:-../src}
+
+trees=$TEST_SRC_DIR/comments.nw
+index=$TEST_OUT_DIR/test_nw_index.nwi
+queries=$TEST_SRC_DIR/test_nw_index_queries
+outfile=$TEST_OUT_DIR/test_nw_index.out
+
+echo -n "indexing - "
+if ${PROG_BIN_DIR}/nw_index -o $index $trees ; then
+	echo "pass"
+else
+	echo "FAIL"
+	exit 1
+fi
+
+echo -n "queries - "
+: > $outfile
+while IFS=':' read prog opts args ; do
+	echo $prog | grep '^#' > /dev/null && continue
+	eval "${PROG_BIN_DIR}/nw_$prog $opts -i $index $trees $args" \
+		>> $outfile
+done < $queries
+if diff $outfile $TEST_SRC_DIR/test_nw_index.exp ; then
+	echo "pass"
+	rm -f $outfile $index
+	exit 0
+else
+	echo "FAIL"
+	exit 1
+fi
@@ -0,0 +1,149 @@
+#!/bin/sh
+
+# Checks nw_serve: a server is started on the sample tree, and the queries in
+# test_nw_serve_queries are sent to it, first by a single client, then by
+# several clients at the same time. Each client must receive the responses in
+# test_nw_serve.exp, one per query and in the same order.
+
+# These variables are set differently depending on the build system. With GNU
+# autotools, we use defaults; with CMake they are passed as arguments.
+
+TEST_SRC_DIR=${1:-.}
+TEST_OUT_DIR=${2:-.}
+PROG_BIN_DIR=${3:-../src}
+
+clients=${NW_SERVE_CLIENTS:-4}
+
+serve=${PROG_BIN_DIR}/nw_serve
+socket=$TEST_OUT_DIR/test_nw_serve.sock
+queries=$TEST_SRC_DIR/test_nw_serve_queries
+expected=$TEST_SRC_DIR/test_nw_serve.exp
+
+$serve $socket $TEST_SRC_DIR/catarrhini.nw > /dev/null 2>&1 &
+server_pid=$!
+
+pass=TRUE
+
+# The client waits for the server's socket, so there is no need to sleep here.
+
+echo -n "single client - "
+$serve -c $socket < $queries > $TEST_OUT_DIR/test_nw_serve.out
+if diff $TEST_OUT_DIR/test_nw_serve.out $expected > /dev/null ; then
+	echo "pass"
+	rm -f $TEST_OUT_DIR/test_nw_serve.out
+else
+	echo "FAIL"
+	pass=FALSE
+fi
+
+echo -n "$clients concurrent clients - "
+i=1
+pids=''
+while [ $i -le $clients ] ; do
+	$serve -c $socket < $queries > $TEST_OUT_DIR/test_nw_serve_$i.out &
+	pids="$pids $!"
+	i=$((i + 1))
+done
+wait $pids
+concurrent_pass=TRUE
+i=1
+while [ $i -le $clients ] ; do
+	if diff $TEST_OUT_DIR/test_nw_serve_$i.out $expected > /dev/null ; then
+		rm -f $TEST_OUT_DIR/test_nw_serve_$i.out
+	else
+		concurrent_pass=FALSE
+	fi
+	i=$((i + 1))
+done
+if test $concurrent_pass = TRUE ; then
+	echo "pass"
+else
+	echo "FAIL"
+	pass=FALSE
+fi
+
+kill $server_pid
+wait $server_pid 2> /dev/null
+
+# 'prune' must give the same trees as nw_prune, for every tree in the file.
+
+prune=${PROG_BIN_DIR}/nw_prune
+prune_trees=$TEST_SRC_DIR/serve_prune.nw
+prune_socket=$TEST_OUT_DIR/test_nw_serve_prune.sock
+
+$serve $prune_socket $prune_trees > /dev/null 2>&1 &
+server_pid=$!
+
+echo -n "prune as nw_prune - "
+prune_pass=TRUE
+while read labels ; do
+	t=1
+	$prune $prune_trees $labels | while read expected_tree ; do
+		echo "OK $expected_tree"
+		echo "prune@$t $labels" >&3
+		t=$((t + 1))
+	done 3> $TEST_OUT_DIR/test_nw_serve_prune_queries \
+		> $TEST_OUT_DIR/test_nw_serve_prune.exp
+	$serve -c $prune_socket < $TEST_OUT_DIR/test_nw_serve_prune_queries \
+		> $TEST_OUT_DIR/test_nw_serve_prune.out
+	if ! diff $TEST_OUT_DIR/test_nw_serve_prune.out \
+			$TEST_OUT_DIR/test_nw_serve_prune.exp > /dev/null ; then
+		prune_pass=FALSE
+	fi
+done < $TEST_SRC_DIR/test_nw_serve_prune_cases
+if test $prune_pass = TRUE ; then
+	echo "pass"
+	rm -f $TEST_OUT_DIR/test_nw_serve_prune*
+else
+	echo "FAIL"
+	pass=FALSE
+fi
+
+kill $server_pid
+wait $server_pid 2> /dev/null
+
+# 'distance' must give the same distances as nw_distance, including on trees
+# with missing lengths (which both count as 1).
+
+distance=${PROG_BIN_DIR}/nw_distance
+distance_trees=$TEST_SRC_DIR/serve_distance.nw
+distance_socket=$TEST_OUT_DIR/test_nw_serve_distance.sock
+distance_queries=$TEST_OUT_DIR/test_nw_serve_distance_queries
+
+$serve $distance_socket $distance_trees > /dev/null 2>&1 &
+server_pid=$!
+
+echo -n "distance as nw_distance - "
+rm -f $distance_queries
+t=1
+while read tree ; do
+	# one query per pair of leaves, from nw_distance's matrix
+	echo "$tree" | $distance -m m -n - | awk -v t=$t -v q=$distance_queries '
+		NR == 1 { for (i = 1; i <= NF; i++) label[i] = $i; next }
+		{
+			for (j = NR; j <= NF - 1; j++) {
+				print "distance@" t " " $1 " " label[j] >> q
+				print "OK " $(j + 1)
+			}
+		}'
+	t=$((t + 1))
+done < $distance_trees > $TEST_OUT_DIR/test_nw_serve_distance.exp
+$serve -c $distance_socket < $distance_queries \
+	> $TEST_OUT_DIR/test_nw_serve_distance.out
+if diff $TEST_OUT_DIR/test_nw_serve_distance.out \
+		$TEST_OUT_DIR/test_nw_serve_distance.exp > /dev/null ; then
+	echo "pass"
+	rm -f $TEST_OUT_DIR/test_nw_serve_distance*
+else
+	echo "FAIL"
+	pass=FALSE
+fi
+
+kill $server_pid
+wait $server_pid 2> /dev/null
+
+if test $pass = FALSE ; then
+	exit 1
+else
+	exit 0
+fi
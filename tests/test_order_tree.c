@@ -32,7 +32,7 @@ int test_order()
 	struct rnode *node_insects = tree.root->first_child;
 	struct rnode *node_vertebrates = tree.root->last_child;
 
-	order_tree(&tree, lbl_comparator, set_sort_field_label);
+	order_tree(&tree, ORDER_ALNUM_LBL);
 	
 	/* insect node should still be 1st */
 	if (tree.root->first_child != node_insects) {
@@ -87,7 +87,7 @@ int test_order_num_desc()
 	struct rooted_tree test_tree = tree_15();
 	/* expected tree is top-light */
 	struct rooted_tree exp_tree = tree_14();
-	order_tree(&test_tree, num_desc_comparator, set_sort_field_num_desc);
+	order_tree(&test_tree, ORDER_NUM_DESCENDANTS);
 	char *obt_newick = to_newick(test_tree.root);
 	char *exp_newick = to_newick(exp_tree.root);
 
@@ -106,7 +106,7 @@ int test_order_deladderize()
 {
 	const char *test_name = __func__;
 	struct rooted_tree test_tree = tree_15();
-	order_tree(&test_tree, num_desc_deladderize, set_sort_field_num_desc);
+	order_tree(&test_tree, ORDER_DELADDERIZE);
 	char *obt_newick = to_newick(test_tree.root);
 	char *exp_newick = "(Petromyzon,((Xenopus,((Equus,Homo)Mammalia,Columba)Amniota)Tetrapoda,Carcharodon)Gnathostomata)Vertebrata;";
 
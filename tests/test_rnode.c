@@ -21,9 +21,9 @@ int test_create_rnode()
 				test_name, label, node->label);
 		return 1;
 	}
-	if (0 != strcmp(node->edge_length_as_string, length)) {
+	if (0 != strcmp(edge_length_string(node), length)) {
 		printf("%s: expected length '%s', got '%s'\n",
-			test_name, length, node->edge_length_as_string);
+			test_name, length, edge_length_string(node));
 		return 1;
 	}
 	if (NULL != node->parent) {
@@ -133,6 +133,46 @@ int test_static_rnode_vars_2()
 	return 0;
 }
 
+int test_destroy_rnodes_since()
+{
+	const char *test_name = __func__;
+
+	destroy_all_rnodes(NULL);
+	struct rnode *kept = create_rnode("kept", "");
+	int watermark = rnode_watermark();
+	if (1 != watermark) {
+		printf("%s: expected watermark of 1, got %d.\n",
+				test_name, watermark);
+		return 1;
+	}
+	/* simulates two input trees, freed after each other */
+	int tree, i;
+	for (tree = 0; tree < 2; tree++) {
+		for (i = 0; i < 5; i++)
+			create_rnode("tmp", "");
+		if (6 != _get_rnode_count()) {
+			printf("%s: expected node count of 6, got %d.\n",
+					test_name, _get_rnode_count());
+			return 1;
+		}
+		destroy_rnodes_since(watermark, NULL);
+		if (1 != _get_rnode_count()) {
+			printf("%s: expected node count of 1, got %d.\n",
+					test_name, _get_rnode_count());
+			return 1;
+		}
+	}
+	if (0 != strcmp("kept", kept->label)) {
+		printf("%s: expected label 'kept', got '%s'.\n", test_name,
+				kept->label);
+		return 1;
+	}
+	destroy_all_rnodes(NULL);
+
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
 int test_create_rnode_nulllabel()
 {
 	const char *test_name = "test_create_rnode_nulllabel";
@@ -143,9 +183,9 @@ int test_create_rnode_nulllabel()
 				test_name, node->label);
 		return 1;
 	}
-	if (0 != strcmp(node->edge_length_as_string, "")) {
+	if (0 != strcmp(edge_length_string(node), "")) {
 		printf("%s: expected empty length, got '%s'\n",
-			test_name, node->edge_length_as_string);
+			test_name, edge_length_string(node));
 		return 1;
 	}
 	if (NULL != node->parent) {
@@ -187,9 +227,9 @@ int test_create_rnode_emptylabel()
 				test_name, node->label);
 		return 1;
 	}
-	if (0 != strcmp(node->edge_length_as_string, "")) {
+	if (0 != strcmp(edge_length_string(node), "")) {
 		printf("%s: expected empty length, got '%s'\n",
-			test_name, node->edge_length_as_string);
+			test_name, edge_length_string(node));
 		return 1;
 	}
 	if (NULL != node->parent) {
@@ -233,9 +273,9 @@ int test_create_rnode_nulllength()
 				test_name, label, node->label);
 		return 1;
 	}
-	if (0 != strcmp(node->edge_length_as_string, "")) {
+	if (0 != strcmp(edge_length_string(node), "")) {
 		printf("%s: expected empty length, got '%s'\n",
-			test_name, node->edge_length_as_string);
+			test_name, edge_length_string(node));
 		return 1;
 	}
 	if (NULL != node->parent) {
@@ -279,9 +319,9 @@ int test_create_rnode_emptylength()
 				test_name, label, node->label);
 		return 1;
 	}
-	if (0 != strcmp(node->edge_length_as_string, "")) {
+	if (0 != strcmp(edge_length_string(node), "")) {
 		printf("%s: expected empty length, got '%s'\n",
-			test_name, node->edge_length_as_string);
+			test_name, edge_length_string(node));
 		return 1;
 	}
 	if (NULL != node->parent) {
@@ -646,9 +686,9 @@ int test_clone_rnode()
 				test_name, label, clone->label);
 		return 1;
 	}
-	if (0 != strcmp(clone->edge_length_as_string, length)) {
+	if (0 != strcmp(edge_length_string(clone), length)) {
 		printf("%s: expected length '%s', got '%s'\n",
-			test_name, length, clone->edge_length_as_string);
+			test_name, length, edge_length_string(clone));
 		return 1;
 	}
 	if (NULL != clone->parent) {
@@ -710,7 +750,8 @@ int test_clone_rnode_wkids()
 
 	clone = clone_rnode(node);
 
-	char *len_s, *label = NULL;
+	const char *len_s;
+	char *label = NULL;
 
 	/* clone */
 	label = clone->label;
@@ -719,7 +760,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->edge_length_as_string;
+	len_s = edge_length_string(clone);
 	if (strcmp("", len_s) != 0) {
 		printf("%s: clone's edge length (as string)"
 			" should be '', got '%s'\n", test_name, len_s);
@@ -733,7 +774,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->first_child->edge_length_as_string;
+	len_s = edge_length_string(clone->first_child);
 	if (strcmp("4", len_s) != 0) {
 		printf("%s: clone->kid1's edge length (as string)"
 			" should be '4', got '%s'\n", test_name, len_s);
@@ -747,7 +788,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->first_child->next_sibling->edge_length_as_string;
+	len_s = edge_length_string(clone->first_child->next_sibling);
 	if (strcmp("3", len_s) != 0) {
 		printf("%s: clone->kid2's edge length (as string)"
 			" should be '3', got '%s'\n", test_name, len_s);
@@ -761,7 +802,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->last_child->edge_length_as_string;
+	len_s = edge_length_string(clone->last_child);
 	if (strcmp("1.1", len_s) != 0) {
 		printf("%s: clone->kid3's edge length (as string)"
 			" should be '1.1', got '%s'\n", test_name, len_s);
@@ -775,7 +816,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->first_child->next_sibling->first_child->edge_length_as_string;
+	len_s = edge_length_string(clone->first_child->next_sibling->first_child);
 	if (strcmp("1.0", len_s) != 0) {
 		printf("%s: clone->kid2->kid1's edge length (as string)"
 			" should be '1.0', got '%s'\n", test_name, len_s);
@@ -789,7 +830,7 @@ int test_clone_rnode_wkids()
 				" got '%s'\n", test_name, label);
 		return 1;
 	}
-	len_s = clone->first_child->next_sibling->last_child->edge_length_as_string;
+	len_s = edge_length_string(clone->first_child->next_sibling->last_child);
 	if (strcmp("2.5", len_s) != 0) {
 		printf("%s: clone->kid2->kid2's edge length (as string)"
 			" should be '2.5', got '%s'\n", test_name, len_s);
@@ -800,6 +841,60 @@ int test_clone_rnode_wkids()
 	return 0;
 }
 
+int test_edge_length()
+{
+	const char *test_name = __func__;
+	struct rnode *node = create_rnode("n", "0.10");
+
+	if (! has_edge_length(node) || 0.1 != get_edge_length(node)) {
+		printf("%s: expected length 0.1, got %g\n", test_name,
+				get_edge_length(node));
+		return 1;
+	}
+	/* set as a number, the length is only formatted when needed */
+	set_edge_length(node, 1.606612 + 0.1);
+	if (NULL != node->edge_length_as_string) {
+		printf("%s: length string should not have been made\n",
+				test_name);
+		return 1;
+	}
+	if (0 != strcmp("1.706612", edge_length_string(node))) {
+		printf("%s: expected length '1.706612', got '%s'\n",
+				test_name, edge_length_string(node));
+		return 1;
+	}
+	set_edge_length_string(node, "");
+	if (has_edge_length(node)) {
+		printf("%s: length should be undefined\n", test_name);
+		return 1;
+	}
+
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
+int test_format_edge_length()
+{
+	const char *test_name = __func__;
+	double lengths[] = { 20, 0.5, 1234567.5, 1e-05, 0.1 + 0.2, -3.25 };
+	char *expected[] = { "20", "0.5", "1234567.5", "1e-05",
+		"0.30000000000000004", "-3.25" };
+	char buf[EDGE_LENGTH_BUFSIZE];
+	int i;
+
+	for (i = 0; i < sizeof(lengths) / sizeof(double); i++) {
+		format_edge_length(buf, lengths[i]);
+		if (0 != strcmp(expected[i], buf)) {
+			printf("%s: expected '%s', got '%s'\n", test_name,
+					expected[i], buf);
+			return 1;
+		}
+	}
+
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
 int main()
 {
 	int failures = 0;
@@ -807,6 +902,7 @@ int main()
 	failures += test_create_rnode();
 	failures += test_static_rnode_vars();
 	failures += test_static_rnode_vars_2();
+	failures += test_destroy_rnodes_since();
 	failures += test_create_rnode_nulllabel();
 	failures += test_create_rnode_emptylabel();
 	failures += test_create_rnode_nulllength();
@@ -820,6 +916,8 @@ int main()
 	failures += test_children_array();
 	failures += test_clone_rnode();
 	failures += test_clone_rnode_wkids();
+	failures += test_edge_length();
+	failures += test_format_edge_length();
 	if (0 == failures) {
 		printf("All tests ok.\n");
 	} else {
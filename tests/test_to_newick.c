@@ -205,9 +205,9 @@ int test_bug2()
 				test_name, root->label);
 		return 1;
 	}
-	if (strcmp("0.10", root->edge_length_as_string) != 0) {
+	if (strcmp("0.10", edge_length_string(root)) != 0) {
 		printf("%s: expected root edge length 0.10 , got '%s'\n",
-				test_name, root->edge_length_as_string);
+				test_name, edge_length_string(root));
 		return 1;
 	}
 	char *obt = to_newick(tree->root);
@@ -10,6 +10,7 @@
 #include "nodemap.h"
 #include "to_newick.h"
 #include "hash.h"
+#include "label_intern.h"
 
 /* Many tests involve creating trees or nodes which are not "used" (in the GCC
  * sense, i.e. in a statement), causing compiler warnings. However, they affect
@@ -351,6 +352,78 @@ int test_nodes_from_regexp()
 	return 0;
 }
 
+/* Checks that 'nodes' has the labels in 'exp_labels' (NULL-terminated) */
+
+static int check_labels(const char *test_name, struct llist *nodes,
+		char **exp_labels)
+{
+	struct list_elem *el = nodes->head;
+	for (; NULL != *exp_labels; exp_labels++, el = el->next) {
+		if (NULL == el) {
+			printf ("%s: expected label '%s', got end of list\n",
+					test_name, *exp_labels);
+			return 1;
+		}
+		char *label = ((struct rnode *) el->data)->label;
+		if (0 != strcmp(*exp_labels, label)) {
+			printf ("%s: expected label '%s', got '%s'\n",
+					test_name, *exp_labels, label);
+			return 1;
+		}
+	}
+	if (NULL != el) {
+		printf ("%s: nodes list not terminated.\n", test_name);
+		return 1;
+	}
+	return 0;
+}
+
+int test_nodes_from_regexp_memo()
+{
+	const char *test_name = __func__;
+	char *exp_labels[] = { "HRV_A1", "HRV_A2", NULL };
+
+	enable_label_interning();
+	regex_t *regexp = compile_regexp("HRV_A.");
+	struct regexp_memo *memo = create_regexp_memo(regexp);
+
+	/* ((HRV_A1:1,HRV_A2:1.0)HRV_A:2.0,(HRV_C:1,(HRV_B1:1,HRV_B2:1)HRV_B:2):3)HRV; */
+	struct rooted_tree tree = tree_8();
+	/* the second time, results come from the memo */
+	if (check_labels(test_name, nodes_from_regexp_memo(&tree, memo),
+				exp_labels))
+		return 1;
+	if (check_labels(test_name, nodes_from_regexp_memo(&tree, memo),
+				exp_labels))
+		return 1;
+
+	/* same labels in another tree */
+	struct rooted_tree tree2 = tree_8();
+	if (check_labels(test_name, nodes_from_regexp_memo(&tree2, memo),
+				exp_labels))
+		return 1;
+
+	destroy_regexp_memo(memo);
+	regfree(regexp);
+	free(regexp);
+	destroy_label_interner();
+
+	/* without interning, nodes are matched directly */
+	regexp = compile_regexp("HRV_[AB]$");
+	memo = create_regexp_memo(regexp);
+	struct rooted_tree tree3 = tree_8();
+	char *exp_labels_2[] = { "HRV_A", "HRV_B", NULL };
+	if (check_labels(test_name, nodes_from_regexp_memo(&tree3, memo),
+				exp_labels_2))
+		return 1;
+	destroy_regexp_memo(memo);
+	regfree(regexp);
+	free(regexp);
+
+	printf ("%s: ok.\n", test_name);
+	return 0;
+}
+
 int test_reset_seen()
 {
 	const char *test_name = __func__;
@@ -408,9 +481,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node A's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -422,9 +495,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1.0", node->edge_length_as_string) != 0) {
+	if (strcmp("1.0", edge_length_string(node)) != 0) {
 		printf ("%s: anonymous node's edge length (as string) should be 1.0,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -436,9 +509,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("2.0", node->edge_length_as_string) != 0) {
+	if (strcmp("2.0", edge_length_string(node)) != 0) {
 		printf ("%s: node f's edge length (as string) should be 2.0,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -450,9 +523,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node C's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -464,9 +537,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node D's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -478,9 +551,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node E's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -492,9 +565,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("2", node->edge_length_as_string) != 0) {
+	if (strcmp("2", edge_length_string(node)) != 0) {
 		printf ("%s: anonymous node's edge length (as string) should be 2,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -506,9 +579,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("3", node->edge_length_as_string) != 0) {
+	if (strcmp("3", edge_length_string(node)) != 0) {
 		printf ("%s: node h's edge length (as string) should be 3,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -520,9 +593,9 @@ int test_clone_tree_result()
 				node->label);
 		return 1;
 	}
-	if (strcmp("", node->edge_length_as_string) != 0) {
+	if (strcmp("", edge_length_string(node)) != 0) {
 		printf ("%s: node i's edge length (as string) should be '',"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -557,9 +630,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node A's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -571,9 +644,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1.0", node->edge_length_as_string) != 0) {
+	if (strcmp("1.0", edge_length_string(node)) != 0) {
 		printf ("%s: anonymous node's edge length (as string) should be 1.0,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -585,9 +658,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("2.0", node->edge_length_as_string) != 0) {
+	if (strcmp("2.0", edge_length_string(node)) != 0) {
 		printf ("%s: node f's edge length (as string) should be 2.0,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -599,9 +672,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node C's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -613,9 +686,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node D's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -627,9 +700,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("1", node->edge_length_as_string) != 0) {
+	if (strcmp("1", edge_length_string(node)) != 0) {
 		printf ("%s: node E's edge length (as string) should be 1,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -641,9 +714,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("2", node->edge_length_as_string) != 0) {
+	if (strcmp("2", edge_length_string(node)) != 0) {
 		printf ("%s: anonymous node's edge length (as string) should be 2,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -655,9 +728,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("3", node->edge_length_as_string) != 0) {
+	if (strcmp("3", edge_length_string(node)) != 0) {
 		printf ("%s: node h's edge length (as string) should be 3,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -669,9 +742,9 @@ int test_clone_tree_original()
 				node->label);
 		return 1;
 	}
-	if (strcmp("", node->edge_length_as_string) != 0) {
+	if (strcmp("", edge_length_string(node)) != 0) {
 		printf ("%s: node i's edge length (as string) should be '',"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -718,9 +791,9 @@ int test_clone_tree_cond()
 				node->label);
 		return 1;
 	}
-	if (strcmp("3", node->edge_length_as_string) != 0) {
+	if (strcmp("3", edge_length_string(node)) != 0) {
 		printf ("%s: node A's edge length (as string) should be 3,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -732,9 +805,9 @@ int test_clone_tree_cond()
 				node->label);
 		return 1;
 	}
-	if (strcmp("3", node->edge_length_as_string) != 0) {
+	if (strcmp("3", edge_length_string(node)) != 0) {
 		printf ("%s: node C's edge length (as string) should be 3,"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -746,9 +819,9 @@ int test_clone_tree_cond()
 				node->label);
 		return 1;
 	}
-	if (strcmp("", node->edge_length_as_string) != 0) {
+	if (strcmp("", edge_length_string(node)) != 0) {
 		printf ("%s: node h's edge length (as string) should be '',"
-			"got %s.\n", test_name, node->edge_length_as_string);
+			"got %s.\n", test_name, edge_length_string(node));
 		return 1;
 	}
 
@@ -779,6 +852,7 @@ int main()
 	failures += test_is_cladogram();
 	failures += test_nodes_from_labels();
 	failures += test_nodes_from_regexp();
+	failures += test_nodes_from_regexp_memo();
 	failures += test_reset_seen();
 	failures += test_clone_tree_result();
 	failures += test_clone_tree_original();
@@ -0,0 +1,269 @@
+/* 
+
+Copyright (c) 2009 Thomas Junier and Evgeny Zdobnov, University of Geneva
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+* Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+* Neither the name of the University of Geneva nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "tree_arrays.h"
+#include "parser.h"
+#include "tree.h"
+#include "rnode.h"
+#include "common.h"
+
+void newick_scanner_set_string_input(char *);
+void newick_scanner_clear_string_input();
+
+static char two_trees[] = "((A:1,B:2)C:3,D)E;(X,Y);";
+
+static int check_ints(const char *test_name, const char *what,
+		const int *obt, const int *exp, int n)
+{
+	int i;
+	for (i = 0; i < n; i++) {
+		if (obt[i] != exp[i]) {
+			printf ("%s: %s[%d]: expected %d, got %d.\n",
+				test_name, what, i, exp[i], obt[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int test_parse()
+{
+	const char *test_name = __func__;
+
+	newick_scanner_set_string_input(two_trees);
+	struct tree_arrays *arrays = parse_tree_arrays(0);
+	newick_scanner_clear_string_input();
+	if (NULL == arrays) {
+		printf ("%s: parse_tree_arrays() failed.\n", test_name);
+		return 1;
+	}
+	if (2 != arrays->tree_count || 8 != arrays->node_count) {
+		printf ("%s: expected 2 trees and 8 nodes, got %d and %d.\n",
+			test_name, arrays->tree_count, arrays->node_count);
+		return 1;
+	}
+
+	/* Preorder: E C A B D, then the unlabelled root, X and Y. */
+	int exp_tree_offsets[] = {0, 5, 8};
+	int exp_tree[] = {0, 0, 0, 0, 0, 1, 1, 1};
+	int exp_parent[] = {-1, 0, 1, 1, 0, -1, 5, 5};
+	int exp_child_offsets[] = {0, 2, 4, 4, 4, 4, 6, 6, 6};
+	int exp_children[] = {1, 4, 2, 3, 6, 7};
+	int exp_label_offsets[] = {0, 1, 2, 3, 4, 5, 5, 6, 7};
+	if (check_ints(test_name, "tree_offsets", arrays->tree_offsets,
+			exp_tree_offsets, 3) ||
+	    check_ints(test_name, "tree", arrays->tree, exp_tree, 8) ||
+	    check_ints(test_name, "parent", arrays->parent, exp_parent, 8) ||
+	    check_ints(test_name, "child_offsets", arrays->child_offsets,
+			exp_child_offsets, 9) ||
+	    check_ints(test_name, "children", arrays->children,
+			exp_children, 6) ||
+	    check_ints(test_name, "label_offsets", arrays->label_offsets,
+			exp_label_offsets, 9))
+		return 1;
+	if (0 != strncmp("ECABDXY", arrays->labels, 7)) {
+		printf ("%s: expected labels 'ECABDXY', got '%.7s'.\n",
+				test_name, arrays->labels);
+		return 1;
+	}
+
+	double exp_length[] = {NAN, 3, 1, 2, NAN, NAN, NAN, NAN};
+	double exp_depth[] = {0, 3, 4, 5, 0, 0, 0, 0};
+	int i;
+	for (i = 0; i < 8; i++) {
+		double length = arrays->edge_length[i];
+		if (isnan(exp_length[i]) ? ! isnan(length) :
+				length != exp_length[i]) {
+			printf ("%s: edge_length[%d]: expected %g, got %g.\n",
+				test_name, i, exp_length[i], length);
+			return 1;
+		}
+		if (arrays->depth[i] != exp_depth[i]) {
+			printf ("%s: depth[%d]: expected %g, got %g.\n",
+				test_name, i, exp_depth[i], arrays->depth[i]);
+			return 1;
+		}
+	}
+
+	destroy_tree_arrays(arrays);
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_max_trees()
+{
+	const char *test_name = __func__;
+
+	newick_scanner_set_string_input(two_trees);
+	struct tree_arrays *arrays = parse_tree_arrays(1);
+	newick_scanner_clear_string_input();
+	if (NULL == arrays) {
+		printf ("%s: parse_tree_arrays() failed.\n", test_name);
+		return 1;
+	}
+	if (1 != arrays->tree_count || 5 != arrays->node_count) {
+		printf ("%s: expected 1 tree and 5 nodes, got %d and %d.\n",
+			test_name, arrays->tree_count, arrays->node_count);
+		return 1;
+	}
+
+	destroy_tree_arrays(arrays);
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+/* Many trees and nodes, so that all arrays have to grow a few times. */
+
+int test_grow()
+{
+	const char *test_name = __func__;
+	const int n = 1000;
+	char newick[] = "((Homo,Pan),Gorilla);";
+	int i;
+
+	struct tree_arrays *arrays = create_tree_arrays();
+	for (i = 0; i < n; i++) {
+		newick_scanner_set_string_input(newick);
+		struct rooted_tree *tree = parse_tree();
+		newick_scanner_clear_string_input();
+		if (FAILURE == tree_arrays_append(arrays, tree)) {
+			printf ("%s: tree_arrays_append() failed.\n",
+					test_name);
+			return 1;
+		}
+		destroy_tree(tree);
+	}
+	if (n != arrays->tree_count || 5 * n != arrays->node_count) {
+		printf ("%s: expected %d trees and %d nodes, got %d and %d.\n",
+			test_name, n, 5 * n, arrays->tree_count,
+			arrays->node_count);
+		return 1;
+	}
+	int last = arrays->tree_offsets[n-1];
+	if (last != 5 * (n-1) || arrays->parent[last+4] != last) {
+		printf ("%s: wrong offsets or parents in the last tree.\n",
+				test_name);
+		return 1;
+	}
+	int label_start = arrays->label_offsets[last+4];
+	if (0 != strncmp("Gorilla", arrays->labels + label_start, 7)) {
+		printf ("%s: expected last label 'Gorilla'.\n", test_name);
+		return 1;
+	}
+
+	destroy_tree_arrays(arrays);
+	destroy_all_rnodes(NULL);
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int test_arrow_export()
+{
+	const char *test_name = __func__;
+	struct ArrowSchema schema;
+	struct ArrowArray array;
+
+	newick_scanner_set_string_input(two_trees);
+	struct tree_arrays *arrays = parse_tree_arrays(0);
+	newick_scanner_clear_string_input();
+	if (SUCCESS != export_tree_arrays_arrow(arrays, &schema, &array)) {
+		printf ("%s: export failed.\n", test_name);
+		return 1;
+	}
+	/* The batch must keep the arrays alive. */
+	destroy_tree_arrays(arrays);
+
+	if (0 != strcmp("+s", schema.format) || 6 != schema.n_children ||
+	    0 != strcmp("label", schema.children[5]->name) ||
+	    0 != strcmp("+l", schema.children[2]->format) ||
+	    0 != strcmp("i", schema.children[2]->children[0]->format)) {
+		printf ("%s: unexpected schema.\n", test_name);
+		return 1;
+	}
+	if (8 != array.length || 6 != array.n_children) {
+		printf ("%s: expected 8 rows and 6 columns.\n", test_name);
+		return 1;
+	}
+	struct ArrowArray *children = array.children[2]->children[0];
+	const int *child_values = children->buffers[1];
+	if (6 != children->length || 7 != child_values[5]) {
+		printf ("%s: wrong 'children' column.\n", test_name);
+		return 1;
+	}
+	const int *label_offsets = array.children[5]->buffers[1];
+	const char *labels = array.children[5]->buffers[2];
+	if (7 != label_offsets[8] || 'Y' != labels[6]) {
+		printf ("%s: wrong 'label' column.\n", test_name);
+		return 1;
+	}
+
+	/* A consumer may move a column out and release it separately. */
+	struct ArrowArray depth = *array.children[4];
+	array.children[4]->release = NULL;
+	array.release(&array);
+	if (NULL != array.release) {
+		printf ("%s: release() should mark the array released.\n",
+				test_name);
+		return 1;
+	}
+	const double *depths = depth.buffers[1];
+	if (5 != depths[3]) {
+		printf ("%s: moved column should outlive its parent.\n",
+				test_name);
+		return 1;
+	}
+	depth.release(&depth);
+	schema.release(&schema);
+
+	printf("%s passed.\n", test_name);
+	return 0;
+}
+
+int main()
+{
+	int failures = 0;
+	printf("Starting tree arrays test...\n");
+	failures += test_parse();
+	failures += test_max_trees();
+	failures += test_grow();
+	failures += test_arrow_export();
+	if (0 == failures) {
+		printf("All tests ok.\n");
+	} else {
+		printf("%d test(s) FAILED.\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
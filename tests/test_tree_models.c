@@ -1,10 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h> 
 
-#include "rnode.h"
-#include "list.h"
-#include "link.h"
+#include "prng.h"
 #include "tree_models.h"
 
 #define TOLERANCE 0.000001
@@ -49,13 +48,10 @@ int test_tlt_grow_node()
 {
 	const char *test_name = "test_tlt_grow_node";
 	double prior_remaining_time = 12.3; 	/* arbitrary units */
-	struct rnode *parent = create_rnode("parent", "");
-	struct rnode *kid = create_rnode("kid", "");
-	kid->data = &prior_remaining_time;
-	add_child(parent, kid);
+	double grown_length;
 
-	double posterior_remaining_time = _tlt_grow_node(kid, 1.0, 0.5);
-	double grown_length = strtod(kid->edge_length_as_string, NULL);
+	double posterior_remaining_time = _tlt_grow_node(prior_remaining_time,
+			1.0, 0.5, &grown_length);
 
 	double exp = prior_remaining_time - posterior_remaining_time;
 	if (fabs(grown_length - exp) > TOLERANCE) {
@@ -64,6 +60,56 @@ int test_tlt_grow_node()
 		return 1;
 	}
 
+	/* length is capped by the alloted time */
+	posterior_remaining_time = _tlt_grow_node(0.1, 1.0, 0.5,
+			&grown_length);
+	if (fabs(grown_length - 0.1) > TOLERANCE) {
+		printf ("%s: expected 0.1, got %g\n", test_name,
+				grown_length);
+		return 1;
+	}
+
+	printf("%s ok.\n", test_name);
+	return 0;
+}
+
+/* The same seed and stream must give the same tree, different streams
+ * different trees. */
+
+int test_streams()
+{
+	const char *test_name = "test_streams";
+	struct tree_generator *gen = create_tree_generator();
+	struct prng prng;
+	size_t length;
+
+	prng_init(&prng, 42, 0);
+	time_limited_tree(gen, &prng, 1.0, 3.0);
+	const char *trees = generated_trees(gen, &length);
+	char *first = malloc(length + 1);
+	memcpy(first, trees, length);
+	first[length] = '\0';
+
+	clear_generated_trees(gen);
+	prng_init(&prng, 42, 0);
+	time_limited_tree(gen, &prng, 1.0, 3.0);
+	prng_init(&prng, 42, 1);
+	time_limited_tree(gen, &prng, 1.0, 3.0);
+	const char *both = generated_trees(gen, &length);
+
+	size_t first_length = strlen(first);
+	if (length <= first_length || strncmp(first, both, first_length) != 0) {
+		printf ("%s: same stream gave different trees\n", test_name);
+		return 1;
+	}
+	if (strncmp(first, both + first_length, first_length) == 0) {
+		printf ("%s: different streams gave the same tree\n",
+				test_name);
+		return 1;
+	}
+
+	free(first);
+	destroy_tree_generator(gen);
 	printf("%s ok.\n", test_name);
 	return 0;
 }
@@ -74,6 +120,7 @@ int main()
 	printf("Starting tree generation models test...\n");
 	failures += test_reciprocal_exponential_CDF();
 	failures += test_tlt_grow_node();
+	failures += test_streams();
 	if (0 == failures) {
 		printf("All tests ok.\n");
 	} else {